@@ -0,0 +1,55 @@
+#include "arena.hpp"
+#include <algorithm>
+
+namespace AST
+{
+
+namespace
+{
+thread_local Arena *currentArena = nullptr;
+
+constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+
+constexpr size_t alignUp(size_t size)
+{
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+} // namespace
+
+Arena::Arena(size_t blockSize) : blockSize(alignUp(std::max<size_t>(blockSize, ALIGNMENT)))
+{
+}
+
+void *Arena::allocate(size_t size)
+{
+    size = alignUp(size);
+    if (static_cast<size_t>(limit - cursor) < size)
+    {
+        // ブロックより大きな要求はそのサイズで専用のブロックを確保する
+        size_t length = std::max(size, blockSize);
+        blocks.emplace_back(new std::byte[length]);
+        cursor = blocks.back().get();
+        limit = cursor + length;
+    }
+    void *result = cursor;
+    cursor += size;
+    allocated += size;
+    return result;
+}
+
+Arena *Arena::current()
+{
+    return currentArena;
+}
+
+ArenaScope::ArenaScope(Arena *arena) : previous(currentArena)
+{
+    currentArena = arena;
+}
+
+ArenaScope::~ArenaScope()
+{
+    currentArena = previous;
+}
+
+} // namespace AST
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace AST
+{
+
+// ASTノード用のバンプアロケータ
+// パース中に生成したノードのメモリをまとめて確保し、アリーナの破棄時に一括で解放する
+// 個々のノードのdeleteではメモリを解放しない（デストラクタのみ実行される）
+class Arena
+{
+  public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // alignof(std::max_align_t)境界に揃えたメモリを確保する
+    void *allocate(size_t size);
+
+    // 確保済みの合計バイト数とブロック数（統計用）
+    size_t bytesAllocated() const
+    {
+        return allocated;
+    }
+    size_t blockCount() const
+    {
+        return blocks.size();
+    }
+
+    // 現在のスレッドでノードの確保先になっているアリーナ（なければnullptr）
+    static Arena *current();
+
+  private:
+    friend class ArenaScope;
+
+    size_t blockSize;
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::byte *cursor = nullptr;
+    std::byte *limit = nullptr;
+    size_t allocated = 0;
+};
+
+// スコープの間、現在のスレッドで生成するASTノードをアリーナから確保する
+class ArenaScope
+{
+  public:
+    explicit ArenaScope(Arena *arena);
+    ~ArenaScope();
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+  private:
+    Arena *previous;
+};
+
+} // namespace AST
@@ -2,6 +2,44 @@
 
 namespace AST
 {
+namespace
+{
+// ノードの直前に置くヘッダ（確保元を記録し、deleteの際に解放の要否を判断する）
+struct alignas(std::max_align_t) AllocationHeader
+{
+    bool inArena;
+};
+} // namespace
+
+void *Node::operator new(size_t size)
+{
+    AllocationHeader *header;
+    if (Arena *arena = Arena::current())
+    {
+        header = static_cast<AllocationHeader *>(arena->allocate(sizeof(AllocationHeader) + size));
+        header->inArena = true;
+    }
+    else
+    {
+        header = static_cast<AllocationHeader *>(::operator new(sizeof(AllocationHeader) + size));
+        header->inArena = false;
+    }
+    return header + 1;
+}
+
+void Node::operator delete(void *pointer)
+{
+    if (!pointer)
+    {
+        return;
+    }
+    auto header = static_cast<AllocationHeader *>(pointer) - 1;
+    if (!header->inArena)
+    {
+        ::operator delete(header);
+    }
+}
+
 // Program実装
 std::string Program::TokenLiteral() const
 {
@@ -26,7 +64,7 @@ std::string Program::String() const
 }
 
 // BlockStatement implementation
-BlockStatement::BlockStatement(Token::Token token) : token(std::move(token))
+BlockStatement::BlockStatement(Token::Token token) : Statement(NodeKind::BLOCK_STATEMENT), token(std::move(token))
 {
 }
 
@@ -55,7 +93,7 @@ std::string BlockStatement::String() const
 
 // Identifier implementation
 Identifier::Identifier(Token::Token token, std::string value)
-    : token(std::move(token)), value(std::move(value))
+    : Expression(NodeKind::IDENTIFIER), token(std::move(token)), value(std::move(value))
 {
 }
 
@@ -75,11 +113,14 @@ std::string Identifier::String() const
 
 Expression *Identifier::clone() const
 {
-    return new Identifier(token, value);
+    auto cloned = new Identifier(token, value);
+    cloned->scope = scope;
+    cloned->slot = slot;
+    return cloned;
 }
 
 // LetStatement implementation
-LetStatement::LetStatement(Token::Token token) : token(std::move(token))
+LetStatement::LetStatement(Token::Token token) : Statement(NodeKind::LET_STATEMENT), token(std::move(token))
 {
 }
 
@@ -123,7 +164,7 @@ Statement *LetStatement::clone() const
 }
 
 // ReturnStatement implementation
-ReturnStatement::ReturnStatement(Token::Token token) : token(std::move(token))
+ReturnStatement::ReturnStatement(Token::Token token) : Statement(NodeKind::RETURN_STATEMENT), token(std::move(token))
 {
 }
 
@@ -158,7 +199,7 @@ Statement *ReturnStatement::clone() const
 }
 
 // ExpressionStatement implementation
-ExpressionStatement::ExpressionStatement(Token::Token token) : token(std::move(token))
+ExpressionStatement::ExpressionStatement(Token::Token token) : Statement(NodeKind::EXPRESSION_STATEMENT), token(std::move(token))
 {
 }
 
@@ -178,7 +219,7 @@ std::string ExpressionStatement::String() const
 
 // IntegerLiteral implementation
 IntegerLiteral::IntegerLiteral(Token::Token token, int64_t value)
-    : token(std::move(token)), value(value)
+    : Expression(NodeKind::INTEGER_LITERAL), token(std::move(token)), value(value)
 {
 }
 
@@ -201,9 +242,37 @@ Expression *IntegerLiteral::clone() const
     return new IntegerLiteral(token, value);
 }
 
+std::string toString(Operator op)
+{
+    switch (op)
+    {
+    case Operator::ADD:
+        return "+";
+    case Operator::SUB:
+    case Operator::NEG:
+        return "-";
+    case Operator::MUL:
+        return "*";
+    case Operator::DIV:
+        return "/";
+    case Operator::LT:
+        return "<";
+    case Operator::GT:
+        return ">";
+    case Operator::EQ:
+        return "==";
+    case Operator::NOT_EQ:
+        return "!=";
+    case Operator::NOT:
+        return "!";
+    default:
+        return "ILLEGAL";
+    }
+}
+
 // PrefixExpression implementation
-PrefixExpression::PrefixExpression(Token::Token token, std::string op)
-    : token(std::move(token)), op(std::move(op))
+PrefixExpression::PrefixExpression(Token::Token token, Operator op)
+    : Expression(NodeKind::PREFIX_EXPRESSION), token(std::move(token)), op(op)
 {
 }
 
@@ -219,7 +288,7 @@ std::string PrefixExpression::TokenLiteral() const
 std::string PrefixExpression::String() const
 {
     std::string result = "(";
-    result += op;
+    result += toString(op);
     if (right)
     {
         result += right->String();
@@ -239,9 +308,8 @@ Expression *PrefixExpression::clone() const
 }
 
 // InfixExpression implementation
-InfixExpression::InfixExpression(Token::Token token, std::string op,
-                                 std::unique_ptr<Expression> left)
-    : token(std::move(token)), op(std::move(op)), left(std::move(left))
+InfixExpression::InfixExpression(Token::Token token, Operator op, std::unique_ptr<Expression> left)
+    : Expression(NodeKind::INFIX_EXPRESSION), token(std::move(token)), op(op), left(std::move(left))
 {
 }
 
@@ -261,7 +329,9 @@ std::string InfixExpression::String() const
     {
         result += left->String();
     }
-    result += " " + op + " ";
+    result += " ";
+    result += toString(op);
+    result += " ";
     if (right)
     {
         result += right->String();
@@ -286,7 +356,7 @@ Expression *InfixExpression::clone() const
 
 // BooleanLiteral implementation
 BooleanLiteral::BooleanLiteral(Token::Token token, bool value)
-    : token(std::move(token)), value(value)
+    : Expression(NodeKind::BOOLEAN_LITERAL), token(std::move(token)), value(value)
 {
 }
 
@@ -310,7 +380,7 @@ Expression *BooleanLiteral::clone() const
 }
 
 // FunctionLiteral implementation
-FunctionLiteral::FunctionLiteral(Token::Token token) : token(std::move(token))
+FunctionLiteral::FunctionLiteral(Token::Token token) : Expression(NodeKind::FUNCTION_LITERAL), token(std::move(token))
 {
 }
 
@@ -345,6 +415,16 @@ std::string FunctionLiteral::String() const
 Expression *FunctionLiteral::clone() const
 {
     auto cloned = new FunctionLiteral(token);
+    cloned->numLocals = numLocals;
+    cloned->numCells = numCells;
+    for (const auto &variable : capturedValues)
+    {
+        cloned->capturedValues.push_back(std::unique_ptr<Identifier>(static_cast<Identifier *>(variable->clone())));
+    }
+    for (const auto &variable : capturedCells)
+    {
+        cloned->capturedCells.push_back(std::unique_ptr<Identifier>(static_cast<Identifier *>(variable->clone())));
+    }
     for (const auto &param : parameters)
     {
         if (param)
@@ -362,7 +442,7 @@ Expression *FunctionLiteral::clone() const
 
 // CallExpression implementation
 CallExpression::CallExpression(Token::Token token, std::unique_ptr<Expression> function)
-    : token(std::move(token)), function(std::move(function))
+    : Expression(NodeKind::CALL_EXPRESSION), token(std::move(token)), function(std::move(function))
 {
 }
 
@@ -409,7 +489,7 @@ Expression *CallExpression::clone() const
 
 // StringLiteral implementation
 StringLiteral::StringLiteral(Token::Token token, std::string value)
-    : token(std::move(token)), value(std::move(value))
+    : Expression(NodeKind::STRING_LITERAL), token(std::move(token)), value(std::move(value))
 {
 }
 
@@ -433,7 +513,7 @@ Expression *StringLiteral::clone() const
 }
 
 // ArrayLiteral実装
-ArrayLiteral::ArrayLiteral(Token::Token token) : token(std::move(token))
+ArrayLiteral::ArrayLiteral(Token::Token token) : Expression(NodeKind::ARRAY_LITERAL), token(std::move(token))
 {
 }
 
@@ -479,7 +559,7 @@ Expression *ArrayLiteral::clone() const
 
 // IndexExpression実装
 IndexExpression::IndexExpression(Token::Token token, std::unique_ptr<Expression> left)
-    : token(std::move(token)), left(std::move(left))
+    : Expression(NodeKind::INDEX_EXPRESSION), token(std::move(token)), left(std::move(left))
 {
 }
 
@@ -523,7 +603,7 @@ Expression *IndexExpression::clone() const
 }
 
 // HashLiteral実装
-HashLiteral::HashLiteral(Token::Token tok) : token(std::move(tok))
+HashLiteral::HashLiteral(Token::Token tok) : Expression(NodeKind::HASH_LITERAL), token(std::move(tok))
 {
 }
 
@@ -573,7 +653,7 @@ Expression *HashLiteral::clone() const
         {
             auto clonedKey = std::unique_ptr<Expression>(key->clone());
             auto clonedValue = std::unique_ptr<Expression>(value->clone());
-            cloned->pairs[std::move(clonedKey)] = std::move(clonedValue);
+            cloned->pairs.emplace_back(std::move(clonedKey), std::move(clonedValue));
         }
     }
     return cloned;
@@ -581,14 +661,14 @@ Expression *HashLiteral::clone() const
 
 // ExpressionStatementのコピーコンストラクタ実装
 ExpressionStatement::ExpressionStatement(const ExpressionStatement &other)
-    : token(other.token),
+    : Statement(NodeKind::EXPRESSION_STATEMENT), token(other.token),
       expression(other.expression ? std::unique_ptr<Expression>(other.expression->clone())
                                   : nullptr)
 {
 }
 
 // BlockStatementのコピーコンストラクタ実装
-BlockStatement::BlockStatement(const BlockStatement &other) : token(other.token)
+BlockStatement::BlockStatement(const BlockStatement &other) : Statement(NodeKind::BLOCK_STATEMENT), token(other.token)
 {
     statements.reserve(other.statements.size());
     for (const auto &stmt : other.statements)
@@ -642,12 +722,12 @@ void Program::addStatement(std::unique_ptr<Statement> stmt)
 }
 
 WhileExpression::WhileExpression(Token::Token tok) 
-    : token(std::move(tok)) {}
+    : Expression(NodeKind::WHILE_EXPRESSION), token(std::move(tok)) {}
 
 WhileExpression::WhileExpression(Token::Token tok,
                                 std::unique_ptr<Expression> cond,
                                 std::unique_ptr<BlockStatement> b)
-    : token(std::move(tok))
+    : Expression(NodeKind::WHILE_EXPRESSION), token(std::move(tok))
     , condition(std::move(cond))
     , body(std::move(b)) {}
 
@@ -674,14 +754,14 @@ Expression* WhileExpression::clone() const {
 }
 
 ForExpression::ForExpression(Token::Token tok)
-    : token(std::move(tok)) {}
+    : Expression(NodeKind::FOR_EXPRESSION), token(std::move(tok)) {}
 
 ForExpression::ForExpression(Token::Token tok,
                            std::unique_ptr<Expression> init,
                            std::unique_ptr<Expression> cond,
                            std::unique_ptr<Expression> update,
                            std::unique_ptr<BlockStatement> b)
-    : token(std::move(tok))
+    : Expression(NodeKind::FOR_EXPRESSION), token(std::move(tok))
     , init(std::move(init))
     , condition(std::move(cond))
     , update(std::move(update))
@@ -718,7 +798,7 @@ Expression* ForExpression::clone() const {
 LetExpression::LetExpression(Token::Token tok,
                            std::unique_ptr<Identifier> name,
                            std::unique_ptr<Expression> value)
-    : token(std::move(tok))
+    : Expression(NodeKind::LET_EXPRESSION), token(std::move(tok))
     , name(std::move(name))
     , value(std::move(value)) {}
 
@@ -747,7 +827,7 @@ IfExpression::IfExpression(Token::Token tok,
                           std::unique_ptr<Expression> cond,
                           std::unique_ptr<BlockStatement> cons,
                           std::unique_ptr<BlockStatement> alt)
-    : token(std::move(tok))
+    : Expression(NodeKind::IF_EXPRESSION), token(std::move(tok))
     , condition(std::move(cond))
     , consequence(std::move(cons))
     , alternative(std::move(alt)) {}
@@ -774,4 +854,115 @@ Expression* IfExpression::clone() const {
         alternative ? std::unique_ptr<BlockStatement>(static_cast<BlockStatement*>(alternative->clone())) : nullptr
     );
 }
+void collectLetNames(const Node *node, std::vector<const Identifier *> &names)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    switch (node->kind())
+    {
+    case NodeKind::LET_STATEMENT:
+    {
+        auto letStmt = as<LetStatement>(node);
+        if (letStmt->name)
+        {
+            names.push_back(letStmt->name.get());
+        }
+        collectLetNames(letStmt->value.get(), names);
+        break;
+    }
+    case NodeKind::LET_EXPRESSION:
+    {
+        auto letExpr = as<LetExpression>(node);
+        if (letExpr->getName())
+        {
+            names.push_back(letExpr->getName());
+        }
+        collectLetNames(letExpr->getValue(), names);
+        break;
+    }
+    case NodeKind::EXPRESSION_STATEMENT:
+        collectLetNames(as<ExpressionStatement>(node)->expression.get(), names);
+        break;
+    case NodeKind::RETURN_STATEMENT:
+        collectLetNames(as<ReturnStatement>(node)->returnValue.get(), names);
+        break;
+    case NodeKind::BLOCK_STATEMENT:
+        for (const auto &stmt : as<BlockStatement>(node)->statements)
+        {
+            collectLetNames(stmt.get(), names);
+        }
+        break;
+    case NodeKind::PREFIX_EXPRESSION:
+        collectLetNames(as<PrefixExpression>(node)->right.get(), names);
+        break;
+    case NodeKind::INFIX_EXPRESSION:
+    {
+        auto infix = as<InfixExpression>(node);
+        collectLetNames(infix->left.get(), names);
+        collectLetNames(infix->right.get(), names);
+        break;
+    }
+    case NodeKind::IF_EXPRESSION:
+    {
+        auto ifExpr = as<IfExpression>(node);
+        collectLetNames(ifExpr->getCondition(), names);
+        collectLetNames(ifExpr->getConsequence(), names);
+        collectLetNames(ifExpr->getAlternative(), names);
+        break;
+    }
+    case NodeKind::WHILE_EXPRESSION:
+    {
+        auto whileExpr = as<WhileExpression>(node);
+        collectLetNames(whileExpr->getCondition(), names);
+        collectLetNames(whileExpr->getBody(), names);
+        break;
+    }
+    case NodeKind::FOR_EXPRESSION:
+    {
+        auto forExpr = as<ForExpression>(node);
+        collectLetNames(forExpr->init.get(), names);
+        collectLetNames(forExpr->condition.get(), names);
+        collectLetNames(forExpr->body.get(), names);
+        collectLetNames(forExpr->update.get(), names);
+        break;
+    }
+    case NodeKind::CALL_EXPRESSION:
+    {
+        auto call = as<CallExpression>(node);
+        collectLetNames(call->function.get(), names);
+        for (const auto &arg : call->arguments)
+        {
+            collectLetNames(arg.get(), names);
+        }
+        break;
+    }
+    case NodeKind::ARRAY_LITERAL:
+        for (const auto &elem : as<ArrayLiteral>(node)->elements)
+        {
+            collectLetNames(elem.get(), names);
+        }
+        break;
+    case NodeKind::INDEX_EXPRESSION:
+    {
+        auto index = as<IndexExpression>(node);
+        collectLetNames(index->left.get(), names);
+        collectLetNames(index->index.get(), names);
+        break;
+    }
+    case NodeKind::HASH_LITERAL:
+        for (const auto &pair : as<HashLiteral>(node)->pairs)
+        {
+            collectLetNames(pair.first.get(), names);
+            collectLetNames(pair.second.get(), names);
+        }
+        break;
+    default:
+        // 関数リテラルと、名前を束縛しない葉のノード
+        break;
+    }
+}
+
 } // namespace AST
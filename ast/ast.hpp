@@ -1,8 +1,10 @@
 #pragma once
 #include "../token/token.hpp"
+#include "arena.hpp"
+#include <cstdint>
 #include <memory>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace AST
@@ -12,18 +14,98 @@ class Expression;
 class Statement;
 using ExpressionPtr = std::unique_ptr<Expression>;
 
+// ノードの種類を表す列挙型
+// 評価器・コンパイラはdynamic_castを順に試す代わりにこのタグでswitchする
+enum class NodeKind : uint8_t
+{
+    PROGRAM,
+    EXPRESSION_STATEMENT,
+    BLOCK_STATEMENT,
+    LET_STATEMENT,
+    RETURN_STATEMENT,
+    IDENTIFIER,
+    INTEGER_LITERAL,
+    PREFIX_EXPRESSION,
+    INFIX_EXPRESSION,
+    BOOLEAN_LITERAL,
+    FUNCTION_LITERAL,
+    CALL_EXPRESSION,
+    STRING_LITERAL,
+    ARRAY_LITERAL,
+    INDEX_EXPRESSION,
+    HASH_LITERAL,
+    IF_EXPRESSION,
+    WHILE_EXPRESSION,
+    FOR_EXPRESSION,
+    LET_EXPRESSION
+};
+
+// 前置・中置演算子の種類
+// パーサーがトークンから決め、評価器・コンパイラ・JITは文字列を比較せずにこの値でswitchする
+enum class Operator : uint8_t
+{
+    ILLEGAL,
+    ADD,    // +
+    SUB,    // -（中置）
+    MUL,    // *
+    DIV,    // /
+    LT,     // <
+    GT,     // >
+    EQ,     // ==
+    NOT_EQ, // !=
+    NOT,    // !（前置）
+    NEG     // -（前置）
+};
+
+// 演算子を記号の文字列に変換する関数
+std::string toString(Operator op);
+
+// 識別子が指す変数の場所
+enum class VariableScope : uint8_t
+{
+    UNRESOLVED, // 解決時に未定義だったグローバル（実行時に名前で検索する）
+    GLOBAL,     // グローバル環境のslot番目
+    LOCAL,      // 呼び出し環境のslot番目
+    CELL,       // 呼び出し環境のslot番目のセル（内側の関数にセルで捕捉される変数）
+    FREE_VALUE, // 実行中の関数が値で捕捉したslot番目の変数
+    FREE_CELL   // 実行中の関数がセルで捕捉したslot番目の変数
+};
+
 // 基本インターフェース
 class Node
 {
   public:
+    explicit Node(NodeKind kind) : kind_(kind)
+    {
+    }
     virtual ~Node() = default;
     virtual std::string TokenLiteral() const = 0;
+
+    // ArenaScopeの内側で生成したノードは現在のアリーナから確保する
+    // アリーナ上のノードをdeleteしてもデストラクタが走るだけで、メモリはアリーナと共に解放される
+    static void *operator new(size_t size);
+    static void operator delete(void *pointer);
     virtual std::string String() const = 0;
+
+    NodeKind kind() const
+    {
+        return kind_;
+    }
+
+  private:
+    NodeKind kind_;
 };
 
+// NodeKindに対応する具象ノード型へキャストする関数（種類の確認は呼び出し側で行う）
+template <typename T> const T *as(const Node *node)
+{
+    return static_cast<const T *>(node);
+}
+
 class Statement : public Node
 {
   public:
+    using Node::Node;
     virtual ~Statement() = default;
     virtual void statementNode() = 0;
     virtual Statement *clone() const = 0;
@@ -32,6 +114,7 @@ class Statement : public Node
 class Expression : public Node
 {
   public:
+    using Node::Node;
     virtual ~Expression() = default;
     virtual void expressionNode() = 0;
     virtual Expression *clone() const = 0;
@@ -71,8 +154,13 @@ class BlockStatement : public Statement
 class Program : public Node
 {
   public:
+    // 文のノードを所有するアリーナ（文より後に破棄されるよう先に宣言する）
+    std::unique_ptr<Arena> arena;
     std::vector<std::unique_ptr<Statement>> statements;
 
+    Program() : Node(NodeKind::PROGRAM)
+    {
+    }
     std::string TokenLiteral() const override;
     std::string String() const override;
     void clearStatements();
@@ -86,6 +174,10 @@ class Identifier : public Expression
     Token::Token token;
     std::string value;
 
+    // 解決パス（Resolver）が設定する変数の場所（slotの意味はscopeによって変わる）
+    mutable VariableScope scope = VariableScope::UNRESOLVED;
+    mutable int slot = -1;
+
     Identifier(Token::Token token, std::string value);
     void expressionNode() override;
     std::string TokenLiteral() const override;
@@ -143,10 +235,10 @@ class PrefixExpression : public Expression
 {
   public:
     Token::Token token;
-    std::string op;
+    Operator op;
     std::unique_ptr<Expression> right;
 
-    PrefixExpression(Token::Token token, std::string op);
+    PrefixExpression(Token::Token token, Operator op);
     void expressionNode() override;
     std::string TokenLiteral() const override;
     std::string String() const override;
@@ -158,11 +250,11 @@ class InfixExpression : public Expression
 {
   public:
     Token::Token token;
-    std::string op;
+    Operator op;
     std::unique_ptr<Expression> left;
     std::unique_ptr<Expression> right;
 
-    InfixExpression(Token::Token token, std::string op, std::unique_ptr<Expression> left);
+    InfixExpression(Token::Token token, Operator op, std::unique_ptr<Expression> left);
     void expressionNode() override;
     std::string TokenLiteral() const override;
     std::string String() const override;
@@ -191,6 +283,15 @@ class FunctionLiteral : public Expression
     std::vector<std::unique_ptr<Identifier>> parameters;
     std::unique_ptr<BlockStatement> body;
 
+    // 解決パスが設定する関数スコープのスロット数（引数を含む、セルに置く変数は除く）
+    mutable int numLocals = 0;
+    // 内側の関数にセルで捕捉される変数の数
+    mutable int numCells = 0;
+    // 本体が参照する外側の関数の変数（関数の生成時に、定義した側のスコープで解決した場所から捕捉する）
+    // 定義した側で代入し直されない引数は値で、それ以外の変数はセルで捕捉する
+    mutable std::vector<std::unique_ptr<Identifier>> capturedValues;
+    mutable std::vector<std::unique_ptr<Identifier>> capturedCells;
+
     explicit FunctionLiteral(Token::Token token);
     void expressionNode() override;
     std::string TokenLiteral() const override;
@@ -267,7 +368,7 @@ class HashLiteral : public Expression
 {
   public:
     Token::Token token; // '{'トークン
-    std::unordered_map<std::unique_ptr<Expression>, std::unique_ptr<Expression>> pairs;
+    std::vector<std::pair<std::unique_ptr<Expression>, std::unique_ptr<Expression>>> pairs; // ソース上の順
 
     explicit HashLiteral(Token::Token tok);
     void expressionNode() override;
@@ -307,6 +408,9 @@ public:
     std::unique_ptr<Expression> condition;
     std::unique_ptr<BlockStatement> body;
 
+    // 評価器が数えるループの反復回数（プロファイル用）
+    mutable uint64_t iterations = 0;
+
     explicit WhileExpression(Token::Token tok);
     WhileExpression(Token::Token tok,
                     std::unique_ptr<Expression> cond,
@@ -330,6 +434,9 @@ public:
     std::unique_ptr<Expression> update;    // 更新式
     std::unique_ptr<BlockStatement> body;  // 本体
 
+    // 評価器が数えるループの反復回数（プロファイル用）
+    mutable uint64_t iterations = 0;
+
     explicit ForExpression(Token::Token tok);
     ForExpression(Token::Token tok,
                  std::unique_ptr<Expression> init,
@@ -356,6 +463,13 @@ public:
     std::string TokenLiteral() const override;
     std::string String() const override;
     Expression* clone() const override;
+
+    const Identifier* getName() const { return name.get(); }
+    const Expression* getValue() const { return value.get(); }
 };
 
+// nodeの中のletが束縛する名前をソース上の順にnamesへ加える関数
+// 関数リテラルの中は別のスコープなので辿らない（関数本体の名前を初期化式より先に宣言するために使う）
+void collectLetNames(const Node *node, std::vector<const Identifier *> &names);
+
 } // namespace AST
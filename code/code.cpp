@@ -0,0 +1,153 @@
+#include "code.hpp"
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace Code
+{
+
+namespace
+{
+const std::vector<Definition> definitions = {
+    {"OpConstant", {2}},
+    {"OpPop", {}},
+    {"OpAdd", {}},
+    {"OpSub", {}},
+    {"OpMul", {}},
+    {"OpDiv", {}},
+    {"OpTrue", {}},
+    {"OpFalse", {}},
+    {"OpNull", {}},
+    {"OpEqual", {}},
+    {"OpNotEqual", {}},
+    {"OpGreaterThan", {}},
+    {"OpLessThan", {}},
+    {"OpMinus", {}},
+    {"OpBang", {}},
+    {"OpJumpNotTruthy", {2}},
+    {"OpJump", {2}},
+    {"OpGetGlobal", {2}},
+    {"OpSetGlobal", {2}},
+    {"OpGetLocal", {1}},
+    {"OpSetLocal", {1}},
+    {"OpGetBuiltin", {1}},
+    {"OpGetFree", {1}},
+    {"OpCurrentClosure", {}},
+    {"OpArray", {2}},
+    {"OpHash", {2}},
+    {"OpIndex", {}},
+    {"OpCall", {1}},
+    {"OpReturnValue", {}},
+    {"OpReturn", {}},
+    {"OpClosure", {2, 1}},
+    {"OpGetCell", {1}},
+    {"OpSetCell", {1}},
+    {"OpGetFreeCell", {1}},
+    {"OpCaptureCell", {1}},
+    {"OpCaptureFreeCell", {1}},
+};
+} // namespace
+
+const Definition &lookup(Opcode op)
+{
+    auto index = static_cast<size_t>(op);
+    if (index >= definitions.size())
+    {
+        throw std::runtime_error("opcode " + std::to_string(index) + " undefined");
+    }
+    return definitions[index];
+}
+
+bool operandFits(int width, int operand)
+{
+    return operand >= 0 && (width >= 4 || operand < (1 << (width * 8)));
+}
+
+Instructions make(Opcode op, std::initializer_list<int> operands)
+{
+    const auto &def = lookup(op);
+
+    size_t length = 1;
+    for (int width : def.operandWidths)
+    {
+        length += width;
+    }
+
+    Instructions ins;
+    ins.reserve(length);
+    ins.push_back(static_cast<uint8_t>(op));
+
+    size_t i = 0;
+    for (int operand : operands)
+    {
+        if (i >= def.operandWidths.size())
+        {
+            break;
+        }
+        if (!operandFits(def.operandWidths[i], operand))
+        {
+            throw std::out_of_range("operand " + std::to_string(operand) + " of " + def.name + " does not fit in " +
+                                    std::to_string(def.operandWidths[i] * 8) + " bits");
+        }
+        switch (def.operandWidths[i])
+        {
+        case 2:
+            ins.push_back(static_cast<uint8_t>((operand >> 8) & 0xff));
+            ins.push_back(static_cast<uint8_t>(operand & 0xff));
+            break;
+        case 1:
+            ins.push_back(static_cast<uint8_t>(operand & 0xff));
+            break;
+        }
+        i++;
+    }
+
+    return ins;
+}
+
+std::vector<int> readOperands(const Definition &def, const uint8_t *ins, size_t &bytesRead)
+{
+    std::vector<int> operands;
+    operands.reserve(def.operandWidths.size());
+    bytesRead = 0;
+
+    for (int width : def.operandWidths)
+    {
+        switch (width)
+        {
+        case 2:
+            operands.push_back(readUint16(ins + bytesRead));
+            break;
+        case 1:
+            operands.push_back(readUint8(ins + bytesRead));
+            break;
+        }
+        bytesRead += width;
+    }
+
+    return operands;
+}
+
+std::string toString(const Instructions &ins)
+{
+    std::ostringstream out;
+    size_t i = 0;
+    while (i < ins.size())
+    {
+        const auto &def = lookup(static_cast<Opcode>(ins[i]));
+        size_t read = 0;
+        auto operands = readOperands(def, ins.data() + i + 1, read);
+
+        out << std::setw(4) << std::setfill('0') << i << " " << def.name;
+        for (int operand : operands)
+        {
+            out << " " << operand;
+        }
+        out << "\n";
+
+        i += 1 + read;
+    }
+    return out.str();
+}
+
+} // namespace Code
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace Code
+{
+
+// バイトコード列
+using Instructions = std::vector<uint8_t>;
+
+// オペコード
+enum class Opcode : uint8_t
+{
+    CONSTANT,          // 定数プールから値をプッシュ (u16: 定数インデックス)
+    POP,               // スタックトップを捨てる
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    TRUE,
+    FALSE,
+    NULL_,
+    EQUAL,
+    NOT_EQUAL,
+    GREATER_THAN,
+    LESS_THAN,
+    MINUS,             // 単項 -
+    BANG,              // 単項 !
+    JUMP_NOT_TRUTHY,   // (u16: ジャンプ先)
+    JUMP,              // (u16: ジャンプ先)
+    GET_GLOBAL,        // (u16: グローバルインデックス)
+    SET_GLOBAL,        // (u16: グローバルインデックス) 値はスタックに残す
+    GET_LOCAL,         // (u8: ローカルインデックス)
+    SET_LOCAL,         // (u8: ローカルインデックス) 値はスタックに残す
+    GET_BUILTIN,       // (u8: ビルトインインデックス)
+    GET_FREE,          // (u8: 自由変数インデックス)
+    CURRENT_CLOSURE,   // 実行中のクロージャ自身をプッシュ
+    ARRAY,             // (u16: 要素数)
+    HASH,              // (u16: キーと値の総数)
+    INDEX,
+    CALL,              // (u8: 引数の数)
+    RETURN_VALUE,
+    RETURN,
+    CLOSURE,           // (u16: 定数インデックス, u8: 自由変数の数)
+    GET_CELL,          // (u8: セルインデックス) 実行中のフレームのセルの値をプッシュ
+    SET_CELL,          // (u8: セルインデックス) 値はスタックに残す
+    GET_FREE_CELL,     // (u8: 捕捉したセルのインデックス)
+    CAPTURE_CELL,      // (u8: セルインデックス) スタックトップのクロージャにフレームのセルを捕捉させる
+    CAPTURE_FREE_CELL, // (u8: 捕捉したセルのインデックス) スタックトップのクロージャに捕捉したセルを引き継がせる
+};
+
+// オペコードの定義（名前とオペランド幅）
+struct Definition
+{
+    std::string name;
+    std::vector<int> operandWidths;
+};
+
+// オペコードの定義を取得する関数
+const Definition &lookup(Opcode op);
+
+// オペランドが指定した幅（バイト数）の符号なし整数に収まるかを判定する関数
+bool operandFits(int width, int operand);
+
+// 命令をエンコードする関数（幅に収まらないオペランドは例外を送出する）
+Instructions make(Opcode op, std::initializer_list<int> operands = {});
+
+// 命令のオペランドをデコードする関数（読み取ったバイト数を返す）
+std::vector<int> readOperands(const Definition &def, const uint8_t *ins, size_t &bytesRead);
+
+inline uint16_t readUint16(const uint8_t *ins)
+{
+    return static_cast<uint16_t>((ins[0] << 8) | ins[1]);
+}
+
+inline uint8_t readUint8(const uint8_t *ins)
+{
+    return ins[0];
+}
+
+// 逆アセンブル結果を文字列に変換する関数
+std::string toString(const Instructions &ins);
+
+} // namespace Code
@@ -0,0 +1,707 @@
+#include "compiler.hpp"
+#include "../object/builtins.hpp"
+#include <algorithm>
+
+namespace Compiler
+{
+
+// SymbolTable implementation
+SymbolTable::SymbolTable(std::shared_ptr<SymbolTable> outer) : outer(std::move(outer))
+{
+}
+
+const Symbol &SymbolTable::Define(const std::string &name)
+{
+    auto scope = outer ? SymbolScope::LOCAL : SymbolScope::GLOBAL;
+
+    auto it = store.find(name);
+    if (it != store.end() && (it->second.scope == scope || it->second.scope == SymbolScope::CELL))
+    {
+        if (outer)
+        {
+            rebound.insert(name);
+        }
+        return it->second;
+    }
+    if (cellNames.count(name))
+    {
+        return DefineCell(name);
+    }
+
+    Symbol symbol{name, scope, numDefinitions++};
+    return store[name] = std::move(symbol);
+}
+
+// 引数は呼び出し時にスタックへ積まれた位置のスロットに定義する（セルに置く引数は本体の先頭で移す）
+const Symbol &SymbolTable::DefineParameter(const std::string &name)
+{
+    parameters.insert(name);
+    return store[name] = Symbol{name, SymbolScope::LOCAL, numDefinitions++};
+}
+
+const Symbol &SymbolTable::DefineCell(const std::string &name)
+{
+    return store[name] = Symbol{name, SymbolScope::CELL, numCells++};
+}
+
+const Symbol &SymbolTable::DefineBuiltin(int index, const std::string &name)
+{
+    return store[name] = Symbol{name, SymbolScope::BUILTIN, index};
+}
+
+const Symbol &SymbolTable::DefineFunctionName(const std::string &name)
+{
+    return store[name] = Symbol{name, SymbolScope::FUNCTION, 0};
+}
+
+const Symbol &SymbolTable::defineFree(const Symbol &original)
+{
+    if (original.scope == SymbolScope::CELL || original.scope == SymbolScope::FREE_CELL)
+    {
+        freeCells.push_back(original);
+        Symbol symbol{original.name, SymbolScope::FREE_CELL, static_cast<int>(freeCells.size()) - 1};
+        return store[original.name] = std::move(symbol);
+    }
+    freeSymbols.push_back(original);
+    Symbol symbol{original.name, SymbolScope::FREE, static_cast<int>(freeSymbols.size()) - 1};
+    return store[original.name] = std::move(symbol);
+}
+
+const Symbol *SymbolTable::Resolve(const std::string &name)
+{
+    auto it = store.find(name);
+    if (it != store.end())
+    {
+        return &it->second;
+    }
+
+    if (!outer)
+    {
+        return nullptr;
+    }
+
+    const Symbol *symbol = outer->Resolve(name);
+    if (!symbol)
+    {
+        return nullptr;
+    }
+
+    if (symbol->scope == SymbolScope::GLOBAL || symbol->scope == SymbolScope::BUILTIN)
+    {
+        return symbol;
+    }
+    if (symbol->scope == SymbolScope::LOCAL)
+    {
+        outer->captured.insert(name);
+    }
+
+    return &defineFree(*symbol);
+}
+
+std::unordered_set<std::string> SymbolTable::missingCells() const
+{
+    std::unordered_set<std::string> names;
+    for (const auto &name : captured)
+    {
+        if (!parameters.count(name) || rebound.count(name))
+        {
+            names.insert(name);
+        }
+    }
+    return names;
+}
+
+std::shared_ptr<SymbolTable> NewGlobalSymbolTable()
+{
+    auto table = std::make_shared<SymbolTable>();
+    const auto &defs = monkey::builtins();
+    for (size_t i = 0; i < defs.size(); i++)
+    {
+        table->DefineBuiltin(static_cast<int>(i), defs[i].name);
+    }
+    return table;
+}
+
+// Compiler implementation
+Compiler::Compiler() : Compiler(NewGlobalSymbolTable(), {})
+{
+}
+
+Compiler::Compiler(std::shared_ptr<SymbolTable> symbolTable,
+                   std::vector<monkey::ObjectPtr> constants)
+    : constants(std::move(constants)), symbolTable(std::move(symbolTable))
+{
+    scopes.emplace_back();
+}
+
+bool Compiler::compile(const AST::Program &program)
+{
+    for (const auto &stmt : program.statements)
+    {
+        if (stmt)
+        {
+            compileStatement(stmt.get());
+        }
+    }
+    return errors.empty();
+}
+
+Bytecode Compiler::bytecode() const
+{
+    return Bytecode{scopes.back().instructions, constants};
+}
+
+void Compiler::compileStatement(const AST::Statement *stmt)
+{
+    switch (stmt->kind())
+    {
+    case AST::NodeKind::EXPRESSION_STATEMENT:
+    {
+        auto exprStmt = AST::as<AST::ExpressionStatement>(stmt);
+        if (!exprStmt->expression)
+        {
+            return;
+        }
+        compileExpression(exprStmt->expression.get());
+        emit(Code::Opcode::POP);
+        break;
+    }
+    case AST::NodeKind::LET_STATEMENT:
+    {
+        auto letStmt = AST::as<AST::LetStatement>(stmt);
+        if (!letStmt->name || !letStmt->value)
+        {
+            errors.push_back("invalid let statement");
+            return;
+        }
+        compileLet(letStmt->name.get(), letStmt->value.get());
+        emit(Code::Opcode::POP);
+        break;
+    }
+    case AST::NodeKind::RETURN_STATEMENT:
+    {
+        auto returnStmt = AST::as<AST::ReturnStatement>(stmt);
+        if (!returnStmt->returnValue)
+        {
+            errors.push_back("return value is null");
+            return;
+        }
+        compileExpression(returnStmt->returnValue.get());
+        emit(Code::Opcode::RETURN_VALUE);
+        break;
+    }
+    case AST::NodeKind::BLOCK_STATEMENT:
+        compileBlockValue(AST::as<AST::BlockStatement>(stmt));
+        emit(Code::Opcode::POP);
+        break;
+    default:
+        errors.push_back("unsupported statement: " + stmt->String());
+        break;
+    }
+}
+
+// ブロックを「値を1つスタックに残す式」としてコンパイルする
+void Compiler::compileBlockValue(const AST::BlockStatement *block)
+{
+    if (!block || block->statements.empty())
+    {
+        emit(Code::Opcode::NULL_);
+        return;
+    }
+
+    for (const auto &stmt : block->statements)
+    {
+        if (stmt)
+        {
+            compileStatement(stmt.get());
+        }
+    }
+
+    if (lastInstructionIs(Code::Opcode::POP))
+    {
+        removeLastPop();
+    }
+    else if (!lastInstructionIs(Code::Opcode::RETURN_VALUE))
+    {
+        emit(Code::Opcode::NULL_);
+    }
+}
+
+void Compiler::compileLet(const AST::Identifier *name, const AST::Expression *value)
+{
+    // 関数リテラルは再帰呼び出しできるよう先に名前を定義する
+    if (value && value->kind() == AST::NodeKind::FUNCTION_LITERAL)
+    {
+        const Symbol symbol = symbolTable->Define(name->value);
+        compileFunctionLiteral(AST::as<AST::FunctionLiteral>(value), name->value);
+        storeSymbol(symbol);
+        return;
+    }
+
+    compileExpression(value);
+    storeSymbol(symbolTable->Define(name->value));
+}
+
+void Compiler::storeSymbol(const Symbol &symbol)
+{
+    switch (symbol.scope)
+    {
+    case SymbolScope::GLOBAL:
+        emit(Code::Opcode::SET_GLOBAL, {symbol.index});
+        break;
+    case SymbolScope::CELL:
+        emit(Code::Opcode::SET_CELL, {symbol.index});
+        break;
+    default:
+        emit(Code::Opcode::SET_LOCAL, {symbol.index});
+        break;
+    }
+}
+
+void Compiler::compileExpression(const AST::Expression *expr)
+{
+    if (!expr)
+    {
+        emit(Code::Opcode::NULL_);
+        return;
+    }
+
+    switch (expr->kind())
+    {
+    case AST::NodeKind::INTEGER_LITERAL:
+        emit(Code::Opcode::CONSTANT,
+             {static_cast<int>(addConstant(
+                 monkey::makeRef<monkey::Integer>(AST::as<AST::IntegerLiteral>(expr)->value)))});
+        break;
+    case AST::NodeKind::INFIX_EXPRESSION:
+        compileInfixExpression(AST::as<AST::InfixExpression>(expr));
+        break;
+    case AST::NodeKind::IDENTIFIER:
+        compileIdentifier(AST::as<AST::Identifier>(expr));
+        break;
+    case AST::NodeKind::BOOLEAN_LITERAL:
+        emit(AST::as<AST::BooleanLiteral>(expr)->value ? Code::Opcode::TRUE : Code::Opcode::FALSE);
+        break;
+    case AST::NodeKind::PREFIX_EXPRESSION:
+        compilePrefixExpression(AST::as<AST::PrefixExpression>(expr));
+        break;
+    case AST::NodeKind::CALL_EXPRESSION:
+    {
+        auto call = AST::as<AST::CallExpression>(expr);
+        compileExpression(call->function.get());
+        for (const auto &arg : call->arguments)
+        {
+            compileExpression(arg.get());
+        }
+        emit(Code::Opcode::CALL, {static_cast<int>(call->arguments.size())});
+        break;
+    }
+    case AST::NodeKind::IF_EXPRESSION:
+        compileIfExpression(AST::as<AST::IfExpression>(expr));
+        break;
+    case AST::NodeKind::WHILE_EXPRESSION:
+        compileWhileExpression(AST::as<AST::WhileExpression>(expr));
+        break;
+    case AST::NodeKind::FOR_EXPRESSION:
+        compileForExpression(AST::as<AST::ForExpression>(expr));
+        break;
+    case AST::NodeKind::LET_EXPRESSION:
+    {
+        auto letExpr = AST::as<AST::LetExpression>(expr);
+        compileLet(letExpr->getName(), letExpr->getValue());
+        break;
+    }
+    case AST::NodeKind::STRING_LITERAL:
+        emit(Code::Opcode::CONSTANT,
+             {static_cast<int>(addConstant(
+                 monkey::makeRef<monkey::String>(AST::as<AST::StringLiteral>(expr)->getValue())))});
+        break;
+    case AST::NodeKind::ARRAY_LITERAL:
+    {
+        auto array = AST::as<AST::ArrayLiteral>(expr);
+        for (const auto &elem : array->elements)
+        {
+            compileExpression(elem.get());
+        }
+        emit(Code::Opcode::ARRAY, {static_cast<int>(array->elements.size())});
+        break;
+    }
+    case AST::NodeKind::HASH_LITERAL:
+    {
+        // キーと値は評価器と同じくソース上の順に評価する
+        const auto &pairs = AST::as<AST::HashLiteral>(expr)->pairs;
+        for (const auto &[key, value] : pairs)
+        {
+            compileExpression(key.get());
+            compileExpression(value.get());
+        }
+        emit(Code::Opcode::HASH, {static_cast<int>(pairs.size() * 2)});
+        break;
+    }
+    case AST::NodeKind::INDEX_EXPRESSION:
+    {
+        auto index = AST::as<AST::IndexExpression>(expr);
+        compileExpression(index->left.get());
+        compileExpression(index->index.get());
+        emit(Code::Opcode::INDEX);
+        break;
+    }
+    case AST::NodeKind::FUNCTION_LITERAL:
+        compileFunctionLiteral(AST::as<AST::FunctionLiteral>(expr), "");
+        break;
+    default:
+        errors.push_back("unsupported expression: " + expr->String());
+        break;
+    }
+}
+
+void Compiler::compileInfixExpression(const AST::InfixExpression *infix)
+{
+    compileExpression(infix->left.get());
+    compileExpression(infix->right.get());
+
+    switch (infix->op)
+    {
+    case AST::Operator::ADD:
+        emit(Code::Opcode::ADD);
+        break;
+    case AST::Operator::SUB:
+        emit(Code::Opcode::SUB);
+        break;
+    case AST::Operator::MUL:
+        emit(Code::Opcode::MUL);
+        break;
+    case AST::Operator::DIV:
+        emit(Code::Opcode::DIV);
+        break;
+    case AST::Operator::EQ:
+        emit(Code::Opcode::EQUAL);
+        break;
+    case AST::Operator::NOT_EQ:
+        emit(Code::Opcode::NOT_EQUAL);
+        break;
+    case AST::Operator::GT:
+        emit(Code::Opcode::GREATER_THAN);
+        break;
+    case AST::Operator::LT:
+        emit(Code::Opcode::LESS_THAN);
+        break;
+    default:
+        errors.push_back("unknown operator: " + AST::toString(infix->op));
+        break;
+    }
+}
+
+void Compiler::compilePrefixExpression(const AST::PrefixExpression *prefix)
+{
+    compileExpression(prefix->right.get());
+
+    if (prefix->op == AST::Operator::NOT)
+        emit(Code::Opcode::BANG);
+    else if (prefix->op == AST::Operator::NEG)
+        emit(Code::Opcode::MINUS);
+    else
+        errors.push_back("unknown operator: " + AST::toString(prefix->op));
+}
+
+void Compiler::compileIfExpression(const AST::IfExpression *ifExpr)
+{
+    compileExpression(ifExpr->getCondition());
+
+    // ジャンプ先は後で書き換える
+    auto jumpNotTruthyPos = emit(Code::Opcode::JUMP_NOT_TRUTHY, {9999});
+
+    compileBlockValue(ifExpr->getConsequence());
+
+    auto jumpPos = emit(Code::Opcode::JUMP, {9999});
+    changeOperand(jumpNotTruthyPos, static_cast<int>(currentInstructions().size()));
+
+    if (ifExpr->getAlternative())
+    {
+        compileBlockValue(ifExpr->getAlternative());
+    }
+    else
+    {
+        emit(Code::Opcode::NULL_);
+    }
+
+    changeOperand(jumpPos, static_cast<int>(currentInstructions().size()));
+}
+
+// while式の値は最後に評価された本体の値（一度も実行されなければnull）
+void Compiler::compileWhileExpression(const AST::WhileExpression *whileExpr)
+{
+    emit(Code::Opcode::NULL_);
+
+    auto loopStart = currentInstructions().size();
+    compileExpression(whileExpr->getCondition());
+    auto exitJumpPos = emit(Code::Opcode::JUMP_NOT_TRUTHY, {9999});
+
+    emit(Code::Opcode::POP);
+    compileBlockValue(whileExpr->getBody());
+    emit(Code::Opcode::JUMP, {static_cast<int>(loopStart)});
+
+    changeOperand(exitJumpPos, static_cast<int>(currentInstructions().size()));
+}
+
+void Compiler::compileForExpression(const AST::ForExpression *forExpr)
+{
+    compileExpression(forExpr->init.get());
+    emit(Code::Opcode::POP);
+    emit(Code::Opcode::NULL_);
+
+    auto loopStart = currentInstructions().size();
+    compileExpression(forExpr->condition.get());
+    auto exitJumpPos = emit(Code::Opcode::JUMP_NOT_TRUTHY, {9999});
+
+    emit(Code::Opcode::POP);
+    compileBlockValue(forExpr->body.get());
+    compileExpression(forExpr->update.get());
+    emit(Code::Opcode::POP);
+    emit(Code::Opcode::JUMP, {static_cast<int>(loopStart)});
+
+    changeOperand(exitJumpPos, static_cast<int>(currentInstructions().size()));
+}
+
+void Compiler::compileFunctionLiteral(const AST::FunctionLiteral *func, const std::string &name)
+{
+    // 捕捉した変数を後から代入し直すかは本体を最後まで見ないとわからないため、
+    // セルに置くべき変数が見つかったら、それをセルに置いて本体をコンパイルし直す
+    size_t numConstants = constants.size();
+    size_t numErrors = errors.size();
+    std::unordered_set<std::string> cellNames;
+    while (true)
+    {
+        enterScope();
+        symbolTable->cellNames = cellNames;
+        compileFunctionBody(func, name);
+
+        auto missing = symbolTable->missingCells();
+        if (missing.empty())
+        {
+            break;
+        }
+        leaveScope();
+        constants.resize(numConstants);
+        errors.resize(numErrors);
+        cellNames.insert(missing.begin(), missing.end());
+    }
+
+    auto freeSymbols = symbolTable->freeSymbols;
+    auto freeCells = symbolTable->freeCells;
+    int numLocals = symbolTable->numDefinitions;
+    int numCells = symbolTable->numCells;
+    auto instructions = leaveScope();
+
+    for (const auto &symbol : freeSymbols)
+    {
+        loadSymbol(symbol);
+    }
+
+    auto compiledFn = monkey::makeRef<monkey::CompiledFunction>(
+        std::move(instructions), numLocals, static_cast<int>(func->parameters.size()), numCells);
+    emit(Code::Opcode::CLOSURE,
+         {static_cast<int>(addConstant(compiledFn)), static_cast<int>(freeSymbols.size())});
+    for (const auto &symbol : freeCells)
+    {
+        emit(symbol.scope == SymbolScope::CELL ? Code::Opcode::CAPTURE_CELL : Code::Opcode::CAPTURE_FREE_CELL,
+             {symbol.index});
+    }
+}
+
+void Compiler::compileFunctionBody(const AST::FunctionLiteral *func, const std::string &name)
+{
+    if (!name.empty())
+    {
+        symbolTable->DefineFunctionName(name);
+    }
+
+    for (const auto &param : func->parameters)
+    {
+        symbolTable->DefineParameter(param->value);
+    }
+    // セルに置く引数は、呼び出し時に置かれたスロットからセルへ移す
+    for (const auto &param : func->parameters)
+    {
+        if (symbolTable->cellNames.count(param->value))
+        {
+            emit(Code::Opcode::GET_LOCAL, {symbolTable->Resolve(param->value)->index});
+            emit(Code::Opcode::SET_CELL, {symbolTable->DefineCell(param->value).index});
+            emit(Code::Opcode::POP);
+        }
+    }
+    // 本体のletが束縛する名前は初期化式より先に定義し、後で定義する局所関数も参照できるようにする（相互再帰）
+    std::vector<const AST::Identifier *> letNames;
+    AST::collectLetNames(func->body.get(), letNames);
+    for (const AST::Identifier *letName : letNames)
+    {
+        symbolTable->Define(letName->value);
+    }
+
+    if (func->body)
+    {
+        for (const auto &stmt : func->body->statements)
+        {
+            if (stmt)
+            {
+                compileStatement(stmt.get());
+            }
+        }
+    }
+
+    if (lastInstructionIs(Code::Opcode::POP))
+    {
+        replaceLastPopWithReturn();
+    }
+    if (!lastInstructionIs(Code::Opcode::RETURN_VALUE))
+    {
+        emit(Code::Opcode::RETURN);
+    }
+}
+
+void Compiler::compileIdentifier(const AST::Identifier *ident)
+{
+    const Symbol *symbol = symbolTable->Resolve(ident->value);
+    if (!symbol)
+    {
+        errors.push_back("identifier not found: " + ident->value);
+        return;
+    }
+    loadSymbol(*symbol);
+}
+
+void Compiler::loadSymbol(const Symbol &symbol)
+{
+    switch (symbol.scope)
+    {
+    case SymbolScope::GLOBAL:
+        emit(Code::Opcode::GET_GLOBAL, {symbol.index});
+        break;
+    case SymbolScope::LOCAL:
+        emit(Code::Opcode::GET_LOCAL, {symbol.index});
+        break;
+    case SymbolScope::BUILTIN:
+        emit(Code::Opcode::GET_BUILTIN, {symbol.index});
+        break;
+    case SymbolScope::FREE:
+        emit(Code::Opcode::GET_FREE, {symbol.index});
+        break;
+    case SymbolScope::FUNCTION:
+        emit(Code::Opcode::CURRENT_CLOSURE);
+        break;
+    case SymbolScope::CELL:
+        emit(Code::Opcode::GET_CELL, {symbol.index});
+        break;
+    case SymbolScope::FREE_CELL:
+        emit(Code::Opcode::GET_FREE_CELL, {symbol.index});
+        break;
+    }
+}
+
+size_t Compiler::emit(Code::Opcode op, std::initializer_list<int> operands)
+{
+    if (!checkOperands(op, operands))
+    {
+        // コンパイルは失敗するため命令は出力しない
+        return currentInstructions().size();
+    }
+    auto pos = addInstruction(Code::make(op, operands));
+    setLastInstruction(op, pos);
+    return pos;
+}
+
+bool Compiler::checkOperands(Code::Opcode op, std::initializer_list<int> operands)
+{
+    const auto &def = Code::lookup(op);
+    size_t i = 0;
+    for (int operand : operands)
+    {
+        if (i < def.operandWidths.size() && !Code::operandFits(def.operandWidths[i], operand))
+        {
+            errors.push_back("operand " + std::to_string(operand) + " of " + def.name + " does not fit in " +
+                             std::to_string(def.operandWidths[i] * 8) + " bits");
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+size_t Compiler::addConstant(monkey::ObjectPtr obj)
+{
+    constants.push_back(std::move(obj));
+    return constants.size() - 1;
+}
+
+size_t Compiler::addInstruction(const Code::Instructions &ins)
+{
+    auto &current = currentInstructions();
+    auto pos = current.size();
+    current.insert(current.end(), ins.begin(), ins.end());
+    return pos;
+}
+
+void Compiler::setLastInstruction(Code::Opcode op, size_t position)
+{
+    auto &scope = scopes.back();
+    scope.previousInstruction = scope.lastInstruction;
+    scope.lastInstruction = EmittedInstruction{op, position, true};
+}
+
+bool Compiler::lastInstructionIs(Code::Opcode op) const
+{
+    const auto &scope = scopes.back();
+    if (scope.instructions.empty() || !scope.lastInstruction.valid)
+    {
+        return false;
+    }
+    return scope.lastInstruction.opcode == op;
+}
+
+void Compiler::removeLastPop()
+{
+    auto &scope = scopes.back();
+    scope.instructions.resize(scope.lastInstruction.position);
+    scope.lastInstruction = scope.previousInstruction;
+}
+
+void Compiler::replaceLastPopWithReturn()
+{
+    auto &scope = scopes.back();
+    scope.instructions[scope.lastInstruction.position] =
+        static_cast<uint8_t>(Code::Opcode::RETURN_VALUE);
+    scope.lastInstruction.opcode = Code::Opcode::RETURN_VALUE;
+}
+
+void Compiler::changeOperand(size_t position, int operand)
+{
+    auto &ins = currentInstructions();
+    auto op = static_cast<Code::Opcode>(ins[position]);
+    if (!checkOperands(op, {operand}))
+    {
+        return;
+    }
+    auto newInstruction = Code::make(op, {operand});
+    std::copy(newInstruction.begin(), newInstruction.end(), ins.begin() + position);
+}
+
+Code::Instructions &Compiler::currentInstructions()
+{
+    return scopes.back().instructions;
+}
+
+void Compiler::enterScope()
+{
+    scopes.emplace_back();
+    symbolTable = std::make_shared<SymbolTable>(symbolTable);
+}
+
+Code::Instructions Compiler::leaveScope()
+{
+    auto instructions = std::move(scopes.back().instructions);
+    scopes.pop_back();
+    symbolTable = symbolTable->outer;
+    return instructions;
+}
+
+} // namespace Compiler
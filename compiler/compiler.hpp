@@ -0,0 +1,159 @@
+#pragma once
+#include "../ast/ast.hpp"
+#include "../code/code.hpp"
+#include "../object/object.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Compiler
+{
+
+// シンボルのスコープ
+enum class SymbolScope
+{
+    GLOBAL,
+    LOCAL,
+    BUILTIN,
+    FREE,
+    FUNCTION,
+    CELL,     // 内側の関数にセルで捕捉されるローカル変数（フレームのセルに置く）
+    FREE_CELL // セルで捕捉した外側の変数
+};
+
+struct Symbol
+{
+    std::string name;
+    SymbolScope scope;
+    int index;
+};
+
+// シンボルテーブル（関数ごとに1つ、外側のテーブルへ連鎖する）
+// 捕捉の方法は評価器の解決パス（evaluator/resolver.hpp）と同じく決める。
+// 内側の関数に捕捉される変数のうち、代入し直されない引数は値で、それ以外はセルで捕捉させる。
+class SymbolTable
+{
+  public:
+    std::shared_ptr<SymbolTable> outer;
+    std::vector<Symbol> freeSymbols; // 値で捕捉した外側の変数
+    std::vector<Symbol> freeCells;   // セルで捕捉した外側の変数
+    int numDefinitions = 0;
+    int numCells = 0;
+    std::unordered_set<std::string> cellNames; // セルに置く変数（関数をコンパイルし直す前に設定する）
+
+    explicit SymbolTable(std::shared_ptr<SymbolTable> outer = nullptr);
+
+    // 同じスコープで既に定義済みの名前は同じスロットを再利用する
+    // （ブロックがスコープを作らないという評価器の意味論に合わせるため）
+    const Symbol &Define(const std::string &name);
+    const Symbol &DefineParameter(const std::string &name);
+    const Symbol &DefineCell(const std::string &name);
+    const Symbol &DefineBuiltin(int index, const std::string &name);
+    const Symbol &DefineFunctionName(const std::string &name);
+    const Symbol *Resolve(const std::string &name);
+
+    // セルに置く必要があるのに、ローカル変数として定義した変数
+    // （内側の関数に捕捉され、引数でないか代入し直されるもの）
+    std::unordered_set<std::string> missingCells() const;
+
+  private:
+    std::unordered_map<std::string, Symbol> store;
+    std::unordered_set<std::string> parameters;
+    std::unordered_set<std::string> rebound;  // 同じスコープのletで代入し直される
+    std::unordered_set<std::string> captured; // 内側の関数にローカル変数のまま捕捉された
+
+    const Symbol &defineFree(const Symbol &original);
+};
+
+// ビルトイン関数を登録済みのグローバルシンボルテーブルを作成する関数
+std::shared_ptr<SymbolTable> NewGlobalSymbolTable();
+
+// コンパイル結果
+struct Bytecode
+{
+    Code::Instructions instructions;
+    std::vector<monkey::ObjectPtr> constants;
+};
+
+class Compiler
+{
+  public:
+    Compiler();
+    // REPLで行をまたいでグローバルと定数を引き継ぐためのコンストラクタ
+    Compiler(std::shared_ptr<SymbolTable> symbolTable, std::vector<monkey::ObjectPtr> constants);
+
+    bool compile(const AST::Program &program);
+    Bytecode bytecode() const;
+
+    const std::vector<std::string> &Errors() const
+    {
+        return errors;
+    }
+    std::shared_ptr<SymbolTable> getSymbolTable() const
+    {
+        return symbolTable;
+    }
+    const std::vector<monkey::ObjectPtr> &getConstants() const
+    {
+        return constants;
+    }
+
+  private:
+    struct EmittedInstruction
+    {
+        Code::Opcode opcode = Code::Opcode::NULL_;
+        size_t position = 0;
+        bool valid = false;
+    };
+
+    struct CompilationScope
+    {
+        Code::Instructions instructions;
+        EmittedInstruction lastInstruction;
+        EmittedInstruction previousInstruction;
+    };
+
+    std::vector<monkey::ObjectPtr> constants;
+    std::shared_ptr<SymbolTable> symbolTable;
+    std::vector<CompilationScope> scopes;
+    std::vector<std::string> errors;
+
+    // 文のコンパイル
+    void compileStatement(const AST::Statement *stmt);
+    void compileBlockValue(const AST::BlockStatement *block);
+    void compileLet(const AST::Identifier *name, const AST::Expression *value);
+    void storeSymbol(const Symbol &symbol);
+
+    // 式のコンパイル
+    void compileExpression(const AST::Expression *expr);
+    void compileInfixExpression(const AST::InfixExpression *infix);
+    void compilePrefixExpression(const AST::PrefixExpression *prefix);
+    void compileIfExpression(const AST::IfExpression *ifExpr);
+    void compileWhileExpression(const AST::WhileExpression *whileExpr);
+    void compileForExpression(const AST::ForExpression *forExpr);
+    void compileFunctionLiteral(const AST::FunctionLiteral *func, const std::string &name);
+    void compileFunctionBody(const AST::FunctionLiteral *func, const std::string &name);
+    void compileIdentifier(const AST::Identifier *ident);
+
+    // 命令の出力
+    size_t emit(Code::Opcode op, std::initializer_list<int> operands = {});
+    // オペランドが命令の幅に収まらない場合はエラーを記録してfalseを返す
+    bool checkOperands(Code::Opcode op, std::initializer_list<int> operands);
+    size_t addConstant(monkey::ObjectPtr obj);
+    size_t addInstruction(const Code::Instructions &ins);
+    void setLastInstruction(Code::Opcode op, size_t position);
+    bool lastInstructionIs(Code::Opcode op) const;
+    void removeLastPop();
+    void replaceLastPopWithReturn();
+    void changeOperand(size_t position, int operand);
+    void loadSymbol(const Symbol &symbol);
+
+    // スコープ管理
+    Code::Instructions &currentInstructions();
+    void enterScope();
+    Code::Instructions leaveScope();
+};
+
+} // namespace Compiler
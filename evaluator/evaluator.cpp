@@ -1,583 +1,463 @@
 #include "evaluator.hpp"
-#include <iostream>
+#include "../object/builtins.hpp"
+#include "../trace/trace.hpp"
+#include <limits>
 
 namespace monkey
 {
 
-namespace
-{
-// デバッグ用の定数
-constexpr bool DEBUG_OUTPUT = false;
-constexpr size_t GC_THRESHOLD = 1000; // ガベージコレクションのしきい値
-size_t allocatedObjects = 0;          // 割り当てられたオブジェクトの数
-
-// objectTypeToString関数の前方宣言
-std::string objectTypeToString(ObjectType type);
-
-// デバッグ出力用のヘルパー関数
-void debugPrint(const std::string &message)
+ObjectPtr Evaluator::eval(const AST::Node* node)
 {
-    if (DEBUG_OUTPUT)
-    {
-        std::cout << "Debug: " << message << "\n";
+    // 評価の前に識別子をスロット番号に解決する
+    resolver.resolve(node);
+
+    // 例外の捕捉は評価の入口でのみ行う（ノードごとの評価には例外処理の枠組みを置かない）
+    // 例外で巻き戻った場合は関数呼び出しの途中の状態が残るため、入口の状態に戻す
+    auto savedLocals = locals;
+    auto savedCells = cells;
+    auto savedFunction = activeFunction;
+    auto savedSource = currentSource;
+    try
+    {
+        auto result = evalNode(node);
+        returning = false;
+        return result.toObject();
+    }
+    catch (const std::exception& e)
+    {
+        TRACE_WARN("eval", "Exception caught during evaluation: " << e.what() << " in " << node->String());
+        // 呼び出しのフレームはFrameScopeが巻き戻りの途中で解放している
+        locals = savedLocals;
+        cells = savedCells;
+        activeFunction = savedFunction;
+        currentSource = std::move(savedSource);
+        returning = false;
+        return newError("Runtime error: " + std::string(e.what())).toObject();
     }
 }
 
-// エラーチェック用のヘルパー関数
-bool isError(const ObjectPtr &obj)
+ObjectPtr Evaluator::eval(std::shared_ptr<const AST::Program> program)
 {
-    return obj != nullptr && obj->type() == ObjectType::ERROR;
-}
-
-// オブジェクトの割り当てを追跡
-void trackObject()
-{
-    allocatedObjects++;
-    debugPrint("Allocated objects: " + std::to_string(allocatedObjects));
+    auto savedSource = currentSource;
+    currentSource = program;
+    auto result = eval(program.get());
+    currentSource = std::move(savedSource);
+    return result;
 }
 
-// 配列用の組み込み関数
-ObjectPtr builtinLen(const std::vector<ObjectPtr> &args)
+Value Evaluator::evalNode(const AST::Node* node)
 {
-    if (args.size() != 1)
-    {
-        return std::make_shared<Error>(
-            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+    if (!node) {
+        TRACE_TRACE("eval", "Node is null, returning Null object");
+        return Value::null();
     }
 
-    if (auto array = std::dynamic_pointer_cast<Array>(args[0]))
-    {
-        return std::make_shared<Integer>(array->elements.size());
-    }
+    TRACE_TRACE("eval", "Starting Evaluation");
+    TRACE_TRACE("eval", "Node string representation: " << node->String());
 
-    return std::make_shared<Error>("argument to `len` not supported, got " +
-                                   objectTypeToString(args[0]->type()));
-}
-
-ObjectPtr builtinFirst(const std::vector<ObjectPtr> &args)
-{
-    if (args.size() != 1)
+    // ノードの種類ごとに分岐する
+    switch (node->kind())
     {
-        return std::make_shared<Error>(
-            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
-    }
-
-    auto array = std::dynamic_pointer_cast<Array>(args[0]);
-    if (!array)
+    // プログラムの評価
+    case AST::NodeKind::PROGRAM:
     {
-        return std::make_shared<Error>("argument to `first` must be ARRAY, got " +
-                                       objectTypeToString(args[0]->type()));
+        auto program = AST::as<AST::Program>(node);
+        TRACE_TRACE("eval", "Found Program node with " << program->statements.size() << " statements");
+        auto result = evalProgram(program);
+        TRACE_TRACE("eval", "Program evaluation result: " << result.inspect());
+        return result;
     }
 
-    if (array->elements.empty())
+    // 式文の評価
+    case AST::NodeKind::EXPRESSION_STATEMENT:
     {
-        return std::make_shared<Null>();
+        auto exprStmt = AST::as<AST::ExpressionStatement>(node);
+        TRACE_TRACE("eval", "Found ExpressionStatement");
+        TRACE_TRACE("eval", "Expression: " << exprStmt->String());
+        auto result = evalNode(exprStmt->expression.get());
+        TRACE_TRACE("eval", "ExpressionStatement result: " << result.inspect());
+        TRACE_TRACE("eval", "Result type: " << objectTypeToString(result.type()));
+        return result;
     }
 
-    return array->elements[0];
-}
-
-ObjectPtr builtinLast(const std::vector<ObjectPtr> &args)
-{
-    if (args.size() != 1)
+    // リテラルの評価
+    case AST::NodeKind::INTEGER_LITERAL:
     {
-        return std::make_shared<Error>(
-            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+        auto intLiteral = AST::as<AST::IntegerLiteral>(node);
+        TRACE_TRACE("eval", "Found IntegerLiteral: " << intLiteral->value);
+        return evalIntegerLiteral(intLiteral);
     }
-
-    auto array = std::dynamic_pointer_cast<Array>(args[0]);
-    if (!array)
+    case AST::NodeKind::BOOLEAN_LITERAL:
     {
-        return std::make_shared<Error>("argument to `last` must be ARRAY, got " +
-                                       objectTypeToString(args[0]->type()));
+        auto boolLiteral = AST::as<AST::BooleanLiteral>(node);
+        TRACE_TRACE("eval", "Found BooleanLiteral: " << boolLiteral->value);
+        auto result = Value::boolean(boolLiteral->value);
+        TRACE_TRACE("eval", "Created Boolean object: " << result.inspect());
+        return result;
     }
-
-    if (array->elements.empty())
+    case AST::NodeKind::STRING_LITERAL:
     {
-        return std::make_shared<Null>();
+        auto strLiteral = AST::as<AST::StringLiteral>(node);
+        TRACE_TRACE("eval", "Found StringLiteral: " << strLiteral->getValue());
+        return makeRef<String>(strLiteral->getValue());
     }
 
-    return array->elements.back();
-}
-
-ObjectPtr builtinRest(const std::vector<ObjectPtr> &args)
-{
-    if (args.size() != 1)
+    // 演算子の評価
+    case AST::NodeKind::PREFIX_EXPRESSION:
     {
-        return std::make_shared<Error>(
-            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+        auto prefixExpr = AST::as<AST::PrefixExpression>(node);
+        TRACE_TRACE("eval", "Found PrefixExpression: " << AST::toString(prefixExpr->op));
+        auto right = evalNode(prefixExpr->right.get());
+        TRACE_TRACE("eval", "PrefixExpression right operand: " << right.inspect());
+        if (isAbrupt(right)) return right;
+        auto result = evalPrefixExpression(prefixExpr->op, right);
+        TRACE_TRACE("eval", "PrefixExpression result: " << result.inspect());
+        return result;
     }
 
-    auto array = std::dynamic_pointer_cast<Array>(args[0]);
-    if (!array)
+    case AST::NodeKind::INFIX_EXPRESSION:
     {
-        return std::make_shared<Error>("argument to `rest` must be ARRAY, got " +
-                                       objectTypeToString(args[0]->type()));
-    }
+        auto infixExpr = AST::as<AST::InfixExpression>(node);
+        TRACE_TRACE("eval", "Evaluating Infix Expression");
+        TRACE_TRACE("eval", "Operator: " << AST::toString(infixExpr->op));
+        TRACE_TRACE("eval", "Left operand: " << (infixExpr->left ? infixExpr->left->String() : "null"));
+        TRACE_TRACE("eval", "Right operand: " << (infixExpr->right ? infixExpr->right->String() : "null"));
+        
+        // 文字列連結の特別処理
+        if (infixExpr->left && infixExpr->right &&
+            infixExpr->left->kind() == AST::NodeKind::STRING_LITERAL &&
+            infixExpr->right->kind() == AST::NodeKind::STRING_LITERAL &&
+            infixExpr->op == AST::Operator::ADD)
+        {
+            auto leftStr = AST::as<AST::StringLiteral>(infixExpr->left.get());
+            auto rightStr = AST::as<AST::StringLiteral>(infixExpr->right.get());
+            TRACE_TRACE("eval", "String concatenation");
+            auto result = makeRef<String>(leftStr->getValue() + rightStr->getValue());
+            TRACE_TRACE("eval", "Concatenation result: " << result->inspect());
+            return result;
+        }
 
-    if (array->elements.empty())
-    {
-        return std::make_shared<Null>();
+        auto left = evalNode(infixExpr->left.get());
+        TRACE_TRACE("eval", "Evaluated left operand: " << left.inspect());
+        if (isAbrupt(left)) return left;
+        
+        auto right = evalNode(infixExpr->right.get());
+        TRACE_TRACE("eval", "Evaluated right operand: " << right.inspect());
+        if (isAbrupt(right)) return right;
+        
+        auto result = evalInfixExpression(infixExpr->op, left, right);
+        TRACE_TRACE("eval", "InfixExpression result: " << result.inspect());
+        return result;
     }
 
-    std::vector<ObjectPtr> newElements(array->elements.begin() + 1, array->elements.end());
-    return std::make_shared<Array>(std::move(newElements));
-}
-
-ObjectPtr builtinPush(const std::vector<ObjectPtr> &args)
-{
-    if (args.size() != 2)
+    // 配列リテラルの評価
+    case AST::NodeKind::ARRAY_LITERAL:
     {
-        return std::make_shared<Error>(
-            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2");
+        auto arrayLiteral = AST::as<AST::ArrayLiteral>(node);
+        TRACE_TRACE("eval", "Found ArrayLiteral");
+        return evalArrayLiteral(arrayLiteral);
     }
 
-    auto array = std::dynamic_pointer_cast<Array>(args[0]);
-    if (!array)
+    // インデックス式の評価
+    case AST::NodeKind::INDEX_EXPRESSION:
     {
-        return std::make_shared<Error>("argument to `push` must be ARRAY, got " +
-                                       objectTypeToString(args[0]->type()));
+        auto indexExpr = AST::as<AST::IndexExpression>(node);
+        TRACE_TRACE("eval", "Found IndexExpression");
+        return evalIndexExpression(indexExpr);
     }
 
-    std::vector<ObjectPtr> newElements = array->elements;
-    newElements.push_back(args[1]);
-    return std::make_shared<Array>(std::move(newElements));
-}
-
-// objectTypeToString関数の実装
-std::string objectTypeToString(ObjectType type)
-{
-    switch (type)
+    // if式の評価
+    case AST::NodeKind::IF_EXPRESSION:
     {
-    case ObjectType::INTEGER:
-        return "INTEGER";
-    case ObjectType::BOOLEAN:
-        return "BOOLEAN";
-    case ObjectType::STRING:
-        return "STRING";
-    case ObjectType::NULL_OBJ:
-        return "NULL";
-    case ObjectType::ERROR:
-        return "ERROR";
-    case ObjectType::ARRAY:
-        return "ARRAY";
-    case ObjectType::HASH:
-        return "HASH";
-    case ObjectType::FUNCTION:
-        return "FUNCTION";
-    case ObjectType::BUILTIN:
-        return "BUILTIN";
-    case ObjectType::RETURN_VALUE:
-        return "RETURN_VALUE";
-    default:
-        return "UNKNOWN";
-    }
-}
-} // namespace
-
-ObjectPtr Evaluator::eval(const AST::Node* node)
-{
-    try {
-        std::cout << "\n=== Starting Evaluation ===" << std::endl;
-        std::cout << "Debug: Node type: " << typeid(*node).name() << std::endl;
-        std::cout << "Debug: Node string representation: " << node->String() << std::endl;
-        
-        if (!node) {
-            std::cout << "Debug: Node is null, returning Null object" << std::endl;
-            return std::make_shared<Null>();
-        }
-
-        // プログラムの評価
-        if (auto program = dynamic_cast<const AST::Program*>(node))
-        {
-            std::cout << "\nDebug: Found Program node with " << program->statements.size() << " statements" << std::endl;
-            auto result = evalProgram(program);
-            std::cout << "Debug: Program evaluation result: " << (result ? result->inspect() : "null") << std::endl;
-            return result;
-        }
+        auto ifExpr = AST::as<AST::IfExpression>(node);
+        TRACE_TRACE("eval", "Found IfExpression");
+        auto condition = evalNode(ifExpr->getCondition());
+        if (isAbrupt(condition)) return condition;
 
-        // 式文の評価
-        if (auto exprStmt = dynamic_cast<const AST::ExpressionStatement*>(node))
+        if (isTruthy(condition))
         {
-            std::cout << "\nDebug: Found ExpressionStatement" << std::endl;
-            std::cout << "Debug: Expression: " << exprStmt->String() << std::endl;
-            auto result = eval(exprStmt->expression.get());
-            std::cout << "Debug: ExpressionStatement result: " << (result ? result->inspect() : "null") << std::endl;
-            std::cout << "Debug: Result type: " << (result ? objectTypeToString(result->type()) : "null") << std::endl;
-            return result;
+            TRACE_TRACE("eval", "Condition is truthy, evaluating consequence");
+            return evalNode(ifExpr->getConsequence());
         }
-
-        // リテラルの評価
-        if (auto intLiteral = dynamic_cast<const AST::IntegerLiteral*>(node))
+        else if (ifExpr->getAlternative())
         {
-            std::cout << "Debug: Found IntegerLiteral: " << intLiteral->value << std::endl;
-            return evalIntegerLiteral(intLiteral);
+            TRACE_TRACE("eval", "Condition is falsy, evaluating alternative");
+            return evalNode(ifExpr->getAlternative());
         }
-        if (auto boolLiteral = dynamic_cast<const AST::BooleanLiteral*>(node))
+        else
         {
-            std::cout << "Debug: Found BooleanLiteral: " << boolLiteral->value << std::endl;
-            auto result = std::make_shared<Boolean>(boolLiteral->value);
-            std::cout << "Debug: Created Boolean object: " << result->inspect() << std::endl;
-            return result;
-        }
-        if (auto strLiteral = dynamic_cast<const AST::StringLiteral*>(node))
-        {
-            std::cout << "Debug: Found StringLiteral: " << strLiteral->getValue() << std::endl;
-            return std::make_shared<String>(strLiteral->getValue());
-        }
-
-        // 演算子の評価
-        if (auto prefixExpr = dynamic_cast<const AST::PrefixExpression*>(node))
-        {
-            std::cout << "Debug: Found PrefixExpression: " << prefixExpr->op << std::endl;
-            auto right = eval(prefixExpr->right.get());
-            std::cout << "Debug: PrefixExpression right operand: " 
-                      << (right ? right->inspect() : "null") << std::endl;
-            if (!right || isError(right)) return right;
-            auto result = evalPrefixExpression(prefixExpr->op, right);
-            std::cout << "Debug: PrefixExpression result: " 
-                      << (result ? result->inspect() : "null") << std::endl;
-            return result;
-        }
-
-        if (auto infixExpr = dynamic_cast<const AST::InfixExpression*>(node))
-        {
-            std::cout << "\n=== Evaluating Infix Expression ===" << std::endl;
-            std::cout << "Debug: Operator: " << infixExpr->op << std::endl;
-            std::cout << "Debug: Left operand: " << (infixExpr->left ? infixExpr->left->String() : "null") << std::endl;
-            std::cout << "Debug: Right operand: " << (infixExpr->right ? infixExpr->right->String() : "null") << std::endl;
-            
-            // 文字列連結の特別処理
-            if (auto leftStr = dynamic_cast<const AST::StringLiteral*>(infixExpr->left.get()))
-            {
-                if (auto rightStr = dynamic_cast<const AST::StringLiteral*>(infixExpr->right.get()))
-                {
-                    if (infixExpr->op == "+")
-                    {
-                        std::cout << "Debug: String concatenation" << std::endl;
-                        auto result = std::make_shared<String>(leftStr->getValue() + rightStr->getValue());
-                        std::cout << "Debug: Concatenation result: " << result->inspect() << std::endl;
-                        return result;
-                    }
-                }
-            }
-
-            auto left = eval(infixExpr->left.get());
-            std::cout << "Debug: Evaluated left operand: " << (left ? left->inspect() : "null") << std::endl;
-            if (!left || isError(left)) return left;
-            
-            auto right = eval(infixExpr->right.get());
-            std::cout << "Debug: Evaluated right operand: " << (right ? right->inspect() : "null") << std::endl;
-            if (!right || isError(right)) return right;
-            
-            auto result = evalInfixExpression(infixExpr->op, left, right);
-            std::cout << "Debug: InfixExpression result: " << (result ? result->inspect() : "null") << std::endl;
-            return result;
-        }
-
-        // 配列リテラルの評価
-        if (auto arrayLiteral = dynamic_cast<const AST::ArrayLiteral*>(node))
-        {
-            std::cout << "Debug: Found ArrayLiteral" << std::endl;
-            return evalArrayLiteral(arrayLiteral);
-        }
-
-        // インデックス式の評価
-        if (auto indexExpr = dynamic_cast<const AST::IndexExpression*>(node))
-        {
-            std::cout << "Debug: Found IndexExpression" << std::endl;
-            return evalIndexExpression(indexExpr);
-        }
-
-        // if式の評価
-        if (auto ifExpr = dynamic_cast<const AST::IfExpression*>(node))
-        {
-            std::cout << "Debug: Found IfExpression" << std::endl;
-            auto condition = eval(ifExpr->getCondition());
-            if (isError(condition)) return condition;
-
-            if (isTruthy(condition))
-            {
-                std::cout << "Debug: Condition is truthy, evaluating consequence" << std::endl;
-                return eval(ifExpr->getConsequence());
-            }
-            else if (ifExpr->getAlternative())
-            {
-                std::cout << "Debug: Condition is falsy, evaluating alternative" << std::endl;
-                return eval(ifExpr->getAlternative());
-            }
-            else
-            {
-                std::cout << "Debug: No alternative, returning Null" << std::endl;
-                return std::make_shared<Null>();
-            }
+            TRACE_TRACE("eval", "No alternative, returning Null");
+            return Value::null();
         }
+    }
 
-        // let文の評価
-        if (auto letStmt = dynamic_cast<const AST::LetStatement*>(node))
+    // let文の評価
+    case AST::NodeKind::LET_STATEMENT:
+    {
+        auto letStmt = AST::as<AST::LetStatement>(node);
+        TRACE_TRACE("eval", "Found LetStatement");
+        if (!letStmt->name || !letStmt->value)
         {
-            std::cout << "Debug: Found LetStatement" << std::endl;
-            if (!letStmt->name || !letStmt->value)
-            {
-                std::cout << "Debug: Invalid let statement" << std::endl;
-                return newError("invalid let statement");
-            }
-
-            auto value = eval(letStmt->value.get());
-            if (isError(value))
-            {
-                std::cout << "Debug: Error evaluating let value" << std::endl;
-                return value;
-            }
-
-            env->Set(letStmt->name->value, value);
-            return value;
+            TRACE_TRACE("eval", "Invalid let statement");
+            return newError("invalid let statement");
         }
+        return evalLet(letStmt->name.get(), letStmt->value.get());
+    }
 
-        // 識別子の評価
-        if (auto ident = dynamic_cast<const AST::Identifier*>(node))
+    // let式の評価（for文の初期化式・更新式）
+    case AST::NodeKind::LET_EXPRESSION:
+    {
+        auto letExpr = AST::as<AST::LetExpression>(node);
+        TRACE_TRACE("eval", "Found LetExpression");
+        if (!letExpr->getName() || !letExpr->getValue())
         {
-            std::cout << "Debug: Found Identifier: " << ident->value << std::endl;
-            return evalIdentifier(ident);
+            return newError("invalid let expression");
         }
+        return evalLet(letExpr->getName(), letExpr->getValue());
+    }
 
-        // return文の評価
-        if (auto returnStmt = dynamic_cast<const AST::ReturnStatement*>(node))
-        {
-            std::cout << "Debug: Found ReturnStatement" << std::endl;
-            if (!returnStmt->returnValue)
-            {
-                std::cout << "Debug: Return value is null" << std::endl;
-                return newError("return value is null");
-            }
+    // 関数リテラルの評価
+    case AST::NodeKind::FUNCTION_LITERAL:
+    {
+        auto funcLiteral = AST::as<AST::FunctionLiteral>(node);
+        TRACE_TRACE("eval", "Found FunctionLiteral");
+        return evalFunctionLiteral(funcLiteral);
+    }
 
-            auto value = eval(returnStmt->returnValue.get());
-            if (isError(value))
-            {
-                std::cout << "Debug: Error evaluating return value" << std::endl;
-                return value;
-            }
+    // 関数呼び出しの評価
+    case AST::NodeKind::CALL_EXPRESSION:
+    {
+        auto callExpr = AST::as<AST::CallExpression>(node);
+        TRACE_TRACE("eval", "Found CallExpression");
+        return evalCallExpression(callExpr);
+    }
 
-            std::cout << "Debug: Creating ReturnValue object with value: " 
-                      << value->inspect() << std::endl;
-            return std::make_shared<ReturnValue>(value);
-        }
+    // ハッシュリテラルの評価
+    case AST::NodeKind::HASH_LITERAL:
+    {
+        auto hashLiteral = AST::as<AST::HashLiteral>(node);
+        TRACE_TRACE("eval", "Found HashLiteral");
+        return evalHashLiteral(hashLiteral);
+    }
 
-        // ブロック文の評価
-        if (auto blockStmt = dynamic_cast<const AST::BlockStatement*>(node))
-        {
-            std::cout << "\n=== Evaluating Block Statement ===" << std::endl;
-            std::cout << "Debug: Block contents: " << blockStmt->String() << std::endl;
-            std::cout << "Debug: Number of statements: " << blockStmt->statements.size() << std::endl;
-            return evalBlockStatement(blockStmt);
-        }
+    // 識別子の評価
+    case AST::NodeKind::IDENTIFIER:
+    {
+        auto ident = AST::as<AST::Identifier>(node);
+        TRACE_TRACE("eval", "Found Identifier: " << ident->value);
+        return evalIdentifier(ident);
+    }
 
-        // while式の評価
-        if (auto whileExpr = dynamic_cast<const AST::WhileExpression*>(node))
-        {
-            std::cout << "\n=== Evaluating While Expression ===" << std::endl;
-            std::cout << "Debug: Condition: " << whileExpr->condition->String() << std::endl;
-            return evalWhileExpression(whileExpr);
-        }
+    // return文の評価
+    case AST::NodeKind::RETURN_STATEMENT:
+    {
+        auto returnStmt = AST::as<AST::ReturnStatement>(node);
+        TRACE_TRACE("eval", "Found ReturnStatement");
+        return evalReturnStatement(returnStmt);
+    }
 
-        // for式の評価
-        if (auto forExpr = dynamic_cast<const AST::ForExpression*>(node))
-        {
-            std::cout << "\n=== Evaluating For Expression ===" << std::endl;
-            return evalForExpression(forExpr);
-        }
+    // ブロック文の評価
+    case AST::NodeKind::BLOCK_STATEMENT:
+    {
+        auto blockStmt = AST::as<AST::BlockStatement>(node);
+        TRACE_TRACE("eval", "Evaluating Block Statement");
+        TRACE_TRACE("eval", "Block contents: " << blockStmt->String());
+        TRACE_TRACE("eval", "Number of statements: " << blockStmt->statements.size());
+        return evalBlockStatement(blockStmt);
+    }
 
-        std::cout << "\nDebug: No matching evaluation case found" << std::endl;
-        std::cout << "Debug: Node string: " << node->String() << std::endl;
-        return std::make_shared<Null>();
+    // while式の評価
+    case AST::NodeKind::WHILE_EXPRESSION:
+    {
+        auto whileExpr = AST::as<AST::WhileExpression>(node);
+        TRACE_TRACE("eval", "Evaluating While Expression");
+        TRACE_TRACE("eval", "Condition: " << whileExpr->condition->String());
+        return evalWhileExpression(whileExpr);
+    }
 
-    } catch (const std::exception& e) {
-        std::cout << "\nDebug: Exception caught during evaluation" << std::endl;
-        std::cout << "Debug: Exception message: " << e.what() << std::endl;
-        std::cout << "Debug: Node string: " << node->String() << std::endl;
-        return newError("Runtime error: " + std::string(e.what()));
+    // for式の評価
+    case AST::NodeKind::FOR_EXPRESSION:
+    {
+        auto forExpr = AST::as<AST::ForExpression>(node);
+        TRACE_TRACE("eval", "Evaluating For Expression");
+        return evalForExpression(forExpr);
+    }
     }
+
+    TRACE_WARN("eval", "No matching evaluation case found: " << node->String());
+    return Value::null();
 }
 
-ObjectPtr Evaluator::evalPrefixExpression(const std::string& op, ObjectPtr right)
+Value Evaluator::evalPrefixExpression(AST::Operator op, Value right)
 {
-    std::cout << "\n=== Evaluating Prefix Expression ===" << std::endl;
-    std::cout << "Debug: Operator: " << op << std::endl;
-    std::cout << "Debug: Right operand: " << (right ? right->inspect() : "null") << std::endl;
-    std::cout << "Debug: Right operand type: " << (right ? objectTypeToString(right->type()) : "null") << std::endl;
+    TRACE_TRACE("eval", "Evaluating Prefix Expression");
+    TRACE_TRACE("eval", "Operator: " << AST::toString(op));
+    TRACE_TRACE("eval", "Right operand: " << right.inspect());
+    TRACE_TRACE("eval", "Right operand type: " << objectTypeToString(right.type()));
 
-    if (op == "!")
+    switch (op)
     {
+    case AST::Operator::NOT:
         return evalBangOperatorExpression(right);
-    }
-    else if (op == "-")
+    case AST::Operator::NEG:
     {
-        if (auto intObj = std::dynamic_pointer_cast<Integer>(right))
+        if (right.isInteger())
         {
-            auto result = std::make_shared<Integer>(-intObj->value());
-            std::cout << "Debug: Negation result: " << result->inspect() << std::endl;
+            auto result = Value::integer(-right.asInteger());
+            TRACE_TRACE("eval", "Negation result: " << result.inspect());
             return result;
         }
-        auto error = newError("unknown operator: -" + objectTypeToString(right->type()));
-        std::cout << "Debug: Error: " << error->inspect() << std::endl;
+        auto error = newError("unknown operator: -" + objectTypeToString(right.type()));
+        TRACE_TRACE("eval", "Error: " << error.inspect());
         return error;
     }
+    default:
+        break;
+    }
 
-    auto error = newError("unknown operator: " + op + objectTypeToString(right->type()));
-    std::cout << "Debug: Error: " << error->inspect() << std::endl;
+    auto error = newError("unknown operator: " + AST::toString(op) + objectTypeToString(right.type()));
+    TRACE_TRACE("eval", "Error: " << error.inspect());
     return error;
 }
 
-ObjectPtr Evaluator::evalInfixExpression(const std::string& op, ObjectPtr left, ObjectPtr right)
+Value Evaluator::evalInfixExpression(AST::Operator op, Value left, Value right)
 {
-    std::cout << "\n=== Evaluating Infix Expression ===" << std::endl;
-    std::cout << "Debug: Operator: " << op << std::endl;
-    std::cout << "Debug: Left operand: " << (left ? left->inspect() : "null") << " (type: " 
-              << (left ? objectTypeToString(left->type()) : "null") << ")" << std::endl;
-    std::cout << "Debug: Right operand: " << (right ? right->inspect() : "null") << " (type: "
-              << (right ? objectTypeToString(right->type()) : "null") << ")" << std::endl;
+    TRACE_TRACE("eval", "Evaluating Infix Expression");
+    TRACE_TRACE("eval", "Operator: " << AST::toString(op));
+    TRACE_TRACE("eval", "Left operand: " << left.inspect() << " (type: " << objectTypeToString(left.type()) << ")");
+    TRACE_TRACE("eval", "Right operand: " << right.inspect() << " (type: " << objectTypeToString(right.type()) << ")");
+
+    // 整数同士の演算は即値のまま処理する
+    if (left.isInteger() && right.isInteger())
+    {
+        return evalIntegerInfixExpression(op, left.asInteger(), right.asInteger());
+    }
 
     // 型が異なる場合は先にチェック
-    if (left->type() != right->type())
+    if (left.type() != right.type())
     {
-        auto error = newError("type mismatch: " + objectTypeToString(left->type()) + " " + op + " " + 
-                            objectTypeToString(right->type()));
-        std::cout << "Debug: Type mismatch error: " << error->inspect() << std::endl;
+        auto error = newError("type mismatch: " + objectTypeToString(left.type()) + " " + AST::toString(op) + " " +
+                            objectTypeToString(right.type()));
+        TRACE_TRACE("eval", "Type mismatch error: " << error.inspect());
         return error;
     }
 
     // 真偽値の演算
-    if (left->type() == ObjectType::BOOLEAN)
+    if (left.type() == ObjectType::BOOLEAN)
     {
-        auto leftBool = std::dynamic_pointer_cast<Boolean>(left);
-        auto rightBool = std::dynamic_pointer_cast<Boolean>(right);
+        bool leftBool = left.asBoolean();
+        bool rightBool = right.asBoolean();
 
-        if (op == "==") return std::make_shared<Boolean>(leftBool->value() == rightBool->value());
-        if (op == "!=") return std::make_shared<Boolean>(leftBool->value() != rightBool->value());
-        if (op == "&&") return std::make_shared<Boolean>(leftBool->value() && rightBool->value());
-        if (op == "||") return std::make_shared<Boolean>(leftBool->value() || rightBool->value());
+        if (op == AST::Operator::EQ) return Value::boolean(leftBool == rightBool);
+        if (op == AST::Operator::NOT_EQ) return Value::boolean(leftBool != rightBool);
 
         // 真偽値に対する無効な演算子の場合はエラーを返す
-        auto error = newError("unknown operator: " + objectTypeToString(left->type()) + " " + op + " " + 
-                            objectTypeToString(right->type()));
-        std::cout << "Debug: Invalid boolean operation error: " << error->inspect() << std::endl;
+        auto error = newError("unknown operator: " + objectTypeToString(left.type()) + " " + AST::toString(op) + " " +
+                            objectTypeToString(right.type()));
+        TRACE_TRACE("eval", "Invalid boolean operation error: " << error.inspect());
         return error;
     }
 
-    // 整数の演算
-    if (left->type() == ObjectType::INTEGER)
-    {
-        auto leftInt = std::dynamic_pointer_cast<Integer>(left);
-        auto rightInt = std::dynamic_pointer_cast<Integer>(right);
-
-        if (op == "+") return std::make_shared<Integer>(leftInt->value() + rightInt->value());
-        if (op == "-") return std::make_shared<Integer>(leftInt->value() - rightInt->value());
-        if (op == "*") return std::make_shared<Integer>(leftInt->value() * rightInt->value());
-        if (op == "/") {
-            if (rightInt->value() == 0) return newError("division by zero");
-            return std::make_shared<Integer>(leftInt->value() / rightInt->value());
-        }
-        if (op == "<") return std::make_shared<Boolean>(leftInt->value() < rightInt->value());
-        if (op == ">") return std::make_shared<Boolean>(leftInt->value() > rightInt->value());
-        if (op == "==") return std::make_shared<Boolean>(leftInt->value() == rightInt->value());
-        if (op == "!=") return std::make_shared<Boolean>(leftInt->value() != rightInt->value());
-
-        return newError("unknown operator: " + objectTypeToString(left->type()) + " " + op + " " + 
-                       objectTypeToString(right->type()));
-    }
-
     // 文字列の連結
-    if (left->type() == ObjectType::STRING)
+    if (left.type() == ObjectType::STRING)
     {
-        if (op == "+") {
-            auto leftStr = std::dynamic_pointer_cast<String>(left);
-            auto rightStr = std::dynamic_pointer_cast<String>(right);
-            return std::make_shared<String>(leftStr->getValue() + rightStr->getValue());
+        if (op == AST::Operator::ADD) {
+            auto leftStr = staticRefCast<String>(left.asObject());
+            auto rightStr = staticRefCast<String>(right.asObject());
+            return makeRef<String>(leftStr->getValue() + rightStr->getValue());
         }
-        return newError("unknown operator: " + objectTypeToString(left->type()) + " " + op + " " + 
-                       objectTypeToString(right->type()));
+        return newError("unknown operator: " + objectTypeToString(left.type()) + " " + AST::toString(op) + " " +
+                       objectTypeToString(right.type()));
     }
 
-    auto result = newError("unknown operator: " + objectTypeToString(left->type()) + " " + op + " " + 
-                           objectTypeToString(right->type()));
-    std::cout << "Debug: Error result: " << result->inspect() << std::endl;
+    auto result = newError("unknown operator: " + objectTypeToString(left.type()) + " " + AST::toString(op) + " " +
+                           objectTypeToString(right.type()));
+    TRACE_TRACE("eval", "Error result: " << result.inspect());
     return result;
 }
 
-ObjectPtr Evaluator::evalIntegerInfixExpression(
-    const std::string& op, std::shared_ptr<Integer> left, std::shared_ptr<Integer> right)
+Value Evaluator::evalIntegerInfixExpression(AST::Operator op, int64_t left, int64_t right)
 {
-    try {
-        if (op == "+") return std::make_shared<Integer>(left->value() + right->value());
-        if (op == "-") return std::make_shared<Integer>(left->value() - right->value());
-        if (op == "*") return std::make_shared<Integer>(left->value() * right->value());
-        if (op == "/") {
-            if (right->value() == 0) {
-                return newError("division by zero");
-            }
-            return std::make_shared<Integer>(left->value() / right->value());
+    switch (op)
+    {
+    case AST::Operator::ADD:
+        return Value::integer(left + right);
+    case AST::Operator::SUB:
+        return Value::integer(left - right);
+    case AST::Operator::MUL:
+        return Value::integer(left * right);
+    case AST::Operator::DIV:
+        if (right == 0) {
+            return newError("division by zero");
+        }
+        // INT64_MIN / -1はオーバーフローしてトラップするため、ラップアラウンドした結果（INT64_MIN）を返す
+        // （VM・JIT・ネイティブ層も同じ結果になる）
+        if (left == std::numeric_limits<int64_t>::min() && right == -1) {
+            return Value::integer(left);
         }
-        // ... 他の演算子 ...
-    } catch (const std::exception& e) {
-        return newError("Integer operation error: " + std::string(e.what()));
+        return Value::integer(left / right);
+    case AST::Operator::LT:
+        return Value::boolean(left < right);
+    case AST::Operator::GT:
+        return Value::boolean(left > right);
+    case AST::Operator::EQ:
+        return Value::boolean(left == right);
+    case AST::Operator::NOT_EQ:
+        return Value::boolean(left != right);
+    default:
+        break;
     }
 
-    return newError(
-        "unknown operator: " + objectTypeToString(left->type()) + " " + op + " " + 
-        objectTypeToString(right->type()));
+    return newError("unknown operator: INTEGER " + AST::toString(op) + " INTEGER");
 }
 
-ObjectPtr Evaluator::evalBooleanLiteral(const AST::BooleanLiteral *node)
+Value Evaluator::evalBooleanLiteral(const AST::BooleanLiteral *node)
 {
     if (!node)
     {
-        return std::make_shared<Null>();
+        return Value::null();
     }
-    debugPrint("Evaluating boolean literal: " + std::string(node->value ? "true" : "false"));
-    return std::static_pointer_cast<Object>(std::make_shared<Boolean>(node->value));
+    TRACE_TRACE("eval", "Evaluating boolean literal: " << (node->value ? "true" : "false"));
+    return Value::boolean(node->value);
 }
 
-ObjectPtr Evaluator::evalStringLiteral(const AST::StringLiteral *node)
+Value Evaluator::evalStringLiteral(const AST::StringLiteral *node)
 {
     if (!node)
     {
-        return std::make_shared<Null>();
+        return Value::null();
     }
-    return std::make_shared<String>(node->getValue());
+    return makeRef<String>(node->getValue());
 }
 
-ObjectPtr Evaluator::evalBangOperatorExpression(const ObjectPtr &right)
+Value Evaluator::evalBangOperatorExpression(const Value &right)
 {
-    if (auto boolean = std::dynamic_pointer_cast<Boolean>(right))
+    if (right.isBoolean())
     {
-        return std::make_shared<Boolean>(!boolean->value());
+        return Value::boolean(!right.asBoolean());
     }
-    if (std::dynamic_pointer_cast<Null>(right))
-    {
-        return std::make_shared<Boolean>(true);
-    }
-    return std::make_shared<Boolean>(false);
+    return Value::boolean(right.isNull());
 }
 
-ObjectPtr Evaluator::newError(const std::string &message)
+Value Evaluator::newError(const std::string &message)
 {
-    debugPrint("Error: " + message);
-    return std::make_shared<Error>(message);
+    TRACE_DEBUG("eval", "Error: " << message);
+    return makeRef<Error>(message);
 }
 
-ObjectPtr Evaluator::evalFunctionLiteral(const AST::FunctionLiteral *node)
+Value Evaluator::evalFunctionLiteral(const AST::FunctionLiteral *node)
 {
-    std::cout << "Debug: Entering evalFunctionLiteral" << std::endl;
+    TRACE_TRACE("eval", "Entering evalFunctionLiteral");
 
     if (!node)
     {
-        std::cout << "Debug: Node is null" << std::endl;
-        return std::make_shared<Null>();
+        TRACE_TRACE("eval", "Node is null");
+        return Value::null();
     }
 
     if (!node->body)
     {
-        std::cout << "Debug: Function body is null" << std::endl;
+        TRACE_TRACE("eval", "Function body is null");
         return newError("function body is null");
     }
 
@@ -591,284 +471,395 @@ ObjectPtr Evaluator::evalFunctionLiteral(const AST::FunctionLiteral *node)
         }
     }
 
-    std::cout << "Debug: Creating function object with " << params.size() << " parameters"
-              << std::endl;
-    std::cout << "Debug: Function body statements: " << node->body->statements.size() << std::endl;
-
-    // 関数本体のコピーを作成
-    auto bodyClone = new AST::BlockStatement(*node->body);
-    std::cout << "Debug: Created body clone with " << bodyClone->statements.size() << " statements"
-              << std::endl;
-
-    // 現在の環境をキャプチャ
-    auto capturedEnv = Environment::NewEnclosedEnvironment(env);
-
-    // 関数オブジェクトを作成
-    auto fn = std::make_shared<Function>(std::move(params),
-                                         bodyClone, // コピーした関数本体を渡す
-                                         capturedEnv);
+    TRACE_TRACE("eval", "Creating function object with " << params.size() << " parameters");
+    TRACE_TRACE("eval", "Function body statements: " << node->body->statements.size());
 
     // bodyの有効性を確認
-    if (!fn->body || fn->body->statements.empty())
+    if (node->body->statements.empty())
     {
-        std::cout << "Debug: Created function has invalid body" << std::endl;
-        delete bodyClone; // エラーの場合はメモリを解放
+        TRACE_TRACE("eval", "Created function has invalid body");
         return newError("function creation failed");
     }
 
-    return fn;
+    // 本体が参照する外側の関数の変数だけを捕捉する
+    // （定義している関数の環境の値とセルか、その関数が捕捉した値とセル）
+    std::vector<Value> capturedValues;
+    capturedValues.reserve(node->capturedValues.size());
+    for (const auto &variable : node->capturedValues)
+    {
+        if (variable->scope == AST::VariableScope::LOCAL)
+        {
+            capturedValues.push_back(*locals[variable->slot]);
+        }
+        else
+        {
+            capturedValues.push_back(activeFunction->capturedValues[variable->slot]);
+        }
+    }
+    std::vector<CellPtr> capturedCells;
+    capturedCells.reserve(node->capturedCells.size());
+    for (const auto &variable : node->capturedCells)
+    {
+        if (variable->scope == AST::VariableScope::CELL)
+        {
+            capturedCells.push_back(cells[variable->slot]);
+        }
+        else
+        {
+            capturedCells.push_back(activeFunction->capturedCells[variable->slot]);
+        }
+    }
+
+    // 関数本体はコピーせず、評価中の構文木の所有権を共有する
+    return makeRef<Function>(std::move(params), node, currentSource, std::move(capturedValues),
+                             std::move(capturedCells));
 }
 
-ObjectPtr Evaluator::evalIdentifier(const AST::Identifier* ident)
+Value Evaluator::evalIdentifier(const AST::Identifier* ident)
 {
-    std::cout << "Debug: Evaluating identifier: " << ident->value << std::endl;
-    
-    if (!env)
+    TRACE_TRACE("eval", "Evaluating identifier: " << ident->value);
+
+    const Value *value = nullptr;
+    switch (ident->scope)
+    {
+    case AST::VariableScope::LOCAL:
+    {
+        const auto &slot = locals[ident->slot];
+        value = slot ? &*slot : nullptr;
+        break;
+    }
+    case AST::VariableScope::CELL:
     {
-        std::cout << "Debug: Environment is null" << std::endl;
-        return newError("environment is null");
+        const auto &cell = cells[ident->slot];
+        value = cell->value ? &*cell->value : nullptr;
+        break;
+    }
+    case AST::VariableScope::FREE_VALUE:
+        value = &activeFunction->capturedValues[ident->slot];
+        break;
+    case AST::VariableScope::FREE_CELL:
+    {
+        const auto &cell = activeFunction->capturedCells[ident->slot];
+        value = cell->value ? &*cell->value : nullptr;
+        break;
+    }
+    case AST::VariableScope::GLOBAL:
+        value = globals->Get(ident->slot);
+        break;
+    case AST::VariableScope::UNRESOLVED:
+    {
+        // 解決時に未定義だったグローバルは名前からスロットを引く
+        int slot = resolver.lookupGlobal(ident->value);
+        if (slot >= 0)
+        {
+            value = globals->Get(slot);
+        }
+        break;
+    }
     }
 
-    auto value = env->Get(ident->value);
-    if (auto error = std::dynamic_pointer_cast<Error>(value))
+    if (!value)
     {
-        std::cout << "Debug: Identifier not found: " << ident->value << std::endl;
-        return error;
+        TRACE_TRACE("eval", "Identifier not found: " << ident->value);
+        return newError("identifier not found: " + ident->value);
     }
 
-    std::cout << "Debug: Identifier value: " << value->inspect() << std::endl;
-    return value;
+    TRACE_TRACE("eval", "Identifier value: " << value->inspect());
+    return *value;
 }
 
-ObjectPtr Evaluator::evalBlockStatement(const AST::BlockStatement* block)
+Value Evaluator::evalBlockStatement(const AST::BlockStatement* block)
 {
-    std::cout << "\n=== Evaluating Block Statement ===" << std::endl;
-    std::cout << "Debug: Block contents: " << block->String() << std::endl;
-    std::cout << "Debug: Number of statements: " << block->statements.size() << std::endl;
-    
+    TRACE_TRACE("eval", "Evaluating Block Statement");
     if (!block)
     {
-        std::cout << "Debug: Block is null" << std::endl;
+        TRACE_TRACE("eval", "Block is null");
         return newError("block statement is null");
     }
+    // ブロックの文字列化はトレースが有効な場合にだけ行われる（TRACE_TRACEがメッセージ式を遅延評価する）
+    TRACE_TRACE("eval", "Block contents: " << block->String());
+    TRACE_TRACE("eval", "Number of statements: " << block->statements.size());
 
-    ObjectPtr result;
+    Value result;
+    bool evaluated = false;
     for (const auto& stmt : block->statements)
     {
         if (!stmt)
         {
-            std::cout << "Debug: Statement is null" << std::endl;
+            TRACE_TRACE("eval", "Statement is null");
             continue;
         }
 
-        std::cout << "Debug: Evaluating statement in block: " << stmt->String() << std::endl;
-        result = eval(stmt.get());
+        TRACE_TRACE("eval", "Evaluating statement in block: " << stmt->String());
+        result = evalNode(stmt.get());
+        evaluated = true;
 
-        // エラーまたは戻り値の場合は即座に返す
-        if (result)
+        // エラーまたはreturn文の場合は即座に返す
+        if (returning)
         {
-            if (isError(result))
-            {
-                std::cout << "Debug: Error in block statement: " << result->inspect() << std::endl;
-                return result;
-            }
-            if (result->type() == ObjectType::RETURN_VALUE)
-            {
-                std::cout << "Debug: Found return value in block" << std::endl;
-                return result;
-            }
+            TRACE_TRACE("eval", "Found return value in block");
+            return result;
+        }
+        if (isError(result))
+        {
+            TRACE_TRACE("eval", "Error in block statement: " << result.inspect());
+            return result;
         }
     }
 
-    // 結果がnullの場合はエラーを返す
-    if (!result)
+    // 文が1つも評価されなかった場合はエラーを返す
+    if (!evaluated)
     {
-        std::cout << "Debug: Block evaluation result is null, returning error" << std::endl;
+        TRACE_TRACE("eval", "Block evaluation result is null, returning error");
         return newError("block statement evaluation failed");
     }
 
-    std::cout << "Debug: Block evaluation result: " << result->inspect() << std::endl;
+    TRACE_TRACE("eval", "Block evaluation result: " << result.inspect());
     return result;
 }
 
-ObjectPtr Evaluator::evalLetStatement(const AST::LetStatement* letStmt)
+Value Evaluator::evalLetStatement(const AST::LetStatement* letStmt)
 {
-    std::cout << "Debug: Evaluating let statement" << std::endl;
+    TRACE_TRACE("eval", "Evaluating let statement");
     
     if (!letStmt || !letStmt->value)
     {
-        std::cout << "Debug: Invalid let statement" << std::endl;
-        return std::make_shared<Null>();
+        TRACE_TRACE("eval", "Invalid let statement");
+        return Value::null();
     }
 
-    auto value = eval(letStmt->value.get());
-    if (isError(value)) return value;
+    return evalLet(letStmt->name.get(), letStmt->value.get());
+}
 
-    if (!env)
+Value Evaluator::evalLet(const AST::Identifier* name, const AST::Expression* valueExpr)
+{
+    auto value = evalNode(valueExpr);
+    if (isAbrupt(value)) return value;
+
+    // letの名前は常に現在のスコープ（グローバル環境か呼び出しのフレーム）に解決されている
+    switch (name->scope)
+    {
+    case AST::VariableScope::CELL:
     {
-        std::cout << "Debug: Environment is null" << std::endl;
-        return newError("environment is null");
+        const auto &cell = cells[name->slot];
+        cell->value = std::move(value);
+        return *cell->value;
+    }
+    case AST::VariableScope::GLOBAL:
+        return globals->Set(name->slot, std::move(value));
+    default:
+    {
+        auto &slot = locals[name->slot];
+        slot = std::move(value);
+        return *slot;
+    }
     }
-
-    env->Set(letStmt->name->value, value);
-    return value;
 }
 
-ObjectPtr Evaluator::evalReturnStatement(const AST::ReturnStatement *returnStmt)
+Value Evaluator::evalReturnStatement(const AST::ReturnStatement *returnStmt)
 {
     if (!returnStmt || !returnStmt->returnValue)
     {
-        return std::make_shared<Null>();
+        TRACE_TRACE("eval", "Return value is null");
+        return newError("return value is null");
     }
 
-    auto value = eval(returnStmt->returnValue.get());
+    auto value = evalNode(returnStmt->returnValue.get());
     if (isError(value))
     {
+        TRACE_TRACE("eval", "Error evaluating return value");
         return value;
     }
 
-    return std::make_shared<ReturnValue>(value);
+    // 値はそのまま返し、関数の本体を抜けるまで後続の文を評価しないことをフラグで伝える
+    TRACE_TRACE("eval", "Returning value: " << value.inspect());
+    returning = true;
+    return value;
 }
 
-ObjectPtr Evaluator::evalCallExpression(const AST::CallExpression *call)
+Value Evaluator::evalCallExpression(const AST::CallExpression *call)
 {
-    std::cout << "Debug: Entering evalCallExpression" << std::endl;
+    TRACE_TRACE("eval", "Entering evalCallExpression");
 
     if (!call || !call->function)
     {
-        std::cout << "Debug: Invalid call expression" << std::endl;
+        TRACE_TRACE("eval", "Invalid call expression");
         return newError("invalid call expression");
     }
 
     // 関数を評価
-    std::cout << "Debug: Evaluating function" << std::endl;
-    auto function = eval(call->function.get());
-    if (isError(function))
+    TRACE_TRACE("eval", "Evaluating function");
+    auto function = evalNode(call->function.get());
+    if (isAbrupt(function))
     {
-        std::cout << "Debug: Function evaluation error" << std::endl;
+        TRACE_TRACE("eval", "Function evaluation error");
         return function;
     }
 
-    // 引数評価
-    std::cout << "Debug: Evaluating arguments" << std::endl;
-    std::vector<ObjectPtr> args;
-    args.reserve(call->arguments.size());
+    // 引数評価（引数はヒープに確保せず、フレームのスタックに並べる）
+    TRACE_TRACE("eval", "Evaluating arguments");
+    size_t argc = 0;
+    for (const auto &arg : call->arguments)
+    {
+        if (arg)
+            argc++;
+    }
+    FrameScope<std::optional<Value>> argFrame(slotStack, argc);
+    std::optional<Value> *args = argFrame.get();
+    size_t index = 0;
     for (const auto &arg : call->arguments)
     {
         if (!arg)
             continue;
 
-        auto evaluated = eval(arg.get());
-        if (isError(evaluated))
+        auto evaluated = evalNode(arg.get());
+        if (isAbrupt(evaluated))
         {
-            std::cout << "Debug: Argument evaluation error" << std::endl;
+            TRACE_TRACE("eval", "Argument evaluation error");
             return evaluated;
         }
-        args.push_back(evaluated);
+        args[index++] = std::move(evaluated);
     }
 
     // 関数オブジェクトの場合
-    if (auto fn = std::dynamic_pointer_cast<Function>(function))
+    // 種類はタグで判定する（呼び出しの間はfunctionが関数オブジェクトを保持しているため生ポインタで参照する）
+    if (function.type() == ObjectType::FUNCTION)
     {
-        std::cout << "Debug: Found function object" << std::endl;
+        auto fn = static_cast<Function *>(function.asObject().get());
+        TRACE_TRACE("eval", "Found function object");
 
-        if (fn->parameters.size() != args.size())
+        if (fn->parameters.size() != argc)
         {
-            std::cout << "Debug: Wrong number of arguments" << std::endl;
+            TRACE_TRACE("eval", "Wrong number of arguments");
             return newError("wrong number of arguments: expected " +
                             std::to_string(fn->parameters.size()) + ", got " +
-                            std::to_string(args.size()));
+                            std::to_string(argc));
         }
 
         if (!fn->body)
         {
-            std::cout << "Debug: Function body is null" << std::endl;
+            TRACE_TRACE("eval", "Function body is null");
             return newError("function body is null");
         }
 
-        // 関数の環境を基に新しい環境を作成
-        std::cout << "Debug: Creating new environment" << std::endl;
-        auto newEnv = Environment::NewEnclosedEnvironment(env);
+        // ネイティブコードがあれば使い、ホットになった関数はJITに渡す
+        Value nativeResult;
+        if (tryNativeCall(*fn, args, argc, nativeResult))
+        {
+            return nativeResult;
+        }
 
-        // パラメータをバインド
-        std::cout << "Debug: Binding parameters" << std::endl;
-        for (size_t i = 0; i < fn->parameters.size(); i++)
+        // 引数はフレームのスタックが保持しているため、呼び出しの直前は収集してよい位置になる
+        heap->safePoint();
+
+        // 呼び出しのフレームを確保する
+        // 関数の生成時に変数は値かセルとして捕捉されるため、フレーム自体は呼び出しの後に参照されない。
+        // ヒープに確保するのは内側の関数に捕捉される変数のセルだけで、捕捉のない関数の呼び出しは確保を行わない
+        TRACE_TRACE("eval", "Creating new frame");
+        const AST::FunctionLiteral *literal = fn->literal;
+        FrameScope<std::optional<Value>> localFrame(slotStack, literal->numLocals);
+        FrameScope<CellPtr> cellFrame(cellStack, literal->numCells);
+        std::optional<Value> *newLocals = localFrame.get();
+        CellPtr *newCells = cellFrame.get();
+        for (int i = 0; i < literal->numCells; i++)
         {
-            newEnv->Set(fn->parameters[i], args[i]);
+            newCells[i] = makeRef<Cell>();
         }
 
-        // 現在の環境を一時的に保存
-        std::cout << "Debug: Saving current environment" << std::endl;
-        auto savedEnv = env;
+        // パラメータをバインド（内側の関数に捕捉される引数はセルに置く）
+        TRACE_TRACE("eval", "Binding parameters");
+        for (size_t i = 0; i < argc; i++)
+        {
+            const AST::Identifier *param = literal->parameters[i].get();
+            if (param->scope == AST::VariableScope::CELL)
+            {
+                newCells[param->slot]->value = std::move(args[i]);
+            }
+            else
+            {
+                newLocals[param->slot] = std::move(args[i]);
+            }
+        }
 
-        // 新しい環境を設定
-        std::cout << "Debug: Setting new environment" << std::endl;
-        env = newEnv;
+        // 現在のフレームを一時的に保存
+        TRACE_TRACE("eval", "Saving current frame");
+        auto savedLocals = locals;
+        auto savedCells = cells;
+        auto savedFunction = activeFunction;
+        auto savedSource = currentSource;
+
+        // 新しいフレームを設定（本体の中で作られる関数は、この関数と同じ構文木を共有する）
+        TRACE_TRACE("eval", "Setting new frame");
+        locals = newLocals;
+        cells = newCells;
+        activeFunction = fn;
+        currentSource = fn->source;
 
         // 関数本体を評価
-        std::cout << "Debug: Evaluating function body" << std::endl;
+        TRACE_TRACE("eval", "Evaluating function body");
         auto result = evalBlockStatement(fn->body);
 
-        // 環境を元に戻す
-        std::cout << "Debug: Restoring environment" << std::endl;
-        env = savedEnv;
-
-        // ReturnValueの場合は、内部の値を返す
-        if (auto returnValue = std::dynamic_pointer_cast<ReturnValue>(result))
-        {
-            std::cout << "Debug: Returning return value" << std::endl;
-            return returnValue->value;
-        }
+        // フレームを元に戻す（確保した領域はFrameScopeが解放する）
+        TRACE_TRACE("eval", "Restoring frame");
+        locals = savedLocals;
+        cells = savedCells;
+        activeFunction = savedFunction;
+        currentSource = std::move(savedSource);
 
-        std::cout << "Debug: Returning result" << std::endl;
+        // return文による脱出は関数の呼び出しで終わる
+        returning = false;
+        TRACE_TRACE("eval", "Returning result");
         return result;
     }
 
     // ビルトイン関数の場合
-    if (auto builtin = std::dynamic_pointer_cast<Builtin>(function))
+    if (function.type() == ObjectType::BUILTIN)
     {
-        std::cout << "Debug: Executing builtin function" << std::endl;
-        return builtin->fn(args);
+        auto builtin = static_cast<const Builtin *>(function.asObject().get());
+        TRACE_TRACE("eval", "Executing builtin function");
+        std::vector<Value> builtinArgs;
+        builtinArgs.reserve(argc);
+        for (size_t i = 0; i < argc; i++)
+        {
+            builtinArgs.push_back(std::move(*args[i]));
+        }
+        return builtin->fn(builtinArgs);
     }
 
-    std::cout << "Debug: Not a function error" << std::endl;
-    return newError("not a function: " + objectTypeToString(function->type()));
+    TRACE_TRACE("eval", "Not a function error");
+    return newError("not a function: " + objectTypeToString(function.type()));
 }
 
-ObjectPtr Evaluator::evalExpressionStatement(const AST::ExpressionStatement *exprStmt)
+Value Evaluator::evalExpressionStatement(const AST::ExpressionStatement *exprStmt)
 {
     if (!exprStmt || !exprStmt->expression)
     {
-        return std::make_shared<Null>();
+        return Value::null();
     }
-    return eval(exprStmt->expression.get());
+    return evalNode(exprStmt->expression.get());
 }
 
-Evaluator::Evaluator() : env(Environment::NewEnvironment())
+Evaluator::Evaluator() : globals(Environment::NewEnvironment()), heap(&Heap::current())
 {
-    env->Set("len", std::make_shared<Builtin>(builtinLen));
-    env->Set("first", std::make_shared<Builtin>(builtinFirst));
-    env->Set("last", std::make_shared<Builtin>(builtinLast));
-    env->Set("rest", std::make_shared<Builtin>(builtinRest));
-    env->Set("push", std::make_shared<Builtin>(builtinPush));
+    for (const auto &def : builtins())
+    {
+        globals->Set(resolver.defineGlobal(def.name), def.builtin);
+    }
 }
 
 void Evaluator::collectGarbage()
 {
-    if (env)
-    {
-        env->MarkAndSweep();
-    }
+    heap->collect();
 }
 
-ObjectPtr Evaluator::evalArrayLiteral(const AST::ArrayLiteral *array)
+Value Evaluator::evalArrayLiteral(const AST::ArrayLiteral *array)
 {
     if (!array)
     {
-        return std::make_shared<Null>();
+        return Value::null();
     }
 
-    std::vector<ObjectPtr> elements;
+    std::vector<Value> elements;
     elements.reserve(array->elements.size());
 
     for (const auto &elem : array->elements)
@@ -876,74 +867,73 @@ ObjectPtr Evaluator::evalArrayLiteral(const AST::ArrayLiteral *array)
         if (!elem)
             continue;
 
-        auto evaluated = eval(elem.get());
-        if (isError(evaluated))
+        auto evaluated = evalNode(elem.get());
+        if (isAbrupt(evaluated))
         {
             return evaluated;
         }
         elements.push_back(evaluated);
     }
 
-    return std::make_shared<Array>(std::move(elements));
+    return makeRef<Array>(std::move(elements));
 }
 
-ObjectPtr Evaluator::evalIndexExpression(const AST::IndexExpression *indexExpr)
+Value Evaluator::evalIndexExpression(const AST::IndexExpression *indexExpr)
 {
     if (!indexExpr || !indexExpr->left || !indexExpr->index)
     {
         return newError("invalid index expression");
     }
 
-    auto left = eval(indexExpr->left.get());
-    if (isError(left))
+    auto left = evalNode(indexExpr->left.get());
+    if (isAbrupt(left))
     {
         return left;
     }
 
-    auto index = eval(indexExpr->index.get());
-    if (isError(index))
+    auto index = evalNode(indexExpr->index.get());
+    if (isAbrupt(index))
     {
         return index;
     }
 
-    if (left->type() == ObjectType::ARRAY)
+    if (left.type() == ObjectType::ARRAY)
     {
         return evalArrayIndexExpression(left, index);
     }
-    else if (left->type() == ObjectType::HASH)
+    else if (left.type() == ObjectType::HASH)
     {
         return evalHashIndexExpression(left, index);
     }
 
-    return newError("index operator not supported: " + objectTypeToString(left->type()));
+    return newError("index operator not supported: " + objectTypeToString(left.type()));
 }
 
-ObjectPtr Evaluator::evalArrayIndexExpression(const ObjectPtr& array, const ObjectPtr& index)
+Value Evaluator::evalArrayIndexExpression(const Value& array, const Value& index)
 {
-    std::cout << "Debug: Evaluating array index expression" << std::endl;
+    TRACE_TRACE("eval", "Evaluating array index expression");
 
-    auto arrayObj = std::dynamic_pointer_cast<Array>(array);
+    auto arrayObj = dynamicRefCast<Array>(array.asObject());
     if (!arrayObj)
     {
-        std::cout << "Debug: Not an array object" << std::endl;
-        return newError("index operator not supported: " + objectTypeToString(array->type()));
+        TRACE_TRACE("eval", "Not an array object");
+        return newError("index operator not supported: " + objectTypeToString(array.type()));
     }
 
-    auto intIndex = std::dynamic_pointer_cast<Integer>(index);
-    if (!intIndex)
+    if (!index.isInteger())
     {
-        std::cout << "Debug: Index is not an integer" << std::endl;
+        TRACE_TRACE("eval", "Index is not an integer");
         return newError("array index must be an integer");
     }
 
-    auto idx = intIndex->value();
+    auto idx = index.asInteger();
     if (idx < 0 || static_cast<size_t>(idx) >= arrayObj->elements.size())
     {
-        std::cout << "Debug: Index out of bounds: " << idx << std::endl;
-        return std::make_shared<Null>();
+        TRACE_TRACE("eval", "Index out of bounds: " << idx);
+        return Value::null();
     }
 
-    std::cout << "Debug: Returning array element at index " << idx << std::endl;
+    TRACE_TRACE("eval", "Returning array element at index " << idx);
     return arrayObj->elements[idx];
 }
 
@@ -969,107 +959,184 @@ std::string Evaluator::objectTypeToString(ObjectType type)
         return "FUNCTION";
     case ObjectType::BUILTIN:
         return "BUILTIN";
-    case ObjectType::RETURN_VALUE:
-        return "RETURN_VALUE";
     default:
         return "UNKNOWN";
     }
 }
 
-ObjectPtr Evaluator::evalHashLiteral(const AST::HashLiteral *node)
+Value Evaluator::evalHashLiteral(const AST::HashLiteral *node)
 {
     if (!node)
     {
-        return std::make_shared<Null>();
+        return Value::null();
     }
 
-    auto hash = std::make_shared<Hash>();
+    auto hash = makeRef<Hash>();
+    hash->pairs.reserve(node->pairs.size());
 
     for (const auto &pair : node->pairs)
     {
-        auto key = eval(pair.first.get());
-        if (isError(key))
+        auto key = evalNode(pair.first.get());
+        if (isAbrupt(key))
             return key;
 
-        auto hashKey = dynamic_cast<HashKey *>(key.get());
+        auto hashKey = key.hashKey();
         if (!hashKey)
         {
-            return newError("unusable as hash key: " + objectTypeToString(key->type()));
+            return newError("unusable as hash key: " + objectTypeToString(key.type()));
         }
 
-        auto value = eval(pair.second.get());
-        if (isError(value))
+        auto value = evalNode(pair.second.get());
+        if (isAbrupt(value))
             return value;
 
-        size_t hashValue = hashKey->hash();
-        hash->pairs[hashValue] = HashPair(key, value);
+        hash->pairs.insert(std::move(key), std::move(value), *hashKey);
     }
 
     return hash;
 }
 
-ObjectPtr Evaluator::evalHashIndexExpression(const ObjectPtr &hash, const ObjectPtr &index)
+Value Evaluator::evalHashIndexExpression(const Value &hash, const Value &index)
 {
-    auto hashObj = std::dynamic_pointer_cast<Hash>(hash);
+    auto hashObj = dynamicRefCast<Hash>(hash.asObject());
     if (!hashObj)
     {
-        return newError("index operator not supported: " + objectTypeToString(hash->type()));
+        return newError("index operator not supported: " + objectTypeToString(hash.type()));
     }
 
-    auto hashKey = dynamic_cast<HashKey *>(index.get());
+    auto hashKey = index.hashKey();
     if (!hashKey)
     {
-        return newError("unusable as hash key: " + objectTypeToString(index->type()));
+        return newError("unusable as hash key: " + objectTypeToString(index.type()));
     }
 
-    auto pair = hashObj->pairs.find(hashKey->hash());
-    if (pair == hashObj->pairs.end())
+    auto value = hashObj->pairs.find(index, *hashKey);
+    if (!value)
     {
-        return std::make_shared<Null>();
+        return Value::null();
     }
 
-    return pair->second.value;
+    return *value;
+}
+
+void Evaluator::setTierUpHook(TierUpHook hook, uint32_t threshold)
+{
+    tierUpHook = std::move(hook);
+    tierUpThreshold = threshold;
+}
+
+void Evaluator::countBackEdge()
+{
+    // ループの反復の区切りも収集してよい位置になる（呼び出しのない長いループでもメモリを抑える）
+    heap->safePoint();
+
+    // ループの反復も実行中の関数のホットさとして数える（次の呼び出しでネイティブコードに切り替わる）
+    if (activeFunction && !activeFunction->native && !activeFunction->tierUpFailed &&
+        activeFunction->hotness < tierUpThreshold)
+    {
+        activeFunction->hotness++;
+    }
+}
+
+bool Evaluator::tryNativeCall(Function &fn, const std::optional<Value> *args, size_t count, Value &result)
+{
+    if (!tierUpHook)
+    {
+        return false;
+    }
+
+    if (!fn.native)
+    {
+        if (fn.tierUpFailed || ++fn.hotness < tierUpThreshold)
+        {
+            return false;
+        }
+        fn.native = tierUpHook(fn.parameters, *fn.body);
+        if (!fn.native)
+        {
+            TRACE_INFO("eval", "Function is not eligible for native code: fn(" << fn.parameters.size() << " params)");
+            fn.tierUpFailed = true;
+            return false;
+        }
+        TRACE_INFO("eval", "Tiered up function after " << fn.hotness << " calls/iterations");
+    }
+
+    // ネイティブコードは整数の引数のみを受け付ける（それ以外の呼び出しはインタプリタで実行する）
+    if (count > MAX_NATIVE_ARGUMENTS)
+    {
+        return false;
+    }
+    int64_t raw[MAX_NATIVE_ARGUMENTS];
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!args[i]->isInteger())
+        {
+            return false;
+        }
+        raw[i] = args[i]->asInteger();
+    }
+
+    int64_t out = 0;
+    if (!fn.native(raw, &out))
+    {
+        // ゼロ除算などはインタプリタで実行し直してエラーを生成する
+        return false;
+    }
+    result = Value::integer(out);
+    return true;
 }
 
 EnvPtr Evaluator::getEnv() const
 {
-    return env;
+    return globals;
+}
+
+void Evaluator::defineGlobal(const std::string &name, ObjectPtr value)
+{
+    globals->Set(resolver.defineGlobal(name), Value(std::move(value)));
+}
+
+ObjectPtr Evaluator::getGlobal(const std::string &name) const
+{
+    const Value *value = globals->Get(resolver.lookupGlobal(name));
+    return value ? value->toObject() : nullptr;
 }
 
-void Evaluator::setEnv(EnvPtr newEnv)
+Value Evaluator::evalIntegerLiteral(const AST::IntegerLiteral* node)
 {
-    env = std::move(newEnv);
+    if (!node) return Value::null();
+    return Value::integer(node->value);
 }
 
-ObjectPtr Evaluator::evalIntegerLiteral(const AST::IntegerLiteral* node)
+bool Evaluator::isError(const Value& obj)
 {
-    if (!node) return std::make_shared<Null>();
-    return std::make_shared<Integer>(node->value);
+    return obj.isError();
 }
 
-bool Evaluator::isError(const ObjectPtr& obj)
+bool Evaluator::isAbrupt(const Value& obj)
 {
-    if (!obj) return false;
-    return obj->type() == ObjectType::ERROR;
+    return returning || obj.isError();
 }
 
-ObjectPtr Evaluator::evalProgram(const AST::Program* program)
+Value Evaluator::evalProgram(const AST::Program* program)
 {
     if (!program)
-        return std::make_shared<Null>();
+        return Value::null();
 
-    ObjectPtr result = std::make_shared<Null>();
+    Value result = Value::null();
     for (const auto& stmt : program->statements)
     {
         if (!stmt)
             continue;
 
-        result = eval(stmt.get());
+        heap->safePoint();
+        result = evalNode(stmt.get());
 
-        // エラーまたは戻り値の場合は即座に返す
-        if (auto returnValue = std::dynamic_pointer_cast<ReturnValue>(result))
+        // トップレベルのreturn文はプログラムの評価を終える
+        if (returning)
         {
-            return returnValue->value;
+            returning = false;
+            return result;
         }
         if (isError(result))
         {
@@ -1080,61 +1147,57 @@ ObjectPtr Evaluator::evalProgram(const AST::Program* program)
     return result;
 }
 
-bool Evaluator::isTruthy(const ObjectPtr& obj)
+bool Evaluator::isTruthy(const Value& obj)
 {
-    std::cout << "Debug: Checking truthiness of object: " 
-              << (obj ? obj->inspect() : "null") << std::endl;
+    TRACE_TRACE("eval", "Checking truthiness of object: " << obj.inspect());
 
-    if (!obj)
+    if (obj.isBoolean())
     {
-        std::cout << "Debug: Object is null, returning false" << std::endl;
-        return false;
+        TRACE_TRACE("eval", "Object is Boolean with value: " << obj.asBoolean());
+        return obj.asBoolean();
     }
 
-    if (auto boolean = std::dynamic_pointer_cast<Boolean>(obj))
+    if (obj.isNull())
     {
-        std::cout << "Debug: Object is Boolean with value: " << boolean->value() << std::endl;
-        return boolean->value();
-    }
-
-    if (obj->type() == ObjectType::NULL_OBJ)
-    {
-        std::cout << "Debug: Object is Null, returning false" << std::endl;
+        TRACE_TRACE("eval", "Object is Null, returning false");
         return false;
     }
 
-    if (auto integer = std::dynamic_pointer_cast<Integer>(obj))
+    if (obj.isInteger())
     {
-        std::cout << "Debug: Object is Integer with value: " << integer->value() << std::endl;
-        return integer->value() != 0;
+        TRACE_TRACE("eval", "Object is Integer with value: " << obj.asInteger());
+        return obj.asInteger() != 0;
     }
 
-    std::cout << "Debug: Object is truthy by default" << std::endl;
+    TRACE_TRACE("eval", "Object is truthy by default");
     return true;
 }
 
-ObjectPtr Evaluator::evalWhileExpression(const AST::WhileExpression* whileExpr) {
-    std::cout << "\n=== Evaluating While Expression ===" << std::endl;
+Value Evaluator::evalWhileExpression(const AST::WhileExpression* whileExpr) {
+    TRACE_TRACE("eval", "Evaluating While Expression");
     
     if (!whileExpr->condition || !whileExpr->body) {
-        std::cout << "Debug: Invalid while expression" << std::endl;
+        TRACE_TRACE("eval", "Invalid while expression");
         return newError("invalid while expression");
     }
 
-    ObjectPtr result = std::make_shared<Null>();
+    Value result = Value::null();
     while (true) {
-        auto condition = eval(whileExpr->condition.get());
-        if (isError(condition)) return condition;
+        auto condition = evalNode(whileExpr->condition.get());
+        if (isAbrupt(condition)) return condition;
 
         if (!isTruthy(condition)) {
             break;
         }
 
-        result = eval(whileExpr->body.get());
+        whileExpr->iterations++;
+        countBackEdge();
+
+        result = evalNode(whileExpr->body.get());
         if (isError(result)) return result;
 
         // return文が見つかった場合は即座に返す
-        if (result && result->type() == ObjectType::RETURN_VALUE) {
+        if (returning) {
             return result;
         }
     }
@@ -1142,40 +1205,43 @@ ObjectPtr Evaluator::evalWhileExpression(const AST::WhileExpression* whileExpr)
     return result;
 }
 
-ObjectPtr Evaluator::evalForExpression(const AST::ForExpression* forExpr) {
-    std::cout << "\n=== Evaluating For Expression ===" << std::endl;
+Value Evaluator::evalForExpression(const AST::ForExpression* forExpr) {
+    TRACE_TRACE("eval", "Evaluating For Expression");
     
     if (!forExpr->init || !forExpr->condition || !forExpr->update || !forExpr->body) {
-        std::cout << "Debug: Invalid for expression" << std::endl;
+        TRACE_TRACE("eval", "Invalid for expression");
         return newError("invalid for expression");
     }
 
     // 初期化式を評価
-    auto init = eval(forExpr->init.get());
-    if (isError(init)) return init;
+    auto init = evalNode(forExpr->init.get());
+    if (isAbrupt(init)) return init;
 
-    ObjectPtr result = std::make_shared<Null>();
+    Value result = Value::null();
     while (true) {
         // 条件式を評価
-        auto condition = eval(forExpr->condition.get());
-        if (isError(condition)) return condition;
+        auto condition = evalNode(forExpr->condition.get());
+        if (isAbrupt(condition)) return condition;
 
         if (!isTruthy(condition)) {
             break;
         }
 
+        forExpr->iterations++;
+        countBackEdge();
+
         // 本体を評価
-        result = eval(forExpr->body.get());
+        result = evalNode(forExpr->body.get());
         if (isError(result)) return result;
 
         // return文が見つかった場合は即座に返す
-        if (result && result->type() == ObjectType::RETURN_VALUE) {
+        if (returning) {
             return result;
         }
 
         // 更新式を評価
-        auto update = eval(forExpr->update.get());
-        if (isError(update)) return update;
+        auto update = evalNode(forExpr->update.get());
+        if (isAbrupt(update)) return update;
     }
 
     return result;
@@ -1,60 +1,111 @@
 #pragma once
 #include "../ast/ast.hpp"
 #include "../object/object.hpp"
+#include "frame_stack.hpp"
+#include "resolver.hpp"
+#include <functional>
 #include <memory>
 
 namespace monkey
 {
 
+// ホットになった関数をネイティブコードに変換するフック
+// 変換できない場合はnullptrを返す（評価器はJITに依存しないため、REPLなどの利用側が設定する）
+using TierUpHook =
+    std::function<NativeFunction(const std::vector<std::string> &parameters, const AST::BlockStatement &body)>;
+
+// 関数をネイティブコードに変換するまでの呼び出し回数（ループの反復も1回として数える）
+constexpr uint32_t DEFAULT_TIER_UP_THRESHOLD = 1000;
+
 class Evaluator
 {
   public:
     Evaluator();
+    Evaluator(const Evaluator &) = delete;
+    Evaluator &operator=(const Evaluator &) = delete;
+    // 構文木の寿命は呼び出し側が保証する（評価中に作られた関数が残る間は破棄しないこと）
     ObjectPtr eval(const AST::Node *node);
+    // 評価中に作られた関数がprogramの所有権を共有する（評価後にprogramを破棄してよい）
+    ObjectPtr eval(std::shared_ptr<const AST::Program> program);
+    // 予算を待たずに循環参照のゴミを収集する
     void collectGarbage();
+    // グローバル環境を返す
     EnvPtr getEnv() const;
-    void setEnv(EnvPtr newEnv);
+    // グローバル変数を定義する（REPLで他の実行方式が束縛した値を引き継ぐ）
+    void defineGlobal(const std::string &name, ObjectPtr value);
+    // グローバル変数の値を返す（未定義の場合はnullptr）
+    ObjectPtr getGlobal(const std::string &name) const;
+    // 直前のeval()でトップレベルのletが束縛した名前（実行されない分岐のletも含む）
+    const std::vector<std::string> &boundGlobals() const
+    {
+        return resolver.boundGlobals();
+    }
+
+    // 階層型実行の設定（フックがない場合は常にインタプリタで実行する）
+    void setTierUpHook(TierUpHook hook, uint32_t threshold = DEFAULT_TIER_UP_THRESHOLD);
 
   private:
-    EnvPtr env;
+    EnvPtr globals;    // グローバル環境（未解決の識別子を名前で検索する際に使用）
+    Resolver resolver; // グローバルスコープはREPLの行をまたいで保持される
+
+    TierUpHook tierUpHook;
+    uint32_t tierUpThreshold = DEFAULT_TIER_UP_THRESHOLD;
+    Heap *heap; // 評価器を生成したスレッドのヒープ
+    Function *activeFunction = nullptr; // 実行中の関数（ループの反復をプロファイルに加算する）
+    std::shared_ptr<const AST::Node> currentSource; // 評価中のコードを含む構文木（関数の生成時に共有する）
+    // 関数呼び出しの引数と変数のスロット（呼び出しごとにヒープへ確保せず、スタックの領域を再利用する）
+    FrameStack<std::optional<Value>> slotStack;
+    FrameStack<CellPtr> cellStack;
+    std::optional<Value> *locals = nullptr; // 実行中の関数の変数スロット（トップレベルではnullptr）
+    CellPtr *cells = nullptr;               // 実行中の関数のセル（内側の関数に捕捉される変数）
+    // return文を評価してから関数の本体（トップレベルではプログラム）を抜けるまでtrue
+    // 戻り値をヒープのラッパーで包まず、ブロックやループはこのフラグを見て後続の文を評価せずに返る
+    bool returning = false;
+
+    void countBackEdge();
+    bool tryNativeCall(Function &fn, const std::optional<Value> *args, size_t count, Value &result);
+
+    // 評価の本体（内部では即値のValueで受け渡しし、eval()の出口でのみObjectPtrに変換する）
+    Value evalNode(const AST::Node* node);
 
     // ヘルパー関数
-    ObjectPtr newError(const std::string& message);
-    bool isError(const ObjectPtr& obj);
+    Value newError(const std::string& message);
+    bool isError(const Value& obj);
+    // 部分式の評価後に、外側の式の評価を打ち切って値をそのまま返すべきか（エラーかreturn文による脱出）
+    bool isAbrupt(const Value& obj);
     std::string objectTypeToString(ObjectType type);
-    bool isTruthy(const ObjectPtr& obj);
+    bool isTruthy(const Value& obj);
     
     // 評価関数
-    ObjectPtr evalProgram(const AST::Program* program);
-    ObjectPtr evalBlockStatement(const AST::BlockStatement* block);
-    ObjectPtr evalExpressionStatement(const AST::ExpressionStatement* exprStmt);
-    ObjectPtr evalLetStatement(const AST::LetStatement* letStmt);
-    ObjectPtr evalReturnStatement(const AST::ReturnStatement* returnStmt);
+    Value evalProgram(const AST::Program* program);
+    Value evalBlockStatement(const AST::BlockStatement* block);
+    Value evalExpressionStatement(const AST::ExpressionStatement* exprStmt);
+    Value evalLetStatement(const AST::LetStatement* letStmt);
+    Value evalLet(const AST::Identifier* name, const AST::Expression* valueExpr);
+    Value evalReturnStatement(const AST::ReturnStatement* returnStmt);
     
     // リテラルの評価
-    ObjectPtr evalIntegerLiteral(const AST::IntegerLiteral* node);
-    ObjectPtr evalBooleanLiteral(const AST::BooleanLiteral* node);
-    ObjectPtr evalStringLiteral(const AST::StringLiteral* node);
-    ObjectPtr evalFunctionLiteral(const AST::FunctionLiteral* node);
-    ObjectPtr evalIdentifier(const AST::Identifier* node);
+    Value evalIntegerLiteral(const AST::IntegerLiteral* node);
+    Value evalBooleanLiteral(const AST::BooleanLiteral* node);
+    Value evalStringLiteral(const AST::StringLiteral* node);
+    Value evalFunctionLiteral(const AST::FunctionLiteral* node);
+    Value evalIdentifier(const AST::Identifier* node);
     
     // 式の評価
-    ObjectPtr evalPrefixExpression(const std::string& op, ObjectPtr right);
-    ObjectPtr evalInfixExpression(const std::string& op, ObjectPtr left, ObjectPtr right);
-    ObjectPtr evalIntegerInfixExpression(const std::string& op, 
-                                       std::shared_ptr<Integer> left,
-                                       std::shared_ptr<Integer> right);
-    ObjectPtr evalBangOperatorExpression(const ObjectPtr& right);
-    ObjectPtr evalCallExpression(const AST::CallExpression* call);
+    Value evalPrefixExpression(AST::Operator op, Value right);
+    Value evalInfixExpression(AST::Operator op, Value left, Value right);
+    Value evalIntegerInfixExpression(AST::Operator op, int64_t left, int64_t right);
+    Value evalBangOperatorExpression(const Value& right);
+    Value evalCallExpression(const AST::CallExpression* call);
     
     // 配列とハッシュの評価
-    ObjectPtr evalArrayLiteral(const AST::ArrayLiteral* array);
-    ObjectPtr evalIndexExpression(const AST::IndexExpression* index);
-    ObjectPtr evalArrayIndexExpression(const ObjectPtr& array, const ObjectPtr& index);
-    ObjectPtr evalHashLiteral(const AST::HashLiteral* hash);
-    ObjectPtr evalHashIndexExpression(const ObjectPtr& hash, const ObjectPtr& index);
-    ObjectPtr evalWhileExpression(const AST::WhileExpression* whileExpr);
-    ObjectPtr evalForExpression(const AST::ForExpression* forExpr);
+    Value evalArrayLiteral(const AST::ArrayLiteral* array);
+    Value evalIndexExpression(const AST::IndexExpression* index);
+    Value evalArrayIndexExpression(const Value& array, const Value& index);
+    Value evalHashLiteral(const AST::HashLiteral* hash);
+    Value evalHashIndexExpression(const Value& hash, const Value& index);
+    Value evalWhileExpression(const AST::WhileExpression* whileExpr);
+    Value evalForExpression(const AST::ForExpression* forExpr);
 };
 
 } // namespace monkey
\ No newline at end of file
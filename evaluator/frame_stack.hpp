@@ -0,0 +1,114 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace monkey
+{
+
+// 関数呼び出しのスロット（引数と変数）を確保する後入れ先出しのスタック
+// 連続した領域をチャンク単位で確保し、呼び出しが終わった領域は次の呼び出しで再利用する。
+// チャンクは解放せずに保持するため、再帰の深さが一度到達した範囲ではヒープ確保が起きない。
+// 確保した領域は移動しない（内側の呼び出しでスタックが伸びても、外側のフレームへのポインタは有効なまま）。
+template <typename T> class FrameStack
+{
+  public:
+    // 1つのチャンクに入るスロット数（これより大きいフレームはそのフレーム専用の大きさで確保する）
+    static constexpr size_t CHUNK_SIZE = 1024;
+
+    FrameStack() = default;
+    FrameStack(const FrameStack &) = delete;
+    FrameStack &operator=(const FrameStack &) = delete;
+
+    // 連続したcount個のスロットを確保する（スロットは既定値で初期化されている）
+    T *push(size_t count)
+    {
+        if (count == 0)
+        {
+            return nullptr;
+        }
+        if (current < chunks.size() && chunks[current].capacity - chunks[current].used < count)
+        {
+            // 残りに収まらない場合は次のチャンクへ移る（末尾の余りは使わない）
+            current++;
+            if (current < chunks.size() && chunks[current].capacity < count)
+            {
+                // 大きいフレームを入れられない既存のチャンクは、より大きなものに取り替える
+                chunks[current] = Chunk(std::max(CHUNK_SIZE, count));
+            }
+        }
+        if (current == chunks.size())
+        {
+            chunks.emplace_back(std::max(CHUNK_SIZE, count));
+        }
+        Chunk &chunk = chunks[current];
+        T *slots = chunk.slots.get() + chunk.used;
+        chunk.used += count;
+        return slots;
+    }
+
+    // pushで確保した最後の領域を解放する（スロットの値は既定値に戻して参照を手放す）
+    void pop(T *slots, size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        std::fill(slots, slots + count, T());
+        Chunk &chunk = chunks[current];
+        chunk.used -= count;
+        if (chunk.used == 0 && current > 0)
+        {
+            current--;
+        }
+    }
+
+    // 確保済みのチャンク数（再利用されている間は増えない）
+    size_t chunkCount() const
+    {
+        return chunks.size();
+    }
+
+  private:
+    struct Chunk
+    {
+        std::unique_ptr<T[]> slots;
+        size_t capacity;
+        size_t used = 0;
+
+        explicit Chunk(size_t capacity) : slots(new T[capacity]()), capacity(capacity)
+        {
+        }
+    };
+
+    std::vector<Chunk> chunks;
+    size_t current = 0; // 最後に確保した領域を含むチャンク
+};
+
+// FrameStackから確保した領域を、スコープを抜けるとき（例外による巻き戻しを含む）に解放する
+template <typename T> class FrameScope
+{
+  public:
+    FrameScope(FrameStack<T> &stack, size_t count) : stack(stack), slots(stack.push(count)), count(count)
+    {
+    }
+    FrameScope(const FrameScope &) = delete;
+    FrameScope &operator=(const FrameScope &) = delete;
+    ~FrameScope()
+    {
+        stack.pop(slots, count);
+    }
+
+    T *get() const
+    {
+        return slots;
+    }
+
+  private:
+    FrameStack<T> &stack;
+    T *slots;
+    size_t count;
+};
+
+} // namespace monkey
@@ -0,0 +1,404 @@
+#include "resolver.hpp"
+
+namespace monkey
+{
+
+Resolver::Resolver() : scopes(1)
+{
+}
+
+void Resolver::resolve(const AST::Node *node)
+{
+    boundGlobalNames.clear();
+    if (!node)
+    {
+        return;
+    }
+
+    if (node->kind() == AST::NodeKind::PROGRAM)
+    {
+        for (const auto &stmt : AST::as<AST::Program>(node)->statements)
+        {
+            resolveStatement(stmt.get());
+        }
+        return;
+    }
+
+    switch (node->kind())
+    {
+    case AST::NodeKind::EXPRESSION_STATEMENT:
+    case AST::NodeKind::BLOCK_STATEMENT:
+    case AST::NodeKind::LET_STATEMENT:
+    case AST::NodeKind::RETURN_STATEMENT:
+        resolveStatement(static_cast<const AST::Statement *>(node));
+        break;
+    default:
+        resolveExpression(static_cast<const AST::Expression *>(node));
+        break;
+    }
+}
+
+int Resolver::defineGlobal(const std::string &name)
+{
+    auto &global = scopes.front();
+    auto it = global.slots.find(name);
+    if (it != global.slots.end())
+    {
+        return it->second;
+    }
+    int slot = global.numSlots++;
+    global.slots.emplace(name, slot);
+    global.slotInfo.emplace_back();
+    return slot;
+}
+
+int Resolver::lookupGlobal(const std::string &name) const
+{
+    const auto &global = scopes.front();
+    auto it = global.slots.find(name);
+    return it != global.slots.end() ? it->second : -1;
+}
+
+size_t Resolver::numGlobals() const
+{
+    return scopes.front().numSlots;
+}
+
+int Resolver::declare(const std::string &name)
+{
+    // 同じスコープで既に定義済みの名前は同じスロットを再利用する
+    auto &scope = scopes.back();
+    if (scopes.size() == 1)
+    {
+        boundGlobalNames.push_back(name);
+    }
+    auto it = scope.slots.find(name);
+    if (it != scope.slots.end())
+    {
+        auto &info = scope.slotInfo[it->second];
+        info.rebound = true;
+        if (info.capturedByValue)
+        {
+            // 値で捕捉させた後に代入し直すので、セルで捕捉させる必要がある
+            scope.cellNames.insert(name);
+            scope.retry = true;
+        }
+        return it->second;
+    }
+    int slot = scope.numSlots++;
+    scope.slots.emplace(name, slot);
+    scope.slotInfo.emplace_back();
+    return slot;
+}
+
+void Resolver::bindLocal(const AST::Identifier *ident, int slot)
+{
+    ident->slot = slot;
+    if (scopes.size() == 1)
+    {
+        ident->scope = AST::VariableScope::GLOBAL;
+        return;
+    }
+    ident->scope = AST::VariableScope::LOCAL;
+    scopes.back().references.push_back(ident);
+}
+
+void Resolver::resolveStatement(const AST::Statement *stmt)
+{
+    if (!stmt)
+    {
+        return;
+    }
+
+    switch (stmt->kind())
+    {
+    case AST::NodeKind::EXPRESSION_STATEMENT:
+        resolveExpression(AST::as<AST::ExpressionStatement>(stmt)->expression.get());
+        break;
+    case AST::NodeKind::LET_STATEMENT:
+    {
+        auto letStmt = AST::as<AST::LetStatement>(stmt);
+        resolveLet(letStmt->name.get(), letStmt->value.get());
+        break;
+    }
+    case AST::NodeKind::RETURN_STATEMENT:
+        resolveExpression(AST::as<AST::ReturnStatement>(stmt)->returnValue.get());
+        break;
+    case AST::NodeKind::BLOCK_STATEMENT:
+        for (const auto &s : AST::as<AST::BlockStatement>(stmt)->statements)
+        {
+            resolveStatement(s.get());
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void Resolver::resolveLet(const AST::Identifier *name, const AST::Expression *value)
+{
+    if (!name)
+    {
+        return;
+    }
+
+    // 関数リテラルは再帰呼び出しできるように先に名前を定義する
+    if (value && value->kind() == AST::NodeKind::FUNCTION_LITERAL)
+    {
+        bindLocal(name, declare(name->value));
+        resolveExpression(value);
+        return;
+    }
+
+    resolveExpression(value);
+    bindLocal(name, declare(name->value));
+}
+
+void Resolver::resolveIdentifier(const AST::Identifier *ident)
+{
+    size_t innermost = scopes.size() - 1;
+    if (innermost > 0)
+    {
+        auto &scope = scopes.back();
+        auto it = scope.slots.find(ident->value);
+        if (it != scope.slots.end())
+        {
+            bindLocal(ident, it->second);
+            return;
+        }
+
+        auto captured = capture(innermost, ident->value);
+        if (captured.first != AST::VariableScope::UNRESOLVED)
+        {
+            ident->scope = captured.first;
+            ident->slot = captured.second;
+            return;
+        }
+    }
+
+    int slot = lookupGlobal(ident->value);
+    if (slot >= 0)
+    {
+        ident->scope = AST::VariableScope::GLOBAL;
+        ident->slot = slot;
+        return;
+    }
+
+    // 後から定義されるグローバル（相互再帰やREPLの後続行）は実行時に名前で検索する
+    ident->scope = AST::VariableScope::UNRESOLVED;
+    ident->slot = -1;
+}
+
+Resolver::Capture Resolver::capture(size_t level, const std::string &name)
+{
+    auto &scope = scopes[level];
+    auto found = scope.captures.find(name);
+    if (found != scope.captures.end())
+    {
+        return found->second;
+    }
+
+    size_t outerLevel = level - 1;
+    if (outerLevel == 0)
+    {
+        return {AST::VariableScope::UNRESOLVED, -1};
+    }
+
+    // 外側の関数のスコープで解決した識別子を、この関数の生成時に評価して値かセルを取り出す
+    auto variable = std::make_unique<AST::Identifier>(Token::Token(Token::TokenType::IDENT, name), name);
+    auto &outer = scopes[outerLevel];
+    bool byValue;
+    auto it = outer.slots.find(name);
+    if (it != outer.slots.end())
+    {
+        auto &info = outer.slotInfo[it->second];
+        byValue = info.parameter && !info.rebound && !outer.cellNames.count(name);
+        (byValue ? info.capturedByValue : info.capturedByCell) = true;
+        variable->scope = AST::VariableScope::LOCAL;
+        variable->slot = it->second;
+        outer.references.push_back(variable.get());
+    }
+    else
+    {
+        auto source = capture(outerLevel, name);
+        if (source.first == AST::VariableScope::UNRESOLVED)
+        {
+            return source;
+        }
+        byValue = source.first == AST::VariableScope::FREE_VALUE;
+        variable->scope = source.first;
+        variable->slot = source.second;
+    }
+
+    auto &list = byValue ? scope.function->capturedValues : scope.function->capturedCells;
+    Capture result{byValue ? AST::VariableScope::FREE_VALUE : AST::VariableScope::FREE_CELL,
+                   static_cast<int>(list.size())};
+    list.push_back(std::move(variable));
+    scope.captures.emplace(name, result);
+    return result;
+}
+
+void Resolver::finishFunction(Scope &scope)
+{
+    // セルで捕捉される変数はセルに、それ以外は呼び出し環境のスロットに、それぞれ詰めて番号を振り直す
+    std::vector<int> renumbered(scope.numSlots);
+    int numLocals = 0;
+    int numCells = 0;
+    for (int slot = 0; slot < scope.numSlots; slot++)
+    {
+        renumbered[slot] = scope.slotInfo[slot].capturedByCell ? numCells++ : numLocals++;
+    }
+    for (const AST::Identifier *ident : scope.references)
+    {
+        if (scope.slotInfo[ident->slot].capturedByCell)
+        {
+            ident->scope = AST::VariableScope::CELL;
+        }
+        ident->slot = renumbered[ident->slot];
+    }
+    scope.function->numLocals = numLocals;
+    scope.function->numCells = numCells;
+}
+
+void Resolver::resolveFunction(const AST::FunctionLiteral *func)
+{
+    // 外側の関数のスコープには、この関数が捕捉した変数への参照が追加される（解決し直す場合は取り消す）
+    auto &outer = scopes.back();
+    size_t outerReferences = outer.references.size();
+
+    std::unordered_set<std::string> cellNames;
+    while (true)
+    {
+        func->capturedValues.clear();
+        func->capturedCells.clear();
+        scopes.emplace_back();
+        auto *scope = &scopes.back();
+        scope->function = func;
+        scope->cellNames = std::move(cellNames);
+        for (const auto &param : func->parameters)
+        {
+            if (param)
+            {
+                int slot = declare(param->value);
+                scope->slotInfo[slot].parameter = true;
+                bindLocal(param.get(), slot);
+            }
+        }
+        // 本体のletが束縛する名前は初期化式より先に宣言し、後で定義する局所関数も参照できるようにする（相互再帰）
+        std::vector<const AST::Identifier *> letNames;
+        AST::collectLetNames(func->body.get(), letNames);
+        for (const AST::Identifier *name : letNames)
+        {
+            declare(name->value);
+        }
+        if (func->body)
+        {
+            resolveStatement(func->body.get());
+        }
+
+        scope = &scopes.back();
+        if (!scope->retry)
+        {
+            finishFunction(*scope);
+            scopes.pop_back();
+            return;
+        }
+
+        // 値で捕捉させた引数を後から代入し直していたので、その引数をセルで捕捉させて解決し直す
+        cellNames = std::move(scope->cellNames);
+        scopes.pop_back();
+        scopes.back().references.resize(outerReferences);
+    }
+}
+
+void Resolver::resolveExpression(const AST::Expression *expr)
+{
+    if (!expr)
+    {
+        return;
+    }
+
+    switch (expr->kind())
+    {
+    case AST::NodeKind::IDENTIFIER:
+        resolveIdentifier(AST::as<AST::Identifier>(expr));
+        break;
+    case AST::NodeKind::PREFIX_EXPRESSION:
+        resolveExpression(AST::as<AST::PrefixExpression>(expr)->right.get());
+        break;
+    case AST::NodeKind::INFIX_EXPRESSION:
+    {
+        auto infix = AST::as<AST::InfixExpression>(expr);
+        resolveExpression(infix->left.get());
+        resolveExpression(infix->right.get());
+        break;
+    }
+    case AST::NodeKind::IF_EXPRESSION:
+    {
+        auto ifExpr = AST::as<AST::IfExpression>(expr);
+        resolveExpression(ifExpr->getCondition());
+        resolveStatement(ifExpr->getConsequence());
+        resolveStatement(ifExpr->getAlternative());
+        break;
+    }
+    case AST::NodeKind::WHILE_EXPRESSION:
+    {
+        auto whileExpr = AST::as<AST::WhileExpression>(expr);
+        resolveExpression(whileExpr->condition.get());
+        resolveStatement(whileExpr->body.get());
+        break;
+    }
+    case AST::NodeKind::FOR_EXPRESSION:
+    {
+        auto forExpr = AST::as<AST::ForExpression>(expr);
+        resolveExpression(forExpr->init.get());
+        resolveExpression(forExpr->condition.get());
+        resolveStatement(forExpr->body.get());
+        resolveExpression(forExpr->update.get());
+        break;
+    }
+    case AST::NodeKind::LET_EXPRESSION:
+    {
+        auto letExpr = AST::as<AST::LetExpression>(expr);
+        resolveLet(letExpr->getName(), letExpr->getValue());
+        break;
+    }
+    case AST::NodeKind::FUNCTION_LITERAL:
+        resolveFunction(AST::as<AST::FunctionLiteral>(expr));
+        break;
+    case AST::NodeKind::CALL_EXPRESSION:
+    {
+        auto call = AST::as<AST::CallExpression>(expr);
+        resolveExpression(call->function.get());
+        for (const auto &arg : call->arguments)
+        {
+            resolveExpression(arg.get());
+        }
+        break;
+    }
+    case AST::NodeKind::ARRAY_LITERAL:
+        for (const auto &elem : AST::as<AST::ArrayLiteral>(expr)->elements)
+        {
+            resolveExpression(elem.get());
+        }
+        break;
+    case AST::NodeKind::INDEX_EXPRESSION:
+    {
+        auto index = AST::as<AST::IndexExpression>(expr);
+        resolveExpression(index->left.get());
+        resolveExpression(index->index.get());
+        break;
+    }
+    case AST::NodeKind::HASH_LITERAL:
+        for (const auto &pair : AST::as<AST::HashLiteral>(expr)->pairs)
+        {
+            resolveExpression(pair.first.get());
+            resolveExpression(pair.second.get());
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+} // namespace monkey
@@ -0,0 +1,83 @@
+#pragma once
+#include "../ast/ast.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace monkey
+{
+
+// 識別子に変数の場所（AST::VariableScopeとslot）を割り当てる解決パス
+// 評価の前にASTを一度走査し、実行時の変数参照を文字列のハッシュ検索から
+// 環境ベクタへのインデックスアクセスに置き換える。
+// スコープは関数ごとに1つで、ブロックはスコープを作らない（評価器の意味論に合わせる）。
+// 関数本体のletが束縛する名前は、本体を解決する前にすべて関数のスコープに宣言する。
+//
+// 関数は外側の環境全体ではなく、本体が参照する外側の関数の変数（自由変数）だけを捕捉する（フラットクロージャ）。
+// 定義した関数の中で代入し直されない引数は、関数の生成時に値をコピーして捕捉する。
+// それ以外の変数は定義した関数の呼び出し環境でセルに置き、捕捉した関数とセルを共有する
+// （捕捉の後に代入し直した値や、再帰呼び出しのための自分自身への参照が見える）。
+// グローバル変数は捕捉せず、常にグローバル環境から読む。
+class Resolver
+{
+  public:
+    Resolver();
+
+    // ASTに解決結果を書き込む（グローバルスコープは呼び出しをまたいで保持される）
+    void resolve(const AST::Node *node);
+
+    // グローバルスコープに名前を定義してスロット番号を返す（定義済みの場合は既存のスロット）
+    int defineGlobal(const std::string &name);
+    // グローバルスコープから名前を検索する（見つからない場合は-1）
+    int lookupGlobal(const std::string &name) const;
+    size_t numGlobals() const;
+    // 直前のresolve()でグローバルスコープのletが束縛する名前（実行されない分岐のletも含む）
+    const std::vector<std::string> &boundGlobals() const
+    {
+        return boundGlobalNames;
+    }
+
+  private:
+    struct Slot
+    {
+        bool parameter = false;       // 引数のスロット
+        bool rebound = false;         // 同じスコープのletで代入し直される
+        bool capturedByValue = false; // 内側の関数に値で捕捉される
+        bool capturedByCell = false;  // 内側の関数にセルで捕捉される
+    };
+    using Capture = std::pair<AST::VariableScope, int>; // 内側の関数から見た捕捉した変数の場所
+
+    struct Scope
+    {
+        std::unordered_map<std::string, int> slots;
+        std::vector<Slot> slotInfo;
+        int numSlots = 0;
+
+        // 以下は関数スコープだけで使う
+        const AST::FunctionLiteral *function = nullptr;
+        std::unordered_map<std::string, Capture> captures; // 捕捉した外側の変数
+        std::vector<const AST::Identifier *> references;   // このスコープのスロットに解決した識別子
+        std::unordered_set<std::string> cellNames;         // 引数でもセルで捕捉させる変数
+        bool retry = false; // 値で捕捉させた引数を後から代入し直した（cellNamesに加えて解決し直す）
+    };
+
+    // scopes[0]がグローバルスコープ、末尾が現在の関数スコープ
+    std::vector<Scope> scopes;
+    std::vector<std::string> boundGlobalNames;
+
+    int declare(const std::string &name);
+    // 現在のスコープのslotに識別子を解決する（グローバルスコープではGLOBAL、関数スコープではLOCAL）
+    void bindLocal(const AST::Identifier *ident, int slot);
+    // scopes[level]の関数がnameを捕捉した場所を返す（外側の関数に定義がない場合はUNRESOLVED）
+    Capture capture(size_t level, const std::string &name);
+    // 関数スコープを閉じ、捕捉される変数をセルに移してスロット番号を詰め直す
+    void finishFunction(Scope &scope);
+    void resolveStatement(const AST::Statement *stmt);
+    void resolveExpression(const AST::Expression *expr);
+    void resolveLet(const AST::Identifier *name, const AST::Expression *value);
+    void resolveIdentifier(const AST::Identifier *ident);
+    void resolveFunction(const AST::FunctionLiteral *func);
+};
+
+} // namespace monkey
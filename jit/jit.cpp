@@ -1,14 +1,27 @@
 #include "jit.hpp"
+#include "../trace/trace.hpp"
+#include <algorithm>
+#include <optional>
+#include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_ostream.h>
-#include <llvm/Transforms/Scalar/GVN.h>
-#include <iostream>
+#include <limits>
+#include <llvm/Transforms/Utils/Cloning.h>
 
 namespace JIT
 {
 
+namespace
+{
+// 実行時エラーを伝えるグローバル変数のシンボル名（0以外ならmainの実行中にエラーが起きた）
+constexpr const char* RUNTIME_ERROR_SYMBOL = "monkey_runtime_error";
+// 行のmainで実行を終えたトップレベルのletの数を記録するグローバル変数のシンボル名
+constexpr const char* COMPLETED_LETS_SYMBOL = "monkey_completed_lets";
+} // namespace
+
 Compiler::Compiler()
+    : threadSafeContext(std::make_unique<llvm::LLVMContext>()),
+      context(threadSafeContext.getContext())
 {
-    context = std::make_unique<llvm::LLVMContext>();
     builder = std::make_unique<llvm::IRBuilder<>>(*context);
     module = std::make_unique<llvm::Module>("monkey_jit", *context);
     setOptimizationLevel(2); // デフォルトで-O2最適化
@@ -21,146 +34,533 @@ void Compiler::setOptimizationLevel(unsigned level)
 
 void Compiler::initializeOptimizations(unsigned level)
 {
-    // 分析マネージャーの初期化のみを行い、最適化は無効化
+    optimizationLevel = std::min(level, 3u);
+
+    // 解析マネージャーを作り直してPassBuilderに登録する
+    loopAnalysisManager = llvm::LoopAnalysisManager();
+    functionAnalysisManager = llvm::FunctionAnalysisManager();
+    cgsccAnalysisManager = llvm::CGSCCAnalysisManager();
     moduleAnalysisManager = llvm::ModuleAnalysisManager();
+    passBuilder.registerModuleAnalyses(moduleAnalysisManager);
+    passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
+    passBuilder.registerFunctionAnalyses(functionAnalysisManager);
+    passBuilder.registerLoopAnalyses(loopAnalysisManager);
+    passBuilder.crossRegisterProxies(loopAnalysisManager, functionAnalysisManager, cgsccAnalysisManager,
+                                     moduleAnalysisManager);
+
+    switch (optimizationLevel)
+    {
+    case 0:
+        // -O0ではIRをそのまま残す
+        passManager = llvm::ModulePassManager();
+        break;
+    case 1:
+        // SROA（mem2reg相当）・instcombine・CFG簡約などを含む軽量なパイプライン
+        passManager = passBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O1);
+        break;
+    case 2:
+        // O1に加えてGVNやループ最適化（LICM・ループ回転・展開など）を含む
+        passManager = passBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+        break;
+    default:
+        passManager = passBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+        break;
+    }
 }
 
 void Compiler::compile(const AST::Program& program)
 {
-    std::cout << "Starting compilation..." << std::endl;
+    TRACE_DEBUG("jit", "Starting compilation...");
     
-    // 既存のモジュールをクリア
+    // 行ごとに新しいモジュールを作る（以前の行の定義はセッションから宣言として参照する）
     module = std::make_unique<llvm::Module>("monkey_jit", *context);
     builder = std::make_unique<llvm::IRBuilder<>>(*context);
     namedValues.clear();
+    pendingSymbols.clear();
+    pendingChanges.clear();
+    letCount = 0;
+    dependencies = nullptr;
+    atTopLevel = true;
+    failureBlock = nullptr;
+    resultIsBoolean = false;
+    resultFunction.reset();
+    complete = true;
+    mainName = "monkey_main_" + std::to_string(lineCount++);
     
     try {
-        std::cout << "Creating main function..." << std::endl;
+        TRACE_DEBUG("jit", "Creating main function...");
         // メイン関数の作成
         llvm::FunctionType* mainType = llvm::FunctionType::get(
             llvm::Type::getInt64Ty(*context), false);
         llvm::Function* mainFunc = llvm::Function::Create(
-            mainType, llvm::Function::ExternalLinkage, "main", module.get());
+            mainType, llvm::Function::ExternalLinkage, mainName, module.get());
         
-        std::cout << "Creating entry block..." << std::endl;
+        TRACE_DEBUG("jit", "Creating entry block...");
         // エントリーブロックの作成
         llvm::BasicBlock* bb = llvm::BasicBlock::Create(*context, "entry", mainFunc);
         builder->SetInsertPoint(bb);
         
         // 文のコンパイル
-        llvm::Value* lastValue = nullptr;
-        std::cout << "Compiling statements..." << std::endl;
+        auto int64Type = llvm::Type::getInt64Ty(*context);
+        bool hasLet = std::any_of(program.statements.begin(), program.statements.end(), [](const auto& stmt) {
+            return stmt && stmt->kind() == AST::NodeKind::LET_STATEMENT;
+        });
+        if (hasLet)
+        {
+            builder->CreateStore(llvm::ConstantInt::get(int64Type, 0), declareGlobal(COMPLETED_LETS_SYMBOL, int64Type));
+        }
+        CompiledValue last;
+        TRACE_DEBUG("jit", "Compiling statements...");
         for (const auto& stmt : program.statements)
         {
             if (stmt)
             {
-                std::cout << "Compiling statement: " << stmt->String() << std::endl;
-                lastValue = compileStatement(stmt.get());
-                if (lastValue)
+                TRACE_DEBUG("jit", "Compiling statement: " << stmt->String());
+                bool isLet = stmt->kind() == AST::NodeKind::LET_STATEMENT;
+                if (isLet)
+                {
+                    letCount++;
+                }
+                last = compileStatement(stmt.get());
+                if (isLet && last.value)
                 {
-                    std::cout << "Statement compiled successfully" << std::endl;
+                    builder->CreateStore(llvm::ConstantInt::get(int64Type, letCount),
+                                         declareGlobal(COMPLETED_LETS_SYMBOL, int64Type));
                 }
-                else
+                resultFunction.reset();
+                if (!last.value)
                 {
-                    std::cout << "Statement compilation returned nullptr" << std::endl;
+                    TRACE_DEBUG("jit", "Statement compilation returned nullptr");
+                    // 値が得られない場合は未対応の構文を含んでいる
+                    complete = false;
+                    continue;
+                }
+                TRACE_DEBUG("jit", "Statement compiled successfully");
+                // 関数を束縛したletの値は、評価器と同じ関数オブジェクトとしてexecute()で返す
+                if (llvm::isa<llvm::Function>(last.value) && stmt->kind() == AST::NodeKind::LET_STATEMENT)
+                {
+                    auto literal = AST::as<AST::FunctionLiteral>(AST::as<AST::LetStatement>(stmt.get())->value.get());
+                    resultFunction.reset(static_cast<AST::FunctionLiteral*>(literal->clone()));
                 }
             }
         }
+        if (program.statements.empty())
+        {
+            // 評価器は空のプログラムにnullを返す
+            complete = false;
+        }
         
-        std::cout << "Setting return value..." << std::endl;
-        // 戻り値の設定
+        TRACE_DEBUG("jit", "Setting return value...");
+        // 戻り値の設定（整数以外の値はmainの戻り値として返せない）
+        llvm::Value* lastValue = last.value;
+        if (resultFunction)
+        {
+            lastValue = nullptr;
+        }
+        else if (lastValue && !lastValue->getType()->isIntegerTy(64))
+        {
+            complete = false;
+            lastValue = nullptr;
+        }
+        // 真偽値はexecute()で真偽値のオブジェクトに戻す
+        resultIsBoolean = lastValue && last.isBoolean;
         if (!lastValue)
         {
             lastValue = llvm::ConstantInt::get(*context, llvm::APInt(64, 0));
         }
         builder->CreateRet(lastValue);
         
-        std::cout << "Verifying module..." << std::endl;
+        TRACE_DEBUG("jit", "Verifying module...");
         // 検証を実行
         std::string error;
         llvm::raw_string_ostream errorStream(error);
         if (llvm::verifyModule(*module, &errorStream))
         {
-            std::cout << "Module verification failed!" << std::endl;
+            TRACE_WARN("jit", "Module verification failed!");
             throw std::runtime_error("Module verification failed: " + error);
         }
         
-        // 最適化は一時的にスキップ
-        std::cout << "Skipping optimizations..." << std::endl;
-        std::cout << "Compilation completed successfully" << std::endl;
+        // 検証済みのモジュールに最適化パイプラインを適用
+        runOptimizations(*module);
+        TRACE_DEBUG("jit", "Compilation completed successfully");
         
     } catch (const std::exception& e) {
-        std::cout << "Compilation failed with exception: " << e.what() << std::endl;
+        TRACE_WARN("jit", "Compilation failed with exception: " << e.what());
         throw;
     }
 }
 
-void Compiler::runOptimizations()
+llvm::orc::LLJIT& Compiler::ensureJIT()
 {
-    // 最適化を一時的に無効化
-    std::cout << "Optimizations disabled" << std::endl;
-    return;
+    if (!jit)
+    {
+        // ネイティブターゲットの初期化はプロセスで一度だけ行う
+        static const bool targetInitialized = []() {
+            llvm::InitializeNativeTarget();
+            llvm::InitializeNativeTargetAsmPrinter();
+            return true;
+        }();
+        (void)targetInitialized;
+
+        auto created = llvm::orc::LLJITBuilder().create();
+        if (!created)
+        {
+            throw std::runtime_error("Failed to create JIT: " + llvm::toString(created.takeError()));
+        }
+        jit = std::move(*created);
+    }
+    return *jit;
 }
 
-llvm::Value* Compiler::compileStatement(const AST::Statement* stmt)
+llvm::orc::JITDylib& Compiler::ensureSession()
 {
-    if (auto exprStmt = dynamic_cast<const AST::ExpressionStatement*>(stmt))
+    if (!sessionDylib)
     {
-        if (exprStmt->expression)
+        auto created = ensureJIT().createJITDylib("session");
+        if (!created)
         {
-            return compileExpression(exprStmt->expression.get());
+            throw std::runtime_error("Failed to create session: " + llvm::toString(created.takeError()));
+        }
+        sessionDylib = &*created;
+    }
+    return *sessionDylib;
+}
+
+monkey::ObjectPtr Compiler::execute()
+{
+    auto& session = ensureSession();
+
+    // getIR()で参照できるようにモジュールは手元に残し、複製をセッションに追加する
+    // 行のモジュールは以降の行から参照される定義を含むため、実行後も破棄しない
+    llvm::orc::ThreadSafeModule threadSafeModule(llvm::CloneModule(*module), threadSafeContext);
+    if (auto err = jit->addIRModule(session, std::move(threadSafeModule)))
+    {
+        throw std::runtime_error("Failed to add module: " + llvm::toString(std::move(err)));
+    }
+    // モジュールが定義したグローバル変数は、実行の結果によらず以降の行では宣言だけにする
+    for (const auto& global : module->globals())
+    {
+        if (global.hasInitializer())
+        {
+            definedGlobals.insert(std::string(global.getName()));
         }
     }
-    else if (auto letStmt = dynamic_cast<const AST::LetStatement*>(stmt))
+
+    auto symbol = jit->lookup(session, mainName);
+    if (!symbol)
     {
-        compileLetStatement(letStmt);
+        throw std::runtime_error("Failed to look up " + mainName + ": " + llvm::toString(symbol.takeError()));
     }
-    else if (auto ifStmt = dynamic_cast<const AST::IfExpression*>(stmt))
+
+    TRACE_DEBUG("jit", "Executing " << mainName << " at 0x" << std::hex << symbol->getAddress());
+    auto mainFunc = reinterpret_cast<int64_t (*)()>(static_cast<uintptr_t>(symbol->getAddress()));
+    int64_t result = mainFunc();
+
+    // 実行時エラーはフラグで伝わる（フラグは次の行のために戻しておく）
+    if (definedGlobals.count(RUNTIME_ERROR_SYMBOL))
     {
-        return compileIfExpression(ifStmt);
+        auto flag = globalAddress(RUNTIME_ERROR_SYMBOL);
+        if (*flag)
+        {
+            // 評価器と同じく、中断する前に実行を終えたletの定義だけを確定する
+            *flag = 0;
+            unsigned completedLets = 0;
+            if (definedGlobals.count(COMPLETED_LETS_SYMBOL))
+            {
+                completedLets = static_cast<unsigned>(*globalAddress(COMPLETED_LETS_SYMBOL));
+            }
+            commitPendingChanges(completedLets);
+            return monkey::makeRef<monkey::Error>("division by zero");
+        }
     }
-    else if (auto whileStmt = dynamic_cast<const AST::WhileExpression*>(stmt))
+
+    // この行の定義を確定する
+    commitPendingChanges(letCount);
+
+    if (resultFunction)
     {
-        return compileWhileExpression(whileStmt);
+        // セッションの関数は外側の変数を捕捉しないため、評価器がトップレベルで作る関数オブジェクトと同じになる
+        std::vector<std::string> parameters;
+        for (const auto& param : resultFunction->parameters)
+        {
+            parameters.push_back(param->value);
+        }
+        return monkey::makeRef<monkey::Function>(std::move(parameters), resultFunction.get(), resultFunction,
+                                                 std::vector<monkey::Value>{}, std::vector<monkey::CellPtr>{});
     }
-    return nullptr;
+    if (resultIsBoolean)
+    {
+        return monkey::canonicalBoolean(result != 0);
+    }
+    return monkey::makeInteger(result);
 }
 
-llvm::Value *Compiler::compileExpression(const AST::Expression *expr)
+int64_t* Compiler::globalAddress(const std::string& symbol)
 {
-    try {
-        if (auto intLiteral = dynamic_cast<const AST::IntegerLiteral*>(expr))
+    auto found = jit->lookup(ensureSession(), symbol);
+    if (!found)
+    {
+        throw std::runtime_error("Failed to look up " + symbol + ": " + llvm::toString(found.takeError()));
+    }
+    return reinterpret_cast<int64_t*>(static_cast<uintptr_t>(found->getAddress()));
+}
+
+void Compiler::commitPendingChanges(unsigned completedLets)
+{
+    std::vector<std::string> bound;
+    for (auto& change : pendingChanges)
+    {
+        if (change.let > completedLets)
+        {
+            break;
+        }
+        if (change.symbol.removed)
+        {
+            sessionSymbols.erase(change.name);
+            continue;
+        }
+        sessionSymbols[change.name] = std::move(change.symbol);
+        if (std::find(bound.begin(), bound.end(), change.name) == bound.end())
+        {
+            bound.push_back(change.name);
+        }
+    }
+    pendingChanges.clear();
+    pendingSymbols.clear();
+
+    // 同じ名前を行の中で何度束縛しても、引き継ぐのは最後の束縛だけでよい
+    bindings.clear();
+    for (const auto& name : bound)
+    {
+        auto symbol = sessionSymbols.find(name);
+        if (symbol == sessionSymbols.end())
         {
-            return compileIntegerLiteral(intLiteral);
+            continue;
         }
-        if (auto infixExpr = dynamic_cast<const AST::InfixExpression*>(expr))
+        if (symbol->second.isFunction)
+        {
+            bindings.push_back(Binding{name, nullptr, symbol->second.definition});
+        }
+        else
+        {
+            bindings.push_back(Binding{name, monkey::makeInteger(*globalAddress(symbol->second.symbol)), nullptr});
+        }
+    }
+}
+
+void Compiler::rebind(const std::string& name, const monkey::ObjectPtr& value)
+{
+    auto symbol = sessionSymbols.find(name);
+    if (symbol == sessionSymbols.end())
+    {
+        return;
+    }
+    // 値の関数からは実行時にグローバル変数を読むため、整数の再束縛はそのまま書き込めばよい
+    if (!symbol->second.isFunction && value && value->type() == monkey::ObjectType::INTEGER)
+    {
+        *globalAddress(symbol->second.symbol) = static_cast<const monkey::Integer*>(value.get())->value();
+        return;
+    }
+
+    // 未実行のcompile()の定義は破棄して、セッションから名前と依存する関数を取り除く
+    pendingSymbols.clear();
+    pendingChanges.clear();
+    SessionSymbol removed;
+    removed.removed = true;
+    setPendingSymbol(name, std::move(removed));
+    invalidateDependents(name);
+    commitPendingChanges(std::numeric_limits<unsigned>::max());
+}
+
+const Compiler::SessionSymbol* Compiler::findSymbol(const std::string& name) const
+{
+    auto pending = pendingSymbols.find(name);
+    if (pending != pendingSymbols.end())
+    {
+        return pending->second.removed ? nullptr : &pending->second;
+    }
+    auto committed = sessionSymbols.find(name);
+    if (committed != sessionSymbols.end())
+    {
+        return &committed->second;
+    }
+    return nullptr;
+}
+
+void Compiler::setPendingSymbol(const std::string& name, SessionSymbol symbol)
+{
+    pendingSymbols[name] = symbol;
+    pendingChanges.push_back(PendingChange{letCount, name, std::move(symbol)});
+}
+
+void Compiler::invalidateDependents(const std::string& name)
+{
+    // 依存する関数を取り除くと、さらにその関数に依存する関数も古い定義を呼び続けるため、推移的にたどる
+    std::vector<std::string> changed{name};
+    while (!changed.empty())
+    {
+        auto current = std::move(changed.back());
+        changed.pop_back();
+
+        std::unordered_set<std::string> candidates;
+        for (const auto& [candidate, symbol] : sessionSymbols)
         {
-            return compileInfixExpression(infixExpr);
+            candidates.insert(candidate);
         }
-        if (auto prefixExpr = dynamic_cast<const AST::PrefixExpression*>(expr))
+        for (const auto& [candidate, symbol] : pendingSymbols)
         {
-            return compilePrefixExpression(prefixExpr);
+            candidates.insert(candidate);
         }
-        if (auto booleanLiteral = dynamic_cast<const AST::BooleanLiteral*>(expr))
+        for (const auto& candidate : candidates)
         {
-            return compileBooleanLiteral(booleanLiteral);
+            auto symbol = findSymbol(candidate);
+            if (candidate == current || !symbol || !symbol->dependencies.count(current))
+            {
+                continue;
+            }
+            TRACE_DEBUG("jit", "Invalidating " << candidate << " (depends on " << current << ")");
+            SessionSymbol removed;
+            removed.removed = true;
+            setPendingSymbol(candidate, std::move(removed));
+            changed.push_back(candidate);
         }
-        if (auto identifier = dynamic_cast<const AST::Identifier*>(expr))
+    }
+}
+
+llvm::GlobalVariable* Compiler::declareGlobal(const std::string& symbol, llvm::Type* type)
+{
+    if (auto existing = module->getNamedGlobal(symbol))
+    {
+        return existing;
+    }
+    // 以前の行で定義済みなら宣言のみ、そうでなければこの行のモジュールで定義する
+    llvm::Constant* initializer = definedGlobals.count(symbol) ? nullptr : llvm::Constant::getNullValue(type);
+    return new llvm::GlobalVariable(*module, type, false, llvm::GlobalValue::ExternalLinkage, initializer, symbol);
+}
+
+llvm::Value* Compiler::declareSymbol(const SessionSymbol& symbol)
+{
+    auto int64Type = llvm::Type::getInt64Ty(*context);
+    if (symbol.isFunction)
+    {
+        if (auto existing = module->getFunction(symbol.symbol))
         {
-            return compileIdentifier(identifier);
+            return existing;
         }
-        if (auto functionLiteral = dynamic_cast<const AST::FunctionLiteral*>(expr))
+        std::vector<llvm::Type*> paramTypes(symbol.arity, int64Type);
+        auto funcType = llvm::FunctionType::get(int64Type, paramTypes, false);
+        return llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, symbol.symbol, module.get());
+    }
+
+    return declareGlobal(symbol.symbol, int64Type);
+}
+
+llvm::GlobalVariable* Compiler::runtimeErrorFlag()
+{
+    return declareGlobal(RUNTIME_ERROR_SYMBOL, llvm::Type::getInt64Ty(*context));
+}
+
+llvm::BasicBlock* Compiler::runtimeFailure()
+{
+    if (!failureBlock)
+    {
+        llvm::Function* function = builder->GetInsertBlock()->getParent();
+        failureBlock = llvm::BasicBlock::Create(*context, "runtime_error", function);
+        llvm::IRBuilder<> failure(failureBlock);
+        auto int64Type = llvm::Type::getInt64Ty(*context);
+        failure.CreateStore(llvm::ConstantInt::get(int64Type, 1), runtimeErrorFlag());
+        failure.CreateRet(llvm::ConstantInt::get(int64Type, 0));
+    }
+    return failureBlock;
+}
+
+void Compiler::propagateRuntimeError(const llvm::Function* callee)
+{
+    if (callee && infallibleFunctions.count(std::string(callee->getName())))
+    {
+        return;
+    }
+    auto int64Type = llvm::Type::getInt64Ty(*context);
+    auto flag = builder->CreateLoad(int64Type, runtimeErrorFlag(), "error");
+    auto failed = builder->CreateICmpNE(flag, llvm::ConstantInt::get(int64Type, 0));
+    auto next = llvm::BasicBlock::Create(*context, "noerror", builder->GetInsertBlock()->getParent());
+    builder->CreateCondBr(failed, runtimeFailure(), next);
+    builder->SetInsertPoint(next);
+}
+
+void Compiler::runOptimizations(llvm::Module& target)
+{
+    if (optimizationLevel == 0)
+    {
+        return;
+    }
+
+    TRACE_DEBUG("jit", "Running -O" << optimizationLevel << " pipeline");
+    passManager.run(target, moduleAnalysisManager);
+
+    // モジュールは実行のたびに作り直すため、解析結果のキャッシュを残さない
+    loopAnalysisManager.clear();
+    functionAnalysisManager.clear();
+    cgsccAnalysisManager.clear();
+    moduleAnalysisManager.clear();
+}
+
+Compiler::CompiledValue Compiler::compileStatement(const AST::Statement* stmt)
+{
+    switch (stmt->kind())
+    {
+    case AST::NodeKind::EXPRESSION_STATEMENT:
+    {
+        auto exprStmt = AST::as<AST::ExpressionStatement>(stmt);
+        if (exprStmt->expression)
         {
-            return compileFunctionLiteral(functionLiteral);
+            return compileExpression(exprStmt->expression.get());
         }
-        if (auto callExpr = dynamic_cast<const AST::CallExpression*>(expr))
+        break;
+    }
+    case AST::NodeKind::LET_STATEMENT:
+        return compileLetStatement(AST::as<AST::LetStatement>(stmt));
+    default:
+        break;
+    }
+    return {};
+}
+
+llvm::Value* Compiler::requireInteger(const CompiledValue& compiled)
+{
+    if (compiled.value && compiled.isBoolean)
+    {
+        complete = false;
+    }
+    return compiled.value;
+}
+
+Compiler::CompiledValue Compiler::compileExpression(const AST::Expression *expr)
+{
+    try {
+        switch (expr->kind())
         {
-            return compileCallExpression(callExpr);
+        case AST::NodeKind::INTEGER_LITERAL:
+            return {compileIntegerLiteral(AST::as<AST::IntegerLiteral>(expr))};
+        case AST::NodeKind::INFIX_EXPRESSION:
+            return {compileInfixExpression(AST::as<AST::InfixExpression>(expr))};
+        case AST::NodeKind::PREFIX_EXPRESSION:
+            return compilePrefixExpression(AST::as<AST::PrefixExpression>(expr));
+        case AST::NodeKind::BOOLEAN_LITERAL:
+            return {compileBooleanLiteral(AST::as<AST::BooleanLiteral>(expr)), true};
+        case AST::NodeKind::IDENTIFIER:
+            return {compileIdentifier(AST::as<AST::Identifier>(expr))};
+        case AST::NodeKind::FUNCTION_LITERAL:
+            return {compileFunctionLiteral(AST::as<AST::FunctionLiteral>(expr))};
+        case AST::NodeKind::CALL_EXPRESSION:
+            return {compileCallExpression(AST::as<AST::CallExpression>(expr))};
+        default:
+            break;
         }
     } catch (...) {
-        return nullptr;
+        return {};
     }
-    return nullptr;
+    return {};
 }
 
 llvm::Value *Compiler::compileIntegerLiteral(const AST::IntegerLiteral *literal)
@@ -170,30 +570,34 @@ llvm::Value *Compiler::compileIntegerLiteral(const AST::IntegerLiteral *literal)
 
 llvm::Value *Compiler::compileInfixExpression(const AST::InfixExpression* infix)
 {
-    std::cout << "Compiling infix expression: " << infix->String() << std::endl;
+    TRACE_DEBUG("jit", "Compiling infix expression: " << infix->String());
     
     if (!infix || !infix->left || !infix->right)
     {
-        std::cout << "Invalid infix expression structure" << std::endl;
+        TRACE_WARN("jit", "Invalid infix expression structure");
         return nullptr;
     }
 
-    std::cout << "Compiling left operand..." << std::endl;
-    auto left = compileExpression(infix->left.get());
-    if (!left)
+    TRACE_DEBUG("jit", "Compiling left operand...");
+    auto compiledLeft = compileExpression(infix->left.get());
+    if (!compiledLeft.value)
     {
-        std::cout << "Left operand compilation failed" << std::endl;
+        TRACE_WARN("jit", "Left operand compilation failed");
         return nullptr;
     }
 
-    std::cout << "Compiling right operand..." << std::endl;
-    auto right = compileExpression(infix->right.get());
-    if (!right)
+    TRACE_DEBUG("jit", "Compiling right operand...");
+    auto compiledRight = compileExpression(infix->right.get());
+    if (!compiledRight.value)
     {
-        std::cout << "Right operand compilation failed" << std::endl;
+        TRACE_WARN("jit", "Right operand compilation failed");
         return nullptr;
     }
 
+    // 評価器では真偽値の算術はエラーになる
+    auto left = requireInteger(compiledLeft);
+    auto right = requireInteger(compiledRight);
+
     // 両オペランドの型を64ビット整数に変換
     if (left->getType()->isIntegerTy(1))
     {
@@ -204,63 +608,70 @@ llvm::Value *Compiler::compileInfixExpression(const AST::InfixExpression* infix)
         right = builder->CreateZExt(right, llvm::Type::getInt64Ty(*context));
     }
 
-    std::cout << "Creating operation: " << infix->op << std::endl;
-    if (infix->op == "+")
+    TRACE_DEBUG("jit", "Creating operation: " << AST::toString(infix->op));
+    switch (infix->op)
+    {
+    case AST::Operator::ADD:
     {
         auto result = builder->CreateAdd(left, right);
         result->setName("add");
         return result;
     }
-    else if (infix->op == "*")
+    case AST::Operator::MUL:
     {
         auto result = builder->CreateMul(left, right);
         result->setName("mul");
         return result;
     }
-    else if (infix->op == "-")
-    {
+    case AST::Operator::SUB:
         return builder->CreateSub(left, right, "subtmp");
-    }
-    else if (infix->op == "/")
+    case AST::Operator::DIV:
     {
-        return builder->CreateSDiv(left, right, "divtmp");
+        // ゼロ除算は評価器と同じくエラーにする（native.cppと同じく除算の前に分岐する）
+        auto int64Type = llvm::Type::getInt64Ty(*context);
+        auto constantDivisor = llvm::dyn_cast<llvm::ConstantInt>(right);
+        if (!constantDivisor || constantDivisor->isZero())
+        {
+            auto isZero = builder->CreateICmpEQ(right, llvm::ConstantInt::get(int64Type, 0));
+            auto divide = llvm::BasicBlock::Create(*context, "div", builder->GetInsertBlock()->getParent());
+            builder->CreateCondBr(isZero, runtimeFailure(), divide);
+            builder->SetInsertPoint(divide);
+        }
+        // INT64_MIN / -1はsdivではトラップするため、ラップアラウンドした結果（INT64_MIN / 1）で求める
+        auto isMin = builder->CreateICmpEQ(left, llvm::ConstantInt::get(int64Type, std::numeric_limits<int64_t>::min()));
+        auto isMinusOne = builder->CreateICmpEQ(right, llvm::ConstantInt::get(int64Type, -1, true));
+        auto divisor = builder->CreateSelect(builder->CreateAnd(isMin, isMinusOne), llvm::ConstantInt::get(int64Type, 1),
+                                             right);
+        return builder->CreateSDiv(left, divisor, "divtmp");
+    }
+    default:
+        break;
     }
 
-    std::cout << "Unknown operator: " << infix->op << std::endl;
+    TRACE_WARN("jit", "Unknown operator: " << AST::toString(infix->op));
     return nullptr;
 }
 
-llvm::Value* Compiler::compilePrefixExpression(const AST::PrefixExpression* prefix)
+Compiler::CompiledValue Compiler::compilePrefixExpression(const AST::PrefixExpression* prefix)
 {
     auto operand = compileExpression(prefix->right.get());
-    if (!operand) return nullptr;
+    if (!operand.value) return {};
 
-    if (prefix->op == "!")
+    if (prefix->op == AST::Operator::NOT)
     {
-        // 真偽値を反転
-        if (operand->getType()->isIntegerTy(1))
-        {
-            auto notResult = builder->CreateXor(operand, 
-                llvm::ConstantInt::get(operand->getType(), 1));
-            notResult->setName("not");
-            // i1をi64に拡張
-            return builder->CreateZExt(notResult, llvm::Type::getInt64Ty(*context));
-        }
-        else
+        // 評価器と同じく、真偽値は反転し、整数は真として扱う（!5も!0もfalse）
+        if (operand.isBoolean)
         {
-            // 64ビット整数を真偽値として扱う
-            auto isZero = builder->CreateICmpEQ(operand, 
-                llvm::ConstantInt::get(operand->getType(), 0));
-            isZero->setName("not");
-            // i1をi64に拡張
-            return builder->CreateZExt(isZero, llvm::Type::getInt64Ty(*context));
+            return {builder->CreateXor(operand.value, llvm::ConstantInt::get(operand.value->getType(), 1), "not"),
+                    true};
         }
+        return {llvm::ConstantInt::get(llvm::Type::getInt64Ty(*context), 0), true};
     }
-    else if (prefix->op == "-")
+    else if (prefix->op == AST::Operator::NEG)
     {
-        return builder->CreateNeg(operand, "negtmp");
+        return {builder->CreateNeg(requireInteger(operand), "negtmp")};
     }
-    return nullptr;
+    return {};
 }
 
 llvm::Value* Compiler::compileBooleanLiteral(const AST::BooleanLiteral* boolean)
@@ -274,8 +685,28 @@ llvm::Value* Compiler::compileIdentifier(const AST::Identifier* ident)
     auto it = namedValues.find(ident->value);
     if (it != namedValues.end())
     {
+        // 関数に束縛された名前は関数そのものを返す（呼び出し側で直接callする）
+        if (llvm::isa<llvm::Function>(it->second))
+        {
+            return it->second;
+        }
         return builder->CreateLoad(llvm::Type::getInt64Ty(*context), it->second, ident->value.c_str());
     }
+
+    // この行または以前の行でトップレベルに定義した名前
+    if (auto symbol = findSymbol(ident->value))
+    {
+        if (dependencies)
+        {
+            dependencies->insert(ident->value);
+        }
+        auto declared = declareSymbol(*symbol);
+        if (symbol->isFunction)
+        {
+            return declared;
+        }
+        return builder->CreateLoad(llvm::Type::getInt64Ty(*context), declared, ident->value.c_str());
+    }
     return nullptr;
 }
 
@@ -300,11 +731,11 @@ llvm::Function* Compiler::createFunction(const std::string& name,
     return f;
 }
 
-llvm::Value* Compiler::compileFunctionLiteral(const AST::FunctionLiteral* func)
+llvm::Value* Compiler::compileFunctionLiteral(const AST::FunctionLiteral* func, const std::string& name)
 {
     if (!func) return nullptr;
 
-    std::cout << "Compiling function literal..." << std::endl;
+    TRACE_DEBUG("jit", "Compiling function literal...");
 
     // パラメータ名を取得
     std::vector<std::string> argNames;
@@ -314,9 +745,8 @@ llvm::Value* Compiler::compileFunctionLiteral(const AST::FunctionLiteral* func)
         }
     }
     
-    // 関数名を生成
-    std::string funcName = "anonymous_func_" + std::to_string(
-        reinterpret_cast<std::uintptr_t>(func));
+    // 関数名を生成（セッション内で一意になるよう連番を使う）
+    std::string funcName = name.empty() ? "anonymous_func_" + std::to_string(functionCount++) : name;
     
     // パラメータの型を設定（すべてint64）
     std::vector<llvm::Type*> paramTypes(argNames.size(), 
@@ -347,7 +777,11 @@ llvm::Value* Compiler::compileFunctionLiteral(const AST::FunctionLiteral* func)
 
     // 現在のスコープを保存
     auto savedValues = namedValues;
+    auto savedTopLevel = atTopLevel;
+    auto savedFailure = failureBlock;
     namedValues.clear();
+    atTopLevel = false;
+    failureBlock = nullptr;
 
     // パラメータをアロケート
     for (auto& arg : function->args()) {
@@ -360,18 +794,27 @@ llvm::Value* Compiler::compileFunctionLiteral(const AST::FunctionLiteral* func)
     // 関数本体をコンパイル
     llvm::Value* bodyValue = nullptr;
     if (func->body) {
-        bodyValue = compileBlockStatement(func->body.get());  // .get()を使用
-        if (bodyValue) {
+        bodyValue = requireInteger(compileBlockStatement(func->body.get()));
+        if (bodyValue && bodyValue->getType()->isIntegerTy(64)) {
             builder->CreateRet(bodyValue);
         } else {
+            complete = false;
             builder->CreateRet(llvm::ConstantInt::get(*context, llvm::APInt(64, 0)));
         }
     } else {
         builder->CreateRet(llvm::ConstantInt::get(*context, llvm::APInt(64, 0)));
     }
 
+    // 実行時エラーで抜ける経路がなければ、呼び出し側はエラーを確認しなくてよい
+    // （再帰呼び出しは本体のコンパイル中にはまだ登録されていないため、常に確認する）
+    if (!failureBlock) {
+        infallibleFunctions.insert(funcName);
+    }
+
     // スコープを復元
     namedValues = std::move(savedValues);
+    atTopLevel = savedTopLevel;
+    failureBlock = savedFailure;
     
     // ビルダーの状態を復元
     if (savedBlock) {
@@ -382,7 +825,7 @@ llvm::Value* Compiler::compileFunctionLiteral(const AST::FunctionLiteral* func)
     std::string error;
     llvm::raw_string_ostream errorStream(error);
     if (llvm::verifyFunction(*function, &errorStream)) {
-        std::cout << "Function verification failed: " << error << std::endl;
+        TRACE_WARN("jit", "Function verification failed: " << error);
         function->eraseFromParent();
         return nullptr;
     }
@@ -410,14 +853,14 @@ std::string Compiler::getIR() const
 llvm::Value* Compiler::compileCallExpression(const AST::CallExpression* call)
 {
     // 関数のコンパイル
-    llvm::Value* callee = compileExpression(call->function.get());
+    llvm::Value* callee = compileExpression(call->function.get()).value;
     if (!callee) return nullptr;
 
     // 引数のコンパイル
     std::vector<llvm::Value*> args;
     for (const auto& arg : call->arguments)
     {
-        if (auto compiled = compileExpression(arg.get()))
+        if (auto compiled = requireInteger(compileExpression(arg.get())))
         {
             args.push_back(compiled);
         }
@@ -434,66 +877,199 @@ llvm::Value* Compiler::compileCallExpression(const AST::CallExpression* call)
         {
             return nullptr; // 引数の数が一致しない
         }
-        return builder->CreateCall(func, args, "calltmp");
+        // 関数の本体は後の行で名前が再束縛された後にも実行されるため、トップレベルの関数はスロットから呼ぶ
+        // （mainでは行の中のletの順にコンパイルするので、コンパイル時点の定義がそのまま呼び出し時点の定義になる）
+        if (!atTopLevel && call->function->kind() == AST::NodeKind::IDENTIFIER)
+        {
+            const auto& name = AST::as<AST::Identifier>(call->function.get())->value;
+            auto symbol = namedValues.count(name) ? nullptr : findSymbol(name);
+            if (symbol && symbol->isFunction)
+            {
+                return createSlotCall(*symbol, func, args);
+            }
+        }
+        auto result = builder->CreateCall(func, args, "calltmp");
+        propagateRuntimeError(func);
+        return result;
     }
 
     return nullptr;
 }
 
-void Compiler::compileLetStatement(const AST::LetStatement* let)
+llvm::Value* Compiler::createSlotCall(const SessionSymbol& symbol, llvm::Function* current,
+                                      const std::vector<llvm::Value*>& args)
+{
+    // 呼び出し時点のスロットがコンパイル時点の定義を指していれば直接呼ぶ（インライン展開の対象になる）
+    auto slotType = current->getType();
+    auto target = builder->CreateLoad(slotType, declareGlobal(symbol.slot, slotType), "target");
+    llvm::Function* function = builder->GetInsertBlock()->getParent();
+    auto directBB = llvm::BasicBlock::Create(*context, "direct", function);
+    auto indirectBB = llvm::BasicBlock::Create(*context, "indirect", function);
+    auto mergeBB = llvm::BasicBlock::Create(*context, "called", function);
+    builder->CreateCondBr(builder->CreateICmpEQ(target, current), directBB, indirectBB);
+
+    builder->SetInsertPoint(directBB);
+    auto directResult = builder->CreateCall(current, args, "calltmp");
+    propagateRuntimeError(current);
+    auto directEnd = builder->GetInsertBlock();
+    builder->CreateBr(mergeBB);
+
+    // 再束縛された定義が実行時エラーを起こすかはコンパイル時に分からないため、常にフラグを確認する
+    builder->SetInsertPoint(indirectBB);
+    auto indirectResult = builder->CreateCall(current->getFunctionType(), target, args, "calltmp");
+    propagateRuntimeError(nullptr);
+    auto indirectEnd = builder->GetInsertBlock();
+    builder->CreateBr(mergeBB);
+
+    builder->SetInsertPoint(mergeBB);
+    auto phi = builder->CreatePHI(directResult->getType(), 2, "callresult");
+    phi->addIncoming(directResult, directEnd);
+    phi->addIncoming(indirectResult, indirectEnd);
+    return phi;
+}
+
+Compiler::CompiledValue Compiler::compileLetStatement(const AST::LetStatement* let)
 {
     if (!let || !let->name || !let->value) {
-        std::cout << "Invalid let statement" << std::endl;
-        return;
+        TRACE_WARN("jit", "Invalid let statement");
+        complete = false;
+        return {};
+    }
+
+    if (atTopLevel) {
+        return compileTopLevelLet(let);
     }
 
-    std::cout << "Compiling let statement value..." << std::endl;
+    TRACE_DEBUG("jit", "Compiling let statement value...");
     
     // 値の評価
-    llvm::Value* value = compileExpression(let->value.get());
+    auto compiled = compileExpression(let->value.get());
+    llvm::Value* value = requireInteger(compiled);
     if (!value) {
-        std::cout << "Failed to compile value" << std::endl;
-        return;
+        TRACE_WARN("jit", "Failed to compile value");
+        complete = false;
+        return {};
     }
 
     // 現在の関数を取得
     llvm::Function* function = builder->GetInsertBlock()->getParent();
     if (!function) {
-        std::cout << "No current function" << std::endl;
-        return;
+        TRACE_WARN("jit", "No current function");
+        return {};
     }
 
-    // 変数のアロケーション
-    llvm::AllocaInst* alloca = nullptr;
+    // 関数の場合は名前を関数に直接束縛する
     if (llvm::isa<llvm::Function>(value)) {
-        // 関数ポインタの場合
-        auto funcType = llvm::cast<llvm::Function>(value)->getFunctionType();
-        alloca = builder->CreateAlloca(funcType->getPointerTo(), nullptr, let->name->value);
-    } else {
-        // 通常の値の場合
-        alloca = createEntryBlockAlloca(function, let->name->value);
+        namedValues[let->name->value] = value;
+        return compiled;
     }
+
+    // 変数のアロケーション
+    llvm::AllocaInst* alloca = createEntryBlockAlloca(function, let->name->value);
     
     // 値の格納
     builder->CreateStore(value, alloca);
     namedValues[let->name->value] = alloca;
+    return compiled;
+}
+
+Compiler::CompiledValue Compiler::compileTopLevelLet(const AST::LetStatement* let)
+{
+    const auto& name = let->name->value;
+    // 再束縛の前の定義（種類や引数の数が変わる場合は、依存する関数をJITで扱わないようにする）
+    auto found = findSymbol(name);
+    auto previousBinding = found ? std::optional<SessionSymbol>(*found) : std::nullopt;
+
+    // 関数の定義はセッションの名前付き関数にする
+    if (let->value->kind() == AST::NodeKind::FUNCTION_LITERAL) {
+        auto func = AST::as<AST::FunctionLiteral>(let->value.get());
+        auto source = func->String();
+
+        // 同じ名前で同じ定義が既にあれば再コンパイルしない
+        if (previousBinding && previousBinding->isFunction && previousBinding->source == source) {
+            TRACE_DEBUG("jit", "Reusing unchanged definition of " << name);
+            setPendingSymbol(name, *previousBinding);
+            auto function = llvm::cast<llvm::Function>(declareSymbol(*previousBinding));
+            builder->CreateStore(function, declareGlobal(previousBinding->slot, function->getType()));
+            return {function};
+        }
+
+        // 本体から自分自身を呼べるように、先に名前を登録してからコンパイルする
+        SessionSymbol symbol;
+        symbol.symbol = "monkey_fn_" + name + "_" + std::to_string(functionCount++);
+        symbol.isFunction = true;
+        symbol.arity = static_cast<unsigned>(func->parameters.size());
+        symbol.source = source;
+        symbol.slot = "monkey_slot_" + name;
+        auto definition = std::make_shared<AST::Program>();
+        definition->statements.emplace_back(let->clone());
+        symbol.definition = std::move(definition);
+        auto previous = pendingSymbols.find(name) != pendingSymbols.end()
+                            ? std::optional<SessionSymbol>(pendingSymbols[name])
+                            : std::nullopt;
+        setPendingSymbol(name, symbol);
+
+        std::unordered_set<std::string> referenced;
+        auto savedDependencies = dependencies;
+        dependencies = &referenced;
+        auto function = llvm::cast_or_null<llvm::Function>(compileFunctionLiteral(func, symbol.symbol));
+        dependencies = savedDependencies;
+        if (!function) {
+            TRACE_WARN("jit", "Failed to compile function " << name);
+            pendingChanges.pop_back();
+            if (previous) {
+                pendingSymbols[name] = *previous;
+            } else {
+                pendingSymbols.erase(name);
+            }
+            complete = false;
+            return {};
+        }
+
+        symbol.dependencies = std::move(referenced);
+        pendingSymbols[name] = symbol;
+        pendingChanges.back().symbol = std::move(symbol);
+        if (previousBinding && (!previousBinding->isFunction || previousBinding->arity != pendingSymbols[name].arity)) {
+            invalidateDependents(name);
+        }
+        builder->CreateStore(function, declareGlobal(pendingSymbols[name].slot, function->getType()));
+        return {function};
+    }
+
+    // 値はセッションのグローバル変数に格納する
+    auto compiled = compileExpression(let->value.get());
+    llvm::Value* value = requireInteger(compiled);
+    if (!value || !value->getType()->isIntegerTy(64)) {
+        TRACE_WARN("jit", "Failed to compile value");
+        complete = false;
+        return {};
+    }
+
+    SessionSymbol symbol;
+    symbol.symbol = "monkey_global_" + name;
+    setPendingSymbol(name, symbol);
+    if (previousBinding && previousBinding->isFunction) {
+        invalidateDependents(name);
+    }
+    builder->CreateStore(value, declareSymbol(symbol));
+    return compiled;
 }
 
-llvm::Value* Compiler::compileBlockStatement(const AST::BlockStatement* block)
+Compiler::CompiledValue Compiler::compileBlockStatement(const AST::BlockStatement* block)
 {
-    llvm::Value* lastValue = nullptr;
+    CompiledValue last;
     for (const auto& stmt : block->statements)
     {
-        lastValue = compileStatement(stmt.get());
-        if (!lastValue) return nullptr;
+        last = compileStatement(stmt.get());
+        if (!last.value) return {};
     }
-    return lastValue;
+    return last;
 }
 
 llvm::Value* Compiler::compileIfExpression(const AST::IfExpression* ifExpr)
 {
     // 条件式のコンパイル
-    auto condition = compileExpression(ifExpr->getCondition());
+    auto condition = compileExpression(ifExpr->getCondition()).value;
     if (!condition) return nullptr;
 
     // 現在の関数を取得
@@ -511,7 +1087,7 @@ llvm::Value* Compiler::compileIfExpression(const AST::IfExpression* ifExpr)
 
     // then部分のコンパイル
     builder->SetInsertPoint(thenBB);
-    auto thenVal = compileBlockStatement(ifExpr->getConsequence());
+    auto thenVal = compileBlockStatement(ifExpr->getConsequence()).value;
     if (!thenVal) return nullptr;
     builder->CreateBr(mergeBB);
 
@@ -519,7 +1095,7 @@ llvm::Value* Compiler::compileIfExpression(const AST::IfExpression* ifExpr)
     llvm::Value* elseVal = nullptr;
     if (elseBB) {
         builder->SetInsertPoint(elseBB);
-        elseVal = compileBlockStatement(ifExpr->getAlternative());
+        elseVal = compileBlockStatement(ifExpr->getAlternative()).value;
         if (!elseVal) return nullptr;
         builder->CreateBr(mergeBB);
     }
@@ -552,13 +1128,13 @@ llvm::Value* Compiler::compileWhileExpression(const AST::WhileExpression* whileE
 
     // 条件式のコンパイル
     builder->SetInsertPoint(condBB);
-    auto condition = compileExpression(whileExpr->getCondition());
+    auto condition = compileExpression(whileExpr->getCondition()).value;
     if (!condition) return nullptr;
     builder->CreateCondBr(condition, loopBB, afterBB);
 
     // ループ本体のコンパイル
     builder->SetInsertPoint(loopBB);
-    auto bodyVal = compileBlockStatement(whileExpr->getBody());
+    auto bodyVal = compileBlockStatement(whileExpr->getBody()).value;
     if (!bodyVal) return nullptr;
     builder->CreateBr(condBB);
 
@@ -1,5 +1,8 @@
 #pragma once
 #include "../ast/ast.hpp"
+#include "../object/object.hpp"
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
@@ -7,6 +10,7 @@
 #include <llvm/Passes/PassBuilder.h>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <llvm/IR/Verifier.h>
 
 namespace JIT
@@ -14,52 +18,173 @@ namespace JIT
 
 class Compiler
 {
+  public:
+    // execute()で確定したトップレベルの束縛
+    // 整数は値を、関数は評価器で評価し直すための定義（letの文だけを含むプログラム）を持つ
+    struct Binding
+    {
+        std::string name;
+        monkey::ObjectPtr value;
+        std::shared_ptr<const AST::Program> definition;
+    };
+
   private:
-    std::unique_ptr<llvm::LLVMContext> context;
+    // コンテキストはORCに渡すモジュールと共有するためThreadSafeContextで所有する
+    llvm::orc::ThreadSafeContext threadSafeContext;
+    llvm::LLVMContext* context;
     std::unique_ptr<llvm::IRBuilder<>> builder;
     std::unique_ptr<llvm::Module> module;
-    llvm::ModulePassManager passManager;
-    llvm::FunctionPassManager functionPassManager;
+    // 最適化パイプライン（setOptimizationLevelで構築し、compileの検証後に実行する）
+    unsigned optimizationLevel = 0;
+    llvm::PassBuilder passBuilder;
+    llvm::LoopAnalysisManager loopAnalysisManager;
+    llvm::FunctionAnalysisManager functionAnalysisManager;
+    llvm::CGSCCAnalysisManager cgsccAnalysisManager;
     llvm::ModuleAnalysisManager moduleAnalysisManager;
+    llvm::ModulePassManager passManager;
     
-    // シンボルテーブル
+    // シンボルテーブル（関数内のローカル変数と、その行で関数に束縛した名前）
     std::unordered_map<std::string, llvm::Value*> namedValues;
+
+    // REPLの行をまたいで保持する定義
+    // トップレベルのletで束縛した値はグローバル変数、関数は名前付きの関数としてセッションのJITDylibに常駐させる
+    // 関数の本体からトップレベルの関数を呼ぶ場合は、名前ごとのスロット（関数ポインタのグローバル変数）を経由する。
+    // letはスロットを書き換えるため、後の行で名前を再束縛すると既存の関数からの呼び出しも新しい定義に向かう（評価器と同じ）
+    struct SessionSymbol
+    {
+        std::string symbol;      // JITDylib内のシンボル名
+        bool isFunction = false;
+        unsigned arity = 0;
+        std::string source;      // 関数の場合は定義のソース（同じ定義の再コンパイルを省略するため）
+        std::string slot;        // 関数の場合は名前のスロットのシンボル名
+        std::unordered_set<std::string> dependencies; // 関数の本体が参照するトップレベルの名前
+        std::shared_ptr<const AST::Program> definition; // 関数の場合は定義のletの文だけを含むプログラム
+        bool removed = false;    // JITでは扱えなくなった名前（execute()でセッションから取り除く）
+    };
+    std::unordered_map<std::string, SessionSymbol> sessionSymbols; // 実行済みの行で確定した定義
+    std::unordered_map<std::string, SessionSymbol> pendingSymbols; // compile()中の行の定義（execute()で確定）
+    // pendingSymbolsへの変更を行の中の順に記録したもの（何番目のletによる変更か）
+    // 行が実行時エラーで中断した場合は、実行を終えたletの分だけ確定する（評価器と同じ）
+    struct PendingChange
+    {
+        unsigned let;
+        std::string name;
+        SessionSymbol symbol;
+    };
+    std::vector<PendingChange> pendingChanges;
+    unsigned letCount = 0;                          // コンパイル中の行のトップレベルのletの数
+    std::unordered_set<std::string>* dependencies = nullptr; // コンパイル中の関数が参照する名前の記録先
+    std::unordered_set<std::string> definedGlobals; // セッションで定義済みのグローバル変数
+    std::vector<Binding> bindings;                  // 直前のexecute()で確定した束縛
+    llvm::orc::JITDylib* sessionDylib = nullptr;
+    unsigned lineCount = 0;
+    unsigned functionCount = 0;
+    std::string mainName;
+    bool atTopLevel = true; // mainの本体をコンパイル中かどうか
     // 現在のコンパイル中の関数
     llvm::Function* currentFunction;
+    // 実行時エラー（ゼロ除算）で関数を抜けるブロック（関数ごとに最初に必要になった時点で作成）
+    llvm::BasicBlock* failureBlock = nullptr;
+    // 実行時エラーを起こさないことが分かっている関数のシンボル名（呼び出し後のフラグの確認を省く）
+    std::unordered_set<std::string> infallibleFunctions;
+    // 直前のcompile()ですべての文をネイティブコードに変換できたかどうか
+    bool complete = false;
+    // コンパイルした式の値と、評価器での型
+    // 真偽値もi64（0か1）で表すため、値からは整数と区別できない（定数は同じ値で共有される）
+    // 真偽値を整数として使う箇所（算術・引数・束縛・関数の戻り値）は評価器と結果が変わるので未対応として扱う
+    struct CompiledValue
+    {
+        llvm::Value* value = nullptr;
+        bool isBoolean = false;
+    };
+    bool resultIsBoolean = false; // mainの戻り値が真偽値かどうか
+    // 行の最後の文が関数を束縛するletの場合、その関数リテラルの複製（execute()で関数オブジェクトとして返す）
+    std::shared_ptr<const AST::FunctionLiteral> resultFunction;
+
+    // 生成したモジュールを実行するORC JIT（最初に必要になった時点で作成）
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+    unsigned nativeCount = 0; // ネイティブ関数の名前を一意にするための連番
 
     // 新しいメソッドの宣言を追加
     llvm::Value* compileIfExpression(const AST::IfExpression* ifExpr);
     llvm::Value* compileWhileExpression(const AST::WhileExpression* whileExpr);
-    llvm::Value* compileBlockStatement(const AST::BlockStatement* block);
+    CompiledValue compileBlockStatement(const AST::BlockStatement* block);
 
   public:
     Compiler();
     ~Compiler() = default;
 
     void compile(const AST::Program& program);
+    // 0〜3の最適化レベルを設定する（3より大きい値は3として扱う）
     void setOptimizationLevel(unsigned level);
+    unsigned getOptimizationLevel() const { return optimizationLevel; }
+
+    // 直前にコンパイルしたモジュールをセッションのJITDylibに追加して実行し、mainの戻り値を返す
+    // 評価器と同じく、最後の文の値（letの場合は束縛した値）を返す
+    // 実行中にゼロ除算が起きた場合は、評価器と同じくErrorを返す（その行の定義は確定しない）
+    // 実行した行の定義は以降のcompile()から参照できる
+    // JITの初期化やシンボル解決に失敗した場合はstd::runtime_errorを送出する
+    monkey::ObjectPtr execute();
+    // 直前のexecute()で確定した束縛（REPLがインタプリタの環境に引き継ぐ）
+    const std::vector<Binding>& committedBindings() const { return bindings; }
+    // インタプリタなど他の実行方式で名前が束縛されたことを伝える
+    // 値のグローバル変数に整数を束縛した場合はその値を書き込み、それ以外はその名前と依存する関数をJITで扱わないようにする
+    void rebind(const std::string& name, const monkey::ObjectPtr& value);
+    // 直前のcompile()で未対応の構文がなく、execute()の結果（整数・真偽値・エラー）が評価器と一致するかどうか
+    bool isComplete() const { return complete; }
+
+    // 整数だけを扱う関数本体をネイティブコードに変換する（評価器の階層型実行から呼ばれる）
+    // 評価器と同じ結果を保証できない構文を含む場合はnullptrを返す
+    monkey::NativeFunction compileNativeFunction(const std::vector<std::string>& parameters,
+                                                 const AST::BlockStatement& body);
     
     // IRの文字列表現を取得
     std::string getIR() const;
 
   private:
     void initializeOptimizations(unsigned level);
-    void runOptimizations();
+    void runOptimizations(llvm::Module& target);
+    llvm::orc::LLJIT& ensureJIT();
+    llvm::orc::JITDylib& ensureSession();
+    // セッションのグローバル変数のアドレス
+    int64_t* globalAddress(const std::string& symbol);
+    const SessionSymbol* findSymbol(const std::string& name) const;
+    void setPendingSymbol(const std::string& name, SessionSymbol symbol);
+    // 行の先頭からcompletedLets個のletによる定義を確定する
+    void commitPendingChanges(unsigned completedLets);
+    // 名前の種類（関数か値か）や関数の引数の数が変わる場合、その名前に依存する関数をJITでは扱わないようにする
+    void invalidateDependents(const std::string& name);
+    llvm::Value* declareSymbol(const SessionSymbol& symbol);
+    // セッションのグローバル変数を宣言する（最初に使った行のモジュールで0またはnullに初期化して定義する）
+    llvm::GlobalVariable* declareGlobal(const std::string& symbol, llvm::Type* type);
+    // スロットを経由してトップレベルの関数を呼ぶ
+    llvm::Value* createSlotCall(const SessionSymbol& symbol, llvm::Function* current, const std::vector<llvm::Value*>& args);
+    // 実行時エラーのフラグ（セッションのグローバル変数）
+    llvm::GlobalVariable* runtimeErrorFlag();
+    // 実行時エラーのフラグを立てて現在の関数を抜けるブロック
+    llvm::BasicBlock* runtimeFailure();
+    // 呼び出した関数で実行時エラーが起きていれば、現在の関数も抜ける（エラーを起こさない関数の呼び出しでは何もしない）
+    void propagateRuntimeError(const llvm::Function* callee);
+
+    // 整数が必要な箇所に真偽値が渡された場合は、行を未対応にする
+    llvm::Value* requireInteger(const CompiledValue& compiled);
 
-    llvm::Value* compileExpression(const AST::Expression* expr);
-    llvm::Value* compileStatement(const AST::Statement* stmt);
+    CompiledValue compileExpression(const AST::Expression* expr);
+    CompiledValue compileStatement(const AST::Statement* stmt);
     
     // 新しいコンパイルメソッド
     llvm::Value* compileIntegerLiteral(const AST::IntegerLiteral* literal);
     llvm::Value* compileInfixExpression(const AST::InfixExpression* infix);
-    llvm::Value* compilePrefixExpression(const AST::PrefixExpression* prefix);
+    CompiledValue compilePrefixExpression(const AST::PrefixExpression* prefix);
     llvm::Value* compileIdentifier(const AST::Identifier* ident);
-    llvm::Value* compileFunctionLiteral(const AST::FunctionLiteral* func);
+    llvm::Value* compileFunctionLiteral(const AST::FunctionLiteral* func, const std::string& name = "");
     llvm::Value* compileCallExpression(const AST::CallExpression* call);
     llvm::Value* compileBooleanLiteral(const AST::BooleanLiteral* boolean);
     
     // 文のコンパイル
-    void compileLetStatement(const AST::LetStatement* let);
+    // 評価器と同じく束縛した値を返す（関数の場合はllvm::Function）
+    CompiledValue compileLetStatement(const AST::LetStatement* let);
+    CompiledValue compileTopLevelLet(const AST::LetStatement* let);
     void compileReturnStatement(const AST::ReturnStatement* ret);
     void compileExpressionStatement(const AST::ExpressionStatement* expr);
     
@@ -0,0 +1,534 @@
+#include "jit.hpp"
+#include "../trace/trace.hpp"
+#include <limits>
+#include <unordered_set>
+
+namespace JIT
+{
+
+namespace
+{
+
+// 階層型実行用に、整数だけを扱う関数本体をLLVM IRに変換するクラス
+// 生成する関数のシグネチャは i1 (i64* args, i64* out) で、monkey::NativeFunctionに対応する
+// 評価器と結果が一致しない可能性のある構文（文字列・配列・関数呼び出し・外側の変数など）を含む場合は変換を中止する
+class NativeLowering
+{
+  public:
+    NativeLowering(llvm::LLVMContext &context, llvm::Module &module) : context(context), module(module), builder(context)
+    {
+    }
+
+    llvm::Function *lower(const std::string &name, const std::vector<std::string> &parameters,
+                          const AST::BlockStatement &body);
+
+  private:
+    // 式の静的な型（NONEは評価器でnullになる値、または値を持たない式）
+    enum class Kind
+    {
+        NONE,
+        INT,
+        BOOL
+    };
+
+    struct Typed
+    {
+        llvm::Value *value = nullptr;
+        Kind kind = Kind::NONE;
+    };
+
+    llvm::LLVMContext &context;
+    llvm::Module &module;
+    llvm::IRBuilder<> builder;
+    llvm::Function *function = nullptr;
+    llvm::BasicBlock *bailout = nullptr; // ゼロ除算などでfalseを返すブロック
+    llvm::Value *out = nullptr;
+
+    std::unordered_map<std::string, llvm::AllocaInst *> locals;
+    // ブロックごとの参照可能な名前（内側のブロックで定義した名前は外側から参照させない）
+    std::vector<std::unordered_set<std::string>> scopes;
+    bool reachable = true; // 現在の挿入位置が到達可能かどうか
+    bool failed = false;
+
+    llvm::Type *int64Type()
+    {
+        return llvm::Type::getInt64Ty(context);
+    }
+
+    Typed fail()
+    {
+        failed = true;
+        return {};
+    }
+
+    bool isVisible(const std::string &name) const;
+    llvm::AllocaInst *localFor(const std::string &name);
+    void startDeadBlock();
+
+    Typed lowerBlock(const AST::BlockStatement &block);
+    Typed lowerStatement(const AST::Statement *stmt);
+    Typed lowerExpression(const AST::Expression *expr);
+    Typed lowerPrefix(const AST::PrefixExpression *prefix);
+    Typed lowerInfix(const AST::InfixExpression *infix);
+    Typed lowerIf(const AST::IfExpression *ifExpr);
+    Typed lowerWhile(const AST::WhileExpression *whileExpr);
+    llvm::Value *lowerCondition(const AST::Expression *expr);
+};
+
+llvm::Function *NativeLowering::lower(const std::string &name, const std::vector<std::string> &parameters,
+                                      const AST::BlockStatement &body)
+{
+    auto pointerType = int64Type()->getPointerTo();
+    auto functionType =
+        llvm::FunctionType::get(llvm::Type::getInt1Ty(context), {pointerType, pointerType}, false);
+    function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, name, module);
+    auto args = function->getArg(0);
+    out = function->getArg(1);
+    args->setName("args");
+    out->setName("out");
+
+    auto entry = llvm::BasicBlock::Create(context, "entry", function);
+    bailout = llvm::BasicBlock::Create(context, "bailout", function);
+    builder.SetInsertPoint(bailout);
+    builder.CreateRet(llvm::ConstantInt::getFalse(context));
+
+    // 引数を配列から読み出してローカル変数に格納する
+    builder.SetInsertPoint(entry);
+    scopes.emplace_back();
+    for (size_t i = 0; i < parameters.size(); i++)
+    {
+        auto pointer = builder.CreateConstInBoundsGEP1_64(int64Type(), args, i);
+        auto value = builder.CreateLoad(int64Type(), pointer, parameters[i]);
+        builder.CreateStore(value, localFor(parameters[i]));
+        scopes.back().insert(parameters[i]);
+    }
+
+    auto result = lowerBlock(body);
+    if (!failed && reachable)
+    {
+        // 最後の文の値が関数の戻り値になる（整数以外は評価器と同じ結果を返せない）
+        if (result.kind != Kind::INT)
+        {
+            fail();
+        }
+        else
+        {
+            builder.CreateStore(result.value, out);
+            builder.CreateRet(llvm::ConstantInt::getTrue(context));
+        }
+    }
+
+    if (failed)
+    {
+        function->eraseFromParent();
+        return nullptr;
+    }
+
+    // return文の後に作った到達不能なブロックを閉じる
+    for (auto &block : *function)
+    {
+        if (!block.getTerminator())
+        {
+            builder.SetInsertPoint(&block);
+            builder.CreateUnreachable();
+        }
+    }
+    return function;
+}
+
+bool NativeLowering::isVisible(const std::string &name) const
+{
+    for (const auto &scope : scopes)
+    {
+        if (scope.count(name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+llvm::AllocaInst *NativeLowering::localFor(const std::string &name)
+{
+    auto it = locals.find(name);
+    if (it != locals.end())
+    {
+        return it->second;
+    }
+    // ローカル変数はエントリーブロックの先頭に確保する（mem2regで昇格できるように）
+    llvm::IRBuilder<> entryBuilder(&function->getEntryBlock(), function->getEntryBlock().begin());
+    auto alloca = entryBuilder.CreateAlloca(int64Type(), nullptr, name);
+    locals.emplace(name, alloca);
+    return alloca;
+}
+
+void NativeLowering::startDeadBlock()
+{
+    reachable = false;
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "dead", function));
+}
+
+NativeLowering::Typed NativeLowering::lowerBlock(const AST::BlockStatement &block)
+{
+    // 評価器は空のブロックをエラーとして扱う
+    if (block.statements.empty())
+    {
+        return fail();
+    }
+
+    Typed last;
+    for (const auto &stmt : block.statements)
+    {
+        if (!stmt)
+        {
+            return fail();
+        }
+        last = lowerStatement(stmt.get());
+        if (failed)
+        {
+            return {};
+        }
+    }
+    return last;
+}
+
+NativeLowering::Typed NativeLowering::lowerStatement(const AST::Statement *stmt)
+{
+    switch (stmt->kind())
+    {
+    case AST::NodeKind::EXPRESSION_STATEMENT:
+    {
+        auto exprStmt = AST::as<AST::ExpressionStatement>(stmt);
+        if (!exprStmt->expression)
+        {
+            return fail();
+        }
+        return lowerExpression(exprStmt->expression.get());
+    }
+    case AST::NodeKind::LET_STATEMENT:
+    {
+        // let文の値は束縛した値になる
+        auto let = AST::as<AST::LetStatement>(stmt);
+        if (!let->name || !let->value)
+        {
+            return fail();
+        }
+        auto value = lowerExpression(let->value.get());
+        if (failed || value.kind != Kind::INT)
+        {
+            return fail();
+        }
+        builder.CreateStore(value.value, localFor(let->name->value));
+        scopes.back().insert(let->name->value);
+        return value;
+    }
+    case AST::NodeKind::RETURN_STATEMENT:
+    {
+        auto ret = AST::as<AST::ReturnStatement>(stmt);
+        if (!ret->returnValue)
+        {
+            return fail();
+        }
+        auto value = lowerExpression(ret->returnValue.get());
+        if (failed || value.kind != Kind::INT)
+        {
+            return fail();
+        }
+        builder.CreateStore(value.value, out);
+        builder.CreateRet(llvm::ConstantInt::getTrue(context));
+        startDeadBlock();
+        return {llvm::UndefValue::get(int64Type()), Kind::INT};
+    }
+    default:
+        return fail();
+    }
+}
+
+NativeLowering::Typed NativeLowering::lowerExpression(const AST::Expression *expr)
+{
+    switch (expr->kind())
+    {
+    case AST::NodeKind::INTEGER_LITERAL:
+        return {llvm::ConstantInt::get(int64Type(), AST::as<AST::IntegerLiteral>(expr)->value, true), Kind::INT};
+    case AST::NodeKind::BOOLEAN_LITERAL:
+        return {llvm::ConstantInt::getBool(context, AST::as<AST::BooleanLiteral>(expr)->value), Kind::BOOL};
+    case AST::NodeKind::IDENTIFIER:
+    {
+        // 引数と関数内で先に定義したローカル変数のみ参照できる（グローバルや外側の変数は変換しない）
+        auto ident = AST::as<AST::Identifier>(expr);
+        if (!isVisible(ident->value))
+        {
+            return fail();
+        }
+        return {builder.CreateLoad(int64Type(), localFor(ident->value), ident->value), Kind::INT};
+    }
+    case AST::NodeKind::PREFIX_EXPRESSION:
+        return lowerPrefix(AST::as<AST::PrefixExpression>(expr));
+    case AST::NodeKind::INFIX_EXPRESSION:
+        return lowerInfix(AST::as<AST::InfixExpression>(expr));
+    case AST::NodeKind::IF_EXPRESSION:
+        return lowerIf(AST::as<AST::IfExpression>(expr));
+    case AST::NodeKind::WHILE_EXPRESSION:
+        return lowerWhile(AST::as<AST::WhileExpression>(expr));
+    default:
+        return fail();
+    }
+}
+
+NativeLowering::Typed NativeLowering::lowerPrefix(const AST::PrefixExpression *prefix)
+{
+    if (!prefix->right)
+    {
+        return fail();
+    }
+    auto operand = lowerExpression(prefix->right.get());
+    if (failed)
+    {
+        return {};
+    }
+
+    if (prefix->op == AST::Operator::NEG && operand.kind == Kind::INT)
+    {
+        return {builder.CreateNeg(operand.value, "neg"), Kind::INT};
+    }
+    if (prefix->op == AST::Operator::NOT && operand.kind == Kind::BOOL)
+    {
+        return {builder.CreateNot(operand.value, "not"), Kind::BOOL};
+    }
+    return fail();
+}
+
+NativeLowering::Typed NativeLowering::lowerInfix(const AST::InfixExpression *infix)
+{
+    if (!infix->left || !infix->right)
+    {
+        return fail();
+    }
+    auto left = lowerExpression(infix->left.get());
+    if (failed)
+    {
+        return {};
+    }
+    auto right = lowerExpression(infix->right.get());
+    if (failed)
+    {
+        return {};
+    }
+
+    if (left.kind == Kind::INT && right.kind == Kind::INT)
+    {
+        switch (infix->op)
+        {
+        case AST::Operator::ADD:
+            return {builder.CreateAdd(left.value, right.value, "add"), Kind::INT};
+        case AST::Operator::SUB:
+            return {builder.CreateSub(left.value, right.value, "sub"), Kind::INT};
+        case AST::Operator::MUL:
+            return {builder.CreateMul(left.value, right.value, "mul"), Kind::INT};
+        case AST::Operator::DIV:
+        {
+            // ゼロ除算はインタプリタに任せる（エラーはインタプリタが作る）
+            auto isZero = builder.CreateICmpEQ(right.value, llvm::ConstantInt::get(int64Type(), 0));
+            auto divide = llvm::BasicBlock::Create(context, "div", function);
+            builder.CreateCondBr(isZero, bailout, divide);
+            builder.SetInsertPoint(divide);
+            // INT64_MIN / -1はsdivではトラップするため、評価器と同じくラップアラウンドした結果（INT64_MIN / 1）で求める
+            auto isMin =
+                builder.CreateICmpEQ(left.value, llvm::ConstantInt::get(int64Type(), std::numeric_limits<int64_t>::min()));
+            auto isMinusOne = builder.CreateICmpEQ(right.value, llvm::ConstantInt::get(int64Type(), -1, true));
+            auto divisor = builder.CreateSelect(builder.CreateAnd(isMin, isMinusOne),
+                                                llvm::ConstantInt::get(int64Type(), 1), right.value);
+            return {builder.CreateSDiv(left.value, divisor, "div"), Kind::INT};
+        }
+        case AST::Operator::LT:
+            return {builder.CreateICmpSLT(left.value, right.value, "lt"), Kind::BOOL};
+        case AST::Operator::GT:
+            return {builder.CreateICmpSGT(left.value, right.value, "gt"), Kind::BOOL};
+        case AST::Operator::EQ:
+            return {builder.CreateICmpEQ(left.value, right.value, "eq"), Kind::BOOL};
+        case AST::Operator::NOT_EQ:
+            return {builder.CreateICmpNE(left.value, right.value, "ne"), Kind::BOOL};
+        default:
+            return fail();
+        }
+    }
+
+    if (left.kind == Kind::BOOL && right.kind == Kind::BOOL)
+    {
+        // 評価器と同じく両辺を評価してから比較する
+        if (infix->op == AST::Operator::EQ)
+            return {builder.CreateICmpEQ(left.value, right.value, "eq"), Kind::BOOL};
+        if (infix->op == AST::Operator::NOT_EQ)
+            return {builder.CreateICmpNE(left.value, right.value, "ne"), Kind::BOOL};
+    }
+    return fail();
+}
+
+llvm::Value *NativeLowering::lowerCondition(const AST::Expression *expr)
+{
+    auto condition = lowerExpression(expr);
+    if (failed)
+    {
+        return nullptr;
+    }
+    switch (condition.kind)
+    {
+    case Kind::BOOL:
+        return condition.value;
+    case Kind::INT:
+        // 評価器では0以外の整数が真になる
+        return builder.CreateICmpNE(condition.value, llvm::ConstantInt::get(int64Type(), 0), "truthy");
+    default:
+        fail();
+        return nullptr;
+    }
+}
+
+NativeLowering::Typed NativeLowering::lowerIf(const AST::IfExpression *ifExpr)
+{
+    if (!ifExpr->getCondition() || !ifExpr->getConsequence())
+    {
+        return fail();
+    }
+    auto condition = lowerCondition(ifExpr->getCondition());
+    if (!condition)
+    {
+        return {};
+    }
+
+    auto thenBlock = llvm::BasicBlock::Create(context, "then", function);
+    auto elseBlock = llvm::BasicBlock::Create(context, "else", function);
+    auto mergeBlock = llvm::BasicBlock::Create(context, "ifcont", function);
+    builder.CreateCondBr(condition, thenBlock, elseBlock);
+
+    // then節
+    builder.SetInsertPoint(thenBlock);
+    scopes.emplace_back();
+    auto thenValue = lowerBlock(*ifExpr->getConsequence());
+    scopes.pop_back();
+    if (failed)
+    {
+        return {};
+    }
+    bool thenReachable = reachable;
+    auto thenEnd = builder.GetInsertBlock();
+    builder.CreateBr(mergeBlock);
+
+    // else節（ない場合の値はnull）
+    reachable = true;
+    builder.SetInsertPoint(elseBlock);
+    Typed elseValue;
+    if (ifExpr->getAlternative())
+    {
+        scopes.emplace_back();
+        elseValue = lowerBlock(*ifExpr->getAlternative());
+        scopes.pop_back();
+        if (failed)
+        {
+            return {};
+        }
+    }
+    bool elseReachable = reachable;
+    auto elseEnd = builder.GetInsertBlock();
+    builder.CreateBr(mergeBlock);
+
+    builder.SetInsertPoint(mergeBlock);
+    reachable = thenReachable || elseReachable;
+
+    if (thenValue.kind == Kind::NONE || thenValue.kind != elseValue.kind)
+    {
+        return {};
+    }
+    auto phi = builder.CreatePHI(thenValue.value->getType(), 2, "iftmp");
+    phi->addIncoming(thenValue.value, thenEnd);
+    phi->addIncoming(elseValue.value, elseEnd);
+    return {phi, thenValue.kind};
+}
+
+NativeLowering::Typed NativeLowering::lowerWhile(const AST::WhileExpression *whileExpr)
+{
+    if (!whileExpr->condition || !whileExpr->body)
+    {
+        return fail();
+    }
+
+    auto condBlock = llvm::BasicBlock::Create(context, "cond", function);
+    auto loopBlock = llvm::BasicBlock::Create(context, "loop", function);
+    auto afterBlock = llvm::BasicBlock::Create(context, "afterloop", function);
+    builder.CreateBr(condBlock);
+
+    builder.SetInsertPoint(condBlock);
+    auto condition = lowerCondition(whileExpr->condition.get());
+    if (!condition)
+    {
+        return {};
+    }
+    builder.CreateCondBr(condition, loopBlock, afterBlock);
+
+    builder.SetInsertPoint(loopBlock);
+    scopes.emplace_back();
+    lowerBlock(*whileExpr->body);
+    scopes.pop_back();
+    if (failed)
+    {
+        return {};
+    }
+    builder.CreateBr(condBlock);
+
+    // ループの値（最後に評価した本体の値）は扱わない
+    builder.SetInsertPoint(afterBlock);
+    reachable = true;
+    return {};
+}
+
+} // namespace
+
+monkey::NativeFunction Compiler::compileNativeFunction(const std::vector<std::string> &parameters,
+                                                       const AST::BlockStatement &body)
+{
+    if (parameters.size() > monkey::MAX_NATIVE_ARGUMENTS)
+    {
+        return nullptr;
+    }
+
+    auto name = "monkey_native_" + std::to_string(nativeCount++);
+    auto nativeModule = std::make_unique<llvm::Module>(name, *context);
+    NativeLowering lowering(*context, *nativeModule);
+    if (!lowering.lower(name, parameters, body))
+    {
+        TRACE_DEBUG("jit", "Function body is not eligible for native code: " << body.String());
+        return nullptr;
+    }
+
+    std::string error;
+    llvm::raw_string_ostream errorStream(error);
+    if (llvm::verifyModule(*nativeModule, &errorStream))
+    {
+        TRACE_WARN("jit", "Native function verification failed: " << error);
+        return nullptr;
+    }
+    runOptimizations(*nativeModule);
+    TRACE_DEBUG("jit", "Native function IR:\n" << [&]() {
+        std::string ir;
+        llvm::raw_string_ostream os(ir);
+        nativeModule->print(os, nullptr);
+        return ir;
+    }());
+
+    // ネイティブ関数は関数オブジェクトから参照され続けるため、リソーストラッカーを使わず常駐させる
+    auto &engine = ensureJIT();
+    if (auto err = engine.addIRModule(llvm::orc::ThreadSafeModule(std::move(nativeModule), threadSafeContext)))
+    {
+        TRACE_WARN("jit", "Failed to add native module: " << llvm::toString(std::move(err)));
+        return nullptr;
+    }
+    auto symbol = engine.lookup(name);
+    if (!symbol)
+    {
+        TRACE_WARN("jit", "Failed to look up native function: " << llvm::toString(symbol.takeError()));
+        return nullptr;
+    }
+    return reinterpret_cast<monkey::NativeFunction>(static_cast<uintptr_t>(symbol->getAddress()));
+}
+
+} // namespace JIT
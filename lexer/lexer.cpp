@@ -1,23 +1,195 @@
 #include "lexer.hpp"
-#include <cctype>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
 #include <stdexcept>
-#include <unordered_map>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace Lexer
 {
 
 namespace
 {
-const std::unordered_map<std::string, Token::TokenType> keywords = {
+// キーワードは少数なので線形探索する（string_viewのまま比較でき、ハッシュ計算も不要）
+constexpr std::pair<std::string_view, Token::TokenType> keywords[] = {
     {"fn", Token::TokenType::FUNCTION},  {"let", Token::TokenType::LET},
     {"true", Token::TokenType::TRUE},    {"false", Token::TokenType::FALSE},
     {"if", Token::TokenType::IF},        {"else", Token::TokenType::ELSE},
     {"return", Token::TokenType::RETURN}, {"while", Token::TokenType::WHILE},
     {"for", Token::TokenType::FOR}};
+
+// 文字の分類（std::isalpha等と違いロケールに依存せず、表を1回引くだけで判定できる）
+enum CharClass : uint8_t
+{
+    CHAR_SPACE = 1 << 0,
+    CHAR_IDENT = 1 << 1, // 識別子に使える文字（英字と'_'）
+    CHAR_DIGIT = 1 << 2,
+    CHAR_STRING_END = 1 << 3 // 文字列リテラルの走査を止める文字（'"'と入力終端の'\0'）
+};
+
+constexpr std::array<uint8_t, 256> makeClassTable()
+{
+    std::array<uint8_t, 256> table{};
+    table[' '] = table['\t'] = table['\n'] = table['\r'] = CHAR_SPACE;
+    for (int c = 'a'; c <= 'z'; ++c)
+    {
+        table[c] = CHAR_IDENT;
+        table[c - 'a' + 'A'] = CHAR_IDENT;
+    }
+    table['_'] = CHAR_IDENT;
+    for (int c = '0'; c <= '9'; ++c)
+    {
+        table[c] = CHAR_DIGIT;
+    }
+    table['"'] = table[0] = CHAR_STRING_END;
+    return table;
 }
 
-Lexer::Lexer(std::string input) : input(std::move(input)), position(0), readPosition(0), ch(0)
+constexpr std::array<uint8_t, 256> CLASS_TABLE = makeClassTable();
+
+inline bool hasClass(char c, uint8_t cls)
 {
+    return (CLASS_TABLE[static_cast<unsigned char>(c)] & cls) != 0;
+}
+
+// posから始まり、clsに属する文字が続く範囲の終端を返す（1文字ずつ表を引く）
+size_t scanScalar(const char *data, size_t pos, size_t end, uint8_t cls)
+{
+    while (pos < end && hasClass(data[pos], cls))
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+// posから始まり、clsに属さない最初の文字の位置を返す
+size_t scanUntilScalar(const char *data, size_t pos, size_t end, uint8_t cls)
+{
+    while (pos < end && !hasClass(data[pos], cls))
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+#if defined(__SSE2__)
+// SIMDで走査する前に1文字ずつ調べる文字数
+// 識別子や空白の大半は数文字で終わるため、短い範囲ではベクトルのロードより速い
+constexpr size_t SCALAR_PREFIX = 8;
+
+// 16バイト分の文字のうちCLSに属するものを1にしたビットマスク
+// 比較は符号付きだが、判定する範囲はすべてASCII内なので0x80以上のバイトは常に不一致になる
+template <uint8_t CLS> inline unsigned classMask(__m128i chunk)
+{
+    auto inRange = [](__m128i value, char low, char high) {
+        return _mm_and_si128(_mm_cmpgt_epi8(value, _mm_set1_epi8(static_cast<char>(low - 1))),
+                             _mm_cmplt_epi8(value, _mm_set1_epi8(static_cast<char>(high + 1))));
+    };
+    auto equals = [chunk](char c) { return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)); };
+
+    __m128i match;
+    if constexpr (CLS == CHAR_SPACE)
+    {
+        match = _mm_or_si128(_mm_or_si128(equals(' '), equals('\t')), _mm_or_si128(equals('\n'), equals('\r')));
+    }
+    else if constexpr (CLS == CHAR_IDENT)
+    {
+        // 0x20をORすると大文字が小文字になる（'_'などは英字の範囲外に移る）
+        __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+        match = _mm_or_si128(inRange(lower, 'a', 'z'), equals('_'));
+    }
+    else if constexpr (CLS == CHAR_DIGIT)
+    {
+        match = inRange(chunk, '0', '9');
+    }
+    else
+    {
+        static_assert(CLS == CHAR_STRING_END);
+        match = _mm_or_si128(equals('"'), equals('\0'));
+    }
+    return static_cast<unsigned>(_mm_movemask_epi8(match));
+}
+
+// UNTILがfalseならCLSに属さない最初の文字、trueならCLSに属する最初の文字の位置を返す
+template <uint8_t CLS, bool UNTIL> size_t scanSimd(const char *data, size_t pos, size_t end)
+{
+    size_t prefixEnd = std::min(end, pos + SCALAR_PREFIX);
+    for (; pos < prefixEnd; ++pos)
+    {
+        if (hasClass(data[pos], CLS) == UNTIL)
+        {
+            return pos;
+        }
+    }
+
+    while (pos + 16 <= end)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        unsigned found = UNTIL ? classMask<CLS>(chunk) : ~classMask<CLS>(chunk) & 0xFFFF;
+        if (found)
+        {
+            return pos + __builtin_ctz(found);
+        }
+        pos += 16;
+    }
+    return UNTIL ? scanUntilScalar(data, pos, end, CLS) : scanScalar(data, pos, end, CLS);
+}
+#endif
+} // namespace
+
+Lexer::Lexer(std::string input, ScanMode mode)
+    : storage(std::make_unique<const std::string>(std::move(input))), input(*storage), position(0), readPosition(0),
+      ch(0), mode(mode)
+{
+    readChar();
+}
+
+Lexer::Lexer(const char *data, size_t size, ScanMode mode)
+    : input(data, size), position(0), readPosition(0), ch(0), mode(mode)
+{
+    readChar();
+}
+
+size_t Lexer::scan(size_t from, uint8_t cls) const
+{
+#if defined(__SSE2__)
+    if (mode == ScanMode::SIMD)
+    {
+        switch (cls)
+        {
+        case CHAR_SPACE:
+            return scanSimd<CHAR_SPACE, false>(input.data(), from, input.size());
+        case CHAR_IDENT:
+            return scanSimd<CHAR_IDENT, false>(input.data(), from, input.size());
+        case CHAR_DIGIT:
+            return scanSimd<CHAR_DIGIT, false>(input.data(), from, input.size());
+        default:
+            break;
+        }
+    }
+#endif
+    return scanScalar(input.data(), from, input.size(), cls);
+}
+
+size_t Lexer::scanUntil(size_t from, uint8_t cls) const
+{
+#if defined(__SSE2__)
+    if (mode == ScanMode::SIMD && cls == CHAR_STRING_END)
+    {
+        return scanSimd<CHAR_STRING_END, true>(input.data(), from, input.size());
+    }
+#endif
+    return scanUntilScalar(input.data(), from, input.size(), cls);
+}
+
+void Lexer::advanceTo(size_t next)
+{
+    readPosition = next;
     readChar();
 }
 
@@ -32,48 +204,68 @@ char Lexer::peekChar() const
     return (readPosition >= input.length()) ? 0 : input[readPosition];
 }
 
-std::string Lexer::readIdentifier()
+std::string_view Lexer::readIdentifier()
 {
     auto pos = position;
-    while (std::isalpha(ch) || ch == '_')
-    {
-        readChar();
-    }
+    advanceTo(scan(pos, CHAR_IDENT));
     return input.substr(pos, position - pos);
 }
 
-std::string Lexer::readNumber()
+Token::TokenView Lexer::readNumber()
 {
     auto pos = position;
-    while (std::isdigit(ch))
+    advanceTo(scan(pos, CHAR_DIGIT));
+    auto literal = input.substr(pos, position - pos);
+
+    int64_t value = 0;
+    bool overflow = false;
+    for (char c : literal)
     {
-        readChar();
+        int64_t digit = c - '0';
+        if (value > (std::numeric_limits<int64_t>::max() - digit) / 10)
+        {
+            overflow = true;
+            break;
+        }
+        value = value * 10 + digit;
     }
-    return input.substr(pos, position - pos);
+    return Token::TokenView(literal, value, overflow);
 }
 
 void Lexer::skipWhitespace()
 {
-    while (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r')
+    if (hasClass(ch, CHAR_SPACE))
+    {
+        advanceTo(scan(position, CHAR_SPACE));
+    }
+}
+
+Token::TokenType Lexer::lookupIdent(std::string_view ident) const
+{
+    for (const auto &[word, type] : keywords)
     {
-        readChar();
+        if (word == ident)
+        {
+            return type;
+        }
     }
+    return Token::TokenType::IDENT;
 }
 
-Token::TokenType Lexer::lookupIdent(const std::string &ident) const
+Token::TokenView Lexer::makeToken(Token::TokenType type, size_t length) const
 {
-    auto it = keywords.find(ident);
-    return it != keywords.end() ? it->second : Token::TokenType::IDENT;
+    // 入力の終端を越えて読み進めた後もEOFトークンを返せるよう位置を切り詰める
+    return Token::TokenView(type, input.substr(std::min(position, input.size()), length));
 }
 
-std::string Lexer::readString()
+std::string_view Lexer::readString()
 {
     readChar(); // 開始の'"'をスキップ
 
     auto startPosition = position;
-    while (ch != 0 && ch != '"')
+    if (position < input.size())
     {
-        readChar();
+        advanceTo(scanUntil(position, CHAR_STRING_END));
     }
 
     if (ch == 0)
@@ -81,99 +273,98 @@ std::string Lexer::readString()
         throw std::runtime_error("unterminated string literal");
     }
 
-    std::string str = input.substr(startPosition, position - startPosition);
+    auto str = input.substr(startPosition, position - startPosition);
     readChar(); // 終わりの'"'をスキップ
     return str;
 }
 
-Token::Token Lexer::NextToken()
+Token::TokenView Lexer::NextToken()
 {
     skipWhitespace();
 
-    Token::Token tok(Token::TokenType::ILLEGAL, std::string(1, ch));
+    auto tok = makeToken(Token::TokenType::ILLEGAL, 1);
 
     switch (ch)
     {
     case '=':
         if (peekChar() == '=')
         {
+            tok = makeToken(Token::TokenType::EQ, 2);
             readChar();
-            tok = Token::Token(Token::TokenType::EQ, "==");
         }
         else
         {
-            tok = Token::Token(Token::TokenType::ASSIGN, "=");
+            tok = makeToken(Token::TokenType::ASSIGN, 1);
         }
         break;
     case '+':
-        tok = Token::Token(Token::TokenType::PLUS, "+");
+        tok = makeToken(Token::TokenType::PLUS, 1);
         break;
     case '-':
-        tok = Token::Token(Token::TokenType::MINUS, "-");
+        tok = makeToken(Token::TokenType::MINUS, 1);
         break;
     case '!':
         if (peekChar() == '=')
         {
+            tok = makeToken(Token::TokenType::NOT_EQ, 2);
             readChar();
-            tok = Token::Token(Token::TokenType::NOT_EQ, "!=");
         }
         else
         {
-            tok = Token::Token(Token::TokenType::BANG, "!");
+            tok = makeToken(Token::TokenType::BANG, 1);
         }
         break;
     case '*':
-        tok = Token::Token(Token::TokenType::ASTERISK, "*");
+        tok = makeToken(Token::TokenType::ASTERISK, 1);
         break;
     case '/':
-        tok = Token::Token(Token::TokenType::SLASH, "/");
+        tok = makeToken(Token::TokenType::SLASH, 1);
         break;
     case '<':
-        tok = Token::Token(Token::TokenType::LT, "<");
+        tok = makeToken(Token::TokenType::LT, 1);
         break;
     case '>':
-        tok = Token::Token(Token::TokenType::GT, ">");
+        tok = makeToken(Token::TokenType::GT, 1);
         break;
     case ';':
-        tok = Token::Token(Token::TokenType::SEMICOLON, ";");
+        tok = makeToken(Token::TokenType::SEMICOLON, 1);
         break;
     case '(':
-        tok = Token::Token(Token::TokenType::LPAREN, "(");
+        tok = makeToken(Token::TokenType::LPAREN, 1);
         break;
     case ')':
-        tok = Token::Token(Token::TokenType::RPAREN, ")");
+        tok = makeToken(Token::TokenType::RPAREN, 1);
         break;
     case ',':
-        tok = Token::Token(Token::TokenType::COMMA, ",");
+        tok = makeToken(Token::TokenType::COMMA, 1);
         break;
     case '{':
-        tok = Token::Token(Token::TokenType::LBRACE, "{");
+        tok = makeToken(Token::TokenType::LBRACE, 1);
         break;
     case '}':
-        tok = Token::Token(Token::TokenType::RBRACE, "}");
+        tok = makeToken(Token::TokenType::RBRACE, 1);
         break;
     case 0:
-        tok = Token::Token(Token::TokenType::EOF_, "");
+        tok = makeToken(Token::TokenType::EOF_, 0);
         break;
     case '"':
-        tok = Token::Token(Token::TokenType::STRING, readString());
-        return tok;
+        return Token::TokenView(Token::TokenType::STRING, readString());
     case '[':
-        tok = Token::Token(Token::TokenType::LBRACKET, "[");
+        tok = makeToken(Token::TokenType::LBRACKET, 1);
         break;
     case ']':
-        tok = Token::Token(Token::TokenType::RBRACKET, "]");
+        tok = makeToken(Token::TokenType::RBRACKET, 1);
         break;
     default:
-        if (std::isalpha(ch) || ch == '_')
+        if (hasClass(ch, CHAR_IDENT))
         {
             auto literal = readIdentifier();
             auto type = lookupIdent(literal);
             return {type, literal};
         }
-        if (std::isdigit(ch))
+        if (hasClass(ch, CHAR_DIGIT))
         {
-            return {Token::TokenType::INT, readNumber()};
+            return readNumber();
         }
         break;
     }
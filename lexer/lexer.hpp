@@ -1,29 +1,53 @@
 #pragma once
 #include "../token/token.hpp"
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 
 namespace Lexer
 {
 
+// 空白・識別子・数値・文字列の境界を探す方法
+// SIMDはSSE2で16バイトずつ走査する（SSE2が使えない環境ではSCALARと同じ動作になる）
+// どちらのモードでも生成されるトークン列は同一
+enum class ScanMode
+{
+    SCALAR,
+    SIMD
+};
+
 class Lexer
 {
   private:
-    std::string input;
+    std::unique_ptr<const std::string> storage; // 入力を所有する場合のみ（ムーブしても位置が変わらないようヒープに置く）
+    std::string_view input;
     size_t position;     // 現在の位置
     size_t readPosition; // 次の文字を読む位置
     char ch;             // 現在検査中の文字
+    ScanMode mode;
 
     void readChar();
+    // 指定した位置まで読み進める
+    void advanceTo(size_t next);
     char peekChar() const;
-    std::string readIdentifier();
-    std::string readNumber();
+    std::string_view readIdentifier();
+    Token::TokenView readNumber();
     void skipWhitespace();
-    Token::TokenType lookupIdent(const std::string &ident) const;
-    std::string readString();
+    // fromから始まりclsに属する文字が続く範囲の終端／clsに属する最初の文字の位置を返す
+    size_t scan(size_t from, uint8_t cls) const;
+    size_t scanUntil(size_t from, uint8_t cls) const;
+    Token::TokenType lookupIdent(std::string_view ident) const;
+    std::string_view readString();
+    // 現在の文字から始まるlength文字分のトークン
+    Token::TokenView makeToken(Token::TokenType type, size_t length) const;
 
   public:
-    explicit Lexer(std::string input);
-    Token::Token NextToken();
+    explicit Lexer(std::string input, ScanMode mode = ScanMode::SIMD);
+    // 入力をコピーせずに参照する（mmapしたファイルなど。呼び出し側がLexerとトークンより長く保持する）
+    Lexer(const char *data, size_t size, ScanMode mode = ScanMode::SIMD);
+    // 返すトークンのリテラルはこのLexerの入力を参照する
+    Token::TokenView NextToken();
 };
 
 } // namespace Lexer
@@ -1,9 +1,27 @@
 #include "repl/repl.hpp"
+#include "script/script.hpp"
 #include <iostream>
 
-int main()
+int main(int argc, char *argv[])
 {
-    REPL::REPL repl;
-    repl.Start();
-    return 0;
+    // 引数がなければ対話モード
+    if (argc == 1)
+    {
+        REPL::REPL repl;
+        repl.Start();
+        return 0;
+    }
+
+    if (argc != 2)
+    {
+        std::cerr << "usage: " << argv[0] << " [script]\n";
+        return static_cast<int>(Script::ExitCode::USAGE);
+    }
+
+    // スクリプトモードでは出力をまとめて書き出す（stdioとの同期をやめ、終了時にフラッシュする）
+    std::ios::sync_with_stdio(false);
+    Script::Runner runner(std::cerr);
+    auto code = runner.runFile(argv[1]);
+    std::cout.flush();
+    return static_cast<int>(code);
 }
@@ -0,0 +1,158 @@
+#include "builtins.hpp"
+#include <iostream>
+
+namespace monkey
+{
+
+namespace
+{
+// 配列用の組み込み関数
+Value builtinLen(const std::vector<Value> &args)
+{
+    if (args.size() != 1)
+    {
+        return makeRef<Error>(
+            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+    }
+
+    if (auto array = dynamicRefCast<Array>(args[0].asObject()))
+    {
+        return Value::integer(static_cast<int64_t>(array->elements.size()));
+    }
+
+    return makeRef<Error>("argument to `len` not supported, got " +
+                                   toString(args[0].type()));
+}
+
+Value builtinFirst(const std::vector<Value> &args)
+{
+    if (args.size() != 1)
+    {
+        return makeRef<Error>(
+            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+    }
+
+    auto array = dynamicRefCast<Array>(args[0].asObject());
+    if (!array)
+    {
+        return makeRef<Error>("argument to `first` must be ARRAY, got " +
+                                       toString(args[0].type()));
+    }
+
+    if (array->elements.empty())
+    {
+        return Value::null();
+    }
+
+    return array->elements[0];
+}
+
+Value builtinLast(const std::vector<Value> &args)
+{
+    if (args.size() != 1)
+    {
+        return makeRef<Error>(
+            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+    }
+
+    auto array = dynamicRefCast<Array>(args[0].asObject());
+    if (!array)
+    {
+        return makeRef<Error>("argument to `last` must be ARRAY, got " +
+                                       toString(args[0].type()));
+    }
+
+    if (array->elements.empty())
+    {
+        return Value::null();
+    }
+
+    return array->elements.back();
+}
+
+Value builtinRest(const std::vector<Value> &args)
+{
+    if (args.size() != 1)
+    {
+        return makeRef<Error>(
+            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=1");
+    }
+
+    auto array = dynamicRefCast<Array>(args[0].asObject());
+    if (!array)
+    {
+        return makeRef<Error>("argument to `rest` must be ARRAY, got " +
+                                       toString(args[0].type()));
+    }
+
+    if (array->elements.empty())
+    {
+        return Value::null();
+    }
+
+    return makeRef<Array>(array->elements.rest());
+}
+
+Value builtinPush(const std::vector<Value> &args)
+{
+    if (args.size() != 2)
+    {
+        return makeRef<Error>(
+            "wrong number of arguments. got=" + std::to_string(args.size()) + ", want=2");
+    }
+
+    auto array = dynamicRefCast<Array>(args[0].asObject());
+    if (!array)
+    {
+        return makeRef<Error>("argument to `push` must be ARRAY, got " +
+                                       toString(args[0].type()));
+    }
+
+    return makeRef<Array>(array->elements.pushBack(args[1]));
+}
+
+// 引数を1行ずつ標準出力に書き出す（フラッシュは出力ストリームに任せる）
+Value builtinPuts(const std::vector<Value> &args)
+{
+    for (const auto &arg : args)
+    {
+        std::cout << arg.inspect() << '\n';
+    }
+    return Value::null();
+}
+
+// ビルトイン関数オブジェクトはプロセス全体で共有するため、参照カウントをアトミックに増減する
+RefPtr<Builtin> makeBuiltin(BuiltinFunction function)
+{
+    auto builtin = makeRef<Builtin>(std::move(function));
+    builtin->shareAcrossThreads();
+    return builtin;
+}
+} // namespace
+
+const std::vector<BuiltinDefinition> &builtins()
+{
+    static const std::vector<BuiltinDefinition> definitions = {
+        {"len", makeBuiltin(builtinLen)},
+        {"first", makeBuiltin(builtinFirst)},
+        {"last", makeBuiltin(builtinLast)},
+        {"rest", makeBuiltin(builtinRest)},
+        {"push", makeBuiltin(builtinPush)},
+        {"puts", makeBuiltin(builtinPuts)},
+    };
+    return definitions;
+}
+
+RefPtr<Builtin> lookupBuiltin(const std::string &name)
+{
+    for (const auto &def : builtins())
+    {
+        if (def.name == name)
+        {
+            return def.builtin;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace monkey
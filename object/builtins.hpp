@@ -0,0 +1,22 @@
+#pragma once
+#include "object.hpp"
+#include <string>
+#include <vector>
+
+namespace monkey
+{
+
+// ビルトイン関数の定義（名前と関数オブジェクト）
+struct BuiltinDefinition
+{
+    std::string name;
+    RefPtr<Builtin> builtin;
+};
+
+// ビルトイン関数の一覧を取得する関数（インデックスはVMのOpGetBuiltinで使用）
+const std::vector<BuiltinDefinition> &builtins();
+
+// 名前からビルトイン関数を検索する関数（見つからない場合はnullptr）
+RefPtr<Builtin> lookupBuiltin(const std::string &name);
+
+} // namespace monkey
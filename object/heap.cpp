@@ -0,0 +1,313 @@
+#include "heap.hpp"
+#include "../trace/trace.hpp"
+#include "object.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace monkey
+{
+
+namespace
+{
+// RefPtrで所有されていないオブジェクト（スタック上に置かれたものなど）は常に根として扱う
+constexpr int64_t UNOWNED_REFERENCES = std::numeric_limits<int64_t>::max() / 2;
+
+Collectable *asCollectable(Object *object)
+{
+    switch (object->type())
+    {
+    case ObjectType::FUNCTION:
+        return static_cast<Function *>(object);
+    case ObjectType::ARRAY:
+        return static_cast<Array *>(object);
+    case ObjectType::HASH:
+        return static_cast<Hash *>(object);
+    case ObjectType::CLOSURE:
+        return static_cast<Closure *>(object);
+    default:
+        return nullptr;
+    }
+}
+} // namespace
+
+// Collectable implementation
+Collectable::Collectable()
+{
+    Heap::current().link(this);
+}
+
+Collectable::Collectable(const Collectable &) : Collectable()
+{
+}
+
+Collectable &Collectable::operator=(const Collectable &)
+{
+    return *this;
+}
+
+Collectable::~Collectable()
+{
+    if (heap)
+    {
+        heap->unlink(this);
+    }
+}
+
+// Tracer implementation
+void Tracer::visit(const Value &value)
+{
+    if (value.isObject())
+    {
+        if (auto collectable = asCollectable(value.asObject().get()))
+        {
+            visit(collectable);
+        }
+    }
+}
+
+// Heap implementation
+Heap::~Heap()
+{
+    // スレッドの終了後も生き残るオブジェクトがヒープを参照しないよう切り離す
+    for (auto &generation : generations)
+    {
+        for (Collectable *object = generation.head; object; object = object->next)
+        {
+            object->heap = nullptr;
+        }
+    }
+}
+
+Heap &Heap::current()
+{
+    thread_local Heap heap;
+    return heap;
+}
+
+size_t Heap::addRootScanner(RootScanner scanner)
+{
+    size_t id = nextRootScannerId++;
+    rootScanners.emplace_back(id, std::move(scanner));
+    return id;
+}
+
+void Heap::removeRootScanner(size_t id)
+{
+    rootScanners.erase(std::remove_if(rootScanners.begin(), rootScanners.end(),
+                                      [id](const auto &entry) { return entry.first == id; }),
+                       rootScanners.end());
+}
+
+void Heap::setBudget(size_t size)
+{
+    budget = std::max<size_t>(size, 1);
+}
+
+void Heap::link(Collectable *object)
+{
+    Generation &young = generations[YOUNG];
+    object->heap = this;
+    object->generation = YOUNG;
+    object->next = young.head;
+    if (young.head)
+    {
+        young.head->prev = object;
+    }
+    young.head = object;
+    young.count++;
+    allocationsSinceCollection++;
+}
+
+void Heap::unlink(Collectable *object)
+{
+    Generation &generation = generations[object->generation];
+    if (object->prev)
+    {
+        object->prev->next = object->next;
+    }
+    else
+    {
+        generation.head = object->next;
+    }
+    if (object->next)
+    {
+        object->next->prev = object->prev;
+    }
+    object->heap = nullptr;
+    object->prev = object->next = nullptr;
+    generation.count--;
+}
+
+void Heap::promoteYoung()
+{
+    Generation &young = generations[YOUNG];
+    Generation &old = generations[OLD];
+    if (!young.head)
+    {
+        return;
+    }
+    Collectable *tail = young.head;
+    for (Collectable *object = young.head; object; object = object->next)
+    {
+        object->generation = OLD;
+        tail = object;
+    }
+    tail->next = old.head;
+    if (old.head)
+    {
+        old.head->prev = tail;
+    }
+    old.head = young.head;
+    old.count += young.count;
+    young.head = nullptr;
+    young.count = 0;
+}
+
+size_t Heap::collect()
+{
+    if (collecting)
+    {
+        return 0;
+    }
+    // 若い世代もまとめて走査する
+    promoteYoung();
+    size_t freed = collectGeneration(OLD);
+    fullCollections++;
+    promotedSinceFullCollection = 0;
+    oldCountAfterFullCollection = generations[OLD].count;
+    allocationsSinceCollection = 0;
+    return freed;
+}
+
+size_t Heap::collectYoung()
+{
+    if (collecting)
+    {
+        return 0;
+    }
+    size_t freed = collectGeneration(YOUNG);
+    promotedSinceFullCollection += generations[YOUNG].count;
+    promoteYoung();
+    allocationsSinceCollection = 0;
+
+    // 古い世代が前回の全体収集の時点から倍程度に増えたら、古い世代に溜まった循環も回収する
+    if (promotedSinceFullCollection >= std::max(budget, oldCountAfterFullCollection))
+    {
+        freed += collect();
+    }
+    return freed;
+}
+
+size_t Heap::collectGeneration(uint8_t target)
+{
+    collecting = true;
+    collections++;
+    Generation &generation = generations[target];
+
+    // 1. 参照カウントからこの世代の内部の参照を引き、外（古い世代やC++側）から参照されている数を求める
+    for (Collectable *object = generation.head; object; object = object->next)
+    {
+        object->marked = false;
+        uint32_t references = object->counted().referenceCount();
+        object->gcReferences = references == 0 ? UNOWNED_REFERENCES : references;
+    }
+
+    struct InternalReferences : Tracer
+    {
+        Heap *heap;
+        uint8_t generation;
+        InternalReferences(Heap *heap, uint8_t generation) : heap(heap), generation(generation)
+        {
+        }
+        void visit(Collectable *object) override
+        {
+            if (object->heap == heap && object->generation == generation)
+            {
+                object->gcReferences--;
+            }
+        }
+        using Tracer::visit;
+    } internal(this, target);
+    // マイナー収集では古い世代のバッファを飛ばす（両方の段階で同じバッファを飛ばせば、中の参照は外からの参照になる）
+    const std::unordered_set<const void *> *skipped = target == YOUNG ? &oldBuffers : nullptr;
+    internal.skippedBuffers = skipped;
+    for (Collectable *object = generation.head; object; object = object->next)
+    {
+        object->traceReferences(internal);
+    }
+
+    // 2. 外から参照されているオブジェクトと登録された根から到達できるものに印を付ける
+    struct Marker : Tracer
+    {
+        Heap *heap;
+        uint8_t generation;
+        std::vector<Collectable *> pending;
+        Marker(Heap *heap, uint8_t generation) : heap(heap), generation(generation)
+        {
+        }
+        void visit(Collectable *object) override
+        {
+            if (object->heap == heap && object->generation == generation && !object->marked)
+            {
+                object->marked = true;
+                pending.push_back(object);
+            }
+        }
+        using Tracer::visit;
+    } marker(this, target);
+    marker.skippedBuffers = skipped;
+    for (Collectable *object = generation.head; object; object = object->next)
+    {
+        if (object->gcReferences > 0)
+        {
+            marker.visit(object);
+        }
+    }
+    for (const auto &[id, scanner] : rootScanners)
+    {
+        scanner(marker);
+    }
+    while (!marker.pending.empty())
+    {
+        Collectable *object = marker.pending.back();
+        marker.pending.pop_back();
+        object->traceReferences(marker);
+    }
+    // 生き残るオブジェクトから到達したバッファを古い世代のものとして覚える
+    // （全体収集では作り直し、解放されたバッファを覚え続けないようにする）
+    if (target == YOUNG)
+    {
+        oldBuffers.insert(marker.visitedBuffers.begin(), marker.visitedBuffers.end());
+    }
+    else
+    {
+        oldBuffers = std::move(marker.visitedBuffers);
+    }
+
+    // 3. 到達できないオブジェクトの参照を断ち切る
+    // 断ち切る途中で他のゴミが解放されないよう、先にすべての所有権を確保しておく
+    std::vector<Collectable *> garbage;
+    std::vector<RefPtr<const RefCounted>> owners;
+    for (Collectable *object = generation.head; object; object = object->next)
+    {
+        if (!object->marked)
+        {
+            garbage.push_back(object);
+            owners.emplace_back(&object->counted());
+        }
+    }
+    for (Collectable *object : garbage)
+    {
+        object->clearReferences();
+    }
+    size_t freed = garbage.size();
+    owners.clear();
+
+    collecting = false;
+    TRACE_DEBUG("gc", (target == YOUNG ? "Minor" : "Full") << " collection freed " << freed << " objects, "
+                                                           << generations[YOUNG].count << " young, "
+                                                           << generations[OLD].count << " old");
+    return freed;
+}
+
+} // namespace monkey
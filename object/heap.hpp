@@ -0,0 +1,177 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "ref.hpp"
+#include <functional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace monkey
+{
+
+class Value;
+class Heap;
+class Tracer;
+
+// 他のオブジェクトへの参照を持ち、循環参照を作りうるオブジェクト（関数・セル・配列・ハッシュ・クロージャ）の基底クラス
+// 生成時に現在のスレッドのHeapへ登録され、破棄時に登録を外す。
+// メモリの解放は参照カウントで行い、Heapは循環していて根から到達できないオブジェクトの参照を断ち切る
+class Collectable
+{
+  public:
+    Collectable();
+    Collectable(const Collectable &other);
+    Collectable &operator=(const Collectable &other);
+    virtual ~Collectable();
+
+    // 参照しているオブジェクトをtracerに渡す
+    virtual void traceReferences(Tracer &tracer) const = 0;
+    // 参照をすべて手放す（到達できないと判定されたオブジェクトに対してだけ呼ばれる）
+    virtual void clearReferences() = 0;
+    // 参照カウントを持つ自分自身（ObjectまたはCellとしての部分）
+    virtual const RefCounted &counted() const = 0;
+
+  private:
+    friend class Heap;
+    friend class Tracer;
+
+    Heap *heap = nullptr;
+    Collectable *prev = nullptr;
+    Collectable *next = nullptr;
+    int64_t gcReferences = 0; // 収集中の作業領域（ヒープの外からの参照数）
+    bool marked = false;
+    uint8_t generation = 0; // 所属する世代（Heap::YOUNG / Heap::OLD）
+};
+
+// 収集の各段階でオブジェクトの参照をたどる訪問者
+class Tracer
+{
+  public:
+    virtual ~Tracer() = default;
+    virtual void visit(Collectable *object) = 0;
+    void visit(const Value &value);
+
+    // 複数のオブジェクトが共有するバッファ（永続ベクタのノードなど）を、1回の走査で初めて訪れる場合にtrue
+    // 共有された要素を重複して数えないために使う
+    bool enterBuffer(const void *buffer)
+    {
+        if (skippedBuffers && skippedBuffers->count(buffer))
+        {
+            return false;
+        }
+        return visitedBuffers.insert(buffer).second;
+    }
+
+  private:
+    friend class Heap;
+
+    std::unordered_set<const void *> visitedBuffers;
+    const std::unordered_set<const void *> *skippedBuffers = nullptr; // 走査しないバッファ（古い世代のもの）
+};
+
+// Collectableを管理するヒープ（スレッドごとに1つ）
+// 収集は次の手順で行う
+//   1. 各オブジェクトの参照カウントから、ヒープ内の他のオブジェクトからの参照数を引く
+//      残りが正のオブジェクトはC++側（評価中の一時値、REPLが保持する値など）から参照されている
+//   2. それらと登録された根（VMのスタックとグローバル変数）から到達できるオブジェクトに印を付ける
+//   3. 印のないオブジェクトの参照を断ち切り、参照カウントで解放させる
+//
+// これは循環参照の検出（試し削除）を世代別にしたものである。
+// メモリの確保と解放はナーサリ（nursery.hpp）がバンプポインタで行い、Heapは循環の回収だけを受け持つ。
+//
+// オブジェクトは若い世代と古い世代に分けて管理する。
+// 新しいオブジェクトは若い世代に登録され、若い世代の収集（マイナー収集）を生き延びると古い世代へ移る。
+// マイナー収集は若い世代だけを走査するため、費用は生きているデータ全体ではなく直近の確保の量に比例する。
+// 古い世代から若い世代への参照は、手順1で古いオブジェクトからの参照を引かないことで
+// 「外からの参照」として数えられるため、書き込みバリアや記憶集合を持たなくても若いオブジェクトは解放されない。
+// 若い配列が古い配列と共有しているバッファも、以前の収集で生き残ったものはマイナー収集では走査しない
+// （中の参照は外からの参照として扱われるので、若いオブジェクトを誤って解放することはない）。
+//
+// マイナー収集は前回の収集以降に登録されたオブジェクトの数が予算を超えた後、評価器やVMが安全な位置で
+// safePoint()を呼んだときに行う。前回の全体収集以降に古い世代へ移った数が、その時点の古い世代の大きさ
+// （と予算の大きい方）を超えたら、続けて全体収集を行う
+class Heap
+{
+  public:
+    using RootScanner = std::function<void(Tracer &)>;
+
+    static constexpr size_t DEFAULT_BUDGET = 10000;
+    static constexpr uint8_t YOUNG = 0;
+    static constexpr uint8_t OLD = 1;
+
+    Heap() = default;
+    Heap(const Heap &) = delete;
+    Heap &operator=(const Heap &) = delete;
+    ~Heap();
+
+    // 現在のスレッドのヒープ
+    static Heap &current();
+
+    // 根を列挙する関数を登録する（戻り値はremoveRootScannerに渡す識別子）
+    size_t addRootScanner(RootScanner scanner);
+    void removeRootScanner(size_t id);
+
+    void safePoint()
+    {
+        if (allocationsSinceCollection >= budget)
+        {
+            collectYoung();
+        }
+    }
+    // 全体を収集して、参照を断ち切ったオブジェクトの数を返す
+    size_t collect();
+    // 若い世代だけを収集して、参照を断ち切ったオブジェクトの数を返す（生き残ったものは古い世代へ移る）
+    size_t collectYoung();
+
+    // マイナー収集の予算（全体収集の間隔の下限にも使う）
+    void setBudget(size_t size);
+
+    size_t objectCount() const
+    {
+        return generations[YOUNG].count + generations[OLD].count;
+    }
+    size_t objectCount(uint8_t generation) const
+    {
+        return generations[generation].count;
+    }
+    size_t collectionCount() const
+    {
+        return collections;
+    }
+    size_t fullCollectionCount() const
+    {
+        return fullCollections;
+    }
+
+  private:
+    friend class Collectable;
+
+    struct Generation
+    {
+        Collectable *head = nullptr;
+        size_t count = 0;
+    };
+
+    Generation generations[2];
+    size_t allocationsSinceCollection = 0;
+    size_t budget = DEFAULT_BUDGET;
+    size_t promotedSinceFullCollection = 0;
+    size_t oldCountAfterFullCollection = 0;
+    size_t collections = 0;
+    size_t fullCollections = 0;
+    bool collecting = false;
+
+    std::unordered_set<const void *> oldBuffers; // 以前の収集で生き残ったオブジェクトから到達したバッファ
+    std::vector<std::pair<size_t, RootScanner>> rootScanners;
+    size_t nextRootScannerId = 0;
+
+    void link(Collectable *object);
+    void unlink(Collectable *object);
+    // 若い世代のオブジェクトをすべて古い世代へ移す
+    void promoteYoung();
+    // generationの世代のオブジェクトを収集する
+    size_t collectGeneration(uint8_t generation);
+};
+
+} // namespace monkey
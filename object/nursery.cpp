@@ -0,0 +1,168 @@
+#include "nursery.hpp"
+#include "../trace/trace.hpp"
+#include "ref.hpp"
+#include <atomic>
+#include <limits>
+#include <new>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define MONKEY_POISON(pointer, size) ASAN_POISON_MEMORY_REGION(pointer, size)
+#define MONKEY_UNPOISON(pointer, size) ASAN_UNPOISON_MEMORY_REGION(pointer, size)
+#else
+#define MONKEY_POISON(pointer, size) ((void)(pointer), (void)(size))
+#define MONKEY_UNPOISON(pointer, size) ((void)(pointer), (void)(size))
+#endif
+
+namespace monkey
+{
+
+namespace
+{
+constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+
+constexpr size_t alignUp(size_t size)
+{
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+// 確保中のチャンクの生存数に加えておく値
+// 所有するナーサリがこの分を持っている間は、オブジェクトがすべて解放されても生存数が0にならない
+constexpr int64_t OWNER_BIAS = std::numeric_limits<int64_t>::max() / 2;
+
+std::atomic<size_t> liveChunks{0};
+} // namespace
+
+// チャンクの先頭に置くヘッダ（オブジェクトはその後ろに並ぶ）
+// チャンクはCHUNK_SIZE境界に揃えて確保するので、オブジェクトのアドレスから所属するチャンクを求められる
+struct alignas(std::max_align_t) Nursery::Chunk
+{
+    // OWNER_BIAS（確保中の場合）- 解放されたオブジェクトの数 + 昇格時に加えた確保数
+    // 確保は所有スレッドだけが行うので数えず、解放（他のスレッドからも行われる）だけをアトミックに数える
+    std::atomic<int64_t> live{OWNER_BIAS};
+
+    std::byte *begin()
+    {
+        return reinterpret_cast<std::byte *>(this + 1);
+    }
+    std::byte *end()
+    {
+        return reinterpret_cast<std::byte *>(this) + CHUNK_SIZE;
+    }
+
+    static Chunk *create()
+    {
+        void *memory = ::operator new(CHUNK_SIZE, std::align_val_t{CHUNK_SIZE});
+        liveChunks.fetch_add(1, std::memory_order_relaxed);
+        auto chunk = new (memory) Chunk();
+        MONKEY_POISON(chunk->begin(), chunk->end() - chunk->begin());
+        return chunk;
+    }
+    static Chunk *of(void *pointer)
+    {
+        return reinterpret_cast<Chunk *>(reinterpret_cast<uintptr_t>(pointer) & ~(uintptr_t(CHUNK_SIZE) - 1));
+    }
+    // 生存数にdeltaを加え、0になったらチャンクを解放する
+    void adjust(int64_t delta) noexcept
+    {
+        if (live.fetch_add(delta, std::memory_order_acq_rel) + delta == 0)
+        {
+            MONKEY_UNPOISON(begin(), end() - begin());
+            this->~Chunk();
+            ::operator delete(this, std::align_val_t{CHUNK_SIZE});
+            liveChunks.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+Nursery::~Nursery()
+{
+    // スレッドの終了後も生き残るオブジェクトのチャンクは、最後の解放に任せる
+    if (chunk)
+    {
+        chunk->adjust(allocatedInChunk - OWNER_BIAS);
+    }
+}
+
+Nursery &Nursery::current()
+{
+    thread_local Nursery nursery;
+    return nursery;
+}
+
+void *Nursery::allocate(size_t size)
+{
+    if (size > MAX_OBJECT_SIZE)
+    {
+        return ::operator new(size);
+    }
+    size_t aligned = alignUp(size);
+    if (static_cast<size_t>(limit - cursor) < aligned)
+    {
+        refill();
+    }
+    void *result = cursor;
+    cursor += aligned;
+    allocatedInChunk++;
+    MONKEY_UNPOISON(result, aligned);
+    return result;
+}
+
+void Nursery::deallocate(void *pointer, size_t size) noexcept
+{
+    if (!pointer)
+    {
+        return;
+    }
+    if (size > MAX_OBJECT_SIZE)
+    {
+        ::operator delete(pointer);
+        return;
+    }
+    MONKEY_POISON(pointer, alignUp(size));
+    Chunk::of(pointer)->adjust(-1);
+}
+
+size_t Nursery::chunkCount()
+{
+    return liveChunks.load(std::memory_order_relaxed);
+}
+
+void Nursery::refill()
+{
+    if (chunk)
+    {
+        // 所有スレッドだけがこのチャンクから確保するので、全部解放されていれば他のスレッドが触れることはない
+        if (chunk->live.load(std::memory_order_acquire) == OWNER_BIAS - allocatedInChunk)
+        {
+            chunk->live.store(OWNER_BIAS, std::memory_order_relaxed);
+            allocatedInChunk = 0;
+            cursor = chunk->begin();
+            recycled++;
+            return;
+        }
+        // 生き残りのあるチャンクを昇格させ、以降は生存数が0になった時点で解放されるようにする
+        TRACE_TRACE("gc", "Nursery promoted a chunk with "
+                              << allocatedInChunk - (OWNER_BIAS - chunk->live.load(std::memory_order_relaxed))
+                              << " of " << allocatedInChunk << " objects alive");
+        promoted++;
+        chunk->adjust(allocatedInChunk - OWNER_BIAS);
+    }
+    chunk = Chunk::create();
+    allocatedInChunk = 0;
+    cursor = chunk->begin();
+    limit = chunk->end();
+}
+
+// RefCountedの派生クラスはナーサリから確保する
+void *RefCounted::operator new(size_t size)
+{
+    return Nursery::current().allocate(size);
+}
+
+void RefCounted::operator delete(void *pointer, size_t size) noexcept
+{
+    Nursery::deallocate(pointer, size);
+}
+
+} // namespace monkey
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace monkey
+{
+
+// 参照カウントで管理するオブジェクト（RefCountedの派生）を確保するバンプポインタのナーサリ（スレッドごとに1つ）
+// 評価中に生成されるオブジェクトの多く（文字列の中間結果、呼び出しごとの環境など）は生成の直後に解放される。
+// ナーサリは固定長のチャンクの中でポインタを進めるだけで確保し、解放ではチャンクの生存数を減らすだけにする。
+//
+// チャンクを使い切ったときにマイナー収集を行う
+//   - チャンクのオブジェクトがすべて解放されていれば、ポインタを先頭に戻して同じチャンクを使い直す
+//   - 生き残った（エスケープした）オブジェクトがあれば、チャンクごと古い領域へ昇格させて新しいチャンクに切り替える
+//     昇格したチャンクは、最後のオブジェクトが解放された時点で解放する（解放はどのスレッドから行ってもよい）
+// C++側が生のポインタを保持するためオブジェクトは移動できず、生き残ったオブジェクトはチャンクに置いたまま昇格する。
+// マイナー収集の費用は生き残りの数によらず一定で、短命なオブジェクトの確保と解放はmalloc/freeを経由しない。
+// MAX_OBJECT_SIZEより大きなオブジェクトは通常のoperator newで確保する。
+class Nursery
+{
+  public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t MAX_OBJECT_SIZE = 1024;
+
+    Nursery() = default;
+    Nursery(const Nursery &) = delete;
+    Nursery &operator=(const Nursery &) = delete;
+    ~Nursery();
+
+    // 現在のスレッドのナーサリ
+    static Nursery &current();
+
+    void *allocate(size_t size);
+    // sizeにはallocateに渡したのと同じ大きさを渡す
+    static void deallocate(void *pointer, size_t size) noexcept;
+
+    // 使い直したチャンクの数と、生き残りがあって昇格させたチャンクの数（統計用）
+    size_t recycledCount() const
+    {
+        return recycled;
+    }
+    size_t promotedCount() const
+    {
+        return promoted;
+    }
+    // プロセス全体で確保されているチャンクの数
+    static size_t chunkCount();
+
+  private:
+    struct Chunk;
+
+    Chunk *chunk = nullptr;
+    std::byte *cursor = nullptr;
+    std::byte *limit = nullptr;
+    int64_t allocatedInChunk = 0; // 現在のチャンクから確保したオブジェクトの数
+    size_t recycled = 0;
+    size_t promoted = 0;
+
+    // 現在のチャンクを使い切ったときに、次の確保先を用意する
+    void refill();
+};
+
+} // namespace monkey
@@ -1,9 +1,256 @@
 #include "object.hpp"
+#include <algorithm>
 #include <sstream>
 
 namespace monkey
 {
 
+std::string toString(ObjectType type)
+{
+    switch (type)
+    {
+    case ObjectType::INTEGER:
+        return "INTEGER";
+    case ObjectType::BOOLEAN:
+        return "BOOLEAN";
+    case ObjectType::STRING:
+        return "STRING";
+    case ObjectType::NULL_OBJ:
+        return "NULL";
+    case ObjectType::ERROR:
+        return "ERROR";
+    case ObjectType::ARRAY:
+        return "ARRAY";
+    case ObjectType::HASH:
+        return "HASH";
+    case ObjectType::FUNCTION:
+        return "FUNCTION";
+    case ObjectType::BUILTIN:
+        return "BUILTIN";
+    case ObjectType::COMPILED_FUNCTION:
+        return "COMPILED_FUNCTION";
+    case ObjectType::CLOSURE:
+        return "CLOSURE";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+// Value implementation
+Value::Value(ObjectPtr obj) : tag_(Tag::NULL_), integer_(0)
+{
+    if (!obj)
+    {
+        return;
+    }
+    switch (obj->type())
+    {
+    case ObjectType::INTEGER:
+        tag_ = Tag::INTEGER;
+        integer_ = static_cast<const Integer *>(obj.get())->value();
+        break;
+    case ObjectType::BOOLEAN:
+        tag_ = Tag::BOOLEAN;
+        integer_ = static_cast<const Boolean *>(obj.get())->value() ? 1 : 0;
+        break;
+    case ObjectType::NULL_OBJ:
+        break;
+    default:
+        tag_ = Tag::OBJECT;
+        new (&object_) ObjectPtr(std::move(obj));
+        break;
+    }
+}
+
+Value::Value(const Value &other)
+{
+    copyFrom(other);
+}
+
+Value::Value(Value &&other) noexcept
+{
+    moveFrom(std::move(other));
+}
+
+Value &Value::operator=(const Value &other)
+{
+    if (this != &other)
+    {
+        destroy();
+        copyFrom(other);
+    }
+    return *this;
+}
+
+Value &Value::operator=(Value &&other) noexcept
+{
+    if (this != &other)
+    {
+        destroy();
+        moveFrom(std::move(other));
+    }
+    return *this;
+}
+
+Value::~Value()
+{
+    destroy();
+}
+
+void Value::destroy() noexcept
+{
+    if (tag_ == Tag::OBJECT)
+    {
+        object_.~ObjectPtr();
+    }
+    tag_ = Tag::NULL_;
+    integer_ = 0;
+}
+
+void Value::copyFrom(const Value &other)
+{
+    tag_ = other.tag_;
+    if (tag_ == Tag::OBJECT)
+    {
+        new (&object_) ObjectPtr(other.object_);
+    }
+    else
+    {
+        integer_ = other.integer_;
+    }
+}
+
+void Value::moveFrom(Value &&other) noexcept
+{
+    tag_ = other.tag_;
+    if (tag_ == Tag::OBJECT)
+    {
+        new (&object_) ObjectPtr(std::move(other.object_));
+        other.destroy();
+    }
+    else
+    {
+        integer_ = other.integer_;
+    }
+}
+
+const ObjectPtr &Value::asObject() const noexcept
+{
+    static const ObjectPtr none;
+    return tag_ == Tag::OBJECT ? object_ : none;
+}
+
+ObjectType Value::type() const
+{
+    switch (tag_)
+    {
+    case Tag::INTEGER:
+        return ObjectType::INTEGER;
+    case Tag::BOOLEAN:
+        return ObjectType::BOOLEAN;
+    case Tag::OBJECT:
+        return object_->type();
+    default:
+        return ObjectType::NULL_OBJ;
+    }
+}
+
+std::string Value::inspect() const
+{
+    switch (tag_)
+    {
+    case Tag::INTEGER:
+        return std::to_string(integer_);
+    case Tag::BOOLEAN:
+        return integer_ ? "true" : "false";
+    case Tag::OBJECT:
+        return object_->inspect();
+    default:
+        return "null";
+    }
+}
+
+bool Value::isError() const
+{
+    return tag_ == Tag::OBJECT && object_->type() == ObjectType::ERROR;
+}
+
+std::optional<size_t> Value::hashKey() const
+{
+    switch (tag_)
+    {
+    case Tag::INTEGER:
+        return std::hash<int64_t>{}(integer_);
+    case Tag::BOOLEAN:
+        return std::hash<bool>{}(integer_ != 0);
+    case Tag::OBJECT:
+        if (auto key = dynamic_cast<const HashKey *>(object_.get()))
+        {
+            return key->hash();
+        }
+        return std::nullopt;
+    default:
+        return std::nullopt;
+    }
+}
+
+ObjectPtr Value::toObject() const
+{
+    switch (tag_)
+    {
+    case Tag::INTEGER:
+        return makeInteger(integer_);
+    case Tag::BOOLEAN:
+        return canonicalBoolean(integer_ != 0);
+    case Tag::OBJECT:
+        return object_;
+    default:
+        return canonicalNull();
+    }
+}
+
+namespace
+{
+// プロセス全体で共有するオブジェクトを作る
+template <typename T, typename... Args> RefPtr<T> makeShared(Args &&...args)
+{
+    auto object = makeRef<T>(std::forward<Args>(args)...);
+    object->shareAcrossThreads();
+    return object;
+}
+} // namespace
+
+const RefPtr<Boolean> &canonicalBoolean(bool value)
+{
+    static const RefPtr<Boolean> trueObject = makeShared<Boolean>(true);
+    static const RefPtr<Boolean> falseObject = makeShared<Boolean>(false);
+    return value ? trueObject : falseObject;
+}
+
+const RefPtr<Null> &canonicalNull()
+{
+    static const RefPtr<Null> nullObject = makeShared<Null>();
+    return nullObject;
+}
+
+RefPtr<Integer> makeInteger(int64_t value)
+{
+    static const std::vector<RefPtr<Integer>> cache = [] {
+        std::vector<RefPtr<Integer>> integers;
+        integers.reserve(SMALL_INTEGER_MAX - SMALL_INTEGER_MIN + 1);
+        for (int64_t i = SMALL_INTEGER_MIN; i <= SMALL_INTEGER_MAX; ++i)
+        {
+            integers.push_back(makeShared<Integer>(i));
+        }
+        return integers;
+    }();
+    if (value >= SMALL_INTEGER_MIN && value <= SMALL_INTEGER_MAX)
+    {
+        return cache[value - SMALL_INTEGER_MIN];
+    }
+    return makeRef<Integer>(value);
+}
+
 // Integer implementation
 Integer::Integer(int64_t value) : value_(value)
 {
@@ -95,25 +342,6 @@ const std::string &Error::message() const
     return message_;
 }
 
-// ReturnValue implementation
-ReturnValue::ReturnValue(ObjectPtr v) : value(std::move(v))
-{
-    if (!value)
-    {
-        value = std::make_shared<Null>();
-    }
-}
-
-ObjectType ReturnValue::type() const
-{
-    return ObjectType::RETURN_VALUE;
-}
-
-std::string ReturnValue::inspect() const
-{
-    return value->inspect();
-}
-
 // Function implementation - only inspect() method
 std::string Function::inspect() const
 {
@@ -139,6 +367,60 @@ std::string Function::inspect() const
     return result;
 }
 
+// CompiledFunction implementation
+CompiledFunction::CompiledFunction(std::vector<uint8_t> ins, int locals, int params, int cells)
+    : instructions(std::move(ins)), numLocals(locals), numParameters(params), numCells(cells)
+{
+}
+
+ObjectType CompiledFunction::type() const
+{
+    return ObjectType::COMPILED_FUNCTION;
+}
+
+std::string CompiledFunction::inspect() const
+{
+    std::stringstream ss;
+    ss << "CompiledFunction[" << this << "]";
+    return ss.str();
+}
+
+// Closure implementation
+Closure::Closure(RefPtr<CompiledFunction> f, std::vector<Value> freeVars)
+    : fn(std::move(f)), free(std::move(freeVars))
+{
+}
+
+ObjectType Closure::type() const
+{
+    return ObjectType::CLOSURE;
+}
+
+std::string Closure::inspect() const
+{
+    std::stringstream ss;
+    ss << "Closure[" << this << "]";
+    return ss.str();
+}
+
+void Closure::traceReferences(Tracer &tracer) const
+{
+    for (const auto &value : free)
+    {
+        tracer.visit(value);
+    }
+    for (const auto &cell : cells)
+    {
+        tracer.visit(cell.get());
+    }
+}
+
+void Closure::clearReferences()
+{
+    free.clear();
+    cells.clear();
+}
+
 // Builtin implementation
 Builtin::Builtin(BuiltinFunction function) : fn(std::move(function))
 {
@@ -155,7 +437,11 @@ std::string Builtin::inspect() const
 }
 
 // Array implementation
-Array::Array(std::vector<ObjectPtr> elems) : elements(std::move(elems))
+Array::Array(std::vector<Value> elems) : elements(std::move(elems))
+{
+}
+
+Array::Array(PersistentVector<Value> elems) : elements(std::move(elems))
 {
 }
 
@@ -168,173 +454,240 @@ std::string Array::inspect() const
 {
     std::stringstream ss;
     ss << "[";
-    for (size_t i = 0; i < elements.size(); ++i)
+    bool first = true;
+    for (const auto &element : elements)
     {
-        if (elements[i])
-        {
-            ss << elements[i]->inspect();
-        }
-        if (i < elements.size() - 1)
+        if (!first)
         {
             ss << ", ";
         }
+        first = false;
+        ss << element.inspect();
     }
     ss << "]";
     return ss.str();
 }
 
+void Array::traceReferences(Tracer &tracer) const
+{
+    // 構造を共有する他の配列と同じ要素を重複して数えないよう、バッファ単位でたどる
+    elements.forEachBuffer([&tracer](const void *buffer) { return tracer.enterBuffer(buffer); },
+                           [&tracer](const Value &value) { tracer.visit(value); });
+}
+
+void Array::clearReferences()
+{
+    elements = PersistentVector<Value>();
+}
+
 // Hash implementation
 ObjectType Hash::type() const
 {
     return ObjectType::HASH;
 }
 
-std::string Hash::inspect() const
+namespace
 {
-    std::string result = "{";
-    bool first = true;
-    for (const auto &pair : pairs)
+// ハッシュのキーが等しいかどうか（整数と真偽値は値とタグ、オブジェクトはHashKey::operator==で比較する）
+bool keysEqual(const Value &a, const Value &b)
+{
+    if (a.tag() != b.tag())
     {
-        if (!first)
+        return false;
+    }
+    switch (a.tag())
+    {
+    case Value::Tag::INTEGER:
+    case Value::Tag::BOOLEAN:
+        return a.asInteger() == b.asInteger();
+    case Value::Tag::OBJECT: {
+        const Object *left = a.asObject().get();
+        const Object *right = b.asObject().get();
+        if (left == right)
         {
-            result += ", ";
+            return true;
         }
-        first = false;
-        result += pair.second.key->inspect();
-        result += ": ";
-        result += pair.second.value->inspect();
+        // よく使われる文字列キーはdynamic_castを避けて直接比較する
+        if (left->type() == ObjectType::STRING && right->type() == ObjectType::STRING)
+        {
+            return static_cast<const String *>(left)->getValue() == static_cast<const String *>(right)->getValue();
+        }
+        auto leftKey = dynamic_cast<const HashKey *>(left);
+        auto rightKey = dynamic_cast<const HashKey *>(right);
+        return leftKey && rightKey && *leftKey == *rightKey;
+    }
+    default:
+        return false;
     }
-    result += "}";
-    return result;
 }
 
-// Environment implementation
-EnvPtr Environment::NewEnvironment()
+// インデックス表の位置を決めるためにハッシュ値の上位ビットを下位へ混ぜる
+// （整数キーのハッシュ値は値そのものなので、混ぜないと連続したキーが隣接スロットに固まる）
+size_t mixHash(size_t hash)
 {
-    return std::make_shared<Environment>();
+    uint64_t h = hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
 }
 
-EnvPtr Environment::NewEnclosedEnvironment(EnvPtr outer)
+constexpr size_t MIN_INDEX_CAPACITY = 8;
+} // namespace
+
+// HashTable implementation
+size_t HashTable::probe(const Value &key, size_t hash) const
 {
-    auto env = NewEnvironment();
-    env->outer = outer;
-    return env;
+    size_t mask = indices.size() - 1;
+    for (size_t slot = mixHash(hash) & mask;; slot = (slot + 1) & mask)
+    {
+        uint32_t index = indices[slot];
+        if (index == EMPTY)
+        {
+            return slot;
+        }
+        const HashPair &pair = pairs[index];
+        if (pair.hash == hash && keysEqual(pair.key, key))
+        {
+            return slot;
+        }
+    }
 }
 
-ObjectPtr Environment::Get(const std::string &name)
+const Value *HashTable::find(const Value &key, size_t hash) const
 {
-    auto it = store.find(name);
-    if (it != store.end())
+    if (pairs.empty())
     {
-        return it->second;
+        return nullptr;
     }
+    uint32_t index = indices[probe(key, hash)];
+    return index == EMPTY ? nullptr : &pairs[index].value;
+}
 
-    if (auto outerEnv = outer.lock())
+void HashTable::insert(Value key, Value value, size_t hash)
+{
+    // 負荷率を1/2以下に保つ（線形探索の探索長を短くする）
+    if ((pairs.size() + 1) * 2 > indices.size())
     {
-        return outerEnv->Get(name);
+        rehash(std::max(MIN_INDEX_CAPACITY, indices.size() * 2));
     }
 
-    return std::make_shared<Error>("identifier not found: " + name);
+    size_t slot = probe(key, hash);
+    if (indices[slot] != EMPTY)
+    {
+        pairs[indices[slot]].value = std::move(value);
+        return;
+    }
+    indices[slot] = static_cast<uint32_t>(pairs.size());
+    pairs.emplace_back(std::move(key), std::move(value), hash);
 }
 
-ObjectPtr Environment::Set(const std::string &name, ObjectPtr val)
+void HashTable::reserve(size_t count)
 {
-    store[name] = val;
-    return val;
+    pairs.reserve(count);
+    size_t capacity = MIN_INDEX_CAPACITY;
+    while (capacity < count * 2)
+    {
+        capacity *= 2;
+    }
+    if (capacity > indices.size())
+    {
+        rehash(capacity);
+    }
 }
 
-void Environment::MarkAndSweep()
+void HashTable::rehash(size_t capacity)
 {
-    std::unordered_set<Object *> marked;
-    marked.reserve(store.size());
-    Mark(marked);
-    Sweep(marked);
+    // ペアは移動せず、キャッシュしたハッシュ値からインデックス表だけを作り直す
+    indices.assign(capacity, EMPTY);
+    size_t mask = capacity - 1;
+    for (uint32_t index = 0; index < pairs.size(); ++index)
+    {
+        size_t slot = mixHash(pairs[index].hash) & mask;
+        while (indices[slot] != EMPTY)
+        {
+            slot = (slot + 1) & mask;
+        }
+        indices[slot] = index;
+    }
 }
 
-void Environment::Mark(std::unordered_set<Object *> &marked)
+std::string Hash::inspect() const
 {
-    marked.reserve(marked.size() + store.size());
-    for (const auto &pair : store)
+    std::string result = "{";
+    bool first = true;
+    for (const auto &pair : pairs)
     {
-        if (pair.second)
+        if (!first)
         {
-            MarkObject(pair.second.get(), marked);
+            result += ", ";
         }
+        first = false;
+        result += pair.key.inspect();
+        result += ": ";
+        result += pair.value.inspect();
     }
+    result += "}";
+    return result;
+}
 
-    if (auto outerEnv = outer.lock())
+void Hash::traceReferences(Tracer &tracer) const
+{
+    for (const auto &pair : pairs)
     {
-        outerEnv->Mark(marked);
+        tracer.visit(pair.key);
+        tracer.visit(pair.value);
     }
 }
 
-void Environment::MarkObject(Object *obj, std::unordered_set<Object *> &marked)
+void Hash::clearReferences()
 {
-    if (!obj || marked.find(obj) != marked.end())
+    pairs = HashTable();
+}
+
+// Cell implementation
+void Cell::traceReferences(Tracer &tracer) const
+{
+    if (value)
     {
-        return;
+        tracer.visit(*value);
     }
+}
 
-    marked.insert(obj);
+void Cell::clearReferences()
+{
+    value.reset();
+}
 
-    if (auto function = dynamic_cast<Function *>(obj))
-    {
-        if (function->env)
-        {
-            function->env->Mark(marked);
-        }
-    }
-    else if (auto array = dynamic_cast<Array *>(obj))
-    {
-        for (const auto &elem : array->elements)
-        {
-            if (elem)
-            {
-                MarkObject(elem.get(), marked);
-            }
-        }
-    }
-    else if (auto hash = dynamic_cast<Hash *>(obj))
-    {
-        for (const auto &pair : hash->pairs)
-        {
-            if (pair.second.key)
-            {
-                MarkObject(pair.second.key.get(), marked);
-            }
-            if (pair.second.value)
-            {
-                MarkObject(pair.second.value.get(), marked);
-            }
-        }
-    }
+// Environment implementation
+EnvPtr Environment::NewEnvironment(size_t size)
+{
+    auto env = makeRef<Environment>();
+    env->slots.resize(size);
+    return env;
 }
 
-void Environment::Sweep(const std::unordered_set<Object *> &marked)
+const Value &Environment::Set(int slot, Value val)
 {
-    auto it = store.begin();
-    while (it != store.end())
+    if (static_cast<size_t>(slot) >= slots.size())
     {
-        if (it->second && marked.find(it->second.get()) == marked.end())
-        {
-            it = store.erase(it);
-        }
-        else
-        {
-            ++it;
-        }
+        slots.resize(slot + 1);
     }
+    slots[slot] = std::move(val);
+    return *slots[slot];
 }
 
-// Function implementation
-Function::Function(std::vector<std::string> params, const AST::BlockStatement *b, EnvPtr e)
-    : parameters(std::move(params)), body(b), env(std::move(e))
+void Environment::Clear()
 {
+    slots.clear();
 }
 
-Function::~Function()
+// Function implementation
+Function::Function(std::vector<std::string> params, const AST::FunctionLiteral *lit,
+                   std::shared_ptr<const AST::Node> src, std::vector<Value> values, std::vector<CellPtr> cells)
+    : parameters(std::move(params)), literal(lit), body(lit ? lit->body.get() : nullptr), source(std::move(src)),
+      capturedValues(std::move(values)), capturedCells(std::move(cells))
 {
-    delete body;
 }
 
 ObjectType Function::type() const
@@ -342,4 +695,22 @@ ObjectType Function::type() const
     return ObjectType::FUNCTION;
 }
 
+void Function::traceReferences(Tracer &tracer) const
+{
+    for (const auto &value : capturedValues)
+    {
+        tracer.visit(value);
+    }
+    for (const auto &cell : capturedCells)
+    {
+        tracer.visit(cell.get());
+    }
+}
+
+void Function::clearReferences()
+{
+    capturedValues.clear();
+    capturedCells.clear();
+}
+
 } // namespace monkey
\ No newline at end of file
@@ -1,20 +1,26 @@
 #pragma once
 #include "../ast/ast.hpp"
+#include "heap.hpp"
+#include "persistent_vector.hpp"
+#include "ref.hpp"
+#include <cstdint>
 #include <functional> // std::function用
 #include <memory>
+#include <optional>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
 #include <variant> // std::variant用
+#include <vector>
 
 namespace monkey
 {
 
 // 前方宣言
 class Object;
-using ObjectPtr = std::shared_ptr<Object>;
-using EnvPtr = std::shared_ptr<class Environment>;
-using WeakEnvPtr = std::weak_ptr<class Environment>;
+using ObjectPtr = RefPtr<Object>;
+using EnvPtr = RefPtr<class Environment>;
+using CellPtr = RefPtr<class Cell>;
 
 // オブジェクトの種類を表す列挙型
 enum class ObjectType
@@ -24,15 +30,19 @@ enum class ObjectType
     STRING,
     NULL_OBJ,
     ERROR,
-    RETURN_VALUE,
     FUNCTION,
     BUILTIN,
     ARRAY,
-    HASH
+    HASH,
+    COMPILED_FUNCTION,
+    CLOSURE
 };
 
-// 基底クラス
-class Object
+// ObjectTypeを文字列に変換する関数
+std::string toString(ObjectType type);
+
+// 基底クラス（参照カウントはオブジェクト自身が持ち、ObjectPtrで参照する）
+class Object : public RefCounted
 {
   public:
     virtual ~Object() = default;
@@ -40,6 +50,109 @@ class Object
     virtual std::string inspect() const = 0;
 };
 
+// 値の表現
+// 整数・真偽値・nullはヒープを使わずにタグ付きでインラインに保持し、
+// 文字列・配列・ハッシュ・関数などのヒープオブジェクトだけをObjectPtrで参照する。
+// 算術演算や比較の中間値でヒープの確保と参照カウントの操作が発生しない。
+class Value
+{
+  public:
+    enum class Tag : uint8_t
+    {
+        NULL_,
+        INTEGER,
+        BOOLEAN,
+        OBJECT
+    };
+
+    Value() noexcept : tag_(Tag::NULL_), integer_(0)
+    {
+    }
+    // ヒープオブジェクトから値を作る（Integer/Boolean/Nullオブジェクトは即値に変換する）
+    Value(ObjectPtr obj);
+    template <typename T, typename = std::enable_if_t<std::is_base_of_v<Object, T>>>
+    Value(RefPtr<T> obj) : Value(ObjectPtr(std::move(obj)))
+    {
+    }
+    Value(const Value &other);
+    Value(Value &&other) noexcept;
+    Value &operator=(const Value &other);
+    Value &operator=(Value &&other) noexcept;
+    ~Value();
+
+    static Value integer(int64_t value) noexcept
+    {
+        Value v;
+        v.tag_ = Tag::INTEGER;
+        v.integer_ = value;
+        return v;
+    }
+    static Value boolean(bool value) noexcept
+    {
+        Value v;
+        v.tag_ = Tag::BOOLEAN;
+        v.integer_ = value ? 1 : 0;
+        return v;
+    }
+    static Value null() noexcept
+    {
+        return Value();
+    }
+
+    Tag tag() const noexcept
+    {
+        return tag_;
+    }
+    bool isInteger() const noexcept
+    {
+        return tag_ == Tag::INTEGER;
+    }
+    bool isBoolean() const noexcept
+    {
+        return tag_ == Tag::BOOLEAN;
+    }
+    bool isNull() const noexcept
+    {
+        return tag_ == Tag::NULL_;
+    }
+    bool isObject() const noexcept
+    {
+        return tag_ == Tag::OBJECT;
+    }
+
+    int64_t asInteger() const noexcept
+    {
+        return integer_;
+    }
+    bool asBoolean() const noexcept
+    {
+        return integer_ != 0;
+    }
+    // ヒープオブジェクトを返す（即値の場合は空のポインタ）
+    const ObjectPtr &asObject() const noexcept;
+
+    ObjectType type() const;
+    std::string inspect() const;
+    bool isError() const;
+
+    // ハッシュのキーとして使う場合のハッシュ値（キーにできない型の場合はstd::nullopt）
+    std::optional<size_t> hashKey() const;
+
+    // ObjectPtrに変換する（即値の場合はここで初めてヒープに確保する）
+    ObjectPtr toObject() const;
+
+  private:
+    Tag tag_;
+    union {
+        int64_t integer_; // INTEGERとBOOLEANで使用
+        ObjectPtr object_; // OBJECTで使用
+    };
+
+    void destroy() noexcept;
+    void copyFrom(const Value &other);
+    void moveFrom(Value &&other) noexcept;
+};
+
 // HashKeyインターフェースを追加
 class HashKey
 {
@@ -132,6 +245,17 @@ class Null : public Object
     std::string inspect() const override;
 };
 
+// 共有の不変オブジェクト
+// true/false/nullはプロセス全体で1つずつのインスタンスを使い回す。
+// SMALL_INTEGER_MIN〜SMALL_INTEGER_MAXの整数は起動時に確保したものを返し、範囲外の場合だけ新たに確保する。
+// 値の受け渡しは即値のValueで行うため、これらはValueをObjectPtrに変換する境界（REPLへの結果の返却など）で使われる。
+constexpr int64_t SMALL_INTEGER_MIN = -128;
+constexpr int64_t SMALL_INTEGER_MAX = 1023;
+// これらはどのスレッドからも参照されるため、参照カウントをアトミックに増減する（RefCounted::shareAcrossThreads）
+const RefPtr<Boolean> &canonicalBoolean(bool value);
+const RefPtr<Null> &canonicalNull();
+RefPtr<Integer> makeInteger(int64_t value);
+
 // エラーオブジェクト
 class Error : public Object
 {
@@ -145,32 +269,80 @@ class Error : public Object
     const std::string &message() const;
 };
 
-// 戻り値オブジェクト
-class ReturnValue : public Object
+// 関数オブジェクト
+// ネイティブコードに変換された関数
+// 整数の引数列を受け取り、結果をresultに書き込んでtrueを返す
+// ゼロ除算などインタプリタでエラーになる場合はfalseを返し、呼び出し側がインタプリタで実行し直す
+using NativeFunction = bool (*)(const int64_t *args, int64_t *result);
+// ネイティブコードに渡せる引数の最大数
+constexpr size_t MAX_NATIVE_ARGUMENTS = 8;
+
+// 関数本体は構文木をコピーせずに参照し、本体を含む構文木（Programなど）をsourceで共有して寿命を保つ
+// （クロージャの生成は本体の大きさによらず一定のコストで済む）
+// 外側の環境は保持せず、本体が参照する外側の関数の変数だけを持つ
+// （AST::FunctionLiteral::capturedValuesの値とcapturedCellsのセルを、それぞれ同じ順に）
+class Function : public Object, public Collectable
 {
   public:
-    ObjectPtr value;
-    explicit ReturnValue(ObjectPtr v);
+    std::vector<std::string> parameters;
+    const AST::FunctionLiteral *literal; // 引数と変数の解決結果
+    const AST::BlockStatement *body;
+    std::shared_ptr<const AST::Node> source; // literalを含む構文木（nullptrの場合は呼び出し側が寿命を保証する）
+    std::vector<Value> capturedValues;
+    std::vector<CellPtr> capturedCells;
+
+    // 階層型実行のためのプロファイル情報
+    uint32_t hotness = 0;             // 呼び出し回数と本体内のループ反復回数の合計
+    NativeFunction native = nullptr;  // JITで生成したネイティブコード
+    bool tierUpFailed = false;        // JITが対応していない本体の場合はtrue（再試行しない）
+
+    Function(std::vector<std::string> params, const AST::FunctionLiteral *lit, std::shared_ptr<const AST::Node> src,
+             std::vector<Value> values, std::vector<CellPtr> cells);
     ObjectType type() const override;
     std::string inspect() const override;
+    void traceReferences(Tracer &tracer) const override;
+    void clearReferences() override;
+    const RefCounted &counted() const override
+    {
+        return *this;
+    }
 };
 
-// 関数オブジェクト
-class Function : public Object
+// コンパイル済み関数オブジェクト（VM用）
+class CompiledFunction : public Object
 {
   public:
-    std::vector<std::string> parameters;
-    const AST::BlockStatement *body;
-    EnvPtr env;
+    std::vector<uint8_t> instructions;
+    int numLocals;
+    int numParameters;
+    int numCells; // 内側の関数にセルで捕捉されるローカル変数の数（呼び出しごとにセルを作る）
+
+    CompiledFunction(std::vector<uint8_t> ins, int locals, int params, int cells = 0);
+    ObjectType type() const override;
+    std::string inspect() const override;
+};
+
+// クロージャオブジェクト（VM用）
+class Closure : public Object, public Collectable
+{
+  public:
+    RefPtr<CompiledFunction> fn;
+    std::vector<Value> free;
+    std::vector<CellPtr> cells; // セルで捕捉した変数（捕捉後の代入が見える）
 
-    Function(std::vector<std::string> params, const AST::BlockStatement *b, EnvPtr e);
-    ~Function();
+    Closure(RefPtr<CompiledFunction> f, std::vector<Value> freeVars);
     ObjectType type() const override;
     std::string inspect() const override;
+    void traceReferences(Tracer &tracer) const override;
+    void clearReferences() override;
+    const RefCounted &counted() const override
+    {
+        return *this;
+    }
 };
 
 // ビルトイン関数の型定義
-using BuiltinFunction = std::function<ObjectPtr(const std::vector<ObjectPtr> &)>;
+using BuiltinFunction = std::function<Value(const std::vector<Value> &)>;
 
 // ビルトイン関数オブジェクト
 class Builtin : public Object
@@ -183,54 +355,136 @@ class Builtin : public Object
 };
 
 // 配列オブジェクト
-class Array : public Object
+// 要素は永続ベクタで保持し、pushやrestは要素をコピーせずに構造を共有した新しい配列を作る
+class Array : public Object, public Collectable
 {
   public:
-    std::vector<ObjectPtr> elements;
-    explicit Array(std::vector<ObjectPtr> elems);
+    PersistentVector<Value> elements;
+    explicit Array(std::vector<Value> elems);
+    explicit Array(PersistentVector<Value> elems);
     ObjectType type() const override;
     std::string inspect() const override;
+    void traceReferences(Tracer &tracer) const override;
+    void clearReferences() override;
+    const RefCounted &counted() const override
+    {
+        return *this;
+    }
 };
 
 // ハッシュペア
 class HashPair
 {
   public:
-    ObjectPtr key;
-    ObjectPtr value;
+    Value key;
+    Value value;
+    size_t hash = 0; // キーのハッシュ値（探索と再配置で再計算しないようキャッシュする）
     HashPair() = default;
-    HashPair(ObjectPtr k, ObjectPtr v) : key(k), value(v)
+    HashPair(Value k, Value v, size_t h) : key(std::move(k)), value(std::move(v)), hash(h)
     {
     }
 };
 
+// ハッシュオブジェクトのキーと値を保持するオープンアドレス法のハッシュ表
+// ペアは挿入順に連続した配列へ並べ、2の冪の大きさのインデックス表（線形探索）からペアの位置を引く
+// 探索ではキャッシュしたハッシュ値を比べてから、キー全体をHashKey::operator==で比較する
+// （ハッシュ値が衝突しても異なるキーを上書きしない）
+class HashTable
+{
+  public:
+    using const_iterator = std::vector<HashPair>::const_iterator;
+
+    // keyに対応する値を返す（見つからない場合はnullptr）。hashはkey.hashKey()の値
+    const Value *find(const Value &key, size_t hash) const;
+    // キーがあれば値を上書きし、なければ末尾に追加する
+    void insert(Value key, Value value, size_t hash);
+    void reserve(size_t count);
+
+    size_t size() const
+    {
+        return pairs.size();
+    }
+    bool empty() const
+    {
+        return pairs.empty();
+    }
+    // 挿入順に列挙する
+    const_iterator begin() const
+    {
+        return pairs.begin();
+    }
+    const_iterator end() const
+    {
+        return pairs.end();
+    }
+
+  private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    std::vector<HashPair> pairs;
+    std::vector<uint32_t> indices; // pairsの位置（空きはEMPTY）
+
+    // keyが入っているか、入れるべきインデックス表の位置を返す
+    size_t probe(const Value &key, size_t hash) const;
+    void rehash(size_t capacity);
+};
+
 // ハッシュオブジェクト
-class Hash : public Object
+class Hash : public Object, public Collectable
 {
   public:
-    std::unordered_map<size_t, HashPair> pairs;
+    HashTable pairs;
     ObjectType type() const override;
     std::string inspect() const override;
+    void traceReferences(Tracer &tracer) const override;
+    void clearReferences() override;
+    const RefCounted &counted() const override
+    {
+        return *this;
+    }
 };
 
-// 環境クラス
-class Environment : public std::enable_shared_from_this<Environment>
+// 内側の関数に捕捉される変数の入れ物
+// 定義した関数の呼び出し環境と、捕捉した関数の両方から同じセルを参照する
+class Cell : public RefCounted, public Collectable
+{
+  public:
+    std::optional<Value> value; // 未代入の場合はstd::nullopt
+
+    void traceReferences(Tracer &tracer) const override;
+    void clearReferences() override;
+    const RefCounted &counted() const override
+    {
+        return *this;
+    }
+};
+
+// グローバル環境
+// 変数は解決パス（Resolver）が割り当てたスロット番号で参照し、名前による検索は行わない。
+// 関数の呼び出しごとの変数は評価器のフレームのスタックに置き、環境は作らない。
+// オブジェクトから環境が参照されることはなく、環境は循環参照に加わらないので、Heapには登録しない
+// （環境から参照されるオブジェクトは、Heapから見ると外から参照されていて生きているものとして扱われる）。
+class Environment : public RefCounted
 {
   private:
-    std::unordered_map<std::string, ObjectPtr> store;
-    WeakEnvPtr outer;
+    std::vector<std::optional<Value>> slots; // 未代入のスロットはstd::nullopt
 
   public:
-    static EnvPtr NewEnvironment();
-    static EnvPtr NewEnclosedEnvironment(EnvPtr outer);
-    ObjectPtr Get(const std::string &name);
-    ObjectPtr Set(const std::string &name, ObjectPtr val);
-    void MarkAndSweep();
+    static EnvPtr NewEnvironment(size_t size = 0);
 
-  private:
-    void Mark(std::unordered_set<Object *> &marked);
-    void MarkObject(Object *obj, std::unordered_set<Object *> &marked);
-    void Sweep(const std::unordered_set<Object *> &marked);
+    // スロットの値を返す（未代入の場合はnullptr）
+    const Value *Get(int slot) const
+    {
+        if (slot < 0 || static_cast<size_t>(slot) >= slots.size() || !slots[slot])
+        {
+            return nullptr;
+        }
+        return &*slots[slot];
+    }
+    // スロットに代入する（グローバル環境はREPLの行ごとに拡張される）
+    const Value &Set(int slot, Value val);
+    // 全スロットを解放する
+    void Clear();
 };
 
 } // namespace monkey
\ No newline at end of file
@@ -0,0 +1,290 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace monkey
+{
+
+// 永続ベクタ（32分岐のトライと末尾バッファ）
+// 更新操作は元のベクタを変更せずに新しいベクタを返し、変更のない部分木は共有する
+//   pushBack: 償却O(1)（末尾バッファに追加し、32要素たまったらトライへ移す）
+//   rest:     O(1)（先頭の位置をずらしたスライスを返す）
+//   operator[]: O(log32 n)
+// 要素はすべて不変として扱う。ただし末尾バッファについては、そのベクタが見えている範囲の
+// 直後にしか追加しないため、最新のベクタからのpushBackはバッファを共有したまま書き足す
+// （古いベクタからは自分の長さより後ろの要素は見えないので値の意味は変わらない）
+template <typename T> class PersistentVector
+{
+  public:
+    class const_iterator
+    {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T *;
+        using reference = const T &;
+
+        const_iterator(const PersistentVector *vector, size_t index) : vector(vector), index(index)
+        {
+        }
+        reference operator*() const
+        {
+            return (*vector)[index];
+        }
+        pointer operator->() const
+        {
+            return &(*vector)[index];
+        }
+        const_iterator &operator++()
+        {
+            ++index;
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            auto previous = *this;
+            ++index;
+            return previous;
+        }
+        bool operator==(const const_iterator &other) const
+        {
+            return index == other.index && vector == other.vector;
+        }
+        bool operator!=(const const_iterator &other) const
+        {
+            return !(*this == other);
+        }
+
+      private:
+        const PersistentVector *vector;
+        size_t index;
+    };
+
+    PersistentVector() = default;
+    explicit PersistentVector(std::vector<T> values)
+    {
+        for (auto &value : values)
+        {
+            appendInPlace(std::move(value));
+        }
+    }
+
+    size_t size() const
+    {
+        return end_ - start_;
+    }
+    bool empty() const
+    {
+        return end_ == start_;
+    }
+
+    const T &operator[](size_t index) const
+    {
+        size_t absolute = start_ + index;
+        size_t tailStart = tailOffset();
+        if (absolute >= tailStart)
+        {
+            return (*tail)[absolute - tailStart];
+        }
+        const Node *node = root.get();
+        for (unsigned level = shift; level > 0; level -= BITS)
+        {
+            node = node->children[(absolute >> level) & MASK].get();
+        }
+        return node->values[absolute & MASK];
+    }
+    const T &front() const
+    {
+        return (*this)[0];
+    }
+    const T &back() const
+    {
+        return (*this)[size() - 1];
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(this, size());
+    }
+
+    // 要素を保持しているバッファ（トライのノードと末尾バッファ）を列挙する
+    // enter(識別子)がfalseを返したバッファとその子は飛ばす（構造を共有する他のベクタで数え済みの場合など）
+    // 見えている範囲の外の要素もバッファが保持しているため、visitにはバッファ内の要素をすべて渡す
+    template <typename Enter, typename Visit> void forEachBuffer(Enter &&enter, Visit &&visit) const
+    {
+        if (root)
+        {
+            forEachNode(root.get(), shift, enter, visit);
+        }
+        if (tail && enter(static_cast<const void *>(tail.get())))
+        {
+            for (const auto &value : *tail)
+            {
+                visit(value);
+            }
+        }
+    }
+
+    // 末尾にvalueを追加したベクタを返す
+    PersistentVector pushBack(T value) const
+    {
+        PersistentVector result = *this;
+        result.appendInPlace(std::move(value));
+        return result;
+    }
+
+    // 先頭の要素を除いたベクタを返す（空の場合は空のまま）
+    PersistentVector rest() const
+    {
+        PersistentVector result = *this;
+        if (!result.empty())
+        {
+            ++result.start_;
+        }
+        return result;
+    }
+
+  private:
+    static constexpr unsigned BITS = 5;
+    static constexpr size_t WIDTH = size_t(1) << BITS;
+    static constexpr size_t MASK = WIDTH - 1;
+
+    // トライのノード（葉はvalues、内部ノードはchildrenを使う）
+    struct Node
+    {
+        std::vector<std::shared_ptr<const Node>> children;
+        std::vector<T> values;
+    };
+    using NodePtr = std::shared_ptr<const Node>;
+
+    NodePtr root;                     // 末尾バッファより前の要素（要素が32個以下の間はnullptr）
+    unsigned shift = BITS;            // ルートの高さ×BITS
+    std::shared_ptr<std::vector<T>> tail; // 末尾の最大32要素
+    size_t start_ = 0;                // 見えている先頭の位置（restでずれる）
+    size_t end_ = 0;                  // 見えている末尾の次の位置
+
+    // 末尾バッファの先頭要素の位置
+    size_t tailOffset() const
+    {
+        return end_ == 0 ? 0 : ((end_ - 1) >> BITS) << BITS;
+    }
+
+    void appendInPlace(T value)
+    {
+        size_t tailLength = end_ - tailOffset();
+        if (end_ != 0 && tailLength == WIDTH)
+        {
+            // 末尾バッファが一杯ならトライへ移し、新しいバッファを始める
+            auto leaf = std::make_shared<Node>();
+            leaf->values.assign(tail->begin(), tail->begin() + WIDTH);
+            if (!root)
+            {
+                root = std::move(leaf);
+                shift = 0;
+            }
+            else if ((end_ >> BITS) > (size_t(1) << shift))
+            {
+                // ルートが一杯なら1段高くする
+                auto newRoot = std::make_shared<Node>();
+                newRoot->children.push_back(root);
+                newRoot->children.push_back(newPath(shift, std::move(leaf)));
+                root = std::move(newRoot);
+                shift += BITS;
+            }
+            else
+            {
+                root = pushLeaf(shift, root.get(), std::move(leaf));
+            }
+            tail.reset();
+            tailLength = 0;
+        }
+
+        if (!tail || tail->size() != tailLength)
+        {
+            // 他のベクタがこのバッファの後ろに書き足している（または未作成）ならコピーする
+            auto copy = std::make_shared<std::vector<T>>();
+            copy->reserve(WIDTH);
+            if (tail)
+            {
+                copy->assign(tail->begin(), tail->begin() + tailLength);
+            }
+            tail = std::move(copy);
+        }
+        tail->push_back(std::move(value));
+        ++end_;
+    }
+
+    template <typename Enter, typename Visit>
+    static void forEachNode(const Node *node, unsigned level, Enter &enter, Visit &visit)
+    {
+        if (!enter(static_cast<const void *>(node)))
+        {
+            return;
+        }
+        if (level == 0)
+        {
+            for (const auto &value : node->values)
+            {
+                visit(value);
+            }
+            return;
+        }
+        for (const auto &child : node->children)
+        {
+            forEachNode(child.get(), level - BITS, enter, visit);
+        }
+    }
+
+    // 高さlevelの位置に葉を置くための経路を作る
+    static NodePtr newPath(unsigned level, NodePtr leaf)
+    {
+        if (level == 0)
+        {
+            return leaf;
+        }
+        auto node = std::make_shared<Node>();
+        node->children.push_back(newPath(level - BITS, std::move(leaf)));
+        return node;
+    }
+
+    // 既存のトライの右端に葉を追加した新しいノードを返す（経路上のノードだけをコピーする）
+    NodePtr pushLeaf(unsigned level, const Node *parent, NodePtr leaf) const
+    {
+        auto node = std::make_shared<Node>(*parent);
+        // 葉を移す前の要素数（tailOffset）からこの段での添字を求める
+        size_t index = ((end_ - 1) >> level) & MASK;
+        NodePtr child;
+        if (level == BITS)
+        {
+            child = std::move(leaf);
+        }
+        else if (index < node->children.size())
+        {
+            child = pushLeaf(level - BITS, node->children[index].get(), std::move(leaf));
+        }
+        else
+        {
+            child = newPath(level - BITS, std::move(leaf));
+        }
+
+        if (index < node->children.size())
+        {
+            node->children[index] = std::move(child);
+        }
+        else
+        {
+            node->children.push_back(std::move(child));
+        }
+        return node;
+    }
+};
+
+} // namespace monkey
@@ -0,0 +1,222 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace monkey
+{
+
+// 参照カウントを自分自身に持つオブジェクトの基底クラス
+// 評価器とVMはセッションごとに1つのスレッドで動くため、通常の増減はアトミック命令を使わずに行う。
+// 複数のスレッドから参照されるオブジェクト（プロセス全体で共有する定数など）は
+// 公開する前にshareAcrossThreads()を呼び、以降の増減をアトミックに行う。
+class RefCounted
+{
+  public:
+    RefCounted() = default;
+    // 参照カウントはオブジェクトごとのものなのでコピーしない
+    RefCounted(const RefCounted &) noexcept
+    {
+    }
+    RefCounted &operator=(const RefCounted &) noexcept
+    {
+        return *this;
+    }
+    virtual ~RefCounted() = default;
+
+    // 派生クラスのオブジェクトは現在のスレッドのナーサリ（nursery.hpp）から確保する
+    // 解放ではナーサリが所属するチャンクを求めるため、確保時と同じ大きさを受け取る
+    static void *operator new(size_t size);
+    static void operator delete(void *pointer, size_t size) noexcept;
+
+    void retain() const noexcept
+    {
+        if (!sharedAcrossThreads)
+        {
+            // 他のスレッドから参照されないので、読み込みと書き込みを分けてよい（アトミックなRMWにならない）
+            references.store(references.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        else
+        {
+            references.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    void release() const noexcept
+    {
+        uint32_t remaining;
+        if (!sharedAcrossThreads)
+        {
+            remaining = references.load(std::memory_order_relaxed) - 1;
+            references.store(remaining, std::memory_order_relaxed);
+        }
+        else
+        {
+            remaining = references.fetch_sub(1, std::memory_order_acq_rel) - 1;
+        }
+        if (remaining == 0)
+        {
+            delete this;
+        }
+    }
+
+    uint32_t referenceCount() const noexcept
+    {
+        return references.load(std::memory_order_relaxed);
+    }
+
+    // 以降の参照カウントの増減をアトミックに行う（他のスレッドへ渡す前に呼ぶ）
+    void shareAcrossThreads() noexcept
+    {
+        sharedAcrossThreads = true;
+    }
+    bool isSharedAcrossThreads() const noexcept
+    {
+        return sharedAcrossThreads;
+    }
+
+  private:
+    mutable std::atomic<uint32_t> references{0};
+    bool sharedAcrossThreads = false;
+};
+
+// RefCountedを参照するスマートポインタ
+// 制御ブロックを持たず、参照カウントはオブジェクト自身が持つ（std::shared_ptrと同じ使い方ができる）
+template <typename T> class RefPtr
+{
+  public:
+    using element_type = T;
+
+    constexpr RefPtr() noexcept = default;
+    constexpr RefPtr(std::nullptr_t) noexcept
+    {
+    }
+    // 生ポインタから作る（参照カウントを1増やす）
+    explicit RefPtr(T *pointer) noexcept : pointer_(pointer)
+    {
+        if (pointer_)
+        {
+            pointer_->retain();
+        }
+    }
+    RefPtr(const RefPtr &other) noexcept : RefPtr(other.pointer_)
+    {
+    }
+    RefPtr(RefPtr &&other) noexcept : pointer_(other.pointer_)
+    {
+        other.pointer_ = nullptr;
+    }
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    RefPtr(const RefPtr<U> &other) noexcept : RefPtr(static_cast<T *>(other.get()))
+    {
+    }
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    RefPtr(RefPtr<U> &&other) noexcept : pointer_(other.detach())
+    {
+    }
+    ~RefPtr()
+    {
+        if (pointer_)
+        {
+            pointer_->release();
+        }
+    }
+
+    RefPtr &operator=(const RefPtr &other) noexcept
+    {
+        RefPtr(other).swap(*this);
+        return *this;
+    }
+    RefPtr &operator=(RefPtr &&other) noexcept
+    {
+        RefPtr(std::move(other)).swap(*this);
+        return *this;
+    }
+    RefPtr &operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    void reset() noexcept
+    {
+        RefPtr().swap(*this);
+    }
+    void swap(RefPtr &other) noexcept
+    {
+        std::swap(pointer_, other.pointer_);
+    }
+    // 参照カウントを減らさずに所有権を手放す
+    T *detach() noexcept
+    {
+        return std::exchange(pointer_, nullptr);
+    }
+
+    T *get() const noexcept
+    {
+        return pointer_;
+    }
+    T &operator*() const noexcept
+    {
+        return *pointer_;
+    }
+    T *operator->() const noexcept
+    {
+        return pointer_;
+    }
+    explicit operator bool() const noexcept
+    {
+        return pointer_ != nullptr;
+    }
+    long use_count() const noexcept
+    {
+        return pointer_ ? pointer_->referenceCount() : 0;
+    }
+
+  private:
+    T *pointer_ = nullptr;
+};
+
+template <typename T, typename U> bool operator==(const RefPtr<T> &a, const RefPtr<U> &b) noexcept
+{
+    return a.get() == b.get();
+}
+template <typename T, typename U> bool operator!=(const RefPtr<T> &a, const RefPtr<U> &b) noexcept
+{
+    return a.get() != b.get();
+}
+template <typename T> bool operator==(const RefPtr<T> &a, std::nullptr_t) noexcept
+{
+    return !a;
+}
+template <typename T> bool operator==(std::nullptr_t, const RefPtr<T> &a) noexcept
+{
+    return !a;
+}
+template <typename T> bool operator!=(const RefPtr<T> &a, std::nullptr_t) noexcept
+{
+    return static_cast<bool>(a);
+}
+template <typename T> bool operator!=(std::nullptr_t, const RefPtr<T> &a) noexcept
+{
+    return static_cast<bool>(a);
+}
+
+// std::make_sharedに相当する生成関数
+template <typename T, typename... Args> RefPtr<T> makeRef(Args &&...args)
+{
+    return RefPtr<T>(new T(std::forward<Args>(args)...));
+}
+
+// std::static_pointer_cast / std::dynamic_pointer_castに相当する変換
+template <typename T, typename U> RefPtr<T> staticRefCast(const RefPtr<U> &pointer) noexcept
+{
+    return RefPtr<T>(static_cast<T *>(pointer.get()));
+}
+template <typename T, typename U> RefPtr<T> dynamicRefCast(const RefPtr<U> &pointer) noexcept
+{
+    return RefPtr<T>(dynamic_cast<T *>(pointer.get()));
+}
+
+} // namespace monkey
@@ -3,75 +3,84 @@
 namespace Parser
 {
 
-std::unordered_map<Token::TokenType, Parser::Precedence> Parser::precedences = {
-    {Token::TokenType::EQ, Precedence::EQUALS},
-    {Token::TokenType::NOT_EQ, Precedence::EQUALS},
-    {Token::TokenType::LT, Precedence::LESSGREATER},
-    {Token::TokenType::GT, Precedence::LESSGREATER},
-    {Token::TokenType::PLUS, Precedence::SUM},
-    {Token::TokenType::MINUS, Precedence::SUM},
-    {Token::TokenType::SLASH, Precedence::PRODUCT},
-    {Token::TokenType::ASTERISK, Precedence::PRODUCT},
-    {Token::TokenType::LPAREN, Precedence::CALL},
-    {Token::TokenType::LBRACKET, Precedence::INDEX},
-};
-
-Parser::Parser(std::unique_ptr<Lexer::Lexer> lexer)
-    : lexer(std::move(lexer)), curToken(Token::TokenType::ILLEGAL, ""),
-      peekToken(Token::TokenType::ILLEGAL, "")
-{
-    initParseFns();
-    nextToken();
-    nextToken();
-}
-
-void Parser::initParseFns()
-{
-    registerPrefix(Token::TokenType::IDENT, [this] { return parseIdentifier(); });
-    registerPrefix(Token::TokenType::INT, std::bind(&Parser::parseIntegerLiteral, this));
-    registerPrefix(Token::TokenType::BANG, std::bind(&Parser::parsePrefixExpression, this));
-    registerPrefix(Token::TokenType::MINUS, std::bind(&Parser::parsePrefixExpression, this));
-    registerPrefix(Token::TokenType::TRUE, std::bind(&Parser::parseBoolean, this));
-    registerPrefix(Token::TokenType::FALSE, std::bind(&Parser::parseBoolean, this));
-    registerPrefix(Token::TokenType::FUNCTION, [this] { return parseFunctionLiteral(); });
-    registerPrefix(Token::TokenType::LPAREN, [this] { return parseGroupedExpression(); });
-    registerPrefix(Token::TokenType::STRING, [this] { return parseStringLiteral(); });
-    registerPrefix(Token::TokenType::LBRACKET, [this] { return parseArrayLiteral(); });
-    registerPrefix(Token::TokenType::IF, [this] { return parseIfExpression(); });
-    registerPrefix(Token::TokenType::WHILE, [this] { return parseWhileExpression(); });
-    registerPrefix(Token::TokenType::FOR, [this] { return parseForExpression(); });
-    registerPrefix(Token::TokenType::LET, [this] { return parseLetExpression(); });
-
-    const std::vector<Token::TokenType> infixOps = {
-        Token::TokenType::PLUS,     Token::TokenType::MINUS, Token::TokenType::SLASH,
-        Token::TokenType::ASTERISK, Token::TokenType::EQ,    Token::TokenType::NOT_EQ,
-        Token::TokenType::LT,       Token::TokenType::GT,    Token::TokenType::LBRACKET,
+// デバッグモードの場合だけメッセージを組み立てる（通常のパースで文字列を確保しない）
+#define PARSER_TRACE(msg)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (debugMode)                                                                                                 \
+        {                                                                                                              \
+            trace(msg);                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+constexpr std::array<Parser::ParseRule, Token::TOKEN_TYPE_COUNT> Parser::makeParseRules()
+{
+    std::array<ParseRule, Token::TOKEN_TYPE_COUNT> rules{};
+    auto rule = [&rules](Token::TokenType type) -> ParseRule & { return rules[static_cast<size_t>(type)]; };
+
+    // 前置の解析関数
+    rule(Token::TokenType::IDENT).prefix = &Parser::parseIdentifier;
+    rule(Token::TokenType::INT).prefix = &Parser::parseIntegerLiteral;
+    rule(Token::TokenType::BANG).prefix = &Parser::parsePrefixExpression;
+    rule(Token::TokenType::BANG).prefixOperator = AST::Operator::NOT;
+    rule(Token::TokenType::MINUS).prefix = &Parser::parsePrefixExpression;
+    rule(Token::TokenType::MINUS).prefixOperator = AST::Operator::NEG;
+    rule(Token::TokenType::TRUE).prefix = &Parser::parseBoolean;
+    rule(Token::TokenType::FALSE).prefix = &Parser::parseBoolean;
+    rule(Token::TokenType::FUNCTION).prefix = &Parser::parseFunctionLiteral;
+    rule(Token::TokenType::LPAREN).prefix = &Parser::parseGroupedExpression;
+    rule(Token::TokenType::STRING).prefix = &Parser::parseStringLiteral;
+    rule(Token::TokenType::LBRACKET).prefix = &Parser::parseArrayLiteral;
+    rule(Token::TokenType::IF).prefix = &Parser::parseIfExpression;
+    rule(Token::TokenType::WHILE).prefix = &Parser::parseWhileExpression;
+    rule(Token::TokenType::FOR).prefix = &Parser::parseForExpression;
+    rule(Token::TokenType::LET).prefix = &Parser::parseLetExpression;
+
+    // 中置の解析関数と優先順位
+    struct BinaryOperator
+    {
+        Token::TokenType type;
+        Precedence precedence;
+        AST::Operator op;
     };
-
-    for (const auto &op : infixOps)
+    const BinaryOperator binaryOperators[] = {
+        {Token::TokenType::EQ, Precedence::EQUALS, AST::Operator::EQ},
+        {Token::TokenType::NOT_EQ, Precedence::EQUALS, AST::Operator::NOT_EQ},
+        {Token::TokenType::LT, Precedence::LESSGREATER, AST::Operator::LT},
+        {Token::TokenType::GT, Precedence::LESSGREATER, AST::Operator::GT},
+        {Token::TokenType::PLUS, Precedence::SUM, AST::Operator::ADD},
+        {Token::TokenType::MINUS, Precedence::SUM, AST::Operator::SUB},
+        {Token::TokenType::SLASH, Precedence::PRODUCT, AST::Operator::DIV},
+        {Token::TokenType::ASTERISK, Precedence::PRODUCT, AST::Operator::MUL},
+    };
+    for (const auto &[type, precedence, op] : binaryOperators)
     {
-        registerInfix(op, [this](auto left) { return parseInfixExpression(std::move(left)); });
+        rule(type).infix = &Parser::parseInfixExpression;
+        rule(type).precedence = precedence;
+        rule(type).infixOperator = op;
     }
+    rule(Token::TokenType::LPAREN).infix = &Parser::parseCallExpression;
+    rule(Token::TokenType::LPAREN).precedence = Precedence::CALL;
+    rule(Token::TokenType::LBRACKET).infix = &Parser::parseIndexExpression;
+    rule(Token::TokenType::LBRACKET).precedence = Precedence::INDEX;
 
-    registerInfix(Token::TokenType::LPAREN,
-                  [this](auto left) { return parseCallExpression(std::move(left)); });
-    registerInfix(Token::TokenType::LBRACKET,
-                  [this](auto left) { return parseIndexExpression(std::move(left)); });
+    return rules;
 }
 
-void Parser::registerPrefix(Token::TokenType type, PrefixParseFn fn)
-{
-    prefixParseFns[type] = std::move(fn);
-}
+// 定数式で初期化されるため、実行時の構築処理は走らない
+const std::array<Parser::ParseRule, Token::TOKEN_TYPE_COUNT> Parser::parseRules = Parser::makeParseRules();
 
-void Parser::registerInfix(Token::TokenType type, InfixParseFn fn)
+Parser::Parser(std::unique_ptr<Lexer::Lexer> lexer)
+    : lexer(std::move(lexer)), curToken(Token::TokenType::ILLEGAL, ""),
+      peekToken(Token::TokenType::ILLEGAL, "")
 {
-    infixParseFns[type] = std::move(fn);
+    nextToken();
+    nextToken();
 }
 
 void Parser::nextToken()
 {
-    curToken = peekToken;
+    curToken = std::move(peekToken);
     peekToken = lexer->NextToken();
 }
 
@@ -115,22 +124,12 @@ void Parser::noPrefixParseFnError(Token::TokenType t)
 
 Parser::Precedence Parser::peekPrecedence() const
 {
-    auto it = precedences.find(peekToken.getType());
-    if (it != precedences.end())
-    {
-        return it->second;
-    }
-    return Precedence::LOWEST;
+    return ruleFor(peekToken.getType()).precedence;
 }
 
 Parser::Precedence Parser::curPrecedence() const
 {
-    auto it = precedences.find(curToken.getType());
-    if (it != precedences.end())
-    {
-        return it->second;
-    }
-    return Precedence::LOWEST;
+    return ruleFor(curToken.getType()).precedence;
 }
 
 void Parser::trace(const std::string &msg)
@@ -143,28 +142,31 @@ void Parser::trace(const std::string &msg)
 
 std::unique_ptr<AST::Program> Parser::ParseProgram()
 {
-    trace("START ParseProgram");
+    PARSER_TRACE("START ParseProgram");
     increaseIndent();
 
+    // Program自体はヒープに置き、文のノードはProgramが所有するアリーナから確保する
     auto program = std::make_unique<AST::Program>();
+    program->arena = std::make_unique<AST::Arena>();
+    AST::ArenaScope scope(program->arena.get());
 
     while (!curTokenIs(Token::TokenType::EOF_))
     {
-        trace("Parsing statement: " + curToken.getLiteral());
+        PARSER_TRACE("Parsing statement: " + std::string(curToken.getLiteral()));
         if (auto stmt = parseStatement())
         {
             program->statements.push_back(std::move(stmt));
-            trace("Statement parsed successfully");
+            PARSER_TRACE("Statement parsed successfully");
         }
         else
         {
-            trace("Failed to parse statement");
+            PARSER_TRACE("Failed to parse statement");
         }
         nextToken();
     }
 
     decreaseIndent();
-    trace("END ParseProgram");
+    PARSER_TRACE("END ParseProgram");
     return program;
 }
 
@@ -183,72 +185,69 @@ std::unique_ptr<AST::Statement> Parser::parseStatement()
 
 std::unique_ptr<AST::Expression> Parser::parseExpression(Precedence precedence)
 {
-    trace("START parseExpression with precedence: " + std::to_string(static_cast<int>(precedence)));
+    PARSER_TRACE("START parseExpression with precedence: " + std::to_string(static_cast<int>(precedence)));
     increaseIndent();
 
-    auto prefix = prefixParseFns.find(curToken.getType());
-    if (prefix == prefixParseFns.end())
+    auto prefix = ruleFor(curToken.getType()).prefix;
+    if (!prefix)
     {
         noPrefixParseFnError(curToken.getType());
-        trace("No prefix parse function found for: " + Token::toString(curToken.getType()));
+        PARSER_TRACE("No prefix parse function found for: " + Token::toString(curToken.getType()));
         decreaseIndent();
         return nullptr;
     }
 
-    auto leftExp = prefix->second();
+    auto leftExp = (this->*prefix)();
     if (!leftExp)
     {
-        trace("Failed to parse prefix expression");
+        PARSER_TRACE("Failed to parse prefix expression");
         decreaseIndent();
         return nullptr;
     }
 
     while (!peekTokenIs(Token::TokenType::SEMICOLON) && precedence < peekPrecedence())
     {
-        trace("Found infix operator: " + peekToken.getLiteral());
-        auto infix = infixParseFns.find(peekToken.getType());
-        if (infix == infixParseFns.end())
+        PARSER_TRACE("Found infix operator: " + std::string(peekToken.getLiteral()));
+        auto infix = ruleFor(peekToken.getType()).infix;
+        if (!infix)
         {
-            trace("No infix parse function found");
+            PARSER_TRACE("No infix parse function found");
             break;
         }
 
         nextToken();
-        leftExp = infix->second(std::move(leftExp));
+        leftExp = (this->*infix)(std::move(leftExp));
         if (!leftExp)
         {
-            trace("Failed to parse infix expression");
+            PARSER_TRACE("Failed to parse infix expression");
             break;
         }
     }
 
     decreaseIndent();
-    trace("END parseExpression");
+    PARSER_TRACE("END parseExpression");
     return leftExp;
 }
 
 std::unique_ptr<AST::Expression> Parser::parseIdentifier()
 {
-    return std::make_unique<AST::Identifier>(curToken, curToken.getLiteral());
+    return std::make_unique<AST::Identifier>(curToken, std::string(curToken.getLiteral()));
 }
 
 std::unique_ptr<AST::Expression> Parser::parseIntegerLiteral()
 {
-    try
-    {
-        int64_t value = std::stoll(curToken.getLiteral());
-        return std::make_unique<AST::IntegerLiteral>(curToken, value);
-    }
-    catch (const std::exception &e)
+    // 値は字句解析時にデコード済み
+    if (curToken.integerOverflowed())
     {
-        registerError("could not parse " + curToken.getLiteral() + " as integer");
+        registerError("could not parse " + std::string(curToken.getLiteral()) + " as integer");
         return nullptr;
     }
+    return std::make_unique<AST::IntegerLiteral>(curToken, curToken.getInteger());
 }
 
 std::unique_ptr<AST::Expression> Parser::parsePrefixExpression()
 {
-    auto expression = std::make_unique<AST::PrefixExpression>(curToken, curToken.getLiteral());
+    auto expression = std::make_unique<AST::PrefixExpression>(curToken, ruleFor(curToken.getType()).prefixOperator);
     nextToken();
 
     expression->right = parseExpression(Precedence::PREFIX);
@@ -263,8 +262,8 @@ std::unique_ptr<AST::Expression> Parser::parsePrefixExpression()
 
 std::unique_ptr<AST::Expression> Parser::parseInfixExpression(std::unique_ptr<AST::Expression> left)
 {
-    auto expression =
-        std::make_unique<AST::InfixExpression>(curToken, curToken.getLiteral(), std::move(left));
+    auto expression = std::make_unique<AST::InfixExpression>(curToken, ruleFor(curToken.getType()).infixOperator,
+                                                             std::move(left));
 
     auto precedence = curPrecedence();
     nextToken();
@@ -292,7 +291,7 @@ std::unique_ptr<AST::Expression> Parser::parseLetExpression() {
 
 std::unique_ptr<AST::LetStatement> Parser::parseLetStatement()
 {
-    trace("START parseLetStatement");
+    PARSER_TRACE("START parseLetStatement");
     increaseIndent();
 
     auto stmt = std::make_unique<AST::LetStatement>(curToken);
@@ -303,7 +302,7 @@ std::unique_ptr<AST::LetStatement> Parser::parseLetStatement()
         return nullptr;
     }
 
-    stmt->name = std::make_unique<AST::Identifier>(curToken, curToken.getLiteral());
+    stmt->name = std::make_unique<AST::Identifier>(curToken, std::string(curToken.getLiteral()));
 
     if (!expectPeek(Token::TokenType::ASSIGN))
     {
@@ -327,7 +326,7 @@ std::unique_ptr<AST::LetStatement> Parser::parseLetStatement()
     }
 
     decreaseIndent();
-    trace("END parseLetStatement");
+    PARSER_TRACE("END parseLetStatement");
     return stmt;
 }
 
@@ -369,7 +368,7 @@ std::unique_ptr<AST::ExpressionStatement> Parser::parseExpressionStatement()
 
 std::unique_ptr<AST::Expression> Parser::parseFunctionLiteral()
 {
-    trace("START parseFunctionLiteral");
+    PARSER_TRACE("START parseFunctionLiteral");
     increaseIndent();
 
     auto lit = std::make_unique<AST::FunctionLiteral>(curToken);
@@ -396,7 +395,7 @@ std::unique_ptr<AST::Expression> Parser::parseFunctionLiteral()
     }
 
     decreaseIndent();
-    trace("END parseFunctionLiteral");
+    PARSER_TRACE("END parseFunctionLiteral");
     return lit;
 }
 
@@ -411,13 +410,13 @@ std::vector<std::unique_ptr<AST::Identifier>> Parser::parseFunctionParameters()
     }
 
     nextToken();
-    params.push_back(std::make_unique<AST::Identifier>(curToken, curToken.getLiteral()));
+    params.push_back(std::make_unique<AST::Identifier>(curToken, std::string(curToken.getLiteral())));
 
     while (peekTokenIs(Token::TokenType::COMMA))
     {
         nextToken(); // COMMA
         nextToken(); // パラメータ
-        params.push_back(std::make_unique<AST::Identifier>(curToken, curToken.getLiteral()));
+        params.push_back(std::make_unique<AST::Identifier>(curToken, std::string(curToken.getLiteral())));
     }
 
     if (!expectPeek(Token::TokenType::RPAREN))
@@ -454,14 +453,14 @@ std::unique_ptr<AST::BlockStatement> Parser::parseBlockStatement()
 std::unique_ptr<AST::Expression>
 Parser::parseCallExpression(std::unique_ptr<AST::Expression> function)
 {
-    trace("START parseCallExpression");
+    PARSER_TRACE("START parseCallExpression");
     increaseIndent();
 
     auto exp = std::make_unique<AST::CallExpression>(curToken, std::move(function));
     exp->arguments = parseExpressionList(Token::TokenType::RPAREN);
 
     decreaseIndent();
-    trace("END parseCallExpression");
+    PARSER_TRACE("END parseCallExpression");
     return exp;
 }
 
@@ -513,12 +512,12 @@ std::unique_ptr<AST::Expression> Parser::parseGroupedExpression()
 
 std::unique_ptr<AST::Expression> Parser::parseStringLiteral()
 {
-    return std::make_unique<AST::StringLiteral>(curToken, curToken.getLiteral());
+    return std::make_unique<AST::StringLiteral>(curToken, std::string(curToken.getLiteral()));
 }
 
 std::unique_ptr<AST::Expression> Parser::parseArrayLiteral()
 {
-    trace("START parseArrayLiteral");
+    PARSER_TRACE("START parseArrayLiteral");
     increaseIndent();
 
     auto array = std::make_unique<AST::ArrayLiteral>(curToken);
@@ -526,13 +525,13 @@ std::unique_ptr<AST::Expression> Parser::parseArrayLiteral()
     array->elements = parseExpressionList(Token::TokenType::RBRACKET);
 
     decreaseIndent();
-    trace("END parseArrayLiteral");
+    PARSER_TRACE("END parseArrayLiteral");
     return array;
 }
 
 std::unique_ptr<AST::Expression> Parser::parseIndexExpression(std::unique_ptr<AST::Expression> left)
 {
-    trace("START parseIndexExpression");
+    PARSER_TRACE("START parseIndexExpression");
     increaseIndent();
 
     auto expr = std::make_unique<AST::IndexExpression>(curToken, std::move(left));
@@ -544,19 +543,19 @@ std::unique_ptr<AST::Expression> Parser::parseIndexExpression(std::unique_ptr<AS
     if (!expr->index)
     {
         decreaseIndent();
-        trace("Failed to parse index expression");
+        PARSER_TRACE("Failed to parse index expression");
         return nullptr;
     }
 
     if (!expectPeek(Token::TokenType::RBRACKET))
     {
         decreaseIndent();
-        trace("Expected ']'");
+        PARSER_TRACE("Expected ']'");
         return nullptr;
     }
 
     decreaseIndent();
-    trace("END parseIndexExpression");
+    PARSER_TRACE("END parseIndexExpression");
     return expr;
 }
 
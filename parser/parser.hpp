@@ -1,11 +1,10 @@
 #pragma once
 #include "../ast/ast.hpp"
 #include "../lexer/lexer.hpp"
-#include <functional>
+#include <array>
 #include <iostream>
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 namespace Parser
@@ -13,9 +12,8 @@ namespace Parser
 
 class Parser
 {
-    using PrefixParseFn = std::function<std::unique_ptr<AST::Expression>()>;
-    using InfixParseFn =
-        std::function<std::unique_ptr<AST::Expression>(std::unique_ptr<AST::Expression>)>;
+    using PrefixParseFn = std::unique_ptr<AST::Expression> (Parser::*)();
+    using InfixParseFn = std::unique_ptr<AST::Expression> (Parser::*)(std::unique_ptr<AST::Expression>);
 
   public:
     explicit Parser(std::unique_ptr<Lexer::Lexer> lexer);
@@ -37,11 +35,9 @@ class Parser
 
   private:
     std::unique_ptr<Lexer::Lexer> lexer;
-    Token::Token curToken;
-    Token::Token peekToken;
+    Token::TokenView curToken;
+    Token::TokenView peekToken;
     std::vector<std::string> errors;
-    std::unordered_map<Token::TokenType, PrefixParseFn> prefixParseFns;
-    std::unordered_map<Token::TokenType, InfixParseFn> infixParseFns;
 
     // デバッグ関
     bool debugMode = false;
@@ -74,14 +70,23 @@ class Parser
         INDEX        // array[index]
     };
 
-    static std::unordered_map<Token::TokenType, Precedence> precedences;
-
-    // パーサー初期化
-    void initParseFns();
+    // TokenTypeごとの構文規則（前置・中置の解析関数と中置演算子としての優先順位、ASTに記録する演算子）
+    struct ParseRule
+    {
+        PrefixParseFn prefix = nullptr;
+        InfixParseFn infix = nullptr;
+        Precedence precedence = Precedence::LOWEST;
+        AST::Operator prefixOperator = AST::Operator::ILLEGAL;
+        AST::Operator infixOperator = AST::Operator::ILLEGAL;
+    };
 
-    // パーサー登録
-    void registerPrefix(Token::TokenType type, PrefixParseFn fn);
-    void registerInfix(Token::TokenType type, InfixParseFn fn);
+    // TokenTypeで引く構文規則の表（コンパイル時に作られ、パーサーごとの初期化は不要）
+    static constexpr std::array<ParseRule, Token::TOKEN_TYPE_COUNT> makeParseRules();
+    static const std::array<ParseRule, Token::TOKEN_TYPE_COUNT> parseRules;
+    static const ParseRule &ruleFor(Token::TokenType type)
+    {
+        return parseRules[static_cast<size_t>(type)];
+    }
 
     // 優先順位関連
     Precedence peekPrecedence() const;
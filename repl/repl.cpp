@@ -1,15 +1,39 @@
 #include "repl.hpp"
 #include "../lexer/lexer.hpp"
 #include "../parser/parser.hpp"
+#include "../trace/trace.hpp"
 #include <iostream>
 
 namespace REPL
 {
 
-REPL::REPL() : evaluator(std::make_unique<monkey::Evaluator>()), 
-               jit(std::make_unique<JIT::Compiler>()), 
-               useJIT(false)
+namespace
 {
+constexpr size_t TRACE_BUFFER_CAPACITY = 4096; // REPLで保持するトレースの件数
+} // namespace
+
+REPL::REPL() : jit(std::make_unique<JIT::Compiler>()),
+               evaluator(std::make_unique<monkey::Evaluator>()),
+               useJIT(false),
+               useVM(false),
+               symbolTable(Compiler::NewGlobalSymbolTable()),
+               globals(VM::VM::NewGlobals())
+{
+    // トレースはリングバッファにだけ記録し、traceコマンドで必要なときに表示する
+    Trace::enableRingBuffer(TRACE_BUFFER_CAPACITY);
+
+    // インタプリタでホットになった整数関数はJITでネイティブコードに変換する
+    evaluator->setTierUpHook([this](const std::vector<std::string>& parameters, const AST::BlockStatement& body) {
+        try
+        {
+            return jit->compileNativeFunction(parameters, body);
+        }
+        catch (const std::exception& e)
+        {
+            TRACE_WARN("jit", "Tier-up failed: " << e.what());
+            return monkey::NativeFunction(nullptr);
+        }
+    });
 }
 
 void REPL::Start()
@@ -17,6 +41,10 @@ void REPL::Start()
     std::cout << "Monkey Programming Language\n";
     std::cout << "Type 'jit' to toggle JIT compilation (currently " 
               << (useJIT ? "enabled" : "disabled") << ")\n";
+    std::cout << "Type 'vm' to toggle the bytecode VM (currently "
+              << (useVM ? "enabled" : "disabled") << ")\n";
+    std::cout << "Type 'trace' to dump recent trace records, 'trace <level>' to set the level (currently "
+              << Trace::levelName(Trace::getLevel()) << "), 'trace clear' to clear them\n";
     std::cout << "Type 'exit' to exit\n";
 
     std::string line;
@@ -35,10 +63,22 @@ void REPL::Start()
             continue;
         }
 
+        if (line == "vm")
+        {
+            toggleVM();
+            continue;
+        }
+
+        if (line == "trace" || line.rfind("trace ", 0) == 0)
+        {
+            handleTraceCommand(line.size() > 6 ? line.substr(6) : "");
+            continue;
+        }
+
         auto lexer = std::make_unique<Lexer::Lexer>(line);
         Parser::Parser parser(std::move(lexer));
 
-        auto program = parser.ParseProgram();
+        std::shared_ptr<const AST::Program> program = parser.ParseProgram();
         if (!program || !parser.Errors().empty())
         {
             printParserErrors(parser.Errors());
@@ -47,11 +87,15 @@ void REPL::Start()
 
         if (useJIT)
         {
-            executeWithJIT(*program);
+            executeWithJIT(std::move(program));
+        }
+        else if (useVM)
+        {
+            executeWithVM(*program);
         }
         else
         {
-            executeWithInterpreter(*program);
+            executeWithInterpreter(std::move(program));
         }
     }
 }
@@ -59,15 +103,80 @@ void REPL::Start()
 void REPL::toggleJIT()
 {
     useJIT = !useJIT;
+    if (useJIT)
+    {
+        useVM = false;
+    }
     std::cout << "JIT compilation " << (useJIT ? "enabled" : "disabled") << "\n";
 }
 
-void REPL::executeWithJIT(const AST::Program& program)
+void REPL::toggleVM()
+{
+    useVM = !useVM;
+    if (useVM)
+    {
+        useJIT = false;
+    }
+    std::cout << "Bytecode VM " << (useVM ? "enabled" : "disabled") << "\n";
+}
+
+void REPL::handleTraceCommand(const std::string& args)
+{
+    if (args.empty())
+    {
+        Trace::dump(std::cout);
+        return;
+    }
+
+    if (args == "clear")
+    {
+        Trace::clear();
+        return;
+    }
+
+    Trace::Level level;
+    if (!Trace::parseLevel(args, level))
+    {
+        std::cout << "Unknown trace level: " << args << " (off, error, warn, info, debug, trace)\n";
+        return;
+    }
+    Trace::setLevel(level);
+    std::cout << "Trace level set to " << Trace::levelName(level);
+    if (!Trace::compiledIn(level))
+    {
+        std::cout << " (this build only records up to " << Trace::levelName(static_cast<Trace::Level>(MONKEY_TRACE_LEVEL))
+                  << ")";
+    }
+    std::cout << "\n";
+}
+
+void REPL::executeWithJIT(std::shared_ptr<const AST::Program> program)
 {
     try
     {
-        jit->compile(program);
-        std::cout << "Generated LLVM IR:\n" << jit->getIR() << std::endl;
+        jit->compile(*program);
+        TRACE_DEBUG("jit", "Generated LLVM IR:\n" << jit->getIR());
+        // JITが対応していない構文を含む場合はインタプリタで評価する
+        if (!jit->isComplete())
+        {
+            TRACE_INFO("jit", "Falling back to the interpreter: " << program->String());
+            executeWithInterpreter(std::move(program));
+            return;
+        }
+        auto result = jit->execute();
+        // JITで束縛した名前は、以降の行をインタプリタで評価するときにも見えるようにする
+        for (const auto& binding : jit->committedBindings())
+        {
+            if (binding.definition)
+            {
+                evaluator->eval(binding.definition);
+            }
+            else
+            {
+                evaluator->defineGlobal(binding.name, binding.value);
+            }
+        }
+        std::cout << result->inspect() << std::endl;
     }
     catch (const std::exception& e)
     {
@@ -75,15 +184,47 @@ void REPL::executeWithJIT(const AST::Program& program)
     }
 }
 
-void REPL::executeWithInterpreter(const AST::Program& program)
+void REPL::executeWithInterpreter(std::shared_ptr<const AST::Program> program)
 {
-    auto evaluated = evaluator->eval(&program);
+    auto evaluated = evaluator->eval(std::move(program));
+    // インタプリタで束縛し直した名前は、JITのセッションでも以前の定義を使わないようにする
+    for (const auto& name : evaluator->boundGlobals())
+    {
+        jit->rebind(name, evaluator->getGlobal(name));
+    }
     if (evaluated)
     {
         std::cout << evaluated->inspect() << std::endl;
     }
 }
 
+void REPL::executeWithVM(const AST::Program& program)
+{
+    // 途中で失敗した行が定義した名前を残さないよう、シンボルテーブルの複製に対してコンパイルし、成功した場合だけ反映する
+    auto candidate = std::make_shared<Compiler::SymbolTable>(*symbolTable);
+    Compiler::Compiler compiler(candidate, constants);
+    if (!compiler.compile(program))
+    {
+        std::cout << "Compilation failed:\n";
+        for (const auto& error : compiler.Errors())
+        {
+            std::cout << "\t" << error << "\n";
+        }
+        return;
+    }
+    symbolTable = std::move(candidate);
+
+    auto bytecode = compiler.bytecode();
+    constants = bytecode.constants;
+
+    VM::VM machine(bytecode, globals);
+    auto result = machine.run();
+    if (result)
+    {
+        std::cout << result->inspect() << std::endl;
+    }
+}
+
 void REPL::printParserErrors(const std::vector<std::string>& errors)
 {
     std::cout << "Parser errors:\n";
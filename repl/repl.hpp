@@ -1,6 +1,7 @@
 #pragma once
 #include "../evaluator/evaluator.hpp"
 #include "../jit/jit.hpp"
+#include "../vm/vm.hpp"
 #include <memory>
 #include <string>
 
@@ -10,20 +11,32 @@ namespace REPL
 class REPL
 {
 private:
-    std::unique_ptr<monkey::Evaluator> evaluator;
+    // 評価器の関数オブジェクトがJITのネイティブコードを参照するため、JITを先に構築し後に破棄する
     std::unique_ptr<JIT::Compiler> jit;
+    std::unique_ptr<monkey::Evaluator> evaluator;
     bool useJIT;
+    bool useVM;
+
+    // VMの状態（行をまたいで引き継ぐ）
+    std::shared_ptr<Compiler::SymbolTable> symbolTable;
+    std::vector<monkey::ObjectPtr> constants;
+    std::shared_ptr<VM::Globals> globals;
 
 public:
     REPL();
     void Start();
     void toggleJIT();
     bool isJITEnabled() const { return useJIT; }
+    void toggleVM();
+    bool isVMEnabled() const { return useVM; }
 
 private:
     void printParserErrors(const std::vector<std::string>& errors);
-    void executeWithJIT(const AST::Program& program);
-    void executeWithInterpreter(const AST::Program& program);
+    void handleTraceCommand(const std::string& args);
+    // 評価器で作られた関数が行をまたいで構文木を参照するため、構文木の所有権を共有して渡す
+    void executeWithJIT(std::shared_ptr<const AST::Program> program);
+    void executeWithInterpreter(std::shared_ptr<const AST::Program> program);
+    void executeWithVM(const AST::Program& program);
 };
 
 } // namespace REPL
@@ -0,0 +1,127 @@
+#include "script.hpp"
+#include "../lexer/lexer.hpp"
+#include "../parser/parser.hpp"
+#include "../trace/trace.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Script
+{
+
+MappedFile::MappedFile(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error(path + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error(path + ": " + std::strerror(error));
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        throw std::runtime_error(path + ": not a regular file");
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0)
+    {
+        void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error(path + ": " + std::strerror(error));
+        }
+        // 字句解析は先頭から順に読むだけなので先読みを促す
+        ::madvise(mapped, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char *>(mapped);
+    }
+    // マップはファイル記述子を閉じても有効
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_)
+    {
+        ::munmap(const_cast<char *>(data_), size_);
+    }
+}
+
+Runner::Runner(std::ostream &err)
+    : jit(std::make_unique<JIT::Compiler>()), evaluator(std::make_unique<monkey::Evaluator>()), err(err)
+{
+    // REPLと同じく、ホットになった整数関数はJITでネイティブコードに変換する
+    evaluator->setTierUpHook([this](const std::vector<std::string> &parameters, const AST::BlockStatement &body) {
+        try
+        {
+            return jit->compileNativeFunction(parameters, body);
+        }
+        catch (const std::exception &e)
+        {
+            TRACE_WARN("jit", "Tier-up failed: " << e.what());
+            return monkey::NativeFunction(nullptr);
+        }
+    });
+}
+
+ExitCode Runner::runFile(const std::string &path)
+{
+    std::unique_ptr<MappedFile> file;
+    try
+    {
+        file = std::make_unique<MappedFile>(path);
+    }
+    catch (const std::exception &e)
+    {
+        err << "monkey: " << e.what() << "\n";
+        return ExitCode::NO_INPUT;
+    }
+    return run(file->data(), file->size());
+}
+
+ExitCode Runner::run(const char *source, size_t size)
+{
+    std::unique_ptr<AST::Program> program;
+    try
+    {
+        Parser::Parser parser(std::make_unique<Lexer::Lexer>(source, size));
+        program = parser.ParseProgram();
+        if (!program || !parser.Errors().empty())
+        {
+            for (const auto &error : parser.Errors())
+            {
+                err << "parse error: " << error << "\n";
+            }
+            return ExitCode::PARSE_ERROR;
+        }
+    }
+    catch (const std::runtime_error &e)
+    {
+        // 閉じていない文字列リテラルなどはレキサーが例外で知らせる
+        err << "parse error: " << e.what() << "\n";
+        return ExitCode::PARSE_ERROR;
+    }
+
+    auto result = evaluator->eval(std::move(program));
+    if (result && result->type() == monkey::ObjectType::ERROR)
+    {
+        err << result->inspect() << "\n";
+        return ExitCode::RUNTIME_ERROR;
+    }
+    return ExitCode::OK;
+}
+
+} // namespace Script
@@ -0,0 +1,66 @@
+#pragma once
+#include "../evaluator/evaluator.hpp"
+#include "../jit/jit.hpp"
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Script
+{
+
+// スクリプト実行の終了コード（sysexits.hの値に合わせる）
+enum class ExitCode : int
+{
+    OK = 0,
+    RUNTIME_ERROR = 1, // 評価結果がエラーになった
+    USAGE = 64,        // コマンドライン引数が不正
+    PARSE_ERROR = 65,  // 字句解析・構文解析のエラー
+    NO_INPUT = 66      // スクリプトファイルを開けない
+};
+
+// 読み取り専用でmmapしたファイル（ムーブ不可。空のファイルはマップせずsize()が0になる）
+// 開けない場合はstd::runtime_errorを投げる
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const
+    {
+        return data_;
+    }
+    size_t size() const
+    {
+        return size_;
+    }
+
+  private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// スクリプトを対話なしで評価する
+// 最後の式の値は表示せず、出力はputsによるもののみ。エラーはerrに書き出して終了コードで知らせる
+class Runner
+{
+  public:
+    explicit Runner(std::ostream &err);
+
+    // ファイルをmmapし、std::stringへコピーせずに字句解析・構文解析して評価する
+    ExitCode runFile(const std::string &path);
+    // メモリ上のソースを評価する（sourceは評価が終わるまで有効でなければならない）
+    ExitCode run(const char *source, size_t size);
+
+  private:
+    // 評価器の関数オブジェクトがJITのネイティブコードを参照するため、JITを先に構築し後に破棄する
+    std::unique_ptr<JIT::Compiler> jit;
+    std::unique_ptr<monkey::Evaluator> evaluator;
+    std::ostream &err;
+};
+
+} // namespace Script
@@ -0,0 +1,200 @@
+#include "../code/code.hpp"
+#include "../compiler/compiler.hpp"
+#include "../lexer/lexer.hpp"
+#include "../parser/parser.hpp"
+#include <gtest/gtest.h>
+
+namespace
+{
+Code::Instructions concat(const std::vector<Code::Instructions> &list)
+{
+    Code::Instructions out;
+    for (const auto &ins : list)
+    {
+        out.insert(out.end(), ins.begin(), ins.end());
+    }
+    return out;
+}
+
+Compiler::Bytecode compileInput(const std::string &input)
+{
+    Parser::Parser parser(std::make_unique<Lexer::Lexer>(input));
+    auto program = parser.ParseProgram();
+
+    Compiler::Compiler compiler;
+    EXPECT_TRUE(compiler.compile(*program));
+    return compiler.bytecode();
+}
+} // namespace
+
+TEST(CodeTest, TestMake)
+{
+    auto ins = Code::make(Code::Opcode::CONSTANT, {65534});
+    Code::Instructions expected = {static_cast<uint8_t>(Code::Opcode::CONSTANT), 255, 254};
+    EXPECT_EQ(ins, expected);
+
+    ins = Code::make(Code::Opcode::CLOSURE, {65534, 255});
+    expected = {static_cast<uint8_t>(Code::Opcode::CLOSURE), 255, 254, 255};
+    EXPECT_EQ(ins, expected);
+}
+
+TEST(CodeTest, TestMakeRejectsOperandOutOfRange)
+{
+    EXPECT_THROW(Code::make(Code::Opcode::CONSTANT, {65536}), std::out_of_range);
+    EXPECT_THROW(Code::make(Code::Opcode::GET_LOCAL, {256}), std::out_of_range);
+    EXPECT_THROW(Code::make(Code::Opcode::CLOSURE, {0, -1}), std::out_of_range);
+}
+
+TEST(CodeTest, TestInstructionsString)
+{
+    auto ins = concat({
+        Code::make(Code::Opcode::ADD),
+        Code::make(Code::Opcode::GET_LOCAL, {1}),
+        Code::make(Code::Opcode::CONSTANT, {2}),
+        Code::make(Code::Opcode::CLOSURE, {65535, 255}),
+    });
+
+    std::string expected = "0000 OpAdd\n"
+                           "0001 OpGetLocal 1\n"
+                           "0003 OpConstant 2\n"
+                           "0006 OpClosure 65535 255\n";
+    EXPECT_EQ(Code::toString(ins), expected);
+}
+
+TEST(CompilerTest, TestIntegerArithmetic)
+{
+    auto bytecode = compileInput("1 + 2");
+    auto expected = concat({
+        Code::make(Code::Opcode::CONSTANT, {0}),
+        Code::make(Code::Opcode::CONSTANT, {1}),
+        Code::make(Code::Opcode::ADD),
+        Code::make(Code::Opcode::POP),
+    });
+    EXPECT_EQ(Code::toString(bytecode.instructions), Code::toString(expected));
+    ASSERT_EQ(bytecode.constants.size(), 2);
+}
+
+TEST(CompilerTest, TestConditionals)
+{
+    auto bytecode = compileInput("if (true) { 10 }; 3333;");
+    auto expected = concat({
+        Code::make(Code::Opcode::TRUE),                  // 0000
+        Code::make(Code::Opcode::JUMP_NOT_TRUTHY, {10}), // 0001
+        Code::make(Code::Opcode::CONSTANT, {0}),         // 0004
+        Code::make(Code::Opcode::JUMP, {11}),            // 0007
+        Code::make(Code::Opcode::NULL_),                 // 0010
+        Code::make(Code::Opcode::POP),                   // 0011
+        Code::make(Code::Opcode::CONSTANT, {1}),         // 0012
+        Code::make(Code::Opcode::POP),                   // 0015
+    });
+    EXPECT_EQ(Code::toString(bytecode.instructions), Code::toString(expected));
+}
+
+TEST(CompilerTest, TestGlobalLetStatements)
+{
+    auto bytecode = compileInput("let one = 1; one;");
+    auto expected = concat({
+        Code::make(Code::Opcode::CONSTANT, {0}),
+        Code::make(Code::Opcode::SET_GLOBAL, {0}),
+        Code::make(Code::Opcode::POP),
+        Code::make(Code::Opcode::GET_GLOBAL, {0}),
+        Code::make(Code::Opcode::POP),
+    });
+    EXPECT_EQ(Code::toString(bytecode.instructions), Code::toString(expected));
+}
+
+TEST(CompilerTest, TestClosures)
+{
+    auto bytecode = compileInput("fn(a) { fn(b) { a + b } }");
+    ASSERT_EQ(bytecode.constants.size(), 2);
+
+    auto inner = monkey::dynamicRefCast<monkey::CompiledFunction>(bytecode.constants[0]);
+    ASSERT_NE(inner, nullptr);
+    auto expectedInner = concat({
+        Code::make(Code::Opcode::GET_FREE, {0}),
+        Code::make(Code::Opcode::GET_LOCAL, {0}),
+        Code::make(Code::Opcode::ADD),
+        Code::make(Code::Opcode::RETURN_VALUE),
+    });
+    EXPECT_EQ(Code::toString(inner->instructions), Code::toString(expectedInner));
+
+    auto outer = monkey::dynamicRefCast<monkey::CompiledFunction>(bytecode.constants[1]);
+    ASSERT_NE(outer, nullptr);
+    auto expectedOuter = concat({
+        Code::make(Code::Opcode::GET_LOCAL, {0}),
+        Code::make(Code::Opcode::CLOSURE, {0, 1}),
+        Code::make(Code::Opcode::RETURN_VALUE),
+    });
+    EXPECT_EQ(Code::toString(outer->instructions), Code::toString(expectedOuter));
+}
+
+TEST(CompilerTest, TestUndefinedIdentifier)
+{
+    Parser::Parser parser(std::make_unique<Lexer::Lexer>("foobar"));
+    auto program = parser.ParseProgram();
+
+    Compiler::Compiler compiler;
+    EXPECT_FALSE(compiler.compile(*program));
+    ASSERT_EQ(compiler.Errors().size(), 1);
+    EXPECT_EQ(compiler.Errors()[0], "identifier not found: foobar");
+}
+
+TEST(CompilerTest, TestOperandOutOfRange)
+{
+    auto compileErrors = [](const std::string &input) {
+        Parser::Parser parser(std::make_unique<Lexer::Lexer>(input));
+        auto program = parser.ParseProgram();
+        Compiler::Compiler compiler;
+        EXPECT_FALSE(compiler.compile(*program)) << input.substr(0, 40);
+        return compiler.Errors();
+    };
+
+    // 引数の数はu8に収まらなければならない
+    std::string call = "len(0";
+    for (int i = 1; i < 256; i++)
+    {
+        call += ", 0";
+    }
+    call += ")";
+    auto errors = compileErrors(call);
+    ASSERT_FALSE(errors.empty());
+    EXPECT_EQ(errors.back(), "operand 256 of OpCall does not fit in 8 bits");
+
+    // 定数のインデックスはu16に収まらなければならない
+    std::string constants = "[0";
+    for (int i = 1; i <= 65536; i++)
+    {
+        constants += ", 0";
+    }
+    constants += "]";
+    errors = compileErrors(constants);
+    ASSERT_FALSE(errors.empty());
+    EXPECT_EQ(errors.front(), "operand 65536 of OpConstant does not fit in 16 bits");
+}
+
+TEST(CompilerTest, TestHashLiteralKeepsSourceOrder)
+{
+    // キーと値はソース上の順に評価される（キーの文字列表現では並べ替えない）
+    auto integer = [](int64_t value) {
+        return std::make_unique<AST::IntegerLiteral>(Token::Token(Token::TokenType::INT, std::to_string(value)), value);
+    };
+    auto hash = std::make_unique<AST::HashLiteral>(Token::Token(Token::TokenType::LBRACE, "{"));
+    hash->pairs.emplace_back(integer(3), integer(30));
+    hash->pairs.emplace_back(integer(1), integer(10));
+    auto stmt = std::make_unique<AST::ExpressionStatement>(Token::Token(Token::TokenType::LBRACE, "{"));
+    stmt->expression = std::move(hash);
+    AST::Program program;
+    program.statements.push_back(std::move(stmt));
+
+    Compiler::Compiler compiler;
+    ASSERT_TRUE(compiler.compile(program));
+    auto bytecode = compiler.bytecode();
+    std::vector<int64_t> constants;
+    for (const auto &constant : bytecode.constants)
+    {
+        auto value = monkey::dynamicRefCast<monkey::Integer>(constant);
+        ASSERT_NE(value, nullptr);
+        constants.push_back(value->value());
+    }
+    EXPECT_EQ(constants, (std::vector<int64_t>{3, 30, 1, 10}));
+}
@@ -1,8 +1,10 @@
 #include "../evaluator/evaluator.hpp"
+#include "../evaluator/resolver.hpp"
 #include "../lexer/lexer.hpp"
 #include "../object/object.hpp"
 #include "../parser/parser.hpp"
 #include <gtest/gtest.h>
+#include <limits>
 
 using namespace monkey;
 
@@ -15,17 +17,17 @@ ObjectPtr testEval(const std::string &input)
 
     if (!program || program->statements.empty())
     {
-        return std::make_shared<Error>("Failed to parse program");
+        return makeRef<Error>("Failed to parse program");
     }
 
     Evaluator evaluator;
-    return evaluator.eval(program.get());
+    return evaluator.eval(std::move(program));
 }
 
 // 整数の評価をテストするヘルパー関数
 void testIntegerObject(const ObjectPtr &obj, int64_t expected)
 {
-    auto integer = std::dynamic_pointer_cast<Integer>(obj);
+    auto integer = dynamicRefCast<Integer>(obj);
     ASSERT_NE(integer, nullptr);
     EXPECT_EQ(integer->value(), expected);
 }
@@ -33,7 +35,7 @@ void testIntegerObject(const ObjectPtr &obj, int64_t expected)
 // 真偽値の評価をテストするヘルパー関数
 void testBooleanObject(const ObjectPtr &obj, bool expected)
 {
-    auto boolean = std::dynamic_pointer_cast<Boolean>(obj);
+    auto boolean = dynamicRefCast<Boolean>(obj);
     ASSERT_NE(boolean, nullptr);
     EXPECT_EQ(boolean->value(), expected);
 }
@@ -41,7 +43,7 @@ void testBooleanObject(const ObjectPtr &obj, bool expected)
 // 文字列の評価をテストするヘルパー関数
 void testStringObject(const ObjectPtr &obj, const std::string &expected)
 {
-    auto str = std::dynamic_pointer_cast<String>(obj);
+    auto str = dynamicRefCast<String>(obj);
     ASSERT_NE(str, nullptr);
     EXPECT_EQ(str->getValue(), expected);
 }
@@ -67,6 +69,8 @@ TEST(EvaluatorTest, TestEvalIntegerExpression)
         {"2 * (5 + 5)", 20},
         {"3 * 3 * 3", 27},
         {"(5 + 10 * 2 + 15 / 3)", 30},
+        // オーバーフローする除算はラップアラウンドする（VM・JITと同じ結果）
+        {"let d = fn(a, b) { a / b }; d(-9223372036854775807 - 1, -1)", std::numeric_limits<int64_t>::min()},
     };
 
     for (const auto &tt : tests)
@@ -142,6 +146,44 @@ TEST(EvaluatorTest, TestBangOperator)
     }
 }
 
+// return文のテスト
+TEST(EvaluatorTest, TestReturnStatements)
+{
+    struct Test
+    {
+        std::string input;
+        int64_t expected;
+    };
+
+    std::vector<Test> tests = {
+        {"return 10;", 10},
+        {"return 10; 9;", 10},
+        {"9; return 2 * 5; 9;", 10},
+        {"if (10 > 1) { if (10 > 1) { return 10; } return 1; }", 10},
+        // 関数内のreturnは呼び出し元の後続の文を止めない
+        {"let f = fn(x) { return x; x + 10; }; f(10); 20;", 20},
+        {"let f = fn(x) { if (x > 1) { return x; } 0 }; f(3) + f(4)", 7},
+        // ループの中のreturnは関数を抜ける
+        {"let f = fn() { let i = 0; while (true) { let i = i + 1; if (i > 4) { return i; } } }; f()", 5},
+        {"let f = fn() { for (let i = 0; i < 10; let i = i + 1) { if (i == 3) { return i * 10; } } 99 }; f()",
+         30},
+        {"let fib = fn(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }; fib(15)", 610},
+        // 部分式の中のreturnも外側の式の評価を打ち切って関数を抜ける
+        {"fn() { 1 + if (true) { return 5 } else { 0 } }()", 5},
+        {"fn() { if (true) { return 5 } else { 0 } + 1 }()", 5},
+        {"fn() { -if (true) { return 5 } else { 0 } }()", 5},
+        {"let g = fn(a, b) { a * b }; fn() { g(2, if (true) { return 5 } else { 3 }) * 100 }()", 5},
+        {"fn() { let x = if (true) { return 5 } else { 0 }; x + 100 }()", 5},
+        {"fn() { [1, if (true) { return 5 } else { 0 }][0] + 100 }()", 5},
+        {"fn() { if (if (true) { return 5 } else { false }) { 100 } else { 200 } }()", 5},
+    };
+
+    for (const auto &tt : tests)
+    {
+        testIntegerObject(testEval(tt.input), tt.expected);
+    }
+}
+
 // エラー処理のテスト
 TEST(EvaluatorTest, TestErrorHandling)
 {
@@ -164,7 +206,7 @@ TEST(EvaluatorTest, TestErrorHandling)
     for (const auto &tt : tests)
     {
         auto evaluated = testEval(tt.input);
-        auto errorObj = std::dynamic_pointer_cast<Error>(evaluated);
+        auto errorObj = dynamicRefCast<Error>(evaluated);
         ASSERT_NE(errorObj, nullptr)
             << "Expected error object, got: " << (evaluated ? evaluated->inspect() : "nullptr");
         EXPECT_EQ(errorObj->message(), tt.expectedMessage);
@@ -192,14 +234,14 @@ TEST(EvaluatorTest, TestArrayLiterals)
     std::string input = "[1, 2 * 2, 3 + 3]";
 
     auto evaluated = testEval(input);
-    auto result = std::dynamic_pointer_cast<monkey::Array>(evaluated);
+    auto result = monkey::dynamicRefCast<monkey::Array>(evaluated);
 
     ASSERT_NE(result, nullptr);
     ASSERT_EQ(result->elements.size(), 3);
 
-    testIntegerObject(result->elements[0], 1);
-    testIntegerObject(result->elements[1], 4);
-    testIntegerObject(result->elements[2], 6);
+    testIntegerObject(result->elements[0].toObject(), 1);
+    testIntegerObject(result->elements[1].toObject(), 4);
+    testIntegerObject(result->elements[2].toObject(), 6);
 }
 
 TEST(EvaluatorTest, TestArrayIndexExpressions)
@@ -233,7 +275,7 @@ TEST(EvaluatorTest, TestArrayIndexExpressions)
         }
         else
         {
-            ASSERT_NE(std::dynamic_pointer_cast<monkey::Null>(evaluated), nullptr);
+            ASSERT_NE(monkey::dynamicRefCast<monkey::Null>(evaluated), nullptr);
         }
     }
 }
@@ -254,7 +296,7 @@ TEST(EvaluatorTest, TestArrayErrorHandling)
     for (const auto &tt : tests)
     {
         auto evaluated = testEval(tt.input);
-        auto errorObj = std::dynamic_pointer_cast<monkey::Error>(evaluated);
+        auto errorObj = monkey::dynamicRefCast<monkey::Error>(evaluated);
 
         ASSERT_NE(errorObj, nullptr);
         EXPECT_EQ(errorObj->message(), tt.expectedError);
@@ -277,4 +319,340 @@ TEST(EvaluatorTest, TestWhileExpression) {
         auto evaluated = testEval(tt.input);
         testIntegerObject(evaluated, tt.expected);
     }
-}
\ No newline at end of file
+}
+TEST(EvaluatorTest, TestFunctionsAndClosures)
+{
+    struct Test
+    {
+        std::string input;
+        int64_t expected;
+    };
+
+    std::vector<Test> tests = {
+        {"let add = fn(a, b) { a + b; }; add(1, 2);", 3},
+        {"let f = fn(x) { let y = x * 2; y + 1; }; f(4);", 9},
+        {"let adder = fn(x) { fn(y) { x + y; }; }; let addTwo = adder(2); addTwo(3);", 5},
+        {"let a = fn(x) { fn(y) { fn(z) { x + y + z; }; }; }; a(1)(2)(3);", 6},
+        {"let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(10);", 55},
+        {"let isEven = fn(n) { if (n == 0) { true } else { isOdd(n - 1) } }; "
+         "let isOdd = fn(n) { if (n == 0) { false } else { isEven(n - 1) } }; "
+         "if (isEven(10)) { 1 } else { 0 }",
+         1},
+        {"let x = 10; let f = fn() { x }; let g = fn(x) { f() }; g(20);", 10},
+        {"let s = 0; for (let i = 0; i < 5; let i = i + 1) { let s = s + i; } s;", 10},
+    };
+
+    for (const auto &tt : tests)
+    {
+        testIntegerObject(testEval(tt.input), tt.expected);
+    }
+}
+
+// クロージャが外側の関数の変数をセルで共有することのテスト
+TEST(EvaluatorTest, TestClosuresShareCapturedCells)
+{
+    struct Test
+    {
+        std::string input;
+        int64_t expected;
+    };
+
+    std::vector<Test> tests = {
+        // 捕捉の後に定義した側で代入し直した値が見える
+        {"let f = fn() { let x = 1; let g = fn() { x }; let x = 2; g() }; f();", 2},
+        // 関数の中で定義した再帰関数は、捕捉したセルから自分自身を呼ぶ
+        {"let f = fn(n) { let fact = fn(k) { if (k < 2) { 1 } else { k * fact(k - 1) } }; fact(n) }; f(5);", 120},
+        // 間の関数を経由して2段外側の変数を捕捉する
+        {"let f = fn(a) { let b = 10; fn() { fn() { a + b } } }; f(1)()();", 11},
+        // 引数も捕捉できる
+        {"let f = fn(a, b) { let g = fn() { a * b }; g() + a }; f(3, 4);", 15},
+        // 値で捕捉した引数を後から代入し直した場合は、セルで捕捉し直して新しい値が見える
+        {"let f = fn(a) { let g = fn() { a }; let a = 5; g() }; f(1);", 5},
+        {"let f = fn(a) { let a = a * 2; fn() { a } }; f(3)();", 6},
+        // 呼び出しが終わった後も返されたクロージャが有効なままになる
+        {"let adder = fn(a) { fn(b) { a + b } }; let addTwo = adder(2); let addFive = adder(5); addTwo(1) + addFive(1);", 9},
+    };
+
+    for (const auto &tt : tests)
+    {
+        testIntegerObject(testEval(tt.input), tt.expected);
+    }
+
+    // 捕捉するのは本体が参照する変数だけ
+    auto evaluated = testEval("let f = fn(a, b, c) { let d = 4; fn() { a + d } }; f(1, 2, 3);");
+    ASSERT_EQ(evaluated->type(), ObjectType::FUNCTION);
+    auto fn = staticRefCast<Function>(evaluated);
+    // 代入し直さない引数は値で、letで定義した変数はセルで捕捉する
+    ASSERT_EQ(fn->capturedValues.size(), 1u);
+    testIntegerObject(fn->capturedValues[0].toObject(), 1);
+    ASSERT_EQ(fn->capturedCells.size(), 1u);
+
+    // 関数の中で後から定義する局所関数も参照できる（相互再帰）
+    testBooleanObject(testEval("let f = fn() { let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } }; "
+                                  "let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } }; even(10) }; f()"),
+                      true);
+}
+
+// REPLのように同じ評価器で複数のプログラムを評価した場合のテスト
+TEST(EvaluatorTest, TestGlobalsPersistAcrossPrograms)
+{
+    Evaluator evaluator;
+    ObjectPtr result;
+    for (const std::string line : {"let f = fn(n) { g(n) + 1 };", "let g = fn(n) { n * 2 };",
+                                   "f(20)"})
+    {
+        Parser::Parser parser(std::make_unique<Lexer::Lexer>(line));
+        auto program = parser.ParseProgram();
+        result = evaluator.eval(std::move(program));
+    }
+    testIntegerObject(result, 41);
+}
+
+// 関数オブジェクトが本体をコピーせず、構文木を共有して保持することのテスト
+TEST(EvaluatorTest, TestFunctionsShareProgram)
+{
+    Evaluator evaluator;
+    Parser::Parser definitions(std::make_unique<Lexer::Lexer>(
+        "let make = fn(n) { fn(x) { x + n } }; let a = make(1); let b = make(2);"));
+    std::shared_ptr<const AST::Program> program = definitions.ParseProgram();
+    std::weak_ptr<const AST::Program> weakProgram = program;
+    evaluator.eval(std::move(program));
+
+    // 定義した行の構文木は関数が参照している間は破棄されない
+    ASSERT_FALSE(weakProgram.expired());
+
+    Parser::Parser use(std::make_unique<Lexer::Lexer>("[a, b, a(10) + b(20)]"));
+    auto result = dynamicRefCast<Array>(evaluator.eval(use.ParseProgram()));
+    ASSERT_NE(result, nullptr);
+    ASSERT_EQ(result->elements.size(), 3u);
+    auto a = dynamicRefCast<Function>(result->elements[0].toObject());
+    auto b = dynamicRefCast<Function>(result->elements[1].toObject());
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    // 同じリテラルから作られたクロージャは同じ本体を指す
+    EXPECT_EQ(a->body, b->body);
+    EXPECT_EQ(a->source, weakProgram.lock());
+    EXPECT_EQ(a->inspect(), "fn(x) {\n{ (x + n) }\n}");
+    testIntegerObject(result->elements[2].toObject(), 33);
+
+    // 関数がなくなれば構文木も解放される
+    a.reset();
+    b.reset();
+    result.reset();
+    evaluator.getEnv()->Clear();
+    EXPECT_TRUE(weakProgram.expired());
+}
+
+// 解決パスが識別子に変数の場所を割り当て、自由変数だけを捕捉させることのテスト
+TEST(ResolverTest, TestLexicalAddresses)
+{
+    Parser::Parser parser(
+        std::make_unique<Lexer::Lexer>("let x = 1; let f = fn(a) { let b = a; fn() { x + b } };"));
+    auto program = parser.ParseProgram();
+
+    Resolver resolver;
+    resolver.resolve(program.get());
+    EXPECT_EQ(resolver.lookupGlobal("x"), 0);
+    EXPECT_EQ(resolver.lookupGlobal("f"), 1);
+    EXPECT_EQ(resolver.numGlobals(), 2);
+
+    auto letF = dynamic_cast<AST::LetStatement *>(program->statements[1].get());
+    ASSERT_NE(letF, nullptr);
+    auto outer = dynamic_cast<AST::FunctionLiteral *>(letF->value.get());
+    ASSERT_NE(outer, nullptr);
+    // aは呼び出し環境のスロットに、内側の関数に捕捉されるbはセルに置かれる
+    EXPECT_EQ(outer->numLocals, 1);
+    EXPECT_EQ(outer->numCells, 1);
+    EXPECT_TRUE(outer->capturedValues.empty());
+    EXPECT_TRUE(outer->capturedCells.empty());
+
+    auto inner = dynamic_cast<AST::ExpressionStatement *>(outer->body->statements[1].get());
+    ASSERT_NE(inner, nullptr);
+    auto innerFn = dynamic_cast<AST::FunctionLiteral *>(inner->expression.get());
+    ASSERT_NE(innerFn, nullptr);
+    EXPECT_EQ(innerFn->numLocals, 0);
+    EXPECT_EQ(innerFn->numCells, 0);
+    // グローバル変数のxは捕捉せず、外側の関数のbだけを捕捉する
+    // （letで定義したbは代入し直されうるのでセルで捕捉する）
+    EXPECT_TRUE(innerFn->capturedValues.empty());
+    ASSERT_EQ(innerFn->capturedCells.size(), 1u);
+    EXPECT_EQ(innerFn->capturedCells[0]->value, "b");
+    EXPECT_EQ(innerFn->capturedCells[0]->scope, AST::VariableScope::CELL);
+    EXPECT_EQ(innerFn->capturedCells[0]->slot, 0);
+
+    auto body = dynamic_cast<AST::ExpressionStatement *>(innerFn->body->statements[0].get());
+    auto sum = dynamic_cast<AST::InfixExpression *>(body->expression.get());
+    ASSERT_NE(sum, nullptr);
+
+    auto x = dynamic_cast<AST::Identifier *>(sum->left.get());
+    auto b = dynamic_cast<AST::Identifier *>(sum->right.get());
+    ASSERT_NE(x, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ(x->scope, AST::VariableScope::GLOBAL);
+    EXPECT_EQ(x->slot, 0);
+    EXPECT_EQ(b->scope, AST::VariableScope::FREE_CELL);
+    EXPECT_EQ(b->slot, 0);
+}
+
+// 呼び出しのフレームがスタックの領域を再利用することのテスト
+TEST(FrameStackTest, TestFramesReuseChunks)
+{
+    FrameStack<std::optional<Value>> stack;
+    for (int i = 0; i < 10000; i++)
+    {
+        FrameScope<std::optional<Value>> frame(stack, 3);
+        frame.get()[0] = Value::integer(i);
+    }
+    EXPECT_EQ(stack.chunkCount(), 1u);
+
+    // 内側の呼び出しでチャンクが増えても、外側のフレームは移動しない
+    auto outer = stack.push(2);
+    outer[0] = Value::integer(42);
+    std::vector<std::optional<Value> *> inner;
+    for (size_t i = 0; i < FrameStack<std::optional<Value>>::CHUNK_SIZE; i++)
+    {
+        inner.push_back(stack.push(2));
+    }
+    auto large = stack.push(FrameStack<std::optional<Value>>::CHUNK_SIZE * 2);
+    ASSERT_TRUE(outer[0]);
+    EXPECT_EQ(outer[0]->asInteger(), 42);
+
+    stack.pop(large, FrameStack<std::optional<Value>>::CHUNK_SIZE * 2);
+    for (auto it = inner.rbegin(); it != inner.rend(); ++it)
+    {
+        stack.pop(*it, 2);
+    }
+    stack.pop(outer, 2);
+    size_t chunks = stack.chunkCount();
+
+    // 解放したスロットは既定値に戻り、同じ深さの呼び出しでは新たに確保しない
+    auto reused = stack.push(2);
+    EXPECT_EQ(reused, outer);
+    EXPECT_FALSE(reused[0]);
+    stack.pop(reused, 2);
+    EXPECT_EQ(stack.chunkCount(), chunks);
+}
+
+TEST(EvaluatorTest, TestCallFrames)
+{
+    // 再帰呼び出しのフレームはそれぞれ独立している
+    testIntegerObject(testEval("let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(15);"), 610);
+    testIntegerObject(testEval("let f = fn(a, b) { let c = a * 10; if (a > 0) { f(a - 1, b + c) } else { b } }; f(3, 0);"),
+                      60);
+
+    // 代入されていない変数のスロットは参照できない
+    auto evaluated = testEval("let f = fn() { if (false) { let x = 1; }; x }; f();");
+    auto errorObj = dynamicRefCast<Error>(evaluated);
+    ASSERT_NE(errorObj, nullptr);
+    EXPECT_EQ(errorObj->message(), "identifier not found: x");
+
+    // 引数の評価がエラーで中断されても、後の呼び出しのフレームは正しく確保される
+    Evaluator evaluator;
+    ObjectPtr result;
+    for (const std::string line : {"let f = fn(a, b) { a + b };", "f(1, f(2, true))", "f(f(1, 2), 3)"})
+    {
+        Parser::Parser parser(std::make_unique<Lexer::Lexer>(line));
+        result = evaluator.eval(parser.ParseProgram());
+    }
+    testIntegerObject(result, 6);
+}
+
+// 評価中に標準出力へ何も書き出さないことのテスト
+TEST(EvaluatorTest, TestEvaluationIsSilent)
+{
+    testing::internal::CaptureStdout();
+    auto evaluated = testEval("let add = fn(a, b) { a + b }; let i = 0; while (i < 3) { let i = add(i, 1); }; i");
+    std::string output = testing::internal::GetCapturedStdout();
+    testIntegerObject(evaluated, 3);
+    EXPECT_EQ(output, "");
+}
+
+namespace
+{
+int nativeCalls = 0;
+
+// テスト用のネイティブ関数（2つの引数の積を返し、0による乗算はインタプリタに任せる）
+bool fakeNativeMultiply(const int64_t *args, int64_t *result)
+{
+    nativeCalls++;
+    if (args[1] == 0)
+    {
+        return false;
+    }
+    *result = args[0] * args[1];
+    return true;
+}
+} // namespace
+
+// しきい値を超えた関数がフック経由でネイティブコードに切り替わることのテスト
+TEST(EvaluatorTest, TestTierUpHook)
+{
+    auto lexer = std::make_unique<Lexer::Lexer>(
+        "let mul = fn(a, b) { a * b }; let i = 0; let s = 0;"
+        "while (i < 10) { let s = s + mul(i, 2); let i = i + 1; }; s");
+    Parser::Parser parser(std::move(lexer));
+    auto program = parser.ParseProgram();
+    ASSERT_TRUE(parser.Errors().empty());
+
+    int hookCalls = 0;
+    nativeCalls = 0;
+    Evaluator evaluator;
+    evaluator.setTierUpHook(
+        [&hookCalls](const std::vector<std::string> &parameters, const AST::BlockStatement &body) {
+            hookCalls++;
+            EXPECT_EQ(parameters.size(), 2u);
+            EXPECT_EQ(body.statements.size(), 1u);
+            return &fakeNativeMultiply;
+        },
+        3);
+
+    testIntegerObject(evaluator.eval(program.get()), 90);
+    EXPECT_EQ(hookCalls, 1);
+    // 3回目の呼び出しで変換され、以降の呼び出し（i = 2..9）はネイティブコードで実行される
+    EXPECT_EQ(nativeCalls, 8);
+
+    // ネイティブコードがfalseを返した場合と整数以外の引数はインタプリタで実行される
+    auto fallback = std::make_unique<Lexer::Lexer>("mul(5, 0) + mul(3, true)");
+    Parser::Parser fallbackParser(std::move(fallback));
+    auto fallbackProgram = fallbackParser.ParseProgram();
+    auto result = evaluator.eval(fallbackProgram.get());
+    EXPECT_EQ(nativeCalls, 9);
+    ASSERT_EQ(result->type(), ObjectType::ERROR);
+}
+
+// ループの反復回数が数えられることのテスト
+TEST(EvaluatorTest, TestLoopIterationCounters)
+{
+    auto lexer = std::make_unique<Lexer::Lexer>("let i = 0; while (i < 5) { let i = i + 1; }");
+    Parser::Parser parser(std::move(lexer));
+    auto program = parser.ParseProgram();
+
+    Evaluator evaluator;
+    evaluator.eval(program.get());
+
+    auto stmt = dynamic_cast<AST::ExpressionStatement *>(program->statements[1].get());
+    ASSERT_NE(stmt, nullptr);
+    auto loop = dynamic_cast<AST::WhileExpression *>(stmt->expression.get());
+    ASSERT_NE(loop, nullptr);
+    EXPECT_EQ(loop->iterations, 5u);
+}
+
+// 循環参照を作る関数を繰り返し呼んでも、安全な位置での収集でオブジェクト数が抑えられることのテスト
+TEST(EvaluatorTest, TestCyclicGarbageIsCollected)
+{
+    auto &heap = Heap::current();
+    heap.collect();
+    heap.setBudget(100);
+    size_t baseline = heap.objectCount();
+    size_t collections = heap.collectionCount();
+
+    // 関数の中で定義した再帰関数は、自分自身を入れたセルを捕捉するため循環する
+    auto evaluated = testEval("let make = fn() { let f = fn() { f }; f };"
+                              "let i = 0; while (i < 5000) { make(); let i = i + 1; }; i");
+    testIntegerObject(evaluated, 5000);
+    EXPECT_GT(heap.collectionCount(), collections);
+    EXPECT_LE(heap.objectCount(), baseline + 300);
+
+    heap.setBudget(Heap::DEFAULT_BUDGET);
+    heap.collect();
+}
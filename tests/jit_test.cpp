@@ -1,6 +1,8 @@
+#include "../evaluator/evaluator.hpp"
 #include "../jit/jit.hpp"
 #include "../parser/parser.hpp"
 #include <gtest/gtest.h>
+#include <limits>
 
 class JITTest : public ::testing::Test
 {
@@ -13,6 +15,14 @@ protected:
         Parser::Parser parser(std::move(lexer));
         return parser.ParseProgram().release();
     }
+
+    // execute()の結果を整数として取り出す（整数でない場合はテストを失敗させる）
+    int64_t executeInteger()
+    {
+        auto result = monkey::dynamicRefCast<monkey::Integer>(compiler.execute());
+        EXPECT_NE(result, nullptr);
+        return result ? result->value() : 0;
+    }
 };
 
 TEST_F(JITTest, TestIntegerArithmetic)
@@ -68,10 +78,434 @@ TEST_F(JITTest, TestVariableBinding)
     std::unique_ptr<AST::Program> program(parseProgram(
         "let x = 42; x;"
     ));
+    // 最適化するとstore/loadは消えるため-O0で確認する
+    compiler.setOptimizationLevel(0);
     compiler.compile(*program);
     
+    // トップレベルの束縛は次の行からも参照できるようセッションのグローバル変数になる
     std::string ir = compiler.getIR();
-    EXPECT_TRUE(ir.find("alloca") != std::string::npos);
+    EXPECT_TRUE(ir.find("@monkey_global_x = global i64") != std::string::npos) << ir;
     EXPECT_TRUE(ir.find("store") != std::string::npos);
     EXPECT_TRUE(ir.find("load") != std::string::npos);
-} 
\ No newline at end of file
+} 
+TEST_F(JITTest, TestExecuteIntegerArithmetic)
+{
+    std::unique_ptr<AST::Program> program(parseProgram("5 + 3 * 2 - 10 / 5"));
+    ASSERT_TRUE(program != nullptr) << "Failed to parse program";
+
+    compiler.compile(*program);
+    EXPECT_TRUE(compiler.isComplete());
+
+    EXPECT_EQ(executeInteger(), 9);
+}
+
+TEST_F(JITTest, TestExecuteFunctionCall)
+{
+    std::unique_ptr<AST::Program> program(parseProgram(
+        "let x = 40; let add = fn(a, b) { a + b; }; add(x, 2);"
+    ));
+    compiler.compile(*program);
+    EXPECT_TRUE(compiler.isComplete());
+    EXPECT_EQ(executeInteger(), 42);
+
+    // 同じコンパイラで続けて実行できる（mainの再定義にならない）
+    std::unique_ptr<AST::Program> next(parseProgram("-7 * 6"));
+    compiler.compile(*next);
+    EXPECT_EQ(executeInteger(), -42);
+}
+
+TEST_F(JITTest, TestUnsupportedSyntaxIsIncomplete)
+{
+    std::unique_ptr<AST::Program> program(parseProgram("\"monkey\""));
+    compiler.compile(*program);
+    EXPECT_FALSE(compiler.isComplete());
+}
+
+TEST_F(JITTest, TestOptimizationLevels)
+{
+    std::unique_ptr<AST::Program> program(parseProgram(
+        "let x = 42; let twice = fn(a) { a * 2; }; twice(x) + x;"
+    ));
+
+    // 同じコンパイラでは2回目以降の定義が再利用されるため、レベルごとに新しいコンパイラを使う
+    std::vector<std::string> irs;
+    for (unsigned level = 0; level <= 3; ++level)
+    {
+        JIT::Compiler compiler;
+        compiler.setOptimizationLevel(level);
+        EXPECT_EQ(compiler.getOptimizationLevel(), level);
+        compiler.compile(*program);
+        irs.push_back(compiler.getIR());
+        // どのレベルでも実行結果は変わらない
+        auto result = monkey::dynamicRefCast<monkey::Integer>(compiler.execute());
+        ASSERT_NE(result, nullptr) << "-O" << level;
+        EXPECT_EQ(result->value(), 126) << "-O" << level;
+    }
+
+    // -O0ではローカル変数がallocaのまま残り、関数はcallで呼ばれる
+    EXPECT_NE(irs[0].find("alloca"), std::string::npos);
+    EXPECT_NE(irs[0].find("call i64"), std::string::npos);
+
+    // -O1以上ではmem2regによりallocaが消える
+    for (unsigned level = 1; level <= 3; ++level)
+    {
+        EXPECT_EQ(irs[level].find("alloca"), std::string::npos) << "-O" << level;
+    }
+
+    // -O2以上ではインライン化と定数畳み込みでmainが定数を返す
+    EXPECT_NE(irs[2].find("ret i64 126"), std::string::npos) << irs[2];
+    EXPECT_NE(irs[3].find("ret i64 126"), std::string::npos) << irs[3];
+
+    // 3より大きいレベルは3として扱う
+    compiler.setOptimizationLevel(7);
+    EXPECT_EQ(compiler.getOptimizationLevel(), 3u);
+}
+
+TEST_F(JITTest, TestSessionKeepsDefinitionsAcrossLines)
+{
+    // REPLの1行ずつと同じように別々のプログラムとしてコンパイル・実行する
+    auto run = [this](const std::string& input) {
+        std::unique_ptr<AST::Program> program(parseProgram(input));
+        compiler.compile(*program);
+        EXPECT_TRUE(compiler.isComplete()) << input;
+        return compiler.execute();
+    };
+    auto integer = [](const monkey::ObjectPtr& object) {
+        auto result = monkey::dynamicRefCast<monkey::Integer>(object);
+        EXPECT_NE(result, nullptr);
+        return result ? result->value() : 0;
+    };
+
+    run("let x = 40;");
+    run("let add = fn(a, b) { a + b; };");
+    EXPECT_EQ(integer(run("add(x, 2);")), 42);
+
+    // 関数の本体からも以前の行の定義を参照できる
+    run("let quad = fn(a) { add(a, a) + add(a, a); };");
+    EXPECT_EQ(integer(run("quad(x);")), 160);
+
+    // グローバル変数の再束縛は以降の行に反映される
+    run("let x = add(x, 60);");
+    EXPECT_EQ(integer(run("x;")), 100);
+}
+
+TEST_F(JITTest, TestLetResultsMatchEvaluator)
+{
+    auto run = [this](const std::string& input) {
+        std::unique_ptr<AST::Program> program(parseProgram(input));
+        compiler.compile(*program);
+        EXPECT_TRUE(compiler.isComplete()) << input;
+        return compiler.execute();
+    };
+
+    // letの行は評価器と同じく束縛した値を返す
+    auto integer = monkey::dynamicRefCast<monkey::Integer>(run("let x = 10;"));
+    ASSERT_NE(integer, nullptr);
+    EXPECT_EQ(integer->value(), 10);
+
+    auto function = run("let f = fn(a) { a * 2; };");
+    ASSERT_NE(monkey::dynamicRefCast<monkey::Function>(function), nullptr);
+    std::unique_ptr<AST::Program> program(parseProgram("let f = fn(a) { a * 2; };"));
+    monkey::Evaluator evaluator;
+    EXPECT_EQ(function->inspect(), evaluator.eval(program.get())->inspect());
+
+    // 実行時エラーで中断した行の束縛は確定せず、以降の参照はインタプリタに任せる
+    EXPECT_NE(monkey::dynamicRefCast<monkey::Error>(run("let z = 1 / 0;")), nullptr);
+    std::unique_ptr<AST::Program> reference(parseProgram("z;"));
+    compiler.compile(*reference);
+    EXPECT_FALSE(compiler.isComplete());
+}
+
+TEST_F(JITTest, TestRebindingIsSeenByExistingFunctions)
+{
+    auto run = [this](const std::string& input) {
+        std::unique_ptr<AST::Program> program(parseProgram(input));
+        compiler.compile(*program);
+        EXPECT_TRUE(compiler.isComplete()) << input;
+        return compiler.execute();
+    };
+    auto integer = [](const monkey::ObjectPtr& object) {
+        auto result = monkey::dynamicRefCast<monkey::Integer>(object);
+        EXPECT_NE(result, nullptr);
+        return result ? result->value() : 0;
+    };
+
+    // 評価器と同じく、関数の本体は呼び出した時点の束縛を使う
+    run("let h = fn() { 1 };");
+    run("let f = fn() { h() };");
+    EXPECT_EQ(integer(run("f()")), 1);
+    run("let h = fn() { 2 };");
+    EXPECT_EQ(integer(run("f()")), 2);
+    EXPECT_EQ(integer(run("let h = fn() { 3 }; f()")), 3);
+
+    // 引数の数や種類が変わると、依存する関数はJITでは扱わない
+    run("let h = fn(a) { a };");
+    std::unique_ptr<AST::Program> stale(parseProgram("f()"));
+    compiler.compile(*stale);
+    EXPECT_FALSE(compiler.isComplete());
+    run("let g = fn() { h(1) };");
+    run("let h = 5;");
+    std::unique_ptr<AST::Program> staleValue(parseProgram("g()"));
+    compiler.compile(*staleValue);
+    EXPECT_FALSE(compiler.isComplete());
+
+    // 実行時エラーの前に実行を終えたletの束縛は確定する
+    EXPECT_NE(monkey::dynamicRefCast<monkey::Error>(run("let q = fn() { 7 }; let r = 1 / 0; 1")), nullptr);
+    EXPECT_EQ(integer(run("q()")), 7);
+    std::unique_ptr<AST::Program> unbound(parseProgram("r"));
+    compiler.compile(*unbound);
+    EXPECT_FALSE(compiler.isComplete());
+}
+
+TEST_F(JITTest, TestBindingsAreSharedWithInterpreter)
+{
+    // REPLと同じく、JITで扱えない行はインタプリタで評価し、束縛は互いに引き継ぐ
+    monkey::Evaluator evaluator;
+    std::vector<std::shared_ptr<const AST::Program>> programs;
+    auto run = [&](const std::string& input) {
+        std::shared_ptr<const AST::Program> program(parseProgram(input));
+        programs.push_back(program);
+        compiler.compile(*program);
+        if (!compiler.isComplete())
+        {
+            auto result = evaluator.eval(program);
+            for (const auto& name : evaluator.boundGlobals())
+            {
+                compiler.rebind(name, evaluator.getGlobal(name));
+            }
+            return result->inspect();
+        }
+        auto result = compiler.execute();
+        for (const auto& binding : compiler.committedBindings())
+        {
+            if (binding.definition)
+            {
+                evaluator.eval(binding.definition);
+            }
+            else
+            {
+                evaluator.defineGlobal(binding.name, binding.value);
+            }
+        }
+        return result->inspect();
+    };
+
+    // JITで束縛した値と関数をインタプリタから参照できる
+    run("let x = 5;");
+    EXPECT_EQ(run("[x]"), "[5]");
+    run("let h = fn() { 1 };");
+    run("let f = fn() { h() };");
+    EXPECT_EQ(run("[f()]"), "[1]");
+
+    // インタプリタで束縛し直した名前はJITでも新しい定義を使う
+    run("let x = len([1, 2, 3]);");
+    EXPECT_EQ(run("x + 1"), "4");
+    run("let h = fn() { [2][0] };");
+    EXPECT_EQ(run("f()"), "2");
+    run("let x = \"s\";");
+    EXPECT_EQ(run("x"), "s");
+
+    // 引数の数が変わった関数を古い呼び出し方で呼ぶと、評価器と同じエラーになる
+    run("let h = fn(a) { a };");
+    EXPECT_EQ(run("f()"), "ERROR: wrong number of arguments: expected 1, got 0");
+}
+
+TEST_F(JITTest, TestUnchangedDefinitionIsNotRecompiled)
+{
+    std::unique_ptr<AST::Program> first(parseProgram("let twice = fn(a) { a * 2; }; twice(4);"));
+    compiler.compile(*first);
+    EXPECT_EQ(executeInteger(), 8);
+    EXPECT_NE(compiler.getIR().find("define i64 @monkey_fn_twice"), std::string::npos);
+
+    // 同じ定義を再入力しても関数は生成されず、既存のシンボルを呼ぶ
+    std::unique_ptr<AST::Program> same(parseProgram("let twice = fn(a) { a * 2; }; twice(5);"));
+    compiler.compile(*same);
+    std::string ir = compiler.getIR();
+    EXPECT_EQ(ir.find("define i64 @monkey_fn_twice"), std::string::npos) << ir;
+    EXPECT_NE(ir.find("declare i64 @monkey_fn_twice"), std::string::npos) << ir;
+    EXPECT_EQ(executeInteger(), 10);
+
+    // 定義を変えると新しい関数が生成され、以降はそちらが呼ばれる
+    std::unique_ptr<AST::Program> changed(parseProgram("let twice = fn(a) { a * 3; };"));
+    compiler.compile(*changed);
+    EXPECT_NE(compiler.getIR().find("define i64 @monkey_fn_twice"), std::string::npos);
+    compiler.execute();
+
+    std::unique_ptr<AST::Program> call(parseProgram("twice(5);"));
+    compiler.compile(*call);
+    EXPECT_EQ(executeInteger(), 15);
+}
+
+TEST_F(JITTest, TestBooleanResults)
+{
+    // 真偽値の結果は評価器と同じく真偽値として返す
+    for (const auto& [input, expected] : std::vector<std::pair<std::string, bool>>{
+             {"true", true}, {"!true", false}, {"!!false", false}, {"!5", false}, {"!0", false}})
+    {
+        std::unique_ptr<AST::Program> program(parseProgram(input));
+        compiler.compile(*program);
+        EXPECT_TRUE(compiler.isComplete()) << input;
+        auto result = monkey::dynamicRefCast<monkey::Boolean>(compiler.execute());
+        ASSERT_NE(result, nullptr) << input;
+        EXPECT_EQ(result->value(), expected) << input;
+    }
+
+    // 真偽値を整数として使う式は評価器ではエラーになるため、インタプリタに任せる
+    for (const std::string input : {"true + 1", "-true", "let b = true;", "let f = fn() { false };"})
+    {
+        std::unique_ptr<AST::Program> program(parseProgram(input));
+        compiler.compile(*program);
+        EXPECT_FALSE(compiler.isComplete()) << input;
+    }
+
+    // 真偽値と同じ値の整数定数は、真偽値として扱わない
+    for (const auto& [input, expected] : std::vector<std::pair<std::string, int64_t>>{
+             {"true; 1", 1}, {"!5; 0", 0}, {"true; 1 + 1", 2}, {"false; 0 - 1", -1}})
+    {
+        std::unique_ptr<AST::Program> program(parseProgram(input));
+        compiler.compile(*program);
+        EXPECT_TRUE(compiler.isComplete()) << input;
+        auto result = monkey::dynamicRefCast<monkey::Integer>(compiler.execute());
+        ASSERT_NE(result, nullptr) << input;
+        EXPECT_EQ(result->value(), expected) << input;
+    }
+}
+
+TEST_F(JITTest, TestDivisionByZeroIsAnError)
+{
+    auto run = [this](const std::string& input) {
+        std::unique_ptr<AST::Program> program(parseProgram(input));
+        compiler.compile(*program);
+        EXPECT_TRUE(compiler.isComplete()) << input;
+        return compiler.execute();
+    };
+    auto expectError = [](const monkey::ObjectPtr& result, const std::string& input) {
+        auto error = monkey::dynamicRefCast<monkey::Error>(result);
+        ASSERT_NE(error, nullptr) << input << " => " << result->inspect();
+        EXPECT_EQ(error->message(), "division by zero") << input;
+    };
+
+    // 定数・以前の行の変数・関数の引数のいずれの除数でも、評価器と同じくエラーになる
+    expectError(run("5 / 0"), "5 / 0");
+    run("let a = 0;");
+    expectError(run("10 / a"), "10 / a");
+    run("let d = fn(p, q) { p / q };");
+    expectError(run("d(5, 0)"), "d(5, 0)");
+    expectError(run("d(5, 0) + 1"), "d(5, 0) + 1");
+
+    // エラーの後も同じセッションで実行を続けられる
+    auto result = monkey::dynamicRefCast<monkey::Integer>(run("d(9, 3)"));
+    ASSERT_NE(result, nullptr);
+    EXPECT_EQ(result->value(), 3);
+
+    // オーバーフローする除算は評価器と同じくラップアラウンドする
+    result = monkey::dynamicRefCast<monkey::Integer>(run("d(-9223372036854775807 - 1, -1)"));
+    ASSERT_NE(result, nullptr);
+    EXPECT_EQ(result->value(), std::numeric_limits<int64_t>::min());
+}
+
+// 関数リテラルの本体をネイティブコードに変換するヘルパー
+static monkey::NativeFunction compileNative(JIT::Compiler &compiler, AST::Program &program)
+{
+    auto stmt = dynamic_cast<AST::ExpressionStatement *>(program.statements[0].get());
+    auto func = stmt ? dynamic_cast<AST::FunctionLiteral *>(stmt->expression.get()) : nullptr;
+    if (!func)
+    {
+        return nullptr;
+    }
+    std::vector<std::string> parameters;
+    for (const auto &param : func->parameters)
+    {
+        parameters.push_back(param->value);
+    }
+    return compiler.compileNativeFunction(parameters, *func->body);
+}
+
+TEST_F(JITTest, TestNativeFunctionWithLoop)
+{
+    std::unique_ptr<AST::Program> program(parseProgram(
+        "fn(n) { let s = 0; let i = 0; while (i < n) { if (i == 3) { let s = s - 100; } let s = s + i; let i = i + 1; }; s }"
+    ));
+    auto native = compileNative(compiler, *program);
+    ASSERT_NE(native, nullptr);
+
+    int64_t args[] = {10};
+    int64_t result = 0;
+    ASSERT_TRUE(native(args, &result));
+    EXPECT_EQ(result, 45 - 100);
+}
+
+TEST_F(JITTest, TestNativeFunctionReturnAndDivision)
+{
+    std::unique_ptr<AST::Program> program(parseProgram(
+        "fn(a, b) { if (b < 0) { return -1; } a / b }"
+    ));
+    auto native = compileNative(compiler, *program);
+    ASSERT_NE(native, nullptr);
+
+    int64_t result = 0;
+    int64_t divide[] = {42, 5};
+    ASSERT_TRUE(native(divide, &result));
+    EXPECT_EQ(result, 8);
+
+    int64_t negative[] = {42, -5};
+    ASSERT_TRUE(native(negative, &result));
+    EXPECT_EQ(result, -1);
+
+    // ゼロ除算はfalseを返してインタプリタに任せる
+    int64_t zero[] = {42, 0};
+    EXPECT_FALSE(native(zero, &result));
+
+    // オーバーフローする除算は評価器と同じくラップアラウンドする
+    std::unique_ptr<AST::Program> quotient(parseProgram("fn(a, b) { a / b }"));
+    auto divideOnly = compileNative(compiler, *quotient);
+    ASSERT_NE(divideOnly, nullptr);
+    int64_t overflow[] = {std::numeric_limits<int64_t>::min(), -1};
+    ASSERT_TRUE(divideOnly(overflow, &result));
+    EXPECT_EQ(result, std::numeric_limits<int64_t>::min());
+}
+
+TEST_F(JITTest, TestNativeFunctionRejectsUnsupportedBodies)
+{
+    const char *inputs[] = {
+        "fn(a) { a + x }",              // 外側の変数
+        "fn(a) { \"str\" }",            // 文字列
+        "fn(a) { a < 1 }",              // 真偽値を返す
+        "fn(a) { if (a) { 1 } }",       // elseがない場合はnullを返し得る
+        "fn(a) { f(a) }",               // 関数呼び出し
+        "fn(a) { if (a) { let t = 1; }; t }", // 内側のブロックで定義した変数
+    };
+    for (const auto input : inputs)
+    {
+        std::unique_ptr<AST::Program> program(parseProgram(input));
+        EXPECT_EQ(compileNative(compiler, *program), nullptr) << input;
+    }
+}
+
+// 評価器のフックとして使い、インタプリタと同じ結果になることのテスト
+TEST_F(JITTest, TestTieredEvaluation)
+{
+    const std::string input =
+        "let sum = fn(n) { let s = 0; let i = 0; while (i < n) { let s = s + i; let i = i + 1; }; s };"
+        "let k = 0; let total = 0; while (k < 50) { let total = total + sum(k); let k = k + 1; }; total";
+
+    std::unique_ptr<AST::Program> program(parseProgram(input));
+    monkey::Evaluator interpreter;
+    auto expected = interpreter.eval(program.get());
+
+    std::unique_ptr<AST::Program> tieredProgram(parseProgram(input));
+    int tierUps = 0;
+    monkey::Evaluator tiered;
+    tiered.setTierUpHook(
+        [&](const std::vector<std::string> &parameters, const AST::BlockStatement &body) {
+            auto native = compiler.compileNativeFunction(parameters, body);
+            tierUps += native ? 1 : 0;
+            return native;
+        },
+        10);
+    auto actual = tiered.eval(tieredProgram.get());
+
+    EXPECT_EQ(tierUps, 1);
+    EXPECT_EQ(actual->inspect(), expected->inspect());
+    EXPECT_EQ(actual->inspect(), "19600");
+}
@@ -1,6 +1,35 @@
 #include "../lexer/lexer.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include <gtest/gtest.h>
 
+// 字句解析中のヒープ確保回数を数えるためのグローバルなoperator new
+namespace
+{
+std::atomic<size_t> allocationCount{0};
+}
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
 // テストケース用の構造体
 struct TestCase
 {
@@ -185,4 +214,120 @@ TEST(LexerTest, TestForLoop)
             << "tests[" << i << "] - literal wrong. "
             << "expected=" << tests[i].expectedLiteral << ", got=" << tok.getLiteral();
     }
-}
\ No newline at end of file
+}
+TEST(LexerTest, TestIntegerLiteralsAreDecoded)
+{
+    Lexer::Lexer lexer("0 42 9223372036854775807 9223372036854775808");
+
+    auto zero = lexer.NextToken();
+    EXPECT_EQ(zero.getType(), Token::TokenType::INT);
+    EXPECT_EQ(zero.getInteger(), 0);
+
+    auto answer = lexer.NextToken();
+    EXPECT_EQ(answer.getInteger(), 42);
+    EXPECT_FALSE(answer.integerOverflowed());
+
+    auto max = lexer.NextToken();
+    EXPECT_EQ(max.getInteger(), INT64_MAX);
+    EXPECT_FALSE(max.integerOverflowed());
+
+    // int64_tに収まらない値はトークンの種類はそのままで、オーバーフローとして印が付く
+    auto tooLarge = lexer.NextToken();
+    EXPECT_EQ(tooLarge.getType(), Token::TokenType::INT);
+    EXPECT_TRUE(tooLarge.integerOverflowed());
+    EXPECT_EQ(tooLarge.getLiteral(), "9223372036854775808");
+}
+
+TEST(LexerTest, TestTokensReferenceSource)
+{
+    Lexer::Lexer lexer("foo==\"bar\"");
+
+    auto foo = lexer.NextToken();
+    auto eq = lexer.NextToken();
+    auto bar = lexer.NextToken();
+    EXPECT_EQ(foo.getLiteral(), "foo");
+    EXPECT_EQ(eq.getLiteral(), "==");
+    EXPECT_EQ(bar.getLiteral(), "bar");
+
+    // リテラルはコピーではなく入力バッファ内の連続した範囲を指す
+    EXPECT_EQ(eq.getLiteral().data(), foo.getLiteral().data() + 3);
+    EXPECT_EQ(bar.getLiteral().data(), eq.getLiteral().data() + 3);
+
+    // 終端に達した後も繰り返しEOFを返す
+    EXPECT_EQ(lexer.NextToken().getType(), Token::TokenType::EOF_);
+    EXPECT_EQ(lexer.NextToken().getType(), Token::TokenType::EOF_);
+}
+
+TEST(LexerTest, TestNoAllocationPerToken)
+{
+    std::string input;
+    for (int i = 0; i < 1000; ++i)
+    {
+        input += "let value_name = fn(a, b) { if (a != 1234567890) { \"a long string literal\" } else { [a, b] } };\n";
+    }
+    Lexer::Lexer lexer(std::move(input));
+
+    size_t before = allocationCount.load();
+    size_t tokens = 0;
+    while (lexer.NextToken().getType() != Token::TokenType::EOF_)
+    {
+        ++tokens;
+    }
+    size_t allocations = allocationCount.load() - before;
+    EXPECT_GT(tokens, 25000u);
+    EXPECT_EQ(allocations, 0u);
+}
+
+TEST(LexerTest, TestScanModesProduceIdenticalTokens)
+{
+    // 16バイト境界をまたぐ長い空白・識別子・数値・文字列と、ASCII外のバイトを含む入力
+    std::vector<std::string> inputs = {
+        "let a_very_long_identifier_name_over_32_bytes = 12345678901234567890123;",
+        "                                   \t\t\n\r\n   x",
+        "\"a string literal that is definitely longer than sixteen bytes\" + \"\"",
+        "caf\xc3\xa9 = \"\xe3\x81\x82\xe3\x81\x84\"; ABC_def_GHI@[]{}",
+        "fn(x, y) { x + y; } 0 007 if else while for return true false",
+        "\"unterminated",
+    };
+
+    // 擬似乱数で記号・空白・英数字を混ぜた入力も比較する
+    uint32_t state = 12345;
+    const std::string alphabet = "abcXYZ_09 \t\n\r\"=+-!*/<>;(),{}[]\x80\xff";
+    for (int n = 0; n < 200; ++n)
+    {
+        std::string input;
+        for (int i = 0; i < 97; ++i)
+        {
+            state = state * 1103515245 + 12345;
+            input += alphabet[(state >> 16) % alphabet.size()];
+        }
+        inputs.push_back(input);
+    }
+
+    auto tokenize = [](const std::string &input, Lexer::ScanMode mode) {
+        Lexer::Lexer lexer(input, mode);
+        std::vector<std::pair<Token::TokenType, std::string>> tokens;
+        try
+        {
+            for (;;)
+            {
+                auto tok = lexer.NextToken();
+                tokens.emplace_back(tok.getType(), std::string(tok.getLiteral()));
+                if (tok.getType() == Token::TokenType::EOF_)
+                {
+                    break;
+                }
+            }
+        }
+        catch (const std::runtime_error &e)
+        {
+            tokens.emplace_back(Token::TokenType::ILLEGAL, e.what());
+        }
+        return tokens;
+    };
+
+    for (const auto &input : inputs)
+    {
+        EXPECT_EQ(tokenize(input, Lexer::ScanMode::SCALAR), tokenize(input, Lexer::ScanMode::SIMD)) << input;
+    }
+}
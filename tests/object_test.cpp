@@ -0,0 +1,514 @@
+#include "../object/nursery.hpp"
+#include "../object/object.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace monkey;
+
+// 即値の生成と取り出しのテスト
+TEST(ValueTest, TestImmediateValues)
+{
+    auto integer = Value::integer(42);
+    EXPECT_TRUE(integer.isInteger());
+    EXPECT_EQ(integer.asInteger(), 42);
+    EXPECT_EQ(integer.type(), ObjectType::INTEGER);
+    EXPECT_EQ(integer.inspect(), "42");
+
+    auto boolean = Value::boolean(true);
+    EXPECT_TRUE(boolean.isBoolean());
+    EXPECT_TRUE(boolean.asBoolean());
+    EXPECT_EQ(boolean.type(), ObjectType::BOOLEAN);
+    EXPECT_EQ(boolean.inspect(), "true");
+
+    Value null;
+    EXPECT_TRUE(null.isNull());
+    EXPECT_EQ(null.type(), ObjectType::NULL_OBJ);
+    EXPECT_EQ(null.inspect(), "null");
+    EXPECT_EQ(null.asObject(), nullptr);
+}
+
+// Integer/Boolean/Nullオブジェクトから作った値は即値になることのテスト
+TEST(ValueTest, TestObjectsAreUnboxed)
+{
+    EXPECT_TRUE(Value(makeRef<Integer>(7)).isInteger());
+    EXPECT_TRUE(Value(makeRef<Boolean>(false)).isBoolean());
+    EXPECT_TRUE(Value(makeRef<Null>()).isNull());
+    EXPECT_TRUE(Value(ObjectPtr()).isNull());
+
+    Value str = makeRef<String>("monkey");
+    EXPECT_TRUE(str.isObject());
+    EXPECT_EQ(str.type(), ObjectType::STRING);
+    EXPECT_EQ(str.inspect(), "monkey");
+}
+
+// ObjectPtrへの変換のテスト
+TEST(ValueTest, TestToObject)
+{
+    auto integer = dynamicRefCast<Integer>(Value::integer(-3).toObject());
+    ASSERT_NE(integer, nullptr);
+    EXPECT_EQ(integer->value(), -3);
+
+    auto boolean = dynamicRefCast<Boolean>(Value::boolean(true).toObject());
+    ASSERT_NE(boolean, nullptr);
+    EXPECT_TRUE(boolean->value());
+
+    EXPECT_NE(dynamicRefCast<Null>(Value().toObject()), nullptr);
+
+    ObjectPtr error = makeRef<Error>("boom");
+    Value value = error;
+    EXPECT_TRUE(value.isError());
+    EXPECT_EQ(value.toObject(), error);
+}
+
+// 真偽値・null・小さい整数は共有のインスタンスに変換されることのテスト
+TEST(ValueTest, TestToObjectReusesCanonicalObjects)
+{
+    EXPECT_EQ(Value::boolean(true).toObject(), Value::boolean(true).toObject());
+    EXPECT_EQ(Value::boolean(false).toObject(), canonicalBoolean(false));
+    EXPECT_NE(canonicalBoolean(true), canonicalBoolean(false));
+    EXPECT_EQ(Value().toObject(), canonicalNull());
+
+    for (int64_t i : {SMALL_INTEGER_MIN, int64_t(0), int64_t(42), SMALL_INTEGER_MAX})
+    {
+        auto first = Value::integer(i).toObject();
+        EXPECT_EQ(first, Value::integer(i).toObject());
+        EXPECT_EQ(staticRefCast<Integer>(first)->value(), i);
+    }
+
+    // 範囲外の整数は毎回新しく確保する
+    for (int64_t i : {SMALL_INTEGER_MIN - 1, SMALL_INTEGER_MAX + 1})
+    {
+        auto first = makeInteger(i);
+        EXPECT_NE(first, makeInteger(i));
+        EXPECT_EQ(first->value(), i);
+    }
+}
+
+// オブジェクトが参照カウントを持ち、参照がなくなった時点で解放されることのテスト
+TEST(RefPtrTest, TestIntrusiveReferenceCount)
+{
+    auto &heap = Heap::current();
+    size_t baseline = heap.objectCount();
+    {
+        auto array = makeRef<Array>(std::vector<Value>{});
+        EXPECT_EQ(array->referenceCount(), 1u);
+        ObjectPtr object = array;
+        EXPECT_EQ(array->referenceCount(), 2u);
+        // 生ポインタからも同じ参照カウントを共有したポインタを作れる
+        RefPtr<Array> again(static_cast<Array *>(object.get()));
+        EXPECT_EQ(array->referenceCount(), 3u);
+        EXPECT_EQ(dynamicRefCast<Array>(object), array);
+        EXPECT_EQ(dynamicRefCast<String>(object), nullptr);
+        EXPECT_EQ(heap.objectCount(), baseline + 1);
+    }
+    EXPECT_EQ(heap.objectCount(), baseline);
+
+    // プロセス全体で共有するオブジェクトはアトミックに数える
+    EXPECT_TRUE(canonicalNull()->isSharedAcrossThreads());
+    EXPECT_TRUE(makeInteger(1)->isSharedAcrossThreads());
+    EXPECT_FALSE(makeRef<String>("local")->isSharedAcrossThreads());
+}
+
+// コピーとムーブで参照カウントが正しく扱われることのテスト
+TEST(ValueTest, TestCopyAndMove)
+{
+    ObjectPtr str = makeRef<String>("shared");
+    {
+        Value a = str;
+        EXPECT_EQ(str.use_count(), 2);
+
+        Value b = a;
+        EXPECT_EQ(str.use_count(), 3);
+
+        Value c = std::move(b);
+        EXPECT_EQ(str.use_count(), 3);
+        EXPECT_TRUE(b.isNull());
+
+        c = Value::integer(1);
+        EXPECT_EQ(str.use_count(), 2);
+
+        a = a;
+        EXPECT_EQ(str.use_count(), 2);
+    }
+    EXPECT_EQ(str.use_count(), 1);
+}
+
+// ハッシュキーのテスト
+TEST(ValueTest, TestHashKey)
+{
+    EXPECT_EQ(Value::integer(1).hashKey(), Value::integer(1).hashKey());
+    EXPECT_NE(Value::integer(1).hashKey(), Value::integer(2).hashKey());
+    EXPECT_TRUE(Value::boolean(true).hashKey().has_value());
+
+    Value a = makeRef<String>("key");
+    Value b = makeRef<String>("key");
+    EXPECT_EQ(a.hashKey(), b.hashKey());
+
+    EXPECT_FALSE(Value().hashKey().has_value());
+    Value array = makeRef<Array>(std::vector<Value>{});
+    EXPECT_FALSE(array.hashKey().has_value());
+}
+
+// ハッシュ表のテスト
+TEST(HashTableTest, TestInsertFindAndOverwrite)
+{
+    HashTable table;
+    for (int64_t i = 0; i < 1000; ++i)
+    {
+        auto key = Value::integer(i);
+        table.insert(key, Value::integer(i * 2), *key.hashKey());
+    }
+    EXPECT_EQ(table.size(), 1000u);
+
+    for (int64_t i = 0; i < 1000; ++i)
+    {
+        auto key = Value::integer(i);
+        auto value = table.find(key, *key.hashKey());
+        ASSERT_NE(value, nullptr);
+        EXPECT_EQ(value->asInteger(), i * 2);
+    }
+    auto missing = Value::integer(1000);
+    EXPECT_EQ(table.find(missing, *missing.hashKey()), nullptr);
+
+    // 同じキーの挿入は上書きになり、位置（挿入順）は変わらない
+    Value key = makeRef<String>("0");
+    table.insert(key, Value::integer(-1), *key.hashKey());
+    auto zero = Value::integer(0);
+    table.insert(zero, Value::integer(-2), *zero.hashKey());
+    EXPECT_EQ(table.size(), 1001u);
+    EXPECT_EQ(table.begin()->value.asInteger(), -2);
+    EXPECT_EQ(table.find(key, *key.hashKey())->asInteger(), -1);
+}
+
+TEST(HashTableTest, TestCollidingHashesKeepDistinctKeys)
+{
+    // 整数1とtrueはハッシュ値が同じだが別のキー
+    auto one = Value::integer(1);
+    auto yes = Value::boolean(true);
+    ASSERT_EQ(one.hashKey(), yes.hashKey());
+
+    HashTable table;
+    table.insert(one, makeRef<String>("one"), *one.hashKey());
+    table.insert(yes, makeRef<String>("yes"), *yes.hashKey());
+    EXPECT_EQ(table.size(), 2u);
+    EXPECT_EQ(table.find(one, *one.hashKey())->inspect(), "one");
+    EXPECT_EQ(table.find(yes, *yes.hashKey())->inspect(), "yes");
+
+    // ハッシュ値を強制的に同じにしても、キー全体の比較で区別される
+    HashTable forced;
+    for (int64_t i = 0; i < 64; ++i)
+    {
+        forced.insert(Value::integer(i), Value::integer(i), 42);
+    }
+    EXPECT_EQ(forced.size(), 64u);
+    for (int64_t i = 0; i < 64; ++i)
+    {
+        EXPECT_EQ(forced.find(Value::integer(i), 42)->asInteger(), i);
+    }
+    EXPECT_EQ(forced.find(Value::integer(64), 42), nullptr);
+}
+
+TEST(HashTableTest, TestInspectPreservesInsertionOrder)
+{
+    auto hash = makeRef<Hash>();
+    const char *keys[] = {"zeta", "alpha", "mid", "beta"};
+    int64_t n = 0;
+    for (const char *name : keys)
+    {
+        Value key = makeRef<String>(name);
+        hash->pairs.insert(key, Value::integer(n++), *key.hashKey());
+    }
+    EXPECT_EQ(hash->inspect(), "{zeta: 0, alpha: 1, mid: 2, beta: 3}");
+}
+
+// 永続ベクタのテスト
+TEST(PersistentVectorTest, TestPushBackAndIndexAcrossLevels)
+{
+    // 末尾バッファ・1段・2段・3段のトライにまたがる大きさまで追加する
+    PersistentVector<int> vector;
+    std::vector<PersistentVector<int>> versions;
+    const int count = 40000;
+    for (int i = 0; i < count; ++i)
+    {
+        vector = vector.pushBack(i);
+        if (i % 997 == 0)
+        {
+            versions.push_back(vector);
+        }
+    }
+    ASSERT_EQ(vector.size(), static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+    {
+        ASSERT_EQ(vector[i], i);
+    }
+
+    // 途中の版は追加後も元の長さと内容のまま
+    for (size_t v = 0; v < versions.size(); ++v)
+    {
+        ASSERT_EQ(versions[v].size(), v * 997 + 1);
+        EXPECT_EQ(versions[v].back(), static_cast<int>(v * 997));
+    }
+}
+
+TEST(PersistentVectorTest, TestBranchingVersionsKeepValueSemantics)
+{
+    PersistentVector<int> base(std::vector<int>{1, 2, 3});
+
+    // 同じ版から2回pushしても互いに影響しない（末尾バッファを共有したまま書き足さない）
+    auto left = base.pushBack(10);
+    auto right = base.pushBack(20);
+    EXPECT_EQ(base.size(), 3u);
+    EXPECT_EQ(left.back(), 10);
+    EXPECT_EQ(right.back(), 20);
+    EXPECT_EQ(left.size(), 4u);
+    EXPECT_EQ(right.size(), 4u);
+
+    // restは先頭をずらしたスライスで、元の配列は変わらない
+    auto tail = base.rest();
+    EXPECT_EQ(tail.size(), 2u);
+    EXPECT_EQ(tail.front(), 2);
+    auto tailPushed = tail.pushBack(30);
+    EXPECT_EQ(std::vector<int>(tailPushed.begin(), tailPushed.end()), (std::vector<int>{2, 3, 30}));
+    EXPECT_EQ(std::vector<int>(base.begin(), base.end()), (std::vector<int>{1, 2, 3}));
+    EXPECT_EQ(std::vector<int>(left.begin(), left.end()), (std::vector<int>{1, 2, 3, 10}));
+
+    PersistentVector<int> empty;
+    EXPECT_TRUE(empty.rest().empty());
+}
+
+TEST(PersistentVectorTest, TestRandomOperationsMatchModel)
+{
+    // 複数の版に対してpushBack/restをランダムに行い、std::vectorのモデルと比較する
+    std::vector<std::pair<PersistentVector<int>, std::vector<int>>> versions(1);
+    uint32_t state = 7;
+    auto next = [&state]() {
+        state = state * 1103515245 + 12345;
+        return state >> 8;
+    };
+    for (int step = 0; step < 5000; ++step)
+    {
+        auto [vector, model] = versions[next() % versions.size()];
+        if (next() % 8 == 0 && !model.empty())
+        {
+            vector = vector.rest();
+            model.erase(model.begin());
+        }
+        else
+        {
+            int value = static_cast<int>(next());
+            vector = vector.pushBack(value);
+            model.push_back(value);
+        }
+        versions.emplace_back(vector, model);
+    }
+    for (const auto &[vector, model] : versions)
+    {
+        ASSERT_EQ(std::vector<int>(vector.begin(), vector.end()), model);
+    }
+}
+
+// ヒープの収集のテスト
+namespace
+{
+// 自分自身を入れたセルを捕捉した関数（関数 -> セル -> 関数の循環）を作る
+RefPtr<Function> makeSelfReferencingFunction()
+{
+    auto cell = makeRef<Cell>();
+    auto fn = makeRef<Function>(std::vector<std::string>{}, nullptr, nullptr, std::vector<Value>{},
+                                std::vector<CellPtr>{cell});
+    cell->value = fn;
+    return fn;
+}
+
+// 関数が捕捉した自分自身
+ObjectPtr capturedSelf(const RefPtr<Function> &fn)
+{
+    if (fn->capturedCells.empty() || !fn->capturedCells[0]->value)
+    {
+        return nullptr;
+    }
+    return fn->capturedCells[0]->value->asObject();
+}
+} // namespace
+
+TEST(HeapTest, TestUnreachableCycleIsFreed)
+{
+    auto &heap = Heap::current();
+    heap.collect();
+    size_t baseline = heap.objectCount();
+    makeSelfReferencingFunction();
+    // 循環しているため参照カウントだけでは解放されない
+    ASSERT_EQ(heap.objectCount(), baseline + 2);
+
+    EXPECT_EQ(heap.collect(), 2u);
+    EXPECT_EQ(heap.objectCount(), baseline);
+}
+
+TEST(HeapTest, TestExternallyReferencedObjectsSurvive)
+{
+    auto fn = makeSelfReferencingFunction();
+    auto array = makeRef<Array>(std::vector<Value>{Value::integer(1), fn});
+
+    Heap::current().collect();
+    EXPECT_EQ(capturedSelf(fn), fn);
+    EXPECT_EQ(array->elements.size(), 2u);
+    EXPECT_EQ(array->elements[1].asObject(), fn);
+}
+
+TEST(HeapTest, TestSharedArrayStructureIsCountedOnce)
+{
+    // 2つの配列が要素のバッファを共有していても、内部からの参照を二重に引かない
+    // （二重に引くと、C++側から参照されている関数まで到達不能と判定されてしまう）
+    auto fn = makeSelfReferencingFunction();
+    {
+        auto first = makeRef<Array>(std::vector<Value>{fn});
+        auto second = makeRef<Array>(first->elements.pushBack(Value::integer(2)));
+        // 関数・セル・配列を循環させて、共有する2つの配列がゴミとして断ち切られるようにする
+        auto cell = makeRef<Cell>();
+        auto holder = makeRef<Function>(std::vector<std::string>{}, nullptr, nullptr, std::vector<Value>{},
+                                         std::vector<CellPtr>{cell});
+        cell->value = makeRef<Array>(std::vector<Value>{holder, first, second});
+    }
+
+    Heap::current().collect();
+    EXPECT_EQ(capturedSelf(fn), fn);
+}
+
+TEST(HeapTest, TestRootScannersKeepObjectsAlive)
+{
+    auto &heap = Heap::current();
+    heap.collect();
+    size_t baseline = heap.objectCount();
+    Function *raw = makeSelfReferencingFunction().get();
+    auto id = heap.addRootScanner([raw](Tracer &tracer) { tracer.visit(static_cast<Collectable *>(raw)); });
+    heap.collect();
+    EXPECT_EQ(heap.objectCount(), baseline + 2);
+
+    heap.removeRootScanner(id);
+    heap.collect();
+    EXPECT_EQ(heap.objectCount(), baseline);
+}
+
+TEST(HeapTest, TestAllocationBudgetTriggersCollection)
+{
+    auto &heap = Heap::current();
+    heap.collect();
+    heap.setBudget(100);
+    size_t baseline = heap.objectCount();
+    size_t collections = heap.collectionCount();
+
+    for (int i = 0; i < 10000; i++)
+    {
+        makeSelfReferencingFunction();
+        heap.safePoint();
+    }
+    EXPECT_GT(heap.collectionCount(), collections);
+    // 生き残るのは直近の予算分のゴミだけ
+    EXPECT_LE(heap.objectCount(), baseline + 200);
+
+    heap.setBudget(Heap::DEFAULT_BUDGET);
+    heap.collect();
+}
+
+TEST(HeapTest, TestYoungCollectionPromotesSurvivors)
+{
+    auto &heap = Heap::current();
+    heap.collect();
+    size_t baselineOld = heap.objectCount(Heap::OLD);
+
+    // 若い世代で死んだ循環はマイナー収集で回収される
+    makeSelfReferencingFunction();
+    auto survivor = makeSelfReferencingFunction();
+    EXPECT_EQ(heap.objectCount(Heap::YOUNG), 4u);
+    EXPECT_EQ(heap.collectYoung(), 2u);
+    EXPECT_EQ(heap.objectCount(Heap::YOUNG), 0u);
+    EXPECT_EQ(heap.objectCount(Heap::OLD), baselineOld + 2);
+
+    // 古い世代へ移った後に到達できなくなった循環は、マイナー収集では走査されず全体収集で回収される
+    survivor.reset();
+    EXPECT_EQ(heap.collectYoung(), 0u);
+    EXPECT_EQ(heap.objectCount(Heap::OLD), baselineOld + 2);
+    EXPECT_EQ(heap.collect(), 2u);
+    EXPECT_EQ(heap.objectCount(), baselineOld);
+}
+
+TEST(HeapTest, TestOldToYoungReferencesKeepYoungObjectsAlive)
+{
+    auto &heap = Heap::current();
+    heap.collect();
+
+    // 古い世代のセルに、後から若い循環を代入する
+    auto holder = makeRef<Cell>();
+    heap.collectYoung();
+    {
+        auto fn = makeSelfReferencingFunction();
+        holder->value = fn;
+    }
+    heap.collectYoung();
+    ASSERT_TRUE(holder->value);
+    auto fn = dynamicRefCast<Function>(holder->value->asObject());
+    ASSERT_NE(fn, nullptr);
+    EXPECT_EQ(capturedSelf(fn), fn);
+}
+
+// ナーサリのテスト
+TEST(NurseryTest, TestShortLivedObjectsReuseTheChunk)
+{
+    auto &nursery = Nursery::current();
+    size_t recycled = nursery.recycledCount();
+    size_t chunks = Nursery::chunkCount();
+
+    // すぐに解放される文字列だけを作り続けると、同じチャンクを使い直す
+    for (int i = 0; i < 100000; i++)
+    {
+        auto string = makeRef<String>("temporary");
+        EXPECT_EQ(string->getValue(), "temporary");
+    }
+    EXPECT_GT(nursery.recycledCount(), recycled);
+    EXPECT_LE(Nursery::chunkCount(), chunks + 1);
+}
+
+TEST(NurseryTest, TestSurvivorsPromoteTheirChunk)
+{
+    auto &nursery = Nursery::current();
+    size_t promoted = nursery.promotedCount();
+    size_t chunks = Nursery::chunkCount();
+
+    // 生き残った文字列のあるチャンクは昇格し、中の文字列はそのまま使える
+    std::vector<RefPtr<String>> survivors;
+    for (int i = 0; i < 100000; i++)
+    {
+        auto string = makeRef<String>(std::to_string(i));
+        if (i % 1000 == 0)
+        {
+            survivors.push_back(string);
+        }
+    }
+    EXPECT_GT(nursery.promotedCount(), promoted);
+    size_t withSurvivors = Nursery::chunkCount();
+    EXPECT_GT(withSurvivors, chunks);
+    for (size_t i = 0; i < survivors.size(); i++)
+    {
+        EXPECT_EQ(survivors[i]->getValue(), std::to_string(i * 1000));
+    }
+
+    // 昇格したチャンクは最後の文字列が解放されたときに解放される
+    survivors.clear();
+    EXPECT_LT(Nursery::chunkCount(), withSurvivors);
+}
+
+TEST(NurseryTest, TestObjectsEscapingToAnotherThread)
+{
+    size_t chunks = Nursery::chunkCount();
+    RefPtr<String> escaped;
+    std::thread([&] {
+        escaped = makeRef<String>("from another thread");
+        escaped->shareAcrossThreads();
+    }).join();
+
+    // スレッドの終了後も、そのスレッドのチャンクは文字列が解放されるまで残る
+    EXPECT_EQ(escaped->getValue(), "from another thread");
+    EXPECT_EQ(Nursery::chunkCount(), chunks + 1);
+    escaped.reset();
+    EXPECT_EQ(Nursery::chunkCount(), chunks);
+}
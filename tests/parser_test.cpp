@@ -199,13 +199,36 @@ TEST_F(ParserTest, TestPrefixExpressions)
         auto exp = dynamic_cast<AST::PrefixExpression *>(stmt->expression.get());
         ASSERT_NE(exp, nullptr);
 
-        EXPECT_EQ(exp->op, tt.op);
+        EXPECT_EQ(AST::toString(exp->op), tt.op);
         auto right = dynamic_cast<AST::IntegerLiteral *>(exp->right.get());
         ASSERT_NE(right, nullptr);
         EXPECT_EQ(right->value, tt.value);
     }
 }
 
+// 同じ記号でも前置と中置で別の演算子として記録されることのテスト
+TEST_F(ParserTest, TestOperatorsResolvedAtParseTime)
+{
+    auto [program, parser_owner, parser] = ParseInput("-a - !b;");
+    ASSERT_TRUE(parser->Errors().empty());
+    ASSERT_EQ(program->statements.size(), 1);
+
+    auto stmt = dynamic_cast<AST::ExpressionStatement *>(program->statements[0].get());
+    ASSERT_NE(stmt, nullptr);
+    auto infix = dynamic_cast<AST::InfixExpression *>(stmt->expression.get());
+    ASSERT_NE(infix, nullptr);
+    EXPECT_EQ(infix->op, AST::Operator::SUB);
+
+    auto left = dynamic_cast<AST::PrefixExpression *>(infix->left.get());
+    ASSERT_NE(left, nullptr);
+    EXPECT_EQ(left->op, AST::Operator::NEG);
+    auto right = dynamic_cast<AST::PrefixExpression *>(infix->right.get());
+    ASSERT_NE(right, nullptr);
+    EXPECT_EQ(right->op, AST::Operator::NOT);
+
+    EXPECT_EQ(program->String(), "((-a) - (!b))");
+}
+
 // ... 他のテストケースも同様にリファクタリング ...
 
 TEST_F(ParserTest, TestFunctionLiteral)
@@ -233,7 +256,7 @@ TEST_F(ParserTest, TestFunctionLiteral)
 
     auto infix = dynamic_cast<AST::InfixExpression *>(bodyStmt->expression.get());
     ASSERT_NE(infix, nullptr);
-    EXPECT_EQ(infix->op, "+");
+    EXPECT_EQ(infix->op, AST::Operator::ADD);
 }
 
 TEST_F(ParserTest, TestFunctionParameterParsing)
@@ -297,12 +320,12 @@ TEST_F(ParserTest, TestCallExpression)
     // Second argument (2 * 3)
     auto second = dynamic_cast<AST::InfixExpression *>(exp->arguments[1].get());
     ASSERT_NE(second, nullptr);
-    EXPECT_EQ(second->op, "*");
+    EXPECT_EQ(second->op, AST::Operator::MUL);
 
     // Third argument (4 + 5)
     auto third = dynamic_cast<AST::InfixExpression *>(exp->arguments[2].get());
     ASSERT_NE(third, nullptr);
-    EXPECT_EQ(third->op, "+");
+    EXPECT_EQ(third->op, AST::Operator::ADD);
 }
 
 TEST_F(ParserTest, TestCallExpressionParameter)
@@ -439,7 +462,7 @@ TEST_F(ParserTest, TestIndexExpressions)
 
     auto index = dynamic_cast<AST::InfixExpression *>(indexExp->index.get());
     ASSERT_NE(index, nullptr);
-    EXPECT_EQ(index->op, "+");
+    EXPECT_EQ(index->op, AST::Operator::ADD);
 
     auto left = dynamic_cast<AST::IntegerLiteral *>(index->left.get());
     ASSERT_NE(left, nullptr);
@@ -471,7 +494,7 @@ void testInfixExpression(AST::Expression *expr, int64_t left_value,
     auto opExpr = dynamic_cast<AST::InfixExpression *>(expr);
     ASSERT_NE(opExpr, nullptr) << "Expression is not InfixExpression";
 
-    EXPECT_EQ(opExpr->op, operator_literal);
+    EXPECT_EQ(AST::toString(opExpr->op), operator_literal);
 
     auto leftExpr = dynamic_cast<AST::IntegerLiteral *>(opExpr->left.get());
     ASSERT_NE(leftExpr, nullptr) << "Left expression is not IntegerLiteral";
@@ -513,7 +536,7 @@ TEST_F(ParserTest, TestWhileExpression)
     // 条件式のテスト
     auto condition = dynamic_cast<AST::InfixExpression*>(whileExpr->condition.get());
     ASSERT_NE(condition, nullptr);
-    EXPECT_EQ(condition->op, "<");
+    EXPECT_EQ(condition->op, AST::Operator::LT);
 
     auto left = dynamic_cast<AST::Identifier*>(condition->left.get());
     ASSERT_NE(left, nullptr);
@@ -561,4 +584,75 @@ TEST_F(ParserTest, TestForExpression)
     ASSERT_NE(forExpr->condition, nullptr);
     ASSERT_NE(forExpr->update, nullptr);
     ASSERT_NE(forExpr->body, nullptr);
-}
\ No newline at end of file
+}
+TEST_F(ParserTest, TestNodeKinds)
+{
+    std::string input = "let x = fn(a) { a + 1 }; x(2);";
+
+    auto [program, parser_owner, parser] = ParseInput(input);
+    ASSERT_NE(program.get(), nullptr);
+    ASSERT_TRUE(parser->Errors().empty());
+    ASSERT_EQ(program->statements.size(), 2);
+
+    EXPECT_EQ(program->kind(), AST::NodeKind::PROGRAM);
+
+    // 各ノードがパース時に正しい種別タグを持つことを確認
+    auto let = program->statements[0].get();
+    ASSERT_EQ(let->kind(), AST::NodeKind::LET_STATEMENT);
+    auto letStmt = AST::as<AST::LetStatement>(let);
+    EXPECT_EQ(letStmt->name->kind(), AST::NodeKind::IDENTIFIER);
+    ASSERT_EQ(letStmt->value->kind(), AST::NodeKind::FUNCTION_LITERAL);
+    auto fn = AST::as<AST::FunctionLiteral>(letStmt->value.get());
+    EXPECT_EQ(fn->body->kind(), AST::NodeKind::BLOCK_STATEMENT);
+
+    auto call = program->statements[1].get();
+    ASSERT_EQ(call->kind(), AST::NodeKind::EXPRESSION_STATEMENT);
+    auto expr = AST::as<AST::ExpressionStatement>(call)->expression.get();
+    ASSERT_EQ(expr->kind(), AST::NodeKind::CALL_EXPRESSION);
+    EXPECT_EQ(AST::as<AST::CallExpression>(expr)->arguments[0]->kind(), AST::NodeKind::INTEGER_LITERAL);
+
+    // clone()しても種別タグは引き継がれる
+    std::unique_ptr<AST::Expression> copy(fn->clone());
+    EXPECT_EQ(copy->kind(), AST::NodeKind::FUNCTION_LITERAL);
+}
+
+TEST_F(ParserTest, TestProgramOwnsArena)
+{
+    std::string input = "let add = fn(a, b) { a + b }; add(1, [2, 3][0]);";
+
+    auto [program, parser_owner, parser] = ParseInput(input);
+    ASSERT_TRUE(parser->Errors().empty());
+    ASSERT_NE(program->arena, nullptr);
+    EXPECT_GT(program->arena->bytesAllocated(), 0u);
+    EXPECT_EQ(program->String(), "let add = fn(a, b) { (a + b) };add(1, ([2, 3][0]))");
+
+    // パースが終わればアリーナは現在のスレッドから外れ、以降のノードはヒープに確保される
+    EXPECT_EQ(AST::Arena::current(), nullptr);
+    auto used = program->arena->bytesAllocated();
+    std::unique_ptr<AST::Statement> copy(program->statements[0]->clone());
+    EXPECT_EQ(program->arena->bytesAllocated(), used);
+    EXPECT_EQ(copy->String(), program->statements[0]->String());
+}
+
+TEST_F(ParserTest, TestArenaScopeNesting)
+{
+    AST::Arena outer(64);
+    AST::Arena inner(64);
+    {
+        AST::ArenaScope outerScope(&outer);
+        EXPECT_EQ(AST::Arena::current(), &outer);
+        {
+            AST::ArenaScope innerScope(&inner);
+            EXPECT_EQ(AST::Arena::current(), &inner);
+        }
+        EXPECT_EQ(AST::Arena::current(), &outer);
+    }
+    EXPECT_EQ(AST::Arena::current(), nullptr);
+
+    // ブロックより大きい要求も確保でき、結果は最大アラインメントに揃う
+    void *large = outer.allocate(1000);
+    void *small = outer.allocate(1);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(large) % alignof(std::max_align_t), 0u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(small) % alignof(std::max_align_t), 0u);
+    EXPECT_EQ(outer.blockCount(), 2u);
+}
@@ -0,0 +1,90 @@
+#include "../script/script.hpp"
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+
+namespace
+{
+// テスト用のスクリプトファイルを書き出してパスを返す
+std::string writeScript(const std::string &name, const std::string &source)
+{
+    std::string path = ::testing::TempDir() + name;
+    std::ofstream out(path, std::ios::binary);
+    out << source;
+    return path;
+}
+
+// std::coutへの出力を捕捉する
+class CaptureStdout
+{
+  public:
+    CaptureStdout() : previous(std::cout.rdbuf(buffer.rdbuf()))
+    {
+    }
+    ~CaptureStdout()
+    {
+        std::cout.rdbuf(previous);
+    }
+    std::string str() const
+    {
+        return buffer.str();
+    }
+
+  private:
+    std::ostringstream buffer;
+    std::streambuf *previous;
+};
+} // namespace
+
+TEST(ScriptTest, TestRunFile)
+{
+    auto path = writeScript("script_run.mk", R"(
+        let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };
+        puts(fib(15), "done");
+        fib(10);
+    )");
+
+    std::ostringstream err;
+    Script::Runner runner(err);
+    CaptureStdout out;
+    EXPECT_EQ(runner.runFile(path), Script::ExitCode::OK);
+    // 最後の式の値は表示せず、putsの出力だけが残る
+    EXPECT_EQ(out.str(), "610\ndone\n");
+    EXPECT_EQ(err.str(), "");
+}
+
+TEST(ScriptTest, TestExitCodes)
+{
+    std::ostringstream err;
+    Script::Runner runner(err);
+
+    EXPECT_EQ(runner.runFile(::testing::TempDir() + "no_such_script.mk"), Script::ExitCode::NO_INPUT);
+    EXPECT_NE(err.str().find("no_such_script.mk"), std::string::npos);
+
+    err.str("");
+    EXPECT_EQ(runner.runFile(writeScript("script_parse.mk", "let = 5;")), Script::ExitCode::PARSE_ERROR);
+    EXPECT_NE(err.str().find("parse error"), std::string::npos);
+
+    err.str("");
+    EXPECT_EQ(runner.runFile(writeScript("script_string.mk", "\"unterminated")), Script::ExitCode::PARSE_ERROR);
+
+    err.str("");
+    EXPECT_EQ(runner.runFile(writeScript("script_error.mk", "5 + true;")), Script::ExitCode::RUNTIME_ERROR);
+    EXPECT_NE(err.str().find("ERROR: "), std::string::npos);
+
+    // 空のファイルはマップせずに正常終了する
+    err.str("");
+    EXPECT_EQ(runner.runFile(writeScript("script_empty.mk", "")), Script::ExitCode::OK);
+    EXPECT_EQ(err.str(), "");
+}
+
+TEST(ScriptTest, TestRunBufferWithoutTerminator)
+{
+    // 終端の'\0'がないバッファの範囲外を読まないことを確認する
+    std::string source = "let x = 40; puts(x + 2);puts(999)";
+    std::ostringstream err;
+    Script::Runner runner(err);
+    CaptureStdout out;
+    EXPECT_EQ(runner.run(source.data(), source.size() - std::string(";puts(999)").size()), Script::ExitCode::OK);
+    EXPECT_EQ(out.str(), "42\n");
+}
@@ -0,0 +1,102 @@
+#include "../trace/trace.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+
+class TraceTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        previousLevel = Trace::getLevel();
+        Trace::enableRingBuffer(4);
+    }
+
+    void TearDown() override
+    {
+        Trace::enableRingBuffer(0);
+        Trace::setStream(nullptr);
+        Trace::setLevel(previousLevel);
+    }
+
+    Trace::Level previousLevel = Trace::Level::WARN;
+};
+
+// 無効なレベルのメッセージ式は評価されないことのテスト
+TEST_F(TraceTest, TestMessageIsFormattedLazily)
+{
+    int evaluated = 0;
+    auto expensive = [&evaluated]() {
+        ++evaluated;
+        return std::string("expensive");
+    };
+
+    Trace::setLevel(Trace::Level::ERROR);
+    TRACE_WARN("test", "value: " << expensive());
+    EXPECT_EQ(evaluated, 0);
+    EXPECT_TRUE(Trace::snapshot().empty());
+
+    Trace::setLevel(Trace::Level::WARN);
+    TRACE_WARN("test", "value: " << expensive());
+    EXPECT_EQ(evaluated, 1);
+
+    auto records = Trace::snapshot();
+    ASSERT_EQ(records.size(), 1u);
+    EXPECT_EQ(records[0].level, Trace::Level::WARN);
+    EXPECT_STREQ(records[0].category, "test");
+    EXPECT_EQ(records[0].message, "value: expensive");
+}
+
+// コンパイル時に除去されたレベルは実行時レベルに関わらず評価されないことのテスト
+TEST_F(TraceTest, TestCompiledOutLevels)
+{
+    Trace::setLevel(Trace::Level::TRACE);
+    int evaluated = 0;
+    MONKEY_TRACE(Trace::Level::TRACE, "test", (++evaluated, "detail"));
+    EXPECT_EQ(evaluated, Trace::compiledIn(Trace::Level::TRACE) ? 1 : 0);
+}
+
+// リングバッファは古いレコードを上書きし、古い順に読み出せることのテスト
+TEST_F(TraceTest, TestRingBufferWrapsAround)
+{
+    Trace::setLevel(Trace::Level::INFO);
+    for (int i = 0; i < 10; ++i)
+    {
+        TRACE_INFO("test", "record " << i);
+    }
+
+    auto records = Trace::snapshot();
+    ASSERT_EQ(records.size(), 4u);
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        EXPECT_EQ(records[i].message, "record " + std::to_string(6 + i));
+    }
+
+    std::ostringstream out;
+    Trace::dump(out);
+    EXPECT_NE(out.str().find("INFO test: record 9"), std::string::npos);
+
+    Trace::clear();
+    EXPECT_TRUE(Trace::snapshot().empty());
+    TRACE_INFO("test", "after clear");
+    ASSERT_EQ(Trace::snapshot().size(), 1u);
+}
+
+// ストリームを設定すると即座に書き出されることのテスト
+TEST_F(TraceTest, TestStreamSink)
+{
+    std::ostringstream out;
+    Trace::setStream(&out);
+    Trace::setLevel(Trace::Level::ERROR);
+    TRACE_ERROR("test", "broken " << 42);
+    EXPECT_NE(out.str().find("ERROR test: broken 42"), std::string::npos);
+}
+
+TEST(TraceLevelTest, TestParseLevel)
+{
+    Trace::Level level;
+    ASSERT_TRUE(Trace::parseLevel("Debug", level));
+    EXPECT_EQ(level, Trace::Level::DEBUG);
+    ASSERT_TRUE(Trace::parseLevel("off", level));
+    EXPECT_EQ(level, Trace::Level::OFF);
+    EXPECT_FALSE(Trace::parseLevel("verbose", level));
+}
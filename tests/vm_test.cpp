@@ -0,0 +1,276 @@
+#include "../compiler/compiler.hpp"
+#include "../lexer/lexer.hpp"
+#include "../object/object.hpp"
+#include "../parser/parser.hpp"
+#include "../vm/vm.hpp"
+#include <gtest/gtest.h>
+#include <limits>
+#include <variant>
+
+using namespace monkey;
+
+// ヘルパー関数（評価器テストのtestEvalと同じ形でVMを実行する）
+ObjectPtr testRun(const std::string &input)
+{
+    auto lexer = std::make_unique<Lexer::Lexer>(input);
+    auto parser = std::make_unique<Parser::Parser>(std::move(lexer));
+    auto program = parser->ParseProgram();
+
+    if (!program || program->statements.empty())
+    {
+        return makeRef<Error>("Failed to parse program");
+    }
+
+    Compiler::Compiler compiler;
+    if (!compiler.compile(*program))
+    {
+        return makeRef<Error>(compiler.Errors().front());
+    }
+
+    VM::VM vm(compiler.bytecode());
+    return vm.run();
+}
+
+void testIntegerObject(const ObjectPtr &obj, int64_t expected)
+{
+    auto integer = dynamicRefCast<Integer>(obj);
+    ASSERT_NE(integer, nullptr) << "got: " << (obj ? obj->inspect() : "nullptr");
+    EXPECT_EQ(integer->value(), expected);
+}
+
+void testBooleanObject(const ObjectPtr &obj, bool expected)
+{
+    auto boolean = dynamicRefCast<Boolean>(obj);
+    ASSERT_NE(boolean, nullptr) << "got: " << (obj ? obj->inspect() : "nullptr");
+    EXPECT_EQ(boolean->value(), expected);
+}
+
+void testStringObject(const ObjectPtr &obj, const std::string &expected)
+{
+    auto str = dynamicRefCast<String>(obj);
+    ASSERT_NE(str, nullptr) << "got: " << (obj ? obj->inspect() : "nullptr");
+    EXPECT_EQ(str->getValue(), expected);
+}
+
+// 評価器テストと同じケースをVMで実行する
+TEST(VMTest, TestIntegerArithmetic)
+{
+    struct Test
+    {
+        std::string input;
+        int64_t expected;
+    };
+
+    std::vector<Test> tests = {
+        {"5", 5},
+        {"10", 10},
+        {"-5", -5},
+        {"-10", -10},
+        {"5 + 5", 10},
+        {"5 - 5", 0},
+        {"5 * 5", 25},
+        {"5 / 5", 1},
+        {"2 * (5 + 5)", 20},
+        {"3 * 3 * 3", 27},
+        {"(5 + 10 * 2 + 15 / 3)", 30},
+        {"let d = fn(a, b) { a / b }; d(-9223372036854775807 - 1, -1)", std::numeric_limits<int64_t>::min()},
+    };
+
+    for (const auto &tt : tests)
+    {
+        testIntegerObject(testRun(tt.input), tt.expected);
+    }
+}
+
+TEST(VMTest, TestBooleanExpressions)
+{
+    struct Test
+    {
+        std::string input;
+        bool expected;
+    };
+
+    std::vector<Test> tests = {
+        {"true", true},          {"false", false},
+        {"1 < 2", true},         {"1 > 2", false},
+        {"1 == 1", true},        {"1 != 1", false},
+        {"true == true", true},  {"false == false", true},
+        {"true != false", true}, {"(1 < 2) == true", true},
+        {"!true", false},        {"!false", true},
+        {"!!true", true},        {"!!false", false},
+        {"!5", false},           {"!!5", true},
+    };
+
+    for (const auto &tt : tests)
+    {
+        testBooleanObject(testRun(tt.input), tt.expected);
+    }
+}
+
+TEST(VMTest, TestStringExpressions)
+{
+    testStringObject(testRun("\"Hello World!\""), "Hello World!");
+    testStringObject(testRun("\"Hello\" + \" \" + \"World!\""), "Hello World!");
+}
+
+TEST(VMTest, TestErrorHandling)
+{
+    struct Test
+    {
+        std::string input;
+        std::string expectedMessage;
+    };
+
+    std::vector<Test> tests = {
+        {"5 + true", "type mismatch: INTEGER + BOOLEAN"},
+        {"5 + true; 5;", "type mismatch: INTEGER + BOOLEAN"},
+        {"-true", "unknown operator: -BOOLEAN"},
+        {"true + false", "unknown operator: BOOLEAN + BOOLEAN"},
+        {"5; true + false; 5", "unknown operator: BOOLEAN + BOOLEAN"},
+        {"if (10 > 1) { true + false; }", "unknown operator: BOOLEAN + BOOLEAN"},
+        {"\"Hello\" - \"World\"", "unknown operator: STRING - STRING"},
+        {"5[1]", "index operator not supported: INTEGER"},
+        {"[1, 2, 3][\"1\"]", "array index must be an integer"},
+        {"foobar", "identifier not found: foobar"},
+        {"fn(x) { x; }()", "wrong number of arguments: expected 1, got 0"},
+        {"1 / 0", "division by zero"},
+    };
+
+    for (const auto &tt : tests)
+    {
+        auto evaluated = testRun(tt.input);
+        auto errorObj = dynamicRefCast<Error>(evaluated);
+        ASSERT_NE(errorObj, nullptr)
+            << "Expected error object, got: " << (evaluated ? evaluated->inspect() : "nullptr");
+        EXPECT_EQ(errorObj->message(), tt.expectedMessage);
+    }
+}
+
+TEST(VMTest, TestArrayLiterals)
+{
+    auto result = monkey::dynamicRefCast<monkey::Array>(testRun("[1, 2 * 2, 3 + 3]"));
+    ASSERT_NE(result, nullptr);
+    ASSERT_EQ(result->elements.size(), 3);
+
+    testIntegerObject(result->elements[0].toObject(), 1);
+    testIntegerObject(result->elements[1].toObject(), 4);
+    testIntegerObject(result->elements[2].toObject(), 6);
+}
+
+TEST(VMTest, TestArrayIndexExpressions)
+{
+    struct TestCase
+    {
+        std::string input;
+        std::variant<int64_t, std::monostate> expected;
+    };
+
+    std::vector<TestCase> tests = {
+        {"[1, 2, 3][0]", 1},
+        {"[1, 2, 3][1]", 2},
+        {"[1, 2, 3][2]", 3},
+        {"let i = 0; [1][i];", 1},
+        {"[1, 2, 3][1 + 1];", 3},
+        {"let myArray = [1, 2, 3]; myArray[2];", 3},
+        {"let myArray = [1, 2, 3]; myArray[0] + myArray[1] + myArray[2];", 6},
+        {"let myArray = [1, 2, 3]; let i = myArray[0]; myArray[i]", 2},
+        {"[1, 2, 3][3]", std::monostate{}},
+        {"[1, 2, 3][-1]", std::monostate{}},
+    };
+
+    for (const auto &tt : tests)
+    {
+        auto evaluated = testRun(tt.input);
+        if (std::holds_alternative<int64_t>(tt.expected))
+        {
+            testIntegerObject(evaluated, std::get<int64_t>(tt.expected));
+        }
+        else
+        {
+            ASSERT_NE(monkey::dynamicRefCast<monkey::Null>(evaluated), nullptr);
+        }
+    }
+}
+
+TEST(VMTest, TestLoops)
+{
+    struct Test
+    {
+        std::string input;
+        int64_t expected;
+    };
+
+    std::vector<Test> tests = {
+        {"let x = 0; while (x < 5) { let x = x + 1; } x;", 5},
+        {"let x = 0; while (false) { let x = x + 1; } x;", 0},
+        {"let x = 0; while (x < 3) { let x = x + 1; } x;", 3},
+        {"let s = 0; for (let i = 0; i < 5; let i = i + 1) { let s = s + i; } s;", 10},
+    };
+
+    for (const auto &tt : tests)
+    {
+        testIntegerObject(testRun(tt.input), tt.expected);
+    }
+}
+
+TEST(VMTest, TestFunctionsAndClosures)
+{
+    struct Test
+    {
+        std::string input;
+        int64_t expected;
+    };
+
+    std::vector<Test> tests = {
+        {"let add = fn(a, b) { a + b; }; add(1, 2);", 3},
+        {"let f = fn() { return 5; 10; }; f();", 5},
+        {"let f = fn(x) { let y = x * 2; y + 1; }; f(4);", 9},
+        {"let adder = fn(x) { fn(y) { x + y; }; }; let addTwo = adder(2); addTwo(3);", 5},
+        {"let a = fn(x) { fn(y) { fn(z) { x + y + z; }; }; }; a(1)(2)(3);", 6},
+        {"let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(15);",
+         610},
+        {"let outer = fn() { let count = fn(n) { if (n == 0) { 0 } else { count(n - 1) } }; "
+         "count(3); }; outer();",
+         0},
+        // 捕捉した後に代入し直した変数は、評価器と同じく代入し直した値が見える
+        {"let h = fn() { let a = 1; let k = fn() { a }; let a = 2; k() }; h()", 2},
+        {"let m = fn(a) { let k = fn() { a }; let a = 3; k() }; m(1)", 3},
+        {"let n = fn(a) { let k = fn() { fn() { a } }; let a = 4; k()() }; n(1)", 4},
+        {"let p = fn(a) { let k = fn() { a }; k() }; p(5)", 5},
+        {"len([1, 2, 3]) + first([4]) + last([5, 6])", 13},
+        {"return 7; 8;", 7},
+    };
+
+    for (const auto &tt : tests)
+    {
+        testIntegerObject(testRun(tt.input), tt.expected);
+    }
+
+    // 関数の中で後から定義する局所関数も参照できる（相互再帰）
+    testBooleanObject(testRun("let f = fn() { let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } }; "
+                              "let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } }; even(10) }; f()"),
+                      true);
+}
+
+TEST(VMTest, TestGlobalsPersistAcrossRuns)
+{
+    auto symbolTable = Compiler::NewGlobalSymbolTable();
+    std::vector<ObjectPtr> constants;
+    auto globals = VM::VM::NewGlobals();
+
+    ObjectPtr result;
+    for (const std::string line : {"let x = 40;", "let inc = fn(n) { n + 1 };", "inc(x) + 1"})
+    {
+        Parser::Parser parser(std::make_unique<Lexer::Lexer>(line));
+        auto program = parser.ParseProgram();
+
+        Compiler::Compiler compiler(symbolTable, constants);
+        ASSERT_TRUE(compiler.compile(*program));
+        auto bytecode = compiler.bytecode();
+        constants = bytecode.constants;
+
+        VM::VM vm(bytecode, globals);
+        result = vm.run();
+    }
+    testIntegerObject(result, 42);
+}
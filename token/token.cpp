@@ -57,6 +57,9 @@ std::string toString(TokenType type) {
 Token::Token(TokenType type, std::string literal) 
     : type_(type), literal_(std::move(literal)) {}
 
+Token::Token(const TokenView& view)
+    : type_(view.getType()), literal_(view.getLiteral()) {}
+
 std::string Token::getTypeString() const {
     return toString(type_);
 }
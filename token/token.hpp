@@ -1,5 +1,7 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 namespace Token
@@ -53,9 +55,36 @@ enum class TokenType
     FOR,
 };
 
+// TokenTypeの個数（TokenTypeで引く表の大きさ。列挙子を追加したら最後の列挙子に合わせて更新する）
+constexpr size_t TOKEN_TYPE_COUNT = static_cast<size_t>(TokenType::FOR) + 1;
+
 // TokenTypeを文字列に変換する関数
 std::string toString(TokenType type);
 
+// レキサーが生成する軽量なトークン
+// リテラルはソースバッファ内の範囲を指すだけで文字列を確保しない
+// ソースバッファ（Lexerが保持する入力）より長く保持してはならない
+class TokenView
+{
+  private:
+    TokenType type_;
+    std::string_view literal_;
+    int64_t integer_ = 0;     // INTトークンの値（字句解析時にデコード済み）
+    bool overflow_ = false;   // INTトークンの値がint64_tに収まらない
+
+  public:
+    TokenView(TokenType type, std::string_view literal) : type_(type), literal_(literal) {}
+    TokenView(std::string_view literal, int64_t integer, bool overflow)
+        : type_(TokenType::INT), literal_(literal), integer_(integer), overflow_(overflow) {}
+
+    // アクセサ
+    TokenType getType() const { return type_; }
+    std::string_view getLiteral() const { return literal_; }
+    int64_t getInteger() const { return integer_; }
+    bool integerOverflowed() const { return overflow_; }
+};
+
+// リテラルを所有するトークン（ASTノードが保持する）
 class Token
 {
   private:
@@ -64,6 +93,8 @@ class Token
 
   public:
     Token(TokenType type, std::string literal);
+    // レキサーのトークンからリテラルをコピーして作る（ASTノードへ渡す際に暗黙に変換される）
+    Token(const TokenView& view);
 
     // アクセサ
     TokenType getType() const { return type_; }
@@ -0,0 +1,227 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace Trace
+{
+
+namespace
+{
+constexpr size_t MAX_MESSAGE = 160; // 1レコードに保存するメッセージの最大長（超過分は切り詰める）
+
+// リングバッファの1スロット
+// sequenceは書き込み中は奇数、書き込み完了後は2*(通し番号+1)になる
+struct Slot
+{
+    std::atomic<uint64_t> sequence{0};
+    uint64_t nanos = 0;
+    Level level = Level::OFF;
+    const char *category = "";
+    uint32_t length = 0;
+    char text[MAX_MESSAGE];
+};
+
+// 複数の書き込み側がロックなしで追記できる固定長のリングバッファ
+// 古いレコードは上書きされ、読み出し側はsequenceを前後で比較して書き込み途中のスロットを読み飛ばす
+struct RingBuffer
+{
+    explicit RingBuffer(size_t capacity) : slots(new Slot[capacity]), capacity(capacity)
+    {
+    }
+
+    void push(uint64_t nanos, Level level, const char *category, const std::string &message)
+    {
+        uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+        Slot &slot = slots[index % capacity];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.nanos = nanos;
+        slot.level = level;
+        slot.category = category;
+        slot.length = static_cast<uint32_t>(std::min(message.size(), MAX_MESSAGE));
+        std::memcpy(slot.text, message.data(), slot.length);
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+    }
+
+    std::vector<Record> read() const
+    {
+        std::vector<Record> records;
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t begin = end > capacity ? end - capacity : 0;
+        begin = std::max(begin, start.load(std::memory_order_relaxed));
+        records.reserve(end - begin);
+        for (uint64_t index = begin; index < end; ++index)
+        {
+            const Slot &slot = slots[index % capacity];
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before != 2 * index + 2)
+            {
+                continue;
+            }
+            Record record{index, slot.nanos, slot.level, slot.category, std::string(slot.text, slot.length)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != before)
+            {
+                continue;
+            }
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> start{0}; // clear()以降のレコードだけを読み出すための開始位置
+};
+
+std::atomic<RingBuffer *> ring{nullptr};
+std::atomic<std::ostream *> stream{nullptr};
+
+// 設定変更と即時出力の排他用（リングバッファへの追記では使用しない）
+std::mutex &configMutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+// 差し替えたリングバッファは書き込み中のスレッドがいる可能性があるため解放しない
+std::vector<std::unique_ptr<RingBuffer>> &retiredBuffers()
+{
+    static std::vector<std::unique_ptr<RingBuffer>> buffers;
+    return buffers;
+}
+
+uint64_t elapsedNanos()
+{
+    static const auto origin = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void writeRecord(std::ostream &out, uint64_t nanos, Level level, const char *category, const std::string &message)
+{
+    out << "[" << (nanos / 1000) << "us] " << levelName(level) << " " << category << ": " << message << "\n";
+}
+} // namespace
+
+const char *levelName(Level level)
+{
+    switch (level)
+    {
+    case Level::OFF:
+        return "OFF";
+    case Level::ERROR:
+        return "ERROR";
+    case Level::WARN:
+        return "WARN";
+    case Level::INFO:
+        return "INFO";
+    case Level::DEBUG:
+        return "DEBUG";
+    case Level::TRACE:
+        return "TRACE";
+    }
+    return "UNKNOWN";
+}
+
+bool parseLevel(const std::string &name, Level &out)
+{
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    static const std::pair<const char *, Level> names[] = {
+        {"off", Level::OFF},     {"error", Level::ERROR}, {"warn", Level::WARN},
+        {"info", Level::INFO},   {"debug", Level::DEBUG}, {"trace", Level::TRACE},
+    };
+    for (const auto &[levelString, level] : names)
+    {
+        if (lower == levelString)
+        {
+            out = level;
+            return true;
+        }
+    }
+    return false;
+}
+
+void setLevel(Level level)
+{
+    runtimeLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+Level getLevel()
+{
+    return static_cast<Level>(runtimeLevel.load(std::memory_order_relaxed));
+}
+
+void setStream(std::ostream *out)
+{
+    std::lock_guard<std::mutex> lock(configMutex());
+    stream.store(out, std::memory_order_release);
+}
+
+void enableRingBuffer(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(configMutex());
+    RingBuffer *next = capacity > 0 ? new RingBuffer(capacity) : nullptr;
+    RingBuffer *previous = ring.exchange(next, std::memory_order_acq_rel);
+    if (previous)
+    {
+        retiredBuffers().emplace_back(previous);
+    }
+}
+
+bool ringBufferEnabled()
+{
+    return ring.load(std::memory_order_acquire) != nullptr;
+}
+
+std::vector<Record> snapshot()
+{
+    RingBuffer *buffer = ring.load(std::memory_order_acquire);
+    if (!buffer)
+    {
+        return {};
+    }
+    return buffer->read();
+}
+
+void dump(std::ostream &out)
+{
+    for (const auto &record : snapshot())
+    {
+        writeRecord(out, record.nanos, record.level, record.category, record.message);
+    }
+    out.flush();
+}
+
+void clear()
+{
+    RingBuffer *buffer = ring.load(std::memory_order_acquire);
+    if (buffer)
+    {
+        buffer->start.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+void emit(Level level, const char *category, const std::string &message)
+{
+    uint64_t nanos = elapsedNanos();
+    if (RingBuffer *buffer = ring.load(std::memory_order_acquire))
+    {
+        buffer->push(nanos, level, category, message);
+    }
+    if (stream.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(configMutex());
+        if (std::ostream *out = stream.load(std::memory_order_relaxed))
+        {
+            writeRecord(*out, nanos, level, category, message);
+        }
+    }
+}
+
+} // namespace Trace
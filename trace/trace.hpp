@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// コンパイル時のトレースレベル上限（CMakeのMONKEY_TRACE_LEVELから渡される）
+// この値より詳細なレベルのトレースはコードごと生成されない
+#ifndef MONKEY_TRACE_LEVEL
+#define MONKEY_TRACE_LEVEL 4
+#endif
+
+namespace Trace
+{
+
+// トレースレベル（数値が大きいほど詳細）
+enum class Level : int
+{
+    OFF = 0,
+    ERROR = 1,
+    WARN = 2,
+    INFO = 3,
+    DEBUG = 4,
+    TRACE = 5
+};
+
+const char *levelName(Level level);
+// "debug"などの名前からレベルを得る（不明な名前の場合はfalseを返す）
+bool parseLevel(const std::string &name, Level &out);
+
+// コンパイル時にそのレベルのトレースが組み込まれているかどうか
+constexpr bool compiledIn(Level level)
+{
+    return static_cast<int>(level) <= MONKEY_TRACE_LEVEL;
+}
+
+// 実行時のトレースレベル（ホットパスではこの値の読み込みと比較だけを行う）
+inline std::atomic<int> runtimeLevel{static_cast<int>(Level::WARN)};
+
+inline bool enabled(Level level)
+{
+    return static_cast<int>(level) <= runtimeLevel.load(std::memory_order_relaxed);
+}
+
+void setLevel(Level level);
+Level getLevel();
+
+// 出力先の設定
+// ストリームを設定すると即座に書き出す（nullptrで無効化）
+void setStream(std::ostream *out);
+// リングバッファを有効にする（capacityが0の場合は無効化）
+void enableRingBuffer(size_t capacity);
+bool ringBufferEnabled();
+
+// リングバッファ内のレコード
+struct Record
+{
+    uint64_t sequence;
+    uint64_t nanos; // プロセス開始からの経過時間
+    Level level;
+    const char *category;
+    std::string message;
+};
+
+// リングバッファ内のレコードを古い順に取得する
+std::vector<Record> snapshot();
+// リングバッファの内容を古い順に書き出す
+void dump(std::ostream &out);
+void clear();
+
+// トレースを1件記録する（マクロから呼ばれる）
+void emit(Level level, const char *category, const std::string &message);
+
+} // namespace Trace
+
+// トレースマクロ
+// メッセージ式はレベルが有効な場合にのみ評価される（遅延フォーマット）
+// 例: MONKEY_TRACE(Trace::Level::DEBUG, "jit", "compiling " << stmt->String());
+#define MONKEY_TRACE(level, category, expr)                                                                            \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (::Trace::compiledIn(level))                                                                      \
+        {                                                                                                              \
+            if (::Trace::enabled(level))                                                                               \
+            {                                                                                                          \
+                std::ostringstream traceOut_;                                                                          \
+                traceOut_ << expr;                                                                                     \
+                ::Trace::emit(level, category, traceOut_.str());                                                       \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (0)
+
+#define TRACE_ERROR(category, expr) MONKEY_TRACE(::Trace::Level::ERROR, category, expr)
+#define TRACE_WARN(category, expr) MONKEY_TRACE(::Trace::Level::WARN, category, expr)
+#define TRACE_INFO(category, expr) MONKEY_TRACE(::Trace::Level::INFO, category, expr)
+#define TRACE_DEBUG(category, expr) MONKEY_TRACE(::Trace::Level::DEBUG, category, expr)
+#define TRACE_TRACE(category, expr) MONKEY_TRACE(::Trace::Level::TRACE, category, expr)
@@ -0,0 +1,589 @@
+#include "vm.hpp"
+#include "../object/builtins.hpp"
+#include <limits>
+
+namespace VM
+{
+
+namespace
+{
+monkey::Value newError(const std::string &message)
+{
+    return monkey::makeRef<monkey::Error>(message);
+}
+
+bool isTruthy(const monkey::Value &value)
+{
+    switch (value.tag())
+    {
+    case monkey::Value::Tag::BOOLEAN:
+        return value.asBoolean();
+    case monkey::Value::Tag::NULL_:
+        return false;
+    case monkey::Value::Tag::INTEGER:
+        return value.asInteger() != 0;
+    default:
+        return true;
+    }
+}
+
+const char *operatorString(Code::Opcode op)
+{
+    switch (op)
+    {
+    case Code::Opcode::ADD:
+        return "+";
+    case Code::Opcode::SUB:
+        return "-";
+    case Code::Opcode::MUL:
+        return "*";
+    case Code::Opcode::DIV:
+        return "/";
+    case Code::Opcode::EQUAL:
+        return "==";
+    case Code::Opcode::NOT_EQUAL:
+        return "!=";
+    case Code::Opcode::GREATER_THAN:
+        return ">";
+    case Code::Opcode::LESS_THAN:
+        return "<";
+    default:
+        return "?";
+    }
+}
+
+monkey::Value unknownOperatorError(Code::Opcode op, const monkey::Value &left,
+                                   const monkey::Value &right)
+{
+    return newError("unknown operator: " + monkey::toString(left.type()) + " " +
+                    operatorString(op) + " " + monkey::toString(right.type()));
+}
+} // namespace
+
+VM::VM(const Compiler::Bytecode &bytecode) : VM(bytecode, NewGlobals())
+{
+}
+
+VM::VM(const Compiler::Bytecode &bytecode, std::shared_ptr<Globals> globals)
+    : stack(STACK_SIZE), globals(std::move(globals)), heap(&monkey::Heap::current())
+{
+    // 定数プールの整数は即値に変換しておき、OpConstantでの型判定を省く
+    constants.reserve(bytecode.constants.size());
+    for (const auto &constant : bytecode.constants)
+    {
+        constants.emplace_back(constant);
+    }
+
+    auto mainFn = monkey::makeRef<monkey::CompiledFunction>(bytecode.instructions, 0, 0);
+    auto mainClosure =
+        monkey::makeRef<monkey::Closure>(mainFn, std::vector<monkey::Value>{});
+    frames.reserve(MAX_FRAMES);
+    frames.emplace_back(mainClosure, 0);
+
+    rootScannerId = heap->addRootScanner([this](monkey::Tracer &tracer) {
+        for (size_t i = 0; i < sp; i++)
+        {
+            tracer.visit(stack[i]);
+        }
+        for (const auto &global : *this->globals)
+        {
+            tracer.visit(global);
+        }
+        for (const auto &frame : frames)
+        {
+            tracer.visit(frame.cl.get());
+            for (const auto &cell : frame.cells)
+            {
+                tracer.visit(cell.get());
+            }
+        }
+    });
+}
+
+VM::~VM()
+{
+    heap->removeRootScanner(rootScannerId);
+}
+
+std::shared_ptr<Globals> VM::NewGlobals()
+{
+    return std::make_shared<Globals>(GLOBALS_SIZE);
+}
+
+monkey::ObjectPtr VM::lastPoppedStackElem() const
+{
+    return stack[sp].toObject();
+}
+
+monkey::Value VM::push(monkey::Value value)
+{
+    if (sp >= STACK_SIZE)
+    {
+        return newError("stack overflow");
+    }
+    stack[sp++] = std::move(value);
+    return monkey::Value();
+}
+
+monkey::Value VM::pop()
+{
+    return stack[--sp];
+}
+
+monkey::ObjectPtr VM::run()
+{
+    while (currentFrame().ip < static_cast<int>(currentFrame().instructions().size()) - 1)
+    {
+        auto &frame = currentFrame();
+        const auto &ins = frame.instructions();
+        int ip = ++frame.ip;
+        auto op = static_cast<Code::Opcode>(ins[ip]);
+
+        monkey::Value err;
+        switch (op)
+        {
+        case Code::Opcode::CONSTANT:
+        {
+            auto constIndex = Code::readUint16(&ins[ip + 1]);
+            frame.ip += 2;
+            err = push(constants[constIndex]);
+            break;
+        }
+        case Code::Opcode::POP:
+            pop();
+            break;
+        case Code::Opcode::ADD:
+        case Code::Opcode::SUB:
+        case Code::Opcode::MUL:
+        case Code::Opcode::DIV:
+        case Code::Opcode::EQUAL:
+        case Code::Opcode::NOT_EQUAL:
+        case Code::Opcode::GREATER_THAN:
+        case Code::Opcode::LESS_THAN:
+            err = executeBinaryOperation(op);
+            break;
+        case Code::Opcode::TRUE:
+            err = push(monkey::Value::boolean(true));
+            break;
+        case Code::Opcode::FALSE:
+            err = push(monkey::Value::boolean(false));
+            break;
+        case Code::Opcode::NULL_:
+            err = push(monkey::Value::null());
+            break;
+        case Code::Opcode::MINUS:
+        {
+            auto operand = pop();
+            if (!operand.isInteger())
+            {
+                return newError("unknown operator: -" + monkey::toString(operand.type()))
+                    .toObject();
+            }
+            err = push(monkey::Value::integer(-operand.asInteger()));
+            break;
+        }
+        case Code::Opcode::BANG:
+        {
+            auto operand = pop();
+            if (operand.isBoolean())
+            {
+                err = push(monkey::Value::boolean(!operand.asBoolean()));
+            }
+            else
+            {
+                err = push(monkey::Value::boolean(operand.isNull()));
+            }
+            break;
+        }
+        case Code::Opcode::JUMP:
+            frame.ip = Code::readUint16(&ins[ip + 1]) - 1;
+            break;
+        case Code::Opcode::JUMP_NOT_TRUTHY:
+        {
+            auto pos = Code::readUint16(&ins[ip + 1]);
+            frame.ip += 2;
+            if (!isTruthy(pop()))
+            {
+                frame.ip = pos - 1;
+            }
+            break;
+        }
+        case Code::Opcode::SET_GLOBAL:
+        {
+            auto globalIndex = Code::readUint16(&ins[ip + 1]);
+            frame.ip += 2;
+            (*globals)[globalIndex] = stack[sp - 1];
+            break;
+        }
+        case Code::Opcode::GET_GLOBAL:
+        {
+            auto globalIndex = Code::readUint16(&ins[ip + 1]);
+            frame.ip += 2;
+            err = push((*globals)[globalIndex]);
+            break;
+        }
+        case Code::Opcode::SET_LOCAL:
+        {
+            auto localIndex = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            stack[frame.basePointer + localIndex] = stack[sp - 1];
+            break;
+        }
+        case Code::Opcode::GET_LOCAL:
+        {
+            auto localIndex = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            err = push(stack[frame.basePointer + localIndex]);
+            break;
+        }
+        case Code::Opcode::GET_BUILTIN:
+        {
+            auto builtinIndex = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            err = push(monkey::builtins()[builtinIndex].builtin);
+            break;
+        }
+        case Code::Opcode::GET_FREE:
+        {
+            auto freeIndex = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            err = push(frame.cl->free[freeIndex]);
+            break;
+        }
+        case Code::Opcode::CURRENT_CLOSURE:
+            err = push(frame.cl);
+            break;
+        case Code::Opcode::ARRAY:
+        {
+            auto numElements = Code::readUint16(&ins[ip + 1]);
+            frame.ip += 2;
+            std::vector<monkey::Value> elements(stack.begin() + (sp - numElements),
+                                                stack.begin() + sp);
+            sp -= numElements;
+            err = push(monkey::makeRef<monkey::Array>(std::move(elements)));
+            break;
+        }
+        case Code::Opcode::HASH:
+        {
+            auto numElements = Code::readUint16(&ins[ip + 1]);
+            frame.ip += 2;
+            auto hash = buildHash(sp - numElements, sp);
+            if (hash.isError())
+            {
+                return hash.toObject();
+            }
+            sp -= numElements;
+            err = push(hash);
+            break;
+        }
+        case Code::Opcode::INDEX:
+        {
+            auto index = pop();
+            auto left = pop();
+            auto result = executeIndexExpression(left, index);
+            if (result.isError())
+            {
+                return result.toObject();
+            }
+            err = push(result);
+            break;
+        }
+        case Code::Opcode::CALL:
+        {
+            auto numArgs = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            heap->safePoint();
+            err = executeCall(numArgs);
+            break;
+        }
+        case Code::Opcode::RETURN_VALUE:
+        {
+            auto returnValue = pop();
+            if (frames.size() == 1)
+            {
+                // トップレベルのreturnはプログラムの実行を終了する
+                return returnValue.toObject();
+            }
+            auto basePointer = frame.basePointer;
+            frames.pop_back();
+            sp = basePointer - 1;
+            err = push(returnValue);
+            break;
+        }
+        case Code::Opcode::RETURN:
+        {
+            if (frames.size() == 1)
+            {
+                return monkey::canonicalNull();
+            }
+            auto basePointer = frame.basePointer;
+            frames.pop_back();
+            sp = basePointer - 1;
+            err = push(monkey::Value::null());
+            break;
+        }
+        case Code::Opcode::CLOSURE:
+        {
+            auto constIndex = Code::readUint16(&ins[ip + 1]);
+            auto numFree = Code::readUint8(&ins[ip + 3]);
+            frame.ip += 3;
+            err = pushClosure(constIndex, numFree);
+            break;
+        }
+        case Code::Opcode::GET_CELL:
+        {
+            auto cellIndex = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            const auto &cell = frame.cells[cellIndex];
+            err = push(cell->value ? *cell->value : monkey::Value::null());
+            break;
+        }
+        case Code::Opcode::SET_CELL:
+        {
+            auto cellIndex = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            frame.cells[cellIndex]->value = stack[sp - 1];
+            break;
+        }
+        case Code::Opcode::GET_FREE_CELL:
+        {
+            auto cellIndex = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            const auto &cell = frame.cl->cells[cellIndex];
+            err = push(cell->value ? *cell->value : monkey::Value::null());
+            break;
+        }
+        case Code::Opcode::CAPTURE_CELL:
+        case Code::Opcode::CAPTURE_FREE_CELL:
+        {
+            // 直前のCLOSUREで積んだクロージャに、捕捉するセルを加える
+            auto cellIndex = Code::readUint8(&ins[ip + 1]);
+            frame.ip += 1;
+            auto closure = monkey::staticRefCast<monkey::Closure>(stack[sp - 1].asObject());
+            closure->cells.push_back(op == Code::Opcode::CAPTURE_CELL ? frame.cells[cellIndex]
+                                                                      : frame.cl->cells[cellIndex]);
+            break;
+        }
+        }
+
+        if (err.isError())
+        {
+            return err.toObject();
+        }
+    }
+
+    return lastPoppedStackElem();
+}
+
+monkey::Value VM::executeBinaryOperation(Code::Opcode op)
+{
+    auto right = pop();
+    auto left = pop();
+
+    // 整数同士の演算は即値のまま処理する
+    if (left.isInteger() && right.isInteger())
+    {
+        auto l = left.asInteger();
+        auto r = right.asInteger();
+        switch (op)
+        {
+        case Code::Opcode::ADD:
+            return push(monkey::Value::integer(l + r));
+        case Code::Opcode::SUB:
+            return push(monkey::Value::integer(l - r));
+        case Code::Opcode::MUL:
+            return push(monkey::Value::integer(l * r));
+        case Code::Opcode::DIV:
+            if (r == 0)
+            {
+                return newError("division by zero");
+            }
+            // INT64_MIN / -1はオーバーフローしてトラップするため、ラップアラウンドした結果（INT64_MIN）を返す
+            if (l == std::numeric_limits<int64_t>::min() && r == -1)
+            {
+                return push(monkey::Value::integer(l));
+            }
+            return push(monkey::Value::integer(l / r));
+        case Code::Opcode::EQUAL:
+            return push(monkey::Value::boolean(l == r));
+        case Code::Opcode::NOT_EQUAL:
+            return push(monkey::Value::boolean(l != r));
+        case Code::Opcode::GREATER_THAN:
+            return push(monkey::Value::boolean(l > r));
+        case Code::Opcode::LESS_THAN:
+            return push(monkey::Value::boolean(l < r));
+        default:
+            return unknownOperatorError(op, left, right);
+        }
+    }
+
+    auto leftType = left.type();
+    auto rightType = right.type();
+
+    if (leftType != rightType)
+    {
+        return newError("type mismatch: " + monkey::toString(leftType) + " " +
+                        operatorString(op) + " " + monkey::toString(rightType));
+    }
+
+    if (leftType == monkey::ObjectType::BOOLEAN)
+    {
+        auto l = left.asBoolean();
+        auto r = right.asBoolean();
+        switch (op)
+        {
+        case Code::Opcode::EQUAL:
+            return push(monkey::Value::boolean(l == r));
+        case Code::Opcode::NOT_EQUAL:
+            return push(monkey::Value::boolean(l != r));
+        default:
+            return unknownOperatorError(op, left, right);
+        }
+    }
+
+    if (leftType == monkey::ObjectType::STRING && op == Code::Opcode::ADD)
+    {
+        const auto &l = static_cast<const monkey::String *>(left.asObject().get())->getValue();
+        const auto &r = static_cast<const monkey::String *>(right.asObject().get())->getValue();
+        return push(monkey::makeRef<monkey::String>(l + r));
+    }
+
+    return unknownOperatorError(op, left, right);
+}
+
+monkey::Value VM::executeIndexExpression(const monkey::Value &left, const monkey::Value &index)
+{
+    auto leftType = left.type();
+    if (leftType == monkey::ObjectType::ARRAY)
+    {
+        if (!index.isInteger())
+        {
+            return newError("array index must be an integer");
+        }
+        const auto &elements = static_cast<const monkey::Array *>(left.asObject().get())->elements;
+        auto idx = index.asInteger();
+        if (idx < 0 || static_cast<size_t>(idx) >= elements.size())
+        {
+            return monkey::Value::null();
+        }
+        return elements[idx];
+    }
+
+    if (leftType == monkey::ObjectType::HASH)
+    {
+        auto hashKey = index.hashKey();
+        if (!hashKey)
+        {
+            return newError("unusable as hash key: " + monkey::toString(index.type()));
+        }
+        const auto &pairs = static_cast<const monkey::Hash *>(left.asObject().get())->pairs;
+        auto value = pairs.find(index, *hashKey);
+        if (!value)
+        {
+            return monkey::Value::null();
+        }
+        return *value;
+    }
+
+    return newError("index operator not supported: " + monkey::toString(leftType));
+}
+
+monkey::Value VM::buildHash(size_t startIndex, size_t endIndex)
+{
+    auto hash = monkey::makeRef<monkey::Hash>();
+    hash->pairs.reserve((endIndex - startIndex) / 2);
+    for (size_t i = startIndex; i < endIndex; i += 2)
+    {
+        const auto &key = stack[i];
+        const auto &value = stack[i + 1];
+
+        auto hashKey = key.hashKey();
+        if (!hashKey)
+        {
+            return newError("unusable as hash key: " + monkey::toString(key.type()));
+        }
+        hash->pairs.insert(key, value, *hashKey);
+    }
+    return hash;
+}
+
+monkey::Value VM::executeCall(int numArgs)
+{
+    const auto &callee = stack[sp - 1 - numArgs];
+    switch (callee.type())
+    {
+    case monkey::ObjectType::CLOSURE:
+        return callClosure(monkey::staticRefCast<monkey::Closure>(callee.asObject()), numArgs);
+    case monkey::ObjectType::BUILTIN:
+        return callBuiltin(monkey::staticRefCast<monkey::Builtin>(callee.asObject()), numArgs);
+    default:
+        return newError("not a function: " + monkey::toString(callee.type()));
+    }
+}
+
+monkey::Value VM::callClosure(monkey::RefPtr<monkey::Closure> cl, int numArgs)
+{
+    if (numArgs != cl->fn->numParameters)
+    {
+        return newError("wrong number of arguments: expected " +
+                        std::to_string(cl->fn->numParameters) + ", got " +
+                        std::to_string(numArgs));
+    }
+    if (frames.size() >= MAX_FRAMES)
+    {
+        return newError("stack overflow");
+    }
+
+    int basePointer = static_cast<int>(sp) - numArgs;
+    if (basePointer + cl->fn->numLocals >= static_cast<int>(STACK_SIZE))
+    {
+        return newError("stack overflow");
+    }
+
+    // 引数以外のローカル変数スロットを初期化する
+    for (int i = numArgs; i < cl->fn->numLocals; i++)
+    {
+        stack[basePointer + i] = monkey::Value::null();
+    }
+
+    frames.emplace_back(std::move(cl), basePointer);
+    auto &frame = frames.back();
+    frame.cells.reserve(frame.cl->fn->numCells);
+    for (int i = 0; i < frame.cl->fn->numCells; i++)
+    {
+        frame.cells.push_back(monkey::makeRef<monkey::Cell>());
+    }
+    sp = basePointer + frame.cl->fn->numLocals;
+    return monkey::Value();
+}
+
+monkey::Value VM::callBuiltin(const monkey::RefPtr<monkey::Builtin> &builtin, int numArgs)
+{
+    std::vector<monkey::Value> args(stack.begin() + (sp - numArgs), stack.begin() + sp);
+    auto result = builtin->fn(args);
+    sp = sp - numArgs - 1;
+
+    if (result.isError())
+    {
+        return result;
+    }
+    return push(std::move(result));
+}
+
+monkey::Value VM::pushClosure(int constIndex, int numFree)
+{
+    const auto &constant = constants[constIndex];
+    if (constant.type() != monkey::ObjectType::COMPILED_FUNCTION)
+    {
+        return newError("not a function: " + monkey::toString(constant.type()));
+    }
+
+    std::vector<monkey::Value> free(stack.begin() + (sp - numFree), stack.begin() + sp);
+    sp -= numFree;
+
+    auto closure = monkey::makeRef<monkey::Closure>(
+        monkey::staticRefCast<monkey::CompiledFunction>(constant.asObject()), std::move(free));
+    return push(closure);
+}
+
+} // namespace VM
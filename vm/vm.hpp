@@ -0,0 +1,78 @@
+#pragma once
+#include "../compiler/compiler.hpp"
+#include "../object/object.hpp"
+#include <memory>
+#include <vector>
+
+namespace VM
+{
+
+constexpr size_t STACK_SIZE = 16384;
+constexpr size_t GLOBALS_SIZE = 65536;
+constexpr size_t MAX_FRAMES = 4096;
+
+using Globals = std::vector<monkey::Value>;
+
+// 呼び出しフレーム
+struct Frame
+{
+    monkey::RefPtr<monkey::Closure> cl;
+    int ip;
+    int basePointer;
+    std::vector<monkey::CellPtr> cells; // 内側の関数にセルで捕捉されるローカル変数
+
+    Frame(monkey::RefPtr<monkey::Closure> closure, int bp)
+        : cl(std::move(closure)), ip(-1), basePointer(bp)
+    {
+    }
+    const Code::Instructions &instructions() const
+    {
+        return cl->fn->instructions;
+    }
+};
+
+// スタックベースの仮想マシン
+class VM
+{
+  public:
+    explicit VM(const Compiler::Bytecode &bytecode);
+    // REPLで行をまたいでグローバル変数を引き継ぐためのコンストラクタ
+    VM(const Compiler::Bytecode &bytecode, std::shared_ptr<Globals> globals);
+    ~VM();
+    VM(const VM &) = delete; // 根としてthisをヒープに登録している
+    VM &operator=(const VM &) = delete;
+
+    static std::shared_ptr<Globals> NewGlobals();
+
+    // 実行してプログラムの値を返す（実行時エラーの場合はErrorオブジェクト）
+    monkey::ObjectPtr run();
+    monkey::ObjectPtr lastPoppedStackElem() const;
+
+  private:
+    std::vector<monkey::Value> constants;
+    std::vector<monkey::Value> stack;
+    size_t sp = 0; // 次に積む位置（スタックトップはstack[sp-1]）
+    std::shared_ptr<Globals> globals;
+    std::vector<Frame> frames;
+    monkey::Heap *heap;   // VMを生成したスレッドのヒープ
+    size_t rootScannerId; // heapに登録した根（スタックとグローバル変数）の識別子
+
+    Frame &currentFrame()
+    {
+        return frames.back();
+    }
+
+    // 失敗した場合はErrorオブジェクトを返し、成功した場合はnullを返す
+    monkey::Value push(monkey::Value value);
+    monkey::Value pop();
+
+    monkey::Value executeBinaryOperation(Code::Opcode op);
+    monkey::Value executeIndexExpression(const monkey::Value &left, const monkey::Value &index);
+    monkey::Value executeCall(int numArgs);
+    monkey::Value callClosure(monkey::RefPtr<monkey::Closure> cl, int numArgs);
+    monkey::Value callBuiltin(const monkey::RefPtr<monkey::Builtin> &builtin, int numArgs);
+    monkey::Value buildHash(size_t startIndex, size_t endIndex);
+    monkey::Value pushClosure(int constIndex, int numFree);
+};
+
+} // namespace VM